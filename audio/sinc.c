@@ -27,8 +27,11 @@
 
 #ifndef RESAMPLER_TEST
 #include "../general.h"
+#include "../file.h"
 #else
+#include <time.h>
 #define RARCH_LOG(...) fprintf(stderr, __VA_ARGS__)
+#define RARCH_WARN(...) fprintf(stderr, __VA_ARGS__)
 #endif
 
 #ifdef __SSE__
@@ -235,6 +238,185 @@ static void aligned_free__(void *ptr)
    free(p[-1]);
 }
 
+// Computing the phase table is by far the most expensive part of bringing up the resampler
+// (one Bessel evaluation per coefficient), and we do it again on every driver reinit.
+// The table only depends on taps and cutoff for a given quality level,
+// so keep the most recent tables around in-process, and optionally on disk.
+#define SINC_CACHE_ENTRIES 4
+#define SINC_CACHE_MAGIC   0x434e4953U // 'SINC'
+#define SINC_CACHE_VERSION 1
+
+struct sinc_cache_entry
+{
+   unsigned taps;
+   double cutoff;
+   size_t elems;
+   float *table;
+};
+
+static struct sinc_cache_entry sinc_cache[SINC_CACHE_ENTRIES];
+static unsigned sinc_cache_next;
+
+struct sinc_cache_header
+{
+   uint32_t magic;
+   uint32_t version;
+   uint32_t phase_bits;
+   uint32_t subphase_bits;
+   uint32_t sidelobes;
+   uint32_t coeff_lerp;
+   uint32_t taps;
+   uint32_t elems;
+   double cutoff;
+};
+
+#ifndef RESAMPLER_TEST
+#define sinc_time_usec() rarch_get_time_usec()
+#else
+static int64_t sinc_time_usec(void)
+{
+   return (int64_t)clock() * 1000000 / CLOCKS_PER_SEC;
+}
+#endif
+
+static bool sinc_cache_lookup(float *phase_table, unsigned taps, double cutoff, size_t elems)
+{
+   for (unsigned i = 0; i < SINC_CACHE_ENTRIES; i++)
+   {
+      const struct sinc_cache_entry *entry = &sinc_cache[i];
+      if (entry->table && entry->taps == taps && entry->cutoff == cutoff && entry->elems == elems)
+      {
+         memcpy(phase_table, entry->table, elems * sizeof(float));
+         return true;
+      }
+   }
+
+   return false;
+}
+
+static void sinc_cache_store(const float *phase_table, unsigned taps, double cutoff, size_t elems)
+{
+   struct sinc_cache_entry *entry = &sinc_cache[sinc_cache_next];
+
+   float *table = (float*)realloc(entry->table, elems * sizeof(float));
+   if (!table)
+      return;
+
+   memcpy(table, phase_table, elems * sizeof(float));
+   entry->table  = table;
+   entry->taps   = taps;
+   entry->cutoff = cutoff;
+   entry->elems  = elems;
+
+   sinc_cache_next = (sinc_cache_next + 1) % SINC_CACHE_ENTRIES;
+}
+
+#ifndef RESAMPLER_TEST
+static void sinc_cache_header_init(struct sinc_cache_header *header,
+      unsigned taps, double cutoff, size_t elems)
+{
+   memset(header, 0, sizeof(*header));
+   header->magic         = SINC_CACHE_MAGIC;
+   header->version       = SINC_CACHE_VERSION;
+   header->phase_bits    = PHASE_BITS;
+   header->subphase_bits = SUBPHASE_BITS;
+   header->sidelobes     = SIDELOBES;
+   header->coeff_lerp    = SINC_COEFF_LERP;
+   header->taps          = taps;
+   header->elems         = elems;
+   header->cutoff        = cutoff;
+}
+
+static bool sinc_cache_path(char *path, size_t size, unsigned taps, double cutoff)
+{
+   if (!*g_settings.audio.resampler_cache_directory)
+      return false;
+
+   char name[64];
+   snprintf(name, sizeof(name), "sinc-%u-%u-%u-%u-%u-%08x.bin",
+         PHASE_BITS, SUBPHASE_BITS, SIDELOBES, SINC_COEFF_LERP, taps,
+         (unsigned)(cutoff * 0x10000000));
+   fill_pathname_join(path, g_settings.audio.resampler_cache_directory, name, size);
+   return true;
+}
+
+static bool sinc_cache_load_file(float *phase_table, unsigned taps, double cutoff, size_t elems)
+{
+   char path[PATH_MAX];
+   if (!sinc_cache_path(path, sizeof(path), taps, cutoff))
+      return false;
+
+   FILE *file = fopen(path, "rb");
+   if (!file)
+      return false;
+
+   struct sinc_cache_header expected, header;
+   sinc_cache_header_init(&expected, taps, cutoff, elems);
+
+   bool ret = fread(&header, sizeof(header), 1, file) == 1 &&
+      memcmp(&header, &expected, sizeof(header)) == 0 &&
+      fread(phase_table, sizeof(float), elems, file) == elems;
+
+   fclose(file);
+
+   if (!ret)
+      RARCH_WARN("SINC table cache \"%s\" is stale or corrupt, regenerating.\n", path);
+   return ret;
+}
+
+static void sinc_cache_save_file(const float *phase_table, unsigned taps, double cutoff, size_t elems)
+{
+   char path[PATH_MAX];
+   if (!sinc_cache_path(path, sizeof(path), taps, cutoff))
+      return;
+
+   FILE *file = fopen(path, "wb");
+   if (!file)
+   {
+      RARCH_WARN("Failed to open SINC table cache \"%s\" for writing.\n", path);
+      return;
+   }
+
+   struct sinc_cache_header header;
+   sinc_cache_header_init(&header, taps, cutoff, elems);
+
+   bool ret = fwrite(&header, sizeof(header), 1, file) == 1 &&
+      fwrite(phase_table, sizeof(float), elems, file) == elems;
+   fclose(file);
+
+   if (!ret)
+   {
+      RARCH_WARN("Failed to write SINC table cache \"%s\".\n", path);
+      remove(path);
+   }
+}
+#else
+#define sinc_cache_load_file(table, taps, cutoff, elems) false
+#define sinc_cache_save_file(table, taps, cutoff, elems)
+#endif
+
+static void sinc_table_get(rarch_sinc_resampler_t *resamp, double cutoff, size_t elems)
+{
+   const char *source = "memory";
+   int64_t start = sinc_time_usec();
+
+   if (!sinc_cache_lookup(resamp->phase_table, resamp->taps, cutoff, elems))
+   {
+      if (sinc_cache_load_file(resamp->phase_table, resamp->taps, cutoff, elems))
+         source = "disk";
+      else
+      {
+         init_sinc_table(resamp, cutoff, resamp->phase_table, 1 << PHASE_BITS, resamp->taps, SINC_COEFF_LERP);
+         sinc_cache_save_file(resamp->phase_table, resamp->taps, cutoff, elems);
+         source = "generated";
+      }
+
+      sinc_cache_store(resamp->phase_table, resamp->taps, cutoff, elems);
+   }
+
+   RARCH_LOG("SINC phase table (%s) in %.3f ms.\n", source, (sinc_time_usec() - start) / 1000.0);
+}
+
 static inline void process_sinc_C(rarch_sinc_resampler_t *resamp, float *out_buffer)
 {
    float sum_l = 0.0f;
@@ -485,7 +667,7 @@ static void *resampler_sinc_new(double bandwidth_mod)
    re->buffer_l = re->main_buffer + phase_elems;
    re->buffer_r = re->buffer_l + 2 * re->taps;
 
-   init_sinc_table(re, cutoff, re->phase_table, 1 << PHASE_BITS, re->taps, SINC_COEFF_LERP);
+   sinc_table_get(re, cutoff, phase_elems);
 
 #if defined(__AVX__) && ENABLE_AVX
    RARCH_LOG("Sinc resampler [AVX]\n");
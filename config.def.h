@@ -250,9 +250,35 @@ static const bool vsync = true;
 // Threaded video. Will possibly increase performance significantly at cost of worse synchronization and latency.
 static const bool video_threaded = false;
 
+// Number of threads used by the software scaler (software video drivers, XVideo YUV conversion, recording). 1 disables threading.
+static const unsigned video_scaler_threads = 1;
+
+// Number of threads used by CPU filter plugins which can be split into slices. 1 disables threading.
+static const unsigned video_filter_threads = 1;
+
+// Dump every Nth frame as PNG with the capture video driver. 0 disables.
+static const unsigned video_capture_interval = 0;
+
+// Quit after this many frames with the capture video driver. 0 runs until quit as usual.
+static const unsigned video_capture_max_frames = 0;
+
+// Detects frames identical to the previous one and treats them as dupes, skipping conversion and upload.
+// Never used for cores which dupe frames on their own.
+static const bool video_dupe_detect = false;
+
+// When the core can't keep up, skips showing frames (conversion, filtering and upload included)
+// while still running the core, so audio keeps playing. Based on audio buffer fill and frame time.
+static const bool video_frameskip_auto = false;
+// Frames skipped after every shown frame are kept within these bounds.
+static const unsigned video_frameskip_min = 0;
+static const unsigned video_frameskip_max = 4;
+
 // Smooths picture
 static const bool video_smooth = true;
 
+// When smoothing in software, point scale by the largest integer factor first, so only the edges of pixels are blurred.
+static const bool video_smooth_sharp = false;
+
 // On resize and fullscreen, rendering area will stay 4:3
 static const bool force_aspect = true; 
 
@@ -300,6 +326,10 @@ static const bool post_filter_record = false;
 // Screenshots post-shaded GPU output if available.
 static const bool gpu_screenshot = true;
 
+// Encodes PNG screenshots with a faster filter heuristic and compression level.
+// Files are slightly larger.
+static const bool screenshot_png_fast = false;
+
 // Record post-shaded GPU output instead of raw game footage if available.
 static const bool gpu_record = false;
 
@@ -376,9 +406,29 @@ static const bool rewind_enable = false;
 // The buffer size for the rewind buffer. This needs to be about 15-20MB per minute. Very game dependant.
 static const unsigned rewind_buffer_size = 20 << 20; // 20MiB
 
+// Memory kept for decoded overlay and shader images, so driver reinits and cycling overlays don't decode them again.
+static const unsigned image_cache_size = 32000000; // 32MB
+
 // How many frames to rewind at a time.
 static const unsigned rewind_granularity = 1;
 
+// Runs the core this many frames ahead every frame, and rolls back afterwards.
+// Hides input lag inherent to the game, at the cost of running the core several times per frame.
+// Needs save state support. 0 disables.
+static const unsigned run_ahead_frames = 0;
+
+// Keeps netplay rollback snapshots as XOR deltas against the next frame instead of whole states.
+// Uses much less memory when little of a large state changes per frame, but rolling back has to walk the deltas.
+static const bool netplay_delta_snapshots = false;
+
+// How many spectators can watch when hosting in spectate mode.
+static const unsigned netplay_max_spectators = 256;
+
+// Bounds on how many frames netplay delays local input.
+// Within them, the delay follows the measured round trip time, which cuts down on rollbacks.
+static const unsigned netplay_input_delay_min = 0;
+static const unsigned netplay_input_delay_max = 4;
+
 // Pause gameplay when gameplay loses focus.
 static const bool pause_nonactive = false;
 
@@ -410,6 +460,9 @@ static const bool network_cmd_enable = false;
 static const uint16_t network_cmd_port = 55355;
 static const bool stdin_cmd_enable = false;
 
+// Keep a timeline of the main loop for this many frames. 0 disables.
+static const unsigned timeline_frames = 0;
+
 
 ////////////////////
 // Keybinds, Joypad
@@ -0,0 +1,54 @@
+#ifndef QB_CONFIG_H__
+#define QB_CONFIG_H__
+
+#define PACKAGE_NAME "retroarch"
+#define PACKAGE_VERSION "0.9.8"
+/* #undef HAVE_ALSA */
+#define HAVE_OSS 1
+/* #undef HAVE_OSS_BSD */
+/* #undef HAVE_OSS_LIB */
+/* #undef HAVE_AL */
+/* #undef HAVE_RSOUND */
+/* #undef HAVE_ROAR */
+/* #undef HAVE_JACK */
+/* #undef HAVE_COREAUDIO */
+/* #undef HAVE_PULSE */
+/* #undef HAVE_SDL */
+#define HAVE_OPENGL 1
+/* #undef HAVE_GLES */
+/* #undef HAVE_VG */
+#define HAVE_EGL 1
+/* #undef HAVE_KMS */
+/* #undef HAVE_GBM */
+/* #undef HAVE_DRM */
+#define HAVE_DYLIB 1
+#define HAVE_GETOPT_LONG 1
+#define HAVE_THREADS 1
+/* #undef HAVE_CG */
+#define HAVE_LIBXML2 1
+/* #undef HAVE_SDL_IMAGE */
+#define HAVE_ZLIB 1
+#define HAVE_DYNAMIC 1
+/* #undef HAVE_AVCODEC */
+/* #undef HAVE_AVFORMAT */
+/* #undef HAVE_AVUTIL */
+/* #undef HAVE_SWSCALE */
+#define HAVE_FREETYPE 1
+/* #undef HAVE_XVIDEO */
+/* #undef HAVE_X11 */
+#define HAVE_XEXT 1
+/* #undef HAVE_XF86VM */
+/* #undef HAVE_XINERAMA */
+#define HAVE_NETPLAY 1
+#define HAVE_NETWORK_CMD 1
+#define HAVE_STDIN_CMD 1
+#define HAVE_COMMAND 1
+/* #undef HAVE_SOCKET_LEGACY */
+#define HAVE_FBO 1
+/* #undef HAVE_STRL */
+/* #undef HAVE_PYTHON */
+#define HAVE_SINC 1
+#define HAVE_BSV_MOVIE 1
+/* #undef HAVE_VIDEOCORE */
+/* #undef HAVE_NEON */
+#endif
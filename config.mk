@@ -0,0 +1,106 @@
+CC = /usr/bin/gcc
+CFLAGS = 
+CXX = /usr/bin/g++
+CXXFLAGS = 
+LDFLAGS = 
+INCLUDE_DIRS = 
+LIBRARY_DIRS =  -L/usr/lib64
+PACKAGE_NAME = retroarch
+PACKAGE_VERSION = 0.9.8
+PREFIX = /usr/local
+HAVE_ALSA = 0
+ALSA_CFLAGS = 
+ALSA_LIBS = 
+HAVE_OSS = 1
+HAVE_OSS_BSD = 0
+HAVE_OSS_LIB = 0
+HAVE_AL = 0
+AL_CFLAGS = 
+AL_LIBS = 
+HAVE_RSOUND = 0
+RSOUND_CFLAGS = 
+RSOUND_LIBS = 
+HAVE_ROAR = 0
+ROAR_CFLAGS = 
+ROAR_LIBS = 
+HAVE_JACK = 0
+JACK_CFLAGS = 
+JACK_LIBS = 
+HAVE_COREAUDIO = 0
+HAVE_PULSE = 0
+PULSE_CFLAGS = 
+PULSE_LIBS = 
+HAVE_SDL = 0
+SDL_CFLAGS = 
+SDL_LIBS = 
+HAVE_OPENGL = 1
+HAVE_GLES = 0
+HAVE_VG = 0
+VG_CFLAGS = 
+VG_LIBS = 
+HAVE_EGL = 1
+EGL_CFLAGS = 
+EGL_LIBS = -lEGL
+HAVE_KMS = 0
+HAVE_GBM = 0
+GBM_CFLAGS = 
+GBM_LIBS = 
+HAVE_DRM = 0
+DRM_CFLAGS = 
+DRM_LIBS = 
+HAVE_DYLIB = 1
+HAVE_GETOPT_LONG = 1
+HAVE_THREADS = 1
+HAVE_CG = 0
+HAVE_LIBXML2 = 1
+LIBXML2_CFLAGS = -I/usr/include/libxml2
+LIBXML2_LIBS = -lxml2
+HAVE_SDL_IMAGE = 0
+HAVE_ZLIB = 1
+ZLIB_CFLAGS = 
+ZLIB_LIBS = -lz
+HAVE_DYNAMIC = 1
+HAVE_AVCODEC = 0
+AVCODEC_CFLAGS = 
+AVCODEC_LIBS = 
+HAVE_AVFORMAT = 0
+AVFORMAT_CFLAGS = 
+AVFORMAT_LIBS = 
+HAVE_AVUTIL = 0
+AVUTIL_CFLAGS = 
+AVUTIL_LIBS = 
+HAVE_SWSCALE = 0
+SWSCALE_CFLAGS = 
+SWSCALE_LIBS = 
+HAVE_FREETYPE = 1
+FREETYPE_CFLAGS = -I/usr/include/freetype2 -I/usr/include/libpng16
+FREETYPE_LIBS = -lfreetype
+HAVE_XVIDEO = 0
+HAVE_X11 = 0
+X11_CFLAGS = 
+X11_LIBS = -lX11
+HAVE_XEXT = 1
+XEXT_CFLAGS = 
+XEXT_LIBS = -lXext
+HAVE_XF86VM = 0
+XF86VM_CFLAGS = 
+XF86VM_LIBS = 
+HAVE_XINERAMA = 0
+XINERAMA_CFLAGS = 
+XINERAMA_LIBS = 
+HAVE_NETPLAY = 1
+HAVE_NETWORK_CMD = 1
+HAVE_STDIN_CMD = 1
+HAVE_COMMAND = 1
+HAVE_SOCKET_LEGACY = 0
+HAVE_FBO = 1
+HAVE_STRL = 0
+HAVE_PYTHON = 0
+HAVE_SINC = 1
+HAVE_BSV_MOVIE = 1
+HAVE_VIDEOCORE = 0
+HAVE_NEON = 0
+NOUNUSED = yes
+DYLIB_LIB = -ldl
+MAN_DIR = /usr/local/share/man/man1
+OS = Linux
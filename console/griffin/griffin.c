@@ -64,6 +64,7 @@ PERFORMANCE
 #endif
 
 #include "../../performance.c"
+#include "../../timeline.c"
 
 /*============================================================
 COMPATIBILITY
@@ -150,6 +151,7 @@ VIDEO DRIVER
 
 #ifdef HAVE_DYLIB
 #include "../../gfx/ext_gfx.c"
+#include "../../gfx/video_filter.c"
 #endif
 
 #include "../../gfx/gfx_common.c"
@@ -24,6 +24,7 @@
 #include "audio/utils.h"
 #include "audio/resampler.h"
 #include "gfx/thread_wrapper.h"
+#include "gfx/video_filter.h"
 
 #ifdef HAVE_X11
 #include "gfx/context/x11_common.h"
@@ -116,6 +117,9 @@ static const video_driver_t *video_drivers[] = {
 #ifdef HAVE_VG
    &video_vg,
 #endif
+#ifdef HAVE_CAPTUREVIDEO
+   &video_capture,
+#endif
 #ifdef HAVE_NULLVIDEO
    &video_null,
 #endif
@@ -315,6 +319,8 @@ void init_drivers(void)
 
 void uninit_drivers(void)
 {
+   rarch_detach_cached_frame();
+
    uninit_audio();
    uninit_video_input();
 
@@ -611,6 +617,11 @@ static void deinit_filter(void)
 {
    g_extern.filter.active = false;
 
+   // The plugin's code lives in the library, so free it first.
+   rarch_video_filter_free(g_extern.filter.plugin);
+   g_extern.filter.plugin  = NULL;
+   g_extern.filter.convert = false;
+
    if (g_extern.filter.lib)
       dylib_close(g_extern.filter.lib);
    g_extern.filter.lib = NULL;
@@ -626,6 +637,82 @@ static void deinit_filter(void)
    memset(&g_extern.filter.scaler, 0, sizeof(g_extern.filter.scaler));
 }
 
+// Output is always 32-bit, and large enough for the filtered max_width/max_height.
+static bool init_filter_buffer(unsigned width, unsigned height)
+{
+   unsigned pow2_x  = next_pow2(width);
+   unsigned pow2_y  = next_pow2(height);
+   unsigned maxsize = pow2_x > pow2_y ? pow2_x : pow2_y; 
+   g_extern.filter.scale = maxsize / RARCH_SCALE_BASE;
+
+   g_extern.filter.buffer = (uint32_t*)malloc(RARCH_SCALE_BASE * RARCH_SCALE_BASE *
+         g_extern.filter.scale * g_extern.filter.scale * sizeof(uint32_t));
+   if (!g_extern.filter.buffer)
+      return false;
+
+   g_extern.filter.pitch = RARCH_SCALE_BASE * g_extern.filter.scale * sizeof(uint32_t);
+   return true;
+}
+
+// Filter plugins take RGB565 or XRGB8888 directly, and can be run on several threads.
+static bool init_filter_plugin(const rarch_filter_plugin_t *plugin, bool rgb32)
+{
+   if (!plugin)
+   {
+      RARCH_ERR("Failed to get a valid filter plugin.\n");
+      return false;
+   }
+
+   if (plugin->api_version != RARCH_FILTER_API_VERSION)
+   {
+      RARCH_ERR("Filter plugin API mismatch. RetroArch: %d, Plugin: %d\n", RARCH_FILTER_API_VERSION, plugin->api_version);
+      return false;
+   }
+
+   RARCH_LOG("Loaded filter plugin: \"%s\"\n", plugin->ident ? plugin->ident : "Unknown");
+
+   // Convert to whatever the plugin takes if it cannot use the game's format.
+   unsigned game_fmt = rgb32 ? RARCH_FILTER_FMT_XRGB8888 : RARCH_FILTER_FMT_RGB565;
+   unsigned in_fmt   = game_fmt;
+   if (!(plugin->input_fmts & in_fmt))
+      in_fmt = plugin->input_fmts & RARCH_FILTER_FMT_XRGB8888 ? RARCH_FILTER_FMT_XRGB8888 : RARCH_FILTER_FMT_RGB565;
+
+   const struct retro_game_geometry *geom = &g_extern.system.av_info.geometry;
+   g_extern.filter.plugin = rarch_video_filter_new(plugin, in_fmt,
+         geom->max_width, geom->max_height, g_settings.video.filter_threads);
+   if (!g_extern.filter.plugin)
+   {
+      RARCH_ERR("Failed to init filter plugin.\n");
+      return false;
+   }
+
+   unsigned width  = geom->max_width;
+   unsigned height = geom->max_height;
+   rarch_video_filter_output_size(g_extern.filter.plugin, &width, &height);
+   if (!init_filter_buffer(width, height))
+      return false;
+
+   g_extern.filter.convert = in_fmt != game_fmt;
+   if (g_extern.filter.convert)
+   {
+      RARCH_WARN("Filter plugin does not support the game's pixel format, converting.\n");
+
+      g_extern.filter.scaler_out = malloc(sizeof(uint32_t) * geom->max_width * geom->max_height);
+      if (!g_extern.filter.scaler_out)
+         return false;
+
+      g_extern.filter.scaler.scaler_type = SCALER_TYPE_POINT;
+      g_extern.filter.scaler.in_fmt      = rgb32 ? SCALER_FMT_ARGB8888 : SCALER_FMT_RGB565;
+      g_extern.filter.scaler.out_fmt     = in_fmt == RARCH_FILTER_FMT_XRGB8888 ? SCALER_FMT_ARGB8888 : SCALER_FMT_RGB565;
+
+      if (!scaler_ctx_gen_filter(&g_extern.filter.scaler))
+         return false;
+   }
+
+   g_extern.filter.active = true;
+   return true;
+}
+
 static void init_filter(bool rgb32)
 {
    if (g_extern.filter.active)
@@ -644,9 +731,16 @@ static void init_filter(bool rgb32)
    struct retro_game_geometry *geom = &g_extern.system.av_info.geometry;
    unsigned width   = geom->max_width;
    unsigned height  = geom->max_height;
-   unsigned pow2_x  = 0;
-   unsigned pow2_y  = 0;
-   unsigned maxsize = 0;
+
+   const rarch_filter_plugin_t* (RARCH_API_CALLTYPE *plugin_init)(void) = 
+      (const rarch_filter_plugin_t *(RARCH_API_CALLTYPE*)(void))dylib_proc(g_extern.filter.lib, "rarch_filter_plugin_init");
+
+   if (plugin_init)
+   {
+      if (!init_filter_plugin(plugin_init(), rgb32))
+         goto error;
+      return;
+   }
 
    g_extern.filter.psize = 
       (void (*)(unsigned*, unsigned*))dylib_proc(g_extern.filter.lib, "filter_size");
@@ -664,18 +758,9 @@ static void init_filter(bool rgb32)
    g_extern.filter.active = true;
    g_extern.filter.psize(&width, &height);
 
-   pow2_x  = next_pow2(width);
-   pow2_y  = next_pow2(height);
-   maxsize = pow2_x > pow2_y ? pow2_x : pow2_y; 
-   g_extern.filter.scale = maxsize / RARCH_SCALE_BASE;
-
-   g_extern.filter.buffer = (uint32_t*)malloc(RARCH_SCALE_BASE * RARCH_SCALE_BASE *
-         g_extern.filter.scale * g_extern.filter.scale * sizeof(uint32_t));
-   if (!g_extern.filter.buffer)
+   if (!init_filter_buffer(width, height))
       goto error;
 
-   g_extern.filter.pitch = RARCH_SCALE_BASE * g_extern.filter.scale * sizeof(uint32_t);
-
    g_extern.filter.colormap = (uint32_t*)malloc(0x10000 * sizeof(uint32_t));
    if (!g_extern.filter.colormap)
       goto error;
@@ -693,7 +778,7 @@ static void init_filter(bool rgb32)
       g_extern.filter.colormap[i] = (r << 16) | (g << 8) | (b << 0);
    }
 
-   g_extern.filter.scaler_out = (uint16_t*)malloc(sizeof(uint16_t) * geom->max_width * geom->max_height);
+   g_extern.filter.scaler_out = malloc(sizeof(uint16_t) * geom->max_width * geom->max_height);
    if (!g_extern.filter.scaler_out)
       goto error;
 
@@ -773,6 +858,9 @@ static bool init_video_pixel_converter(unsigned size)
 
 void init_video_input(void)
 {
+   // A new driver has no texture yet, so the next frame can't be skipped as a dupe.
+   g_extern.frame_dupe.valid = false;
+
 #ifdef HAVE_DYLIB
    init_filter(g_extern.system.pix_fmt == RETRO_PIXEL_FORMAT_XRGB8888);
 #endif
@@ -842,6 +930,7 @@ void init_video_input(void)
    video.smooth = g_settings.video.smooth;
    video.input_scale = scale;
    video.rgb32 = g_extern.filter.active || (g_extern.system.pix_fmt == RETRO_PIXEL_FORMAT_XRGB8888);
+   video.rgb1555 = !g_extern.filter.active && (g_extern.system.pix_fmt == RETRO_PIXEL_FORMAT_0RGB1555);
 
    const input_driver_t *tmp = driver.input;
 #ifdef HAVE_THREADS
@@ -871,6 +960,15 @@ void init_video_input(void)
    if (driver.video->poke_interface)
       driver.video->poke_interface(driver.video_data, &driver.video_poke);
 
+   driver.video_rgb1555 = false;
+   if (video.rgb1555 && driver.video_poke && driver.video_poke->get_pixel_formats)
+   {
+      unsigned formats = driver.video_poke->get_pixel_formats(driver.video_data);
+      driver.video_rgb1555 = formats & (1 << RETRO_PIXEL_FORMAT_0RGB1555);
+      if (driver.video_rgb1555)
+         RARCH_LOG("Video driver takes 0RGB1555 natively, skipping conversion pass.\n");
+   }
+
    if (driver.video->set_rotation && g_extern.system.rotation)
       video_set_rotation_func(g_extern.system.rotation);
 
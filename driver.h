@@ -164,6 +164,7 @@ typedef struct video_info
    bool smooth;
    unsigned input_scale; // Maximum input size: RARCH_SCALE_BASE * input_scale
    bool rgb32; // Use 32-bit RGBA rather than native XBGR1555.
+   bool rgb1555; // Core renders 0RGB1555. Driver may take it directly if it reports so in get_pixel_formats().
 } video_info_t;
 
 typedef struct audio_driver
@@ -332,6 +333,14 @@ typedef struct video_poke_interface
    void (*set_rgui_texture)(void *data, const void *frame);
 #endif
    void (*set_osd_msg)(void *data, const char *msg, void *userdata);
+
+   // Returns a mask of (1 << RETRO_PIXEL_FORMAT_*) which frame() accepts without conversion.
+   // Only consulted for 0RGB1555 cores. If NULL, 0RGB1555 is converted to RGB565 up front.
+   unsigned (*get_pixel_formats)(void *data);
+
+   // Hands out a buffer the core can render its next frame into.
+   // frame() must recognize the buffer and skip its own copy. See RETRO_ENVIRONMENT_GET_CURRENT_SOFTWARE_FRAMEBUFFER.
+   bool (*get_current_framebuffer)(void *data, struct retro_framebuffer *fb);
 } video_poke_interface_t;
 
 typedef struct video_driver
@@ -414,6 +423,7 @@ typedef struct driver
    // Used for 15-bit -> 16-bit conversions that take place before being passed to video driver.
    struct scaler_ctx scaler;
    void *scaler_out;
+   bool video_rgb1555; // Video driver takes 0RGB1555 frames directly. Conversion is then only done for recording.
 
    // Graphics driver requires RGBA byte order data (ABGR on little-endian) for 32-bit.
    // This takes effect for overlay and shader cores that wants to load data into graphics driver.
@@ -478,6 +488,7 @@ extern const video_driver_t video_xdk_d3d;
 extern const video_driver_t video_sdl;
 extern const video_driver_t video_vg;
 extern const video_driver_t video_null;
+extern const video_driver_t video_capture;
 extern const input_driver_t input_android;
 extern const input_driver_t input_sdl;
 extern const input_driver_t input_dinput;
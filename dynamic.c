@@ -327,6 +327,7 @@ static bool environment_cb(unsigned cmd, void *data)
 
       case RETRO_ENVIRONMENT_GET_CAN_DUPE:
          *(bool*)data = true;
+         g_extern.frame_dupe.core_dupes = true;
          RARCH_LOG("Environ GET_CAN_DUPE: true\n");
          break;
 
@@ -437,6 +438,10 @@ static bool environment_cb(unsigned cmd, void *data)
          }
          
          g_extern.system.pix_fmt = pix_fmt;
+
+         // Lines change size, so the copy of the last frame has to be resized.
+         g_extern.frame_dupe.width = g_extern.frame_dupe.height = 0;
+         g_extern.frame_dupe.valid = false;
          break;
       }
 
@@ -496,6 +501,28 @@ static bool environment_cb(unsigned cmd, void *data)
          g_extern.system.disk_control = *(const struct retro_disk_control_callback*)data;
          break;
 
+      // Called every frame, so don't log.
+      case RETRO_ENVIRONMENT_GET_CURRENT_SOFTWARE_FRAMEBUFFER:
+      {
+         // Filters and the 0RGB1555 conversion pass need a separate copy of the frame anyways.
+         if (g_extern.filter.active)
+            return false;
+         if (g_extern.system.pix_fmt == RETRO_PIXEL_FORMAT_0RGB1555 && !driver.video_rgb1555)
+            return false;
+         if (!driver.video_poke || !driver.video_poke->get_current_framebuffer)
+            return false;
+
+         struct retro_framebuffer *fb = (struct retro_framebuffer*)data;
+         if (!driver.video_poke->get_current_framebuffer(driver.video_data, fb))
+            return false;
+
+         // The core is about to draw over the frame we have cached.
+         if (fb->data == g_extern.frame_cache.data)
+            rarch_detach_cached_frame();
+         g_extern.frame_cache.driver_fb = fb->data;
+         return true;
+      }
+
       default:
          RARCH_LOG("Environ UNSUPPORTED (#%u).\n", cmd);
          return false;
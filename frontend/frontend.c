@@ -15,6 +15,7 @@
  */
 
 #include "../general.h"
+#include "../gfx/image.h"
 
 #ifdef __APPLE__
 #include "SDL.h" 
@@ -35,6 +36,7 @@ int main(int argc, char *argv[])
    while ((g_extern.is_paused && !g_extern.is_oneshot) ? rarch_main_idle_iterate() : rarch_main_iterate());
    rarch_main_deinit();
    rarch_deinit_msg_queue();
+   texture_image_cache_free();
 
 #ifdef PERF_TEST
    rarch_perf_log();
@@ -1642,21 +1642,22 @@ bool menu_iterate(void)
       unsigned device = input_overlay_full_screen(driver.overlay) ?
          RARCH_DEVICE_POINTER_SCREEN : RETRO_DEVICE_POINTER;
 
-      bool polled = false;
-      for (unsigned i = 0;
-            input_input_state_func(NULL, 0, device, i, RETRO_DEVICE_ID_POINTER_PRESSED);
-            i++)
+      int16_t x[INPUT_OVERLAY_MAX_POINTERS];
+      int16_t y[INPUT_OVERLAY_MAX_POINTERS];
+      unsigned count = 0;
+      while (count < INPUT_OVERLAY_MAX_POINTERS &&
+            input_input_state_func(NULL, 0, device, count, RETRO_DEVICE_ID_POINTER_PRESSED))
       {
-         int16_t x = input_input_state_func(NULL, 0,
-               device, i, RETRO_DEVICE_ID_POINTER_X);
-         int16_t y = input_input_state_func(NULL, 0,
-               device, i, RETRO_DEVICE_ID_POINTER_Y);
-
-         driver.overlay_state |= input_overlay_poll(driver.overlay, x, y);
-         polled = true;
+         x[count] = input_input_state_func(NULL, 0,
+               device, count, RETRO_DEVICE_ID_POINTER_X);
+         y[count] = input_input_state_func(NULL, 0,
+               device, count, RETRO_DEVICE_ID_POINTER_Y);
+         count++;
       }
 
-      if (!polled)
+      if (count)
+         driver.overlay_state = input_overlay_poll(driver.overlay, x, y, count);
+      else
          input_overlay_poll_clear(driver.overlay);
    }
 #endif
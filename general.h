@@ -32,6 +32,7 @@
 #include "audio/ext/rarch_dsp.h"
 #include "compat/strl.h"
 #include "performance.h"
+#include "timeline.h"
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -160,6 +161,7 @@ struct settings
       unsigned fullscreen_y;
       bool vsync;
       bool smooth;
+      bool smooth_sharp;
       bool force_aspect;
       bool crop_overscan;
       float aspect_ratio;
@@ -172,6 +174,17 @@ struct settings
       enum rarch_shader_type shader_type;
       float refresh_rate;
       bool threaded;
+      unsigned scaler_threads;
+      unsigned filter_threads;
+      bool dupe_detect;
+      bool frameskip_auto;
+      unsigned frameskip_min;
+      unsigned frameskip_max;
+
+      char capture_directory[PATH_MAX];
+      char capture_frames[256];
+      unsigned capture_interval;
+      unsigned capture_max_frames;
 
       bool render_to_texture;
 
@@ -222,6 +235,7 @@ struct settings
       float volume; // dB scale
 
       char resampler[32];
+      char resampler_cache_directory[PATH_MAX];
    } audio;
 
    struct
@@ -254,12 +268,22 @@ struct settings
    char cheat_settings_path[PATH_MAX];
 
    char screenshot_directory[PATH_MAX];
+   bool screenshot_png_fast;
    char system_directory[PATH_MAX];
 
+   size_t image_cache_size;
+   char image_cache_directory[PATH_MAX];
+
    bool rewind_enable;
    size_t rewind_buffer_size;
    unsigned rewind_granularity;
 
+   unsigned run_ahead_frames;
+   bool netplay_delta_snapshots;
+   unsigned netplay_max_spectators;
+   unsigned netplay_input_delay_min;
+   unsigned netplay_input_delay_max;
+
    float slowmotion_ratio;
 
    bool pause_nonactive;
@@ -273,6 +297,9 @@ struct settings
    bool network_cmd_enable;
    uint16_t network_cmd_port;
    bool stdin_cmd_enable;
+
+   unsigned timeline_frames;
+   char timeline_path[PATH_MAX];
 };
 
 enum rarch_game_type
@@ -439,9 +466,14 @@ struct global
       void (*prender)(uint32_t *colormap, uint32_t *output, unsigned outpitch,
             const uint16_t *input, unsigned pitch, unsigned width, unsigned height);
 
-      // CPU filters only work on *XRGB1555*. We have to convert to XRGB1555 first.
+      // Filter plugin using the rarch_filter_plugin API. If set, psize/prender are not used.
+      struct rarch_video_filter *plugin;
+
+      // Old style CPU filters only work on *XRGB1555*. We have to convert to XRGB1555 first.
+      // Plugins are only fed through the scaler if they cannot take the game's format (convert is set).
       struct scaler_ctx scaler;
-      uint16_t *scaler_out;
+      void *scaler_out;
+      bool convert;
    } filter;
 
    msg_queue_t *msg_queue;
@@ -493,13 +525,15 @@ struct global
    bool netplay_is_client;
    bool netplay_is_spectate;
    unsigned netplay_sync_frames;
+   unsigned netplay_players;
    uint16_t netplay_port;
    char netplay_nick[32];
 #endif
 
-   // FFmpeg record.
-#ifdef HAVE_FFMPEG
-   ffemu_t *rec;
+   // Recording.
+#ifdef HAVE_RECORD
+   const ffemu_backend_t *rec_driver;
+   void *rec;
    char record_path[PATH_MAX];
    char record_config[PATH_MAX];
    bool recording;
@@ -517,9 +551,61 @@ struct global
       unsigned width;
       unsigned height;
       size_t pitch;
+
+      // Set if data points into a framebuffer from GET_CURRENT_SOFTWARE_FRAMEBUFFER.
+      // The driver recycles those, so the frame is copied to buffer before that happens.
+      const void *driver_fb;
+      bool driver_owned;
+      uint8_t *buffer;
+      size_t size;
    } frame_cache;
 
+   // Detection of frames identical to the previous one.
+   struct
+   {
+      uint8_t *buffer; // Copy of the last frame.
+      size_t size;
+      unsigned width;
+      unsigned height;
+      bool valid;
+      bool core_dupes; // Core passes NULL frames on its own, so don't bother.
+
+      unsigned checked;
+      unsigned skipped;
+   } frame_dupe;
+
+   // Automatic frameskip. The core always runs, skipped frames are just not shown.
+   struct
+   {
+      bool skip; // Don't show the current frame.
+      unsigned level; // Frames to skip after every shown frame.
+      unsigned skipped_in_row;
+      unsigned healthy; // Shown frames in a row where skipping less would have been fine.
+      rarch_time_t last_time;
+      rarch_time_t frame_time; // Smoothed wall time per frame.
+
+      unsigned frames;
+      unsigned skipped;
+      unsigned max_level;
+   } frameskip;
+
+   // Runs the core ahead and rolls back to hide input lag.
+   struct
+   {
+      void *state; // Real state, restored after running ahead.
+      size_t state_size;
+      bool hide_video;
+      bool speculative; // Frames which will be rolled back. No audio, no input polling.
+
+      unsigned frames;
+      rarch_time_t run_time; // Real frames.
+      rarch_time_t extra_time; // Serialization and speculative frames.
+      rarch_time_t present_time; // Part of extra_time spent showing the last speculative frame.
+   } run_ahead;
+
    unsigned frame_count;
+   rarch_timeline_t *timeline;
+
    // two timers, the first for handling menu and exit button delays, the second for scrolling delays
    unsigned delay_timer[2];
    char title_buf[64];
@@ -644,6 +730,7 @@ bool rarch_main_idle_iterate(void);
 bool rarch_main_iterate(void);
 void rarch_main_deinit(void);
 void rarch_render_cached_frame(void);
+void rarch_detach_cached_frame(void);
 void rarch_init_msg_queue(void);
 void rarch_deinit_msg_queue(void);
 
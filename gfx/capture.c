@@ -0,0 +1,484 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2013 - Hans-Kristian Arntzen
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Headless video driver. Frames are scaled into an XRGB8888 framebuffer in memory
+// and get messages drawn on top just like a real driver would, but never leave the process.
+// Every frame is timed and hashed, and selected frames can be dumped as PNG.
+// Meant for benchmarking and regression testing the video path without a display.
+
+#include "../driver.h"
+#include "../general.h"
+#include "../file.h"
+#include "../hash.h"
+#include "../performance.h"
+#include "scaler/scaler.h"
+#include "fonts/fonts.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_CONFIG_H
+#include "../config.h"
+#endif
+
+#ifdef HAVE_ZLIB_DEFLATE
+#include "rpng/rpng.h"
+#endif
+
+#define CAPTURE_MAX_DUMP_FRAMES 64
+
+typedef struct capture_video
+{
+   uint32_t *buffer;
+   unsigned width;
+   unsigned height;
+
+   struct scaler_ctx scaler;
+   unsigned last_width;
+   unsigned last_height;
+
+   void *font;
+   const font_renderer_driver_t *font_driver;
+   uint8_t font_r;
+   uint8_t font_g;
+   uint8_t font_b;
+
+   FILE *log;
+   unsigned dump_interval;
+   unsigned dump_frames[CAPTURE_MAX_DUMP_FRAMES];
+   unsigned num_dump_frames;
+   unsigned max_frames;
+
+   unsigned frames;
+   unsigned dumped;
+   uint32_t crc;      // Of the last presented frame.
+   uint32_t seq_crc;  // Of all frames presented so far.
+
+   rarch_time_t last_time;
+   rarch_time_t interval_total;
+   rarch_time_t interval_max;
+   rarch_time_t frame_total;
+   rarch_time_t frame_max;
+} capture_video_t;
+
+static void capture_gfx_free(void *data)
+{
+   capture_video_t *vid = (capture_video_t*)data;
+   if (!vid)
+      return;
+
+   if (vid->frames)
+   {
+      unsigned intervals = vid->frames > 1 ? vid->frames - 1 : 1;
+      RARCH_LOG("[Capture]: %u frames, %u dumped. Sequence CRC32: 0x%08x.\n",
+            vid->frames, vid->dumped, (unsigned)vid->seq_crc);
+      RARCH_LOG("[Capture]: Frame interval: %.3f ms avg, %.3f ms max. Driver time: %.3f ms avg, %.3f ms max.\n",
+            vid->interval_total / (1000.0 * intervals), vid->interval_max / 1000.0,
+            vid->frame_total / (1000.0 * vid->frames), vid->frame_max / 1000.0);
+   }
+
+   if (vid->log)
+      fclose(vid->log);
+
+   if (vid->font)
+      vid->font_driver->free(vid->font);
+
+   scaler_ctx_gen_reset(&vid->scaler);
+   free(vid->buffer);
+   free(vid);
+}
+
+static void capture_init_font(capture_video_t *vid)
+{
+   if (!g_settings.video.font_enable)
+      return;
+
+   if (font_renderer_create_default(&vid->font_driver, &vid->font))
+   {
+      int r = g_settings.video.msg_color_r * 255;
+      int g = g_settings.video.msg_color_g * 255;
+      int b = g_settings.video.msg_color_b * 255;
+
+      vid->font_r = r < 0 ? 0 : (r > 255 ? 255 : r);
+      vid->font_g = g < 0 ? 0 : (g > 255 ? 255 : g);
+      vid->font_b = b < 0 ? 0 : (b > 255 ? 255 : b);
+   }
+   else
+      RARCH_LOG("Could not initialize fonts.\n");
+}
+
+// Parses a comma separated list of frame numbers, e.g. "60,120,600".
+static void capture_parse_dump_frames(capture_video_t *vid, const char *list)
+{
+   while (*list && vid->num_dump_frames < CAPTURE_MAX_DUMP_FRAMES)
+   {
+      char *end = NULL;
+      unsigned long frame = strtoul(list, &end, 0);
+      if (end == list)
+      {
+         RARCH_WARN("[Capture]: Invalid frame list \"%s\".\n", list);
+         break;
+      }
+
+      vid->dump_frames[vid->num_dump_frames++] = frame;
+
+      list = end;
+      while (*list == ',' || *list == ' ')
+         list++;
+   }
+}
+
+static void *capture_gfx_init(const video_info_t *video, const input_driver_t **input, void **input_data)
+{
+   if (input && input_data)
+   {
+      *input = NULL;
+      *input_data = NULL;
+   }
+
+   capture_video_t *vid = (capture_video_t*)calloc(1, sizeof(*vid));
+   if (!vid)
+      return NULL;
+
+   const struct retro_game_geometry *geom = &g_extern.system.av_info.geometry;
+   vid->width  = video->width ? video->width : geom->base_width;
+   vid->height = video->height ? video->height : geom->base_height;
+
+   vid->buffer = (uint32_t*)calloc(vid->width * vid->height, sizeof(uint32_t));
+   if (!vid->buffer)
+      goto error;
+
+   RARCH_LOG("[Capture]: Capturing to %ux%u framebuffer.\n", vid->width, vid->height);
+
+   capture_init_font(vid);
+
+   if (!video->smooth)
+      vid->scaler.scaler_type = SCALER_TYPE_POINT;
+   else
+      vid->scaler.scaler_type = g_settings.video.smooth_sharp ? SCALER_TYPE_SHARP_BILINEAR : SCALER_TYPE_BILINEAR;
+   if (video->rgb32)
+      vid->scaler.in_fmt = SCALER_FMT_ARGB8888;
+   else if (video->rgb1555)
+      vid->scaler.in_fmt = SCALER_FMT_0RGB1555;
+   else
+      vid->scaler.in_fmt = SCALER_FMT_RGB565;
+   vid->scaler.out_fmt    = SCALER_FMT_ARGB8888;
+   vid->scaler.out_width  = vid->width;
+   vid->scaler.out_height = vid->height;
+   vid->scaler.out_stride = vid->width * sizeof(uint32_t);
+   vid->scaler.threads    = g_settings.video.scaler_threads;
+
+   vid->dump_interval = g_settings.video.capture_interval;
+   vid->max_frames    = g_settings.video.capture_max_frames;
+   capture_parse_dump_frames(vid, g_settings.video.capture_frames);
+
+   if (*g_settings.video.capture_directory)
+   {
+      char path[PATH_MAX];
+      fill_pathname_join(path, g_settings.video.capture_directory, "capture.csv", sizeof(path));
+      vid->log = fopen(path, "w");
+      if (vid->log)
+         fprintf(vid->log, "frame,crc32,interval_usec,driver_usec,dumped\n");
+      else
+         RARCH_WARN("[Capture]: Failed to open \"%s\" for writing.\n", path);
+   }
+   else if (vid->dump_interval || vid->num_dump_frames)
+      RARCH_WARN("[Capture]: video_capture_directory is not set, frames will not be dumped.\n");
+
+   return vid;
+
+error:
+   capture_gfx_free(vid);
+   return NULL;
+}
+
+static void capture_render_msg(capture_video_t *vid, const char *msg)
+{
+   if (!vid->font)
+      return;
+
+   struct font_output_list out;
+   vid->font_driver->render_msg(vid->font, msg, &out);
+   struct font_output *head = out.head;
+
+   int msg_base_x = g_settings.video.msg_pos_x * vid->width;
+   int msg_base_y = (1.0 - g_settings.video.msg_pos_y) * vid->height;
+
+   for (; head; head = head->next)
+   {
+      int base_x = msg_base_x + head->off_x;
+      int base_y = msg_base_y - head->off_y - head->height;
+
+      int glyph_width  = head->width;
+      int glyph_height = head->height;
+
+      const uint8_t *src = head->output;
+
+      if (base_x < 0)
+      {
+         src -= base_x;
+         glyph_width += base_x;
+         base_x = 0;
+      }
+
+      if (base_y < 0)
+      {
+         src -= base_y * (int)head->pitch;
+         glyph_height += base_y;
+         base_y = 0;
+      }
+
+      int max_width  = vid->width - base_x;
+      int max_height = vid->height - base_y;
+
+      if (max_width <= 0 || max_height <= 0)
+         continue;
+
+      if (glyph_width > max_width)
+         glyph_width = max_width;
+      if (glyph_height > max_height)
+         glyph_height = max_height;
+
+      uint32_t *out = vid->buffer + base_y * vid->width + base_x;
+
+      for (int y = 0; y < glyph_height; y++, src += head->pitch, out += vid->width)
+      {
+         for (int x = 0; x < glyph_width; x++)
+         {
+            unsigned blend = src[x];
+            unsigned out_pix = out[x];
+            unsigned r = (out_pix >> 16) & 0xff;
+            unsigned g = (out_pix >>  8) & 0xff;
+            unsigned b = (out_pix >>  0) & 0xff;
+
+            unsigned out_r = (r * (256 - blend) + vid->font_r * blend) >> 8;
+            unsigned out_g = (g * (256 - blend) + vid->font_g * blend) >> 8;
+            unsigned out_b = (b * (256 - blend) + vid->font_b * blend) >> 8;
+            out[x] = (0xffu << 24) | (out_r << 16) | (out_g << 8) | (out_b << 0);
+         }
+      }
+   }
+
+   vid->font_driver->free_output(vid->font, &out);
+}
+
+static bool capture_should_dump(capture_video_t *vid, unsigned frame)
+{
+   if (vid->dump_interval && (frame % vid->dump_interval) == 0)
+      return true;
+
+   for (unsigned i = 0; i < vid->num_dump_frames; i++)
+      if (vid->dump_frames[i] == frame)
+         return true;
+
+   return false;
+}
+
+static bool capture_dump(capture_video_t *vid, unsigned frame)
+{
+#ifdef HAVE_ZLIB_DEFLATE
+   char filename[64];
+   char path[PATH_MAX];
+   snprintf(filename, sizeof(filename), "capture-%06u.png", frame);
+   fill_pathname_join(path, g_settings.video.capture_directory, filename, sizeof(path));
+
+   if (!rpng_save_image_argb(path, vid->buffer, vid->width, vid->height, vid->width * sizeof(uint32_t)))
+   {
+      RARCH_ERR("[Capture]: Failed to dump frame to \"%s\".\n", path);
+      return false;
+   }
+
+   return true;
+#else
+   (void)vid;
+   (void)frame;
+   RARCH_WARN("[Capture]: Cannot dump frames without PNG support.\n");
+   return false;
+#endif
+}
+
+static bool capture_gfx_frame(void *data, const void *frame,
+      unsigned width, unsigned height, unsigned pitch, const char *msg)
+{
+   capture_video_t *vid = (capture_video_t*)data;
+
+   rarch_time_t start = rarch_get_time_usec();
+   rarch_time_t interval = vid->last_time ? start - vid->last_time : 0;
+   vid->last_time = start;
+
+   // A NULL frame means the last one is shown again, so the framebuffer stays as is.
+   if (frame)
+   {
+      vid->scaler.in_stride = pitch;
+      if (width != vid->last_width || height != vid->last_height)
+      {
+         vid->scaler.in_width  = width;
+         vid->scaler.in_height = height;
+
+         if (!scaler_ctx_gen_filter(&vid->scaler))
+         {
+            RARCH_ERR("[Capture]: Failed to set up scaler for %ux%u.\n", width, height);
+            return false;
+         }
+
+         vid->last_width  = width;
+         vid->last_height = height;
+      }
+
+      scaler_ctx_scale(&vid->scaler, vid->buffer, frame);
+
+      // The X byte of XRGB8888 frames is undefined, and filtering fades alpha at the borders.
+      // Make it opaque, so it doesn't leak into the CRC, nor make dumped frames transparent.
+      uint32_t *pix = vid->buffer;
+      for (size_t i = 0; i < (size_t)vid->width * vid->height; i++)
+         pix[i] |= 0xff000000u;
+
+      if (msg)
+         capture_render_msg(vid, msg);
+
+      vid->crc = crc32_calculate((const uint8_t*)vid->buffer,
+            vid->width * vid->height * sizeof(uint32_t));
+   }
+
+   rarch_time_t frame_time = rarch_get_time_usec() - start;
+
+   for (unsigned i = 0; i < sizeof(vid->crc); i++)
+      vid->seq_crc = crc32_adjust(vid->seq_crc, (uint8_t)(vid->crc >> (i * 8)));
+
+   unsigned index = vid->frames++;
+
+   vid->interval_total += interval;
+   if (interval > vid->interval_max)
+      vid->interval_max = interval;
+   vid->frame_total += frame_time;
+   if (frame_time > vid->frame_max)
+      vid->frame_max = frame_time;
+
+   bool dumped = false;
+   if (*g_settings.video.capture_directory && capture_should_dump(vid, index))
+   {
+      dumped = capture_dump(vid, index);
+      if (dumped)
+         vid->dumped++;
+   }
+
+   if (vid->log)
+   {
+      fprintf(vid->log, "%u,%08x,%lld,%lld,%d\n", index, (unsigned)vid->crc,
+            (long long)interval, (long long)frame_time, dumped);
+   }
+
+   return true;
+}
+
+static void capture_gfx_set_nonblock_state(void *data, bool toggle)
+{
+   (void)data;
+   (void)toggle;
+}
+
+static bool capture_gfx_alive(void *data)
+{
+   capture_video_t *vid = (capture_video_t*)data;
+   return !vid->max_frames || vid->frames < vid->max_frames;
+}
+
+static bool capture_gfx_focus(void *data)
+{
+   (void)data;
+   return true;
+}
+
+static void capture_gfx_viewport_info(void *data, struct rarch_viewport *vp)
+{
+   capture_video_t *vid = (capture_video_t*)data;
+   vp->x = vp->y = 0;
+   vp->width  = vp->full_width  = vid->width;
+   vp->height = vp->full_height = vid->height;
+}
+
+// Bottom-up BGR24, same as the GL driver.
+static bool capture_gfx_read_viewport(void *data, uint8_t *buffer)
+{
+   capture_video_t *vid = (capture_video_t*)data;
+
+   for (unsigned y = 0; y < vid->height; y++)
+   {
+      const uint32_t *src = vid->buffer + (vid->height - 1 - y) * vid->width;
+      for (unsigned x = 0; x < vid->width; x++, buffer += 3)
+      {
+         buffer[0] = (src[x] >>  0) & 0xff;
+         buffer[1] = (src[x] >>  8) & 0xff;
+         buffer[2] = (src[x] >> 16) & 0xff;
+      }
+   }
+
+   return true;
+}
+
+static unsigned capture_gfx_get_pixel_formats(void *data)
+{
+   (void)data;
+   return (1 << RETRO_PIXEL_FORMAT_0RGB1555) | (1 << RETRO_PIXEL_FORMAT_XRGB8888) | (1 << RETRO_PIXEL_FORMAT_RGB565);
+}
+
+static const video_poke_interface_t capture_poke_interface = {
+   NULL, // set_blend
+   NULL, // set_filtering
+#ifdef HAVE_FBO
+   NULL, // set_fbo_state
+   NULL, // get_fbo_state
+#endif
+   NULL, // set_aspect_ratio
+   NULL, // apply_state_changes
+#ifdef HAVE_RGUI
+   NULL, // set_rgui_texture
+#endif
+   NULL, // set_osd_msg
+   capture_gfx_get_pixel_formats,
+};
+
+static void capture_gfx_get_poke_interface(void *data, const video_poke_interface_t **iface)
+{
+   (void)data;
+   *iface = &capture_poke_interface;
+}
+
+const video_driver_t video_capture = {
+   capture_gfx_init,
+   capture_gfx_frame,
+   capture_gfx_set_nonblock_state,
+   capture_gfx_alive,
+   capture_gfx_focus,
+   NULL,
+   capture_gfx_free,
+   "capture",
+
+#ifdef RARCH_CONSOLE
+   NULL,
+   NULL,
+   NULL,
+#endif
+
+   NULL,
+   capture_gfx_viewport_info,
+   capture_gfx_read_viewport,
+
+#ifdef HAVE_OVERLAY
+   NULL,
+#endif
+   capture_gfx_get_poke_interface,
+};
+
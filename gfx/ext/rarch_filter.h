@@ -0,0 +1,111 @@
+/////
+// API header for external RetroArch CPU video filter plugins.
+//
+//
+
+#ifndef __RARCH_FILTER_PLUGIN_H
+#define __RARCH_FILTER_PLUGIN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef RARCH_API_EXPORT
+#ifdef _WIN32
+#ifdef RARCH_DLL_IMPORT
+#define RARCH_API_EXPORT __declspec(dllimport)
+#else
+#define RARCH_API_EXPORT __declspec(dllexport)
+#endif
+#define RARCH_API_CALLTYPE __cdecl
+#else
+#define RARCH_API_EXPORT
+#define RARCH_API_CALLTYPE
+#endif
+#endif
+
+#define RARCH_FILTER_API_VERSION 1
+
+// Input pixel formats. Both are native endian, same as the libretro formats.
+// Output is always XRGB8888.
+#define RARCH_FILTER_FMT_RGB565   (1 << 0)
+#define RARCH_FILTER_FMT_XRGB8888 (1 << 1)
+
+// process() is reentrant, and can be called from several threads at once
+// on different slices of the same frame.
+#define RARCH_FILTER_SLICEABLE (1 << 0)
+
+typedef struct rarch_filter_info
+{
+   // Largest input frame the plugin will be given.
+   unsigned max_width;
+   unsigned max_height;
+
+   // One of RARCH_FILTER_FMT_*. Chosen by RetroArch from input_fmts.
+   unsigned in_fmt;
+} rarch_filter_info_t;
+
+typedef struct rarch_filter_slice
+{
+   // Full output and input frames. Pitches are in bytes.
+   uint32_t *output;
+   size_t out_pitch;
+   const void *input;
+   size_t in_pitch;
+
+   // Size of the full input frame.
+   unsigned width;
+   unsigned height;
+
+   // Input lines [first_line, last_line) should be processed,
+   // and the output lines these map to written.
+   // Lines outside this range may be read, e.g. for neighbouring pixels, but never written.
+   unsigned first_line;
+   unsigned last_line;
+} rarch_filter_slice_t;
+
+typedef struct rarch_filter_plugin
+{
+   // Creates a handle of the plugin. Returns NULL if failed.
+   void *(*init)(const rarch_filter_info_t *info);
+
+   // Translates an input size into the output size of the filter.
+   void (*output_size)(void *data, unsigned *width, unsigned *height);
+
+   // Filters a frame, or a part of it.
+   void (*process)(void *data, const rarch_filter_slice_t *slice);
+
+   // Frees the handle.
+   void (*free)(void *data);
+
+   // API version used to compile the plugin.
+   // Used to detect mismatches in API.
+   // Must be set to RARCH_FILTER_API_VERSION on compile.
+   int api_version;
+
+   // Mask of RARCH_FILTER_FMT_* the plugin can take as input.
+   // If the game's format is not in here, RetroArch converts the frame first.
+   unsigned input_fmts;
+
+   // Mask of RARCH_FILTER_* flags.
+   unsigned flags;
+
+   // Human readable identification string.
+   const char *ident;
+} rarch_filter_plugin_t;
+
+// Called by RetroArch when loading the filter to get the callback struct.
+// This is NOT dynamically allocated!
+// Plugins not exporting this symbol are loaded as old style bSNES filters.
+RARCH_API_EXPORT const rarch_filter_plugin_t* RARCH_API_CALLTYPE
+   rarch_filter_plugin_init(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
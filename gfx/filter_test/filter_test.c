@@ -0,0 +1,117 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2013 - Hans-Kristian Arntzen
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Runs the sample plugin through the filter runner, and verifies that slicing it across threads
+// is byte exact with running it over the whole frame at once.
+
+#include "../video_filter.h"
+#include "../../general.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct global g_extern;
+
+static void fill_random(void *data, size_t size)
+{
+   uint8_t *buf = (uint8_t*)data;
+   for (size_t i = 0; i < size; i++)
+      buf[i] = rand();
+}
+
+static bool test_filter(const rarch_filter_plugin_t *plugin, unsigned in_fmt, unsigned threads,
+      unsigned width, unsigned height)
+{
+   unsigned bpp = in_fmt == RARCH_FILTER_FMT_XRGB8888 ? sizeof(uint32_t) : sizeof(uint16_t);
+   size_t in_pitch = (width + 7) * bpp; // Padding must be left alone.
+
+   rarch_video_filter_t *filt = rarch_video_filter_new(plugin, in_fmt, width, height, threads);
+   if (!filt)
+      return false;
+
+   rarch_filter_info_t info = {0};
+   info.max_width  = width;
+   info.max_height = height;
+   info.in_fmt     = in_fmt;
+   void *handle = plugin->init(&info);
+
+   unsigned out_width = width, out_height = height;
+   rarch_video_filter_output_size(filt, &out_width, &out_height);
+   size_t out_pitch = (out_width + 3) * sizeof(uint32_t);
+   size_t out_size  = out_pitch * out_height;
+
+   uint8_t *input       = (uint8_t*)malloc(in_pitch * height);
+   uint32_t *output_ref = (uint32_t*)malloc(out_size);
+   uint32_t *output     = (uint32_t*)malloc(out_size);
+   memset(output_ref, 0xaa, out_size);
+   memset(output, 0xaa, out_size);
+
+   bool ret = true;
+   // Render a few frames, so the workers are reused.
+   for (unsigned i = 0; i < 4 && ret; i++)
+   {
+      fill_random(input, in_pitch * height);
+
+      rarch_filter_slice_t slice = {0};
+      slice.output     = output_ref;
+      slice.out_pitch  = out_pitch;
+      slice.input      = input;
+      slice.in_pitch   = in_pitch;
+      slice.width      = width;
+      slice.height     = height;
+      slice.first_line = 0;
+      slice.last_line  = height;
+      plugin->process(handle, &slice);
+
+      rarch_video_filter_render(filt, output, out_pitch, input, in_pitch, width, height);
+      ret = memcmp(output_ref, output, out_size) == 0;
+   }
+
+   fprintf(stderr, "[%s] Format %u, %u threads: %ux%u -> %ux%u: %s.\n", plugin->ident,
+         in_fmt, threads, width, height, out_width, out_height, ret ? "OK" : "MISMATCH");
+
+   free(input);
+   free(output_ref);
+   free(output);
+   plugin->free(handle);
+   rarch_video_filter_free(filt);
+   return ret;
+}
+
+int main(void)
+{
+   static const unsigned sizes[][2] = {
+      { 256, 224 },
+      { 321, 239 },
+      { 160, 17 },
+      { 37, 5 },
+   };
+
+   const rarch_filter_plugin_t *plugin = rarch_filter_plugin_init();
+   if (plugin->api_version != RARCH_FILTER_API_VERSION)
+      return 1;
+
+   bool ret = true;
+   for (unsigned threads = 1; threads <= 5; threads++)
+   {
+      for (unsigned i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+      {
+         ret &= test_filter(plugin, RARCH_FILTER_FMT_RGB565, threads, sizes[i][0], sizes[i][1]);
+         ret &= test_filter(plugin, RARCH_FILTER_FMT_XRGB8888, threads, sizes[i][0], sizes[i][1]);
+      }
+   }
+
+   return ret ? 0 : 1;
+}
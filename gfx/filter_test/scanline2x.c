@@ -0,0 +1,107 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2013 - Hans-Kristian Arntzen
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Sample filter plugin (see ../ext/rarch_filter.h).
+// Doubles the frame, and fills every second line with a darkened blend of the lines around it.
+// Reading the next input line shows how slices may look past their own lines.
+
+#include "../ext/rarch_filter.h"
+#include <stdlib.h>
+
+struct scanline2x
+{
+   unsigned in_fmt;
+};
+
+static void *scanline2x_init(const rarch_filter_info_t *info)
+{
+   struct scanline2x *filt = (struct scanline2x*)calloc(1, sizeof(*filt));
+   if (!filt)
+      return NULL;
+
+   filt->in_fmt = info->in_fmt;
+   return filt;
+}
+
+static void scanline2x_output_size(void *data, unsigned *width, unsigned *height)
+{
+   (void)data;
+   *width  *= 2;
+   *height *= 2;
+}
+
+static inline uint32_t read_pixel(const struct scanline2x *filt, const uint8_t *line, unsigned x)
+{
+   if (filt->in_fmt == RARCH_FILTER_FMT_XRGB8888)
+      return ((const uint32_t*)line)[x] & 0xffffff;
+
+   uint16_t col = ((const uint16_t*)line)[x];
+   uint32_t r = (col >> 11) & 0x1f;
+   uint32_t g = (col >>  5) & 0x3f;
+   uint32_t b = (col >>  0) & 0x1f;
+   r = (r << 3) | (r >> 2);
+   g = (g << 2) | (g >> 4);
+   b = (b << 3) | (b >> 2);
+   return (r << 16) | (g << 8) | b;
+}
+
+// Average of both pixels at 3/4 brightness, per channel.
+static inline uint32_t scanline(uint32_t a, uint32_t b)
+{
+   uint32_t avg = ((a & 0xfefefe) >> 1) + ((b & 0xfefefe) >> 1);
+   return ((avg & 0xfcfcfc) >> 2) * 3;
+}
+
+static void scanline2x_process(void *data, const rarch_filter_slice_t *slice)
+{
+   const struct scanline2x *filt = (const struct scanline2x*)data;
+
+   for (unsigned y = slice->first_line; y < slice->last_line; y++)
+   {
+      const uint8_t *in = (const uint8_t*)slice->input + y * slice->in_pitch;
+      const uint8_t *in_next = y + 1 < slice->height ? in + slice->in_pitch : in;
+      uint32_t *out = (uint32_t*)((uint8_t*)slice->output + 2 * y * slice->out_pitch);
+      uint32_t *out_scan = (uint32_t*)((uint8_t*)out + slice->out_pitch);
+
+      for (unsigned x = 0; x < slice->width; x++)
+      {
+         uint32_t col = read_pixel(filt, in, x);
+         uint32_t scan = scanline(col, read_pixel(filt, in_next, x));
+         out[2 * x] = out[2 * x + 1] = col;
+         out_scan[2 * x] = out_scan[2 * x + 1] = scan;
+      }
+   }
+}
+
+static void scanline2x_free(void *data)
+{
+   free(data);
+}
+
+static const rarch_filter_plugin_t scanline2x_plugin = {
+   scanline2x_init,
+   scanline2x_output_size,
+   scanline2x_process,
+   scanline2x_free,
+   RARCH_FILTER_API_VERSION,
+   RARCH_FILTER_FMT_RGB565 | RARCH_FILTER_FMT_XRGB8888,
+   RARCH_FILTER_SLICEABLE,
+   "Scanline 2x",
+};
+
+RARCH_API_EXPORT const rarch_filter_plugin_t* RARCH_API_CALLTYPE rarch_filter_plugin_init(void)
+{
+   return &scanline2x_plugin;
+}
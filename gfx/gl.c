@@ -988,13 +988,14 @@ static void gl_update_input_size(void *data, unsigned width, unsigned height, un
 static inline void gl_convert_frame_rgb16_32(void *data, void *output, const void *input, int width, int height, int in_pitch)
 {
    gl_t *gl = (gl_t*)data;
-   if (width != gl->scaler.in_width || height != gl->scaler.in_height)
+   enum scaler_pix_fmt in_fmt = gl->rgb1555 ? SCALER_FMT_0RGB1555 : SCALER_FMT_RGB565;
+   if (width != gl->scaler.in_width || height != gl->scaler.in_height || in_fmt != gl->scaler.in_fmt)
    {
       gl->scaler.in_width    = width;
       gl->scaler.in_height   = height;
       gl->scaler.out_width   = width;
       gl->scaler.out_height  = height;
-      gl->scaler.in_fmt      = SCALER_FMT_RGB565;
+      gl->scaler.in_fmt      = in_fmt;
       gl->scaler.out_fmt     = SCALER_FMT_ARGB8888;
       gl->scaler.scaler_type = SCALER_TYPE_POINT;
       scaler_ctx_gen_filter(&gl->scaler);
@@ -1243,7 +1244,7 @@ static inline void gl_set_shader_viewport(void *data, unsigned shader)
    gl_set_viewport(gl, gl->win_width, gl->win_height, false, true);
 }
 
-#if !defined(HAVE_OPENGLES) && defined(HAVE_FFMPEG)
+#if !defined(HAVE_OPENGLES) && defined(HAVE_RECORD)
 static void gl_pbo_async_readback(void *data)
 {
    gl_t *gl = (gl_t*)data;
@@ -1416,7 +1417,7 @@ static bool gl_frame(void *data, const void *frame, unsigned width, unsigned hei
 #endif
       context_swap_buffers_func();
 
-#if !defined(HAVE_OPENGLES) && defined(HAVE_FFMPEG)
+#if !defined(HAVE_OPENGLES) && defined(HAVE_RECORD)
    if (gl->pbo_readback_enable)
       gl_pbo_async_readback(gl);
 #endif
@@ -1473,7 +1474,7 @@ static void gl_free(void *data)
 
    scaler_ctx_gen_reset(&gl->scaler);
 
-#if !defined(HAVE_OPENGLES) && defined(HAVE_FFMPEG)
+#if !defined(HAVE_OPENGLES) && defined(HAVE_RECORD)
    if (gl->pbo_readback_enable)
    {
       pglDeleteBuffers(4, gl->pbo_readback);
@@ -1540,10 +1541,18 @@ static bool resolve_extensions(gl_t *gl)
    return true;
 }
 
-static inline void gl_set_texture_fmts(void *data, bool rgb32)
+static inline void gl_set_texture_fmts(void *data, bool rgb32, bool rgb1555)
 {
    gl_t *gl = (gl_t*)data;
 
+#if !defined(HAVE_PSGL) && !defined(HAVE_OPENGLES2)
+   // 16-bit frames are expanded to 32-bit on upload anyways, so 0RGB1555 can be expanded directly.
+   gl->rgb1555 = rgb1555 && !rgb32;
+#else
+   (void)rgb1555;
+   gl->rgb1555 = false;
+#endif
+
    gl->internal_fmt = rgb32 ? RARCH_GL_INTERNAL_FORMAT32 : RARCH_GL_INTERNAL_FORMAT16;
    gl->texture_type = rgb32 ? RARCH_GL_TEXTURE_TYPE32 : RARCH_GL_TEXTURE_TYPE16;
    gl->texture_fmt  = rgb32 ? RARCH_GL_FORMAT32 : RARCH_GL_FORMAT16;
@@ -1563,7 +1572,7 @@ static inline void gl_reinit_textures(void *data, const video_info_t *video)
    unsigned old_width     = gl->tex_w;
    unsigned old_height    = gl->tex_h;
 
-   gl_set_texture_fmts(gl, video->rgb32);
+   gl_set_texture_fmts(gl, video->rgb32, video->rgb1555);
    gl->tex_w = gl->tex_h = RARCH_SCALE_BASE * video->input_scale;
 
    gl->empty_buf = realloc(gl->empty_buf, sizeof(uint32_t) * gl->tex_w * gl->tex_h);
@@ -1609,8 +1618,8 @@ static inline void gl_reinit_textures(void *data, const video_info_t *video)
 static void gl_init_pbo_readback(void *data)
 {
    gl_t *gl = (gl_t*)data;
-#if !defined(HAVE_OPENGLES) && defined(HAVE_FFMPEG)
-   // Only bother with this if we're doing FFmpeg GPU recording.
+#if !defined(HAVE_OPENGLES) && defined(HAVE_RECORD)
+   // Only bother with this if we're doing GPU recording.
    gl->pbo_readback_enable = g_settings.video.gpu_record && g_extern.recording;
    if (!gl->pbo_readback_enable)
       return;
@@ -1800,7 +1809,7 @@ static void *gl_init(const video_info_t *video, const input_driver_t **input, vo
    else
       gl->tex_filter = video->smooth ? GL_LINEAR : GL_NEAREST;
 
-   gl_set_texture_fmts(gl, video->rgb32);
+   gl_set_texture_fmts(gl, video->rgb32, video->rgb1555);
 
 #ifndef HAVE_OPENGLES
    glEnable(GL_TEXTURE_2D);
@@ -2008,7 +2017,7 @@ static bool gl_read_viewport(void *data, uint8_t *buffer)
       pixels[0] = tmp;
    }
 #else
-#ifdef HAVE_FFMPEG
+#ifdef HAVE_RECORD
    if (gl->pbo_readback_enable)
    {
       if (!gl->pbo_readback_valid) // We haven't buffered up enough frames yet, come back later.
@@ -2334,6 +2343,15 @@ static void gl_set_osd_msg(void *data, const char *msg, void *userdata)
       gl->font_ctx->render_msg(gl, msg, params);
 }
 
+static unsigned gl_get_pixel_formats(void *data)
+{
+   gl_t *gl = (gl_t*)data;
+   unsigned formats = (1 << RETRO_PIXEL_FORMAT_RGB565) | (1 << RETRO_PIXEL_FORMAT_XRGB8888);
+   if (gl->rgb1555)
+      formats |= 1 << RETRO_PIXEL_FORMAT_0RGB1555;
+   return formats;
+}
+
 static const video_poke_interface_t gl_poke_interface = {
    gl_set_blend,
    gl_set_filtering,
@@ -2347,6 +2365,7 @@ static const video_poke_interface_t gl_poke_interface = {
    gl_set_rgui_texture,
 #endif
    gl_set_osd_msg,
+   gl_get_pixel_formats,
 };
 
 static void gl_get_poke_interface(void *data, const video_poke_interface_t **iface)
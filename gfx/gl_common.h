@@ -271,6 +271,7 @@ typedef struct gl
    GLenum texture_fmt;
    GLenum border_type;
    unsigned base_size; // 2 or 4
+   bool rgb1555; // 16-bit frames are 0RGB1555 rather than RGB565.
 
    // Fonts
    void *font;
@@ -296,7 +297,7 @@ typedef struct gl
    GLfloat overlay_alpha_mod;
 #endif
 
-#if !defined(HAVE_OPENGLES) && defined(HAVE_FFMPEG)
+#if !defined(HAVE_OPENGLES) && defined(HAVE_RECORD)
    // PBOs used for asynchronous viewport readbacks.
    GLuint pbo_readback[4];
    bool pbo_readback_enable;
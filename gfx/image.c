@@ -23,7 +23,11 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stddef.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 #include "../general.h"
+#include "../performance.h"
+#include "../hash.h"
 #include "rpng/rpng.h"
 
 #ifdef HAVE_SDL_IMAGE
@@ -221,12 +225,364 @@ bool texture_image_load_argb_shift(const char *path, struct texture_image *out_i
 
 #endif
 
+// Decoded images are cached in memory, and optionally on disk as raw pixels.
+// Overlays and shader LUTs are loaded again every time the drivers are reinited
+// (e.g. toggling fullscreen) or overlays are cycled.
+// Entries are keyed on path, modification time and size of the source image, and pixel layout.
+
+#define IMAGE_CACHE_MAGIC 0x43494152 // RAIC
+#define IMAGE_CACHE_VERSION 1
+
+struct image_cache_key
+{
+   const char *path;
+   uint32_t layout;
+   uint64_t mtime;
+   uint64_t size;
+};
+
+struct image_cache_entry
+{
+   char *path;
+   uint32_t layout;
+   uint64_t mtime;
+   uint64_t size;
+
+   unsigned width;
+   unsigned height;
+   uint32_t *pixels;
+
+   uint64_t last_use;
+   struct image_cache_entry *next;
+};
+
+// Raw pixels follow at data_offset, which is aligned, so the file can be mapped as is.
+struct image_cache_header
+{
+   uint32_t magic;
+   uint32_t version;
+   uint32_t layout;
+   uint32_t width;
+   uint32_t height;
+   uint32_t path_len;
+   uint32_t data_offset;
+   uint32_t reserved;
+   uint64_t mtime;
+   uint64_t size;
+};
+
+static struct
+{
+   struct image_cache_entry *entries;
+   size_t bytes;
+   uint64_t clock;
+
+   unsigned hits;
+   unsigned disk_hits;
+   unsigned misses;
+   rarch_time_t hit_time;
+   rarch_time_t disk_time;
+   rarch_time_t decode_time;
+} image_cache;
+
+static size_t image_cache_entry_bytes(unsigned width, unsigned height)
+{
+   return (size_t)width * height * sizeof(uint32_t);
+}
+
+static bool image_cache_key_init(struct image_cache_key *key, const char *path, uint32_t layout)
+{
+   struct stat buf;
+   if (stat(path, &buf) < 0)
+      return false;
+
+   key->path   = path;
+   key->layout = layout;
+   key->mtime  = buf.st_mtime;
+   key->size   = buf.st_size;
+   return true;
+}
+
+static void image_cache_entry_free(struct image_cache_entry *entry)
+{
+   image_cache.bytes -= image_cache_entry_bytes(entry->width, entry->height);
+   free(entry->path);
+   free(entry->pixels);
+   free(entry);
+}
+
+static void image_cache_remove(struct image_cache_entry **link)
+{
+   struct image_cache_entry *entry = *link;
+   *link = entry->next;
+   image_cache_entry_free(entry);
+}
+
+static struct image_cache_entry **image_cache_find(const char *path, uint32_t layout)
+{
+   for (struct image_cache_entry **link = &image_cache.entries; *link; link = &(*link)->next)
+   {
+      if ((*link)->layout == layout && strcmp((*link)->path, path) == 0)
+         return link;
+   }
+
+   return NULL;
+}
+
+static bool image_cache_lookup(const struct image_cache_key *key, struct texture_image *out_img)
+{
+   struct image_cache_entry **link = image_cache_find(key->path, key->layout);
+   if (!link)
+      return false;
+
+   struct image_cache_entry *entry = *link;
+   if (entry->mtime != key->mtime || entry->size != key->size)
+   {
+      image_cache_remove(link); // Stale.
+      return false;
+   }
+
+   size_t bytes = image_cache_entry_bytes(entry->width, entry->height);
+   out_img->pixels = (uint32_t*)malloc(bytes);
+   if (!out_img->pixels)
+      return false;
+
+   memcpy(out_img->pixels, entry->pixels, bytes);
+   out_img->width  = entry->width;
+   out_img->height = entry->height;
+   entry->last_use = ++image_cache.clock;
+   return true;
+}
+
+static void image_cache_store(const struct image_cache_key *key, const struct texture_image *img)
+{
+   size_t bytes = image_cache_entry_bytes(img->width, img->height);
+   if (bytes > g_settings.image_cache_size)
+      return;
+
+   struct image_cache_entry **link = image_cache_find(key->path, key->layout);
+   if (link)
+      image_cache_remove(link);
+
+   // Evict least recently used images until it fits.
+   while (image_cache.bytes + bytes > g_settings.image_cache_size)
+   {
+      struct image_cache_entry **lru = &image_cache.entries;
+      for (link = &image_cache.entries; *link; link = &(*link)->next)
+      {
+         if ((*link)->last_use < (*lru)->last_use)
+            lru = link;
+      }
+      image_cache_remove(lru);
+   }
+
+   struct image_cache_entry *entry = (struct image_cache_entry*)calloc(1, sizeof(*entry));
+   if (!entry)
+      return;
+
+   entry->path   = strdup(key->path);
+   entry->pixels = (uint32_t*)malloc(bytes);
+   if (!entry->path || !entry->pixels)
+   {
+      free(entry->path);
+      free(entry->pixels);
+      free(entry);
+      return;
+   }
+
+   memcpy(entry->pixels, img->pixels, bytes);
+   entry->layout   = key->layout;
+   entry->mtime    = key->mtime;
+   entry->size     = key->size;
+   entry->width    = img->width;
+   entry->height   = img->height;
+   entry->last_use = ++image_cache.clock;
+
+   entry->next = image_cache.entries;
+   image_cache.entries = entry;
+   image_cache.bytes += bytes;
+}
+
+static void image_cache_header_init(struct image_cache_header *header,
+      const struct image_cache_key *key, unsigned width, unsigned height)
+{
+   memset(header, 0, sizeof(*header));
+   header->magic       = IMAGE_CACHE_MAGIC;
+   header->version     = IMAGE_CACHE_VERSION;
+   header->layout      = key->layout;
+   header->width       = width;
+   header->height      = height;
+   header->path_len    = strlen(key->path);
+   header->data_offset = (sizeof(*header) + header->path_len + 63) & ~63;
+   header->mtime       = key->mtime;
+   header->size        = key->size;
+}
+
+static bool image_cache_path(char *path, size_t size, const struct image_cache_key *key)
+{
+   if (!*g_settings.image_cache_directory)
+      return false;
+
+   char name[64];
+   snprintf(name, sizeof(name), "image-%08x-%08x.bin",
+         (unsigned)crc32_calculate((const uint8_t*)key->path, strlen(key->path)),
+         (unsigned)key->layout);
+   fill_pathname_join(path, g_settings.image_cache_directory, name, size);
+   return true;
+}
+
+static bool image_cache_load_file(const struct image_cache_key *key, struct texture_image *out_img)
+{
+   char path[PATH_MAX];
+   if (!image_cache_path(path, sizeof(path), key))
+      return false;
+
+   FILE *file = fopen(path, "rb");
+   if (!file)
+      return false;
+
+   bool ret = false;
+   char *cached_path = NULL;
+   size_t bytes = 0;
+   struct image_cache_header header, expected;
+
+   if (fread(&header, sizeof(header), 1, file) != 1 || !header.width || !header.height)
+      goto end;
+
+   // Different paths can map to the same file, so the path is stored and compared as well.
+   image_cache_header_init(&expected, key, header.width, header.height);
+   if (memcmp(&header, &expected, sizeof(header)) != 0)
+      goto end;
+
+   cached_path = (char*)malloc(header.path_len);
+   if (!cached_path || fread(cached_path, 1, header.path_len, file) != header.path_len ||
+         memcmp(cached_path, key->path, header.path_len) != 0)
+      goto end;
+
+   bytes = image_cache_entry_bytes(header.width, header.height);
+   out_img->pixels = (uint32_t*)malloc(bytes);
+   if (!out_img->pixels)
+      goto end;
+
+   ret = fseek(file, header.data_offset, SEEK_SET) == 0 &&
+      fread(out_img->pixels, 1, bytes, file) == bytes;
+
+   if (ret)
+   {
+      out_img->width  = header.width;
+      out_img->height = header.height;
+   }
+   else
+   {
+      free(out_img->pixels);
+      out_img->pixels = NULL;
+   }
+
+end:
+   if (!ret)
+      RARCH_WARN("Image cache \"%s\" is stale or corrupt, decoding again.\n", path);
+   free(cached_path);
+   fclose(file);
+   return ret;
+}
+
+static void image_cache_save_file(const struct image_cache_key *key, const struct texture_image *img)
+{
+   char path[PATH_MAX];
+   if (!image_cache_path(path, sizeof(path), key))
+      return;
+
+   FILE *file = fopen(path, "wb");
+   if (!file)
+   {
+      RARCH_WARN("Failed to open image cache \"%s\" for writing.\n", path);
+      return;
+   }
+
+   struct image_cache_header header;
+   image_cache_header_init(&header, key, img->width, img->height);
+
+   size_t bytes = image_cache_entry_bytes(img->width, img->height);
+   bool ret = fwrite(&header, sizeof(header), 1, file) == 1 &&
+      fwrite(key->path, 1, header.path_len, file) == header.path_len &&
+      fseek(file, header.data_offset, SEEK_SET) == 0 &&
+      fwrite(img->pixels, 1, bytes, file) == bytes;
+   fclose(file);
+
+   if (!ret)
+   {
+      RARCH_WARN("Failed to write image cache \"%s\".\n", path);
+      remove(path);
+   }
+}
+
+static bool texture_image_load_cached(const char *path, struct texture_image *out_img,
+      unsigned a_shift, unsigned r_shift, unsigned g_shift, unsigned b_shift)
+{
+   struct image_cache_key key;
+   uint32_t layout = (a_shift << 24) | (r_shift << 16) | (g_shift << 8) | (b_shift << 0);
+   if (!image_cache_key_init(&key, path, layout))
+      return texture_image_load_argb_shift(path, out_img, a_shift, r_shift, g_shift, b_shift);
+
+   const char *source = "memory";
+   rarch_time_t start = rarch_get_time_usec();
+
+   if (image_cache_lookup(&key, out_img))
+   {
+      image_cache.hits++;
+      image_cache.hit_time += rarch_get_time_usec() - start;
+   }
+   else
+   {
+      if (image_cache_load_file(&key, out_img))
+      {
+         source = "disk";
+         image_cache.disk_hits++;
+         image_cache.disk_time += rarch_get_time_usec() - start;
+      }
+      else
+      {
+         if (!texture_image_load_argb_shift(path, out_img, a_shift, r_shift, g_shift, b_shift))
+            return false;
+
+         source = "decoded";
+         image_cache.misses++;
+         image_cache.decode_time += rarch_get_time_usec() - start;
+         image_cache_save_file(&key, out_img);
+      }
+
+      image_cache_store(&key, out_img);
+   }
+
+   RARCH_LOG("Image \"%s\" (%s) in %.3f ms.\n", path, source, (rarch_get_time_usec() - start) / 1000.0);
+   return true;
+}
+
+void texture_image_cache_free(void)
+{
+   unsigned loads = image_cache.hits + image_cache.disk_hits + image_cache.misses;
+   if (loads)
+   {
+      RARCH_LOG("Image cache: %u loads, %u from memory, %u from disk, %u decoded (%.1f %% hit rate).\n",
+            loads, image_cache.hits, image_cache.disk_hits, image_cache.misses,
+            100.0 * (image_cache.hits + image_cache.disk_hits) / loads);
+      RARCH_LOG("Image cache: %.3f ms from memory, %.3f ms from disk, %.3f ms decoded on average.\n",
+            image_cache.hits ? image_cache.hit_time / (1000.0 * image_cache.hits) : 0.0,
+            image_cache.disk_hits ? image_cache.disk_time / (1000.0 * image_cache.disk_hits) : 0.0,
+            image_cache.misses ? image_cache.decode_time / (1000.0 * image_cache.misses) : 0.0);
+   }
+
+   while (image_cache.entries)
+      image_cache_remove(&image_cache.entries);
+   memset(&image_cache, 0, sizeof(image_cache));
+}
+
 bool texture_image_load(const char *path, struct texture_image *out_img)
 {
    // This interface "leak" is very ugly. FIXME: Fix this properly ...
    if (driver.gfx_use_rgba)
-      return texture_image_load_argb_shift(path, out_img, 24, 0, 8, 16);
+      return texture_image_load_cached(path, out_img, 24, 0, 8, 16);
    else
-      return texture_image_load_argb_shift(path, out_img, 24, 16, 8, 0);
+      return texture_image_load_cached(path, out_img, 24, 16, 8, 0);
 }
 
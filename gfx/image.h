@@ -45,5 +45,8 @@ bool texture_image_render(struct texture_image *out_img);
 
 bool texture_image_load(const char *path, struct texture_image* img);
 
+// Frees the decoded images kept between loads, and logs hit rates and load times.
+void texture_image_cache_free(void);
+
 #endif
 
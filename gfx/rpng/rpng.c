@@ -26,6 +26,14 @@
 #include <string.h>
 #include "../../hash.h"
 
+#if !defined(RPNG_NO_SIMD) && defined(__SSE2__)
+#define RPNG_HAVE_SSE2
+#include <emmintrin.h>
+#elif !defined(RPNG_NO_SIMD) && defined(HAVE_NEON) && (defined(__ARM_NEON__) || defined(__ARM_NEON))
+#define RPNG_HAVE_NEON
+#include <arm_neon.h>
+#endif
+
 // Decodes a subset of PNG standard.
 // Does not handle much outside 24/32-bit RGB(A) images.
 //
@@ -98,12 +106,6 @@ struct
    { "IEND", PNG_CHUNK_IEND },
 };
 
-struct idat_buffer
-{
-   uint8_t *data;
-   size_t size;
-};
-
 static enum png_chunk_type png_chunk_type(const struct png_chunk *chunk)
 {
    for (unsigned i = 0; i < sizeof(chunk_map) / sizeof(chunk_map[0]); i++)
@@ -192,6 +194,199 @@ static inline int paeth(int a, int b, int c)
       return c;
 }
 
+#if defined(RPNG_HAVE_SSE2)
+// Paeth predictor on 16-bit lanes.
+static inline __m128i paeth_sse2(__m128i a, __m128i b, __m128i c)
+{
+   __m128i zero = _mm_setzero_si128();
+   __m128i bc = _mm_sub_epi16(b, c);
+   __m128i ac = _mm_sub_epi16(a, c);
+   __m128i abc = _mm_add_epi16(bc, ac);
+
+   // p - a == b - c, p - b == a - c, p - c == (b - c) + (a - c).
+   __m128i pa = _mm_max_epi16(bc, _mm_sub_epi16(zero, bc));
+   __m128i pb = _mm_max_epi16(ac, _mm_sub_epi16(zero, ac));
+   __m128i pc = _mm_max_epi16(abc, _mm_sub_epi16(zero, abc));
+
+   __m128i not_a = _mm_or_si128(_mm_cmpgt_epi16(pa, pb), _mm_cmpgt_epi16(pa, pc));
+   __m128i not_b = _mm_cmpgt_epi16(pb, pc);
+
+   __m128i b_or_c = _mm_or_si128(_mm_andnot_si128(not_b, b), _mm_and_si128(not_b, c));
+   return _mm_or_si128(_mm_andnot_si128(not_a, a), _mm_and_si128(not_a, b_or_c));
+}
+#endif
+
+// Unfilters a scanline. Sub, Avg and Paeth depend on the pixel to the left,
+// so the SIMD versions work on one pixel at a time, with all channels in parallel.
+// Pixels are always moved as 4 bytes. With RGB, the extra byte belongs to the next pixel
+// (or the padding at the end of the line buffers), and is written before it is used.
+#if defined(RPNG_HAVE_SSE2)
+static inline __m128i load_pixel(const uint8_t *ptr)
+{
+   uint32_t pixel;
+   memcpy(&pixel, ptr, sizeof(pixel));
+   return _mm_cvtsi32_si128(pixel);
+}
+
+static inline void store_pixel(uint8_t *ptr, __m128i pixel)
+{
+   uint32_t val = _mm_cvtsi128_si32(pixel);
+   memcpy(ptr, &val, sizeof(val));
+}
+
+static void unfilter_up(uint8_t *out, const uint8_t *in, const uint8_t *prev, unsigned pitch)
+{
+   unsigned i;
+   for (i = 0; i + 16 <= pitch; i += 16)
+   {
+      __m128i x = _mm_loadu_si128((const __m128i*)(in + i));
+      __m128i b = _mm_loadu_si128((const __m128i*)(prev + i));
+      _mm_storeu_si128((__m128i*)(out + i), _mm_add_epi8(x, b));
+   }
+
+   for (; i < pitch; i++)
+      out[i] = prev[i] + in[i];
+}
+
+static void unfilter_sub(uint8_t *out, const uint8_t *in, unsigned pitch, unsigned bpp)
+{
+   __m128i a = _mm_setzero_si128();
+   for (unsigned i = 0; i < pitch; i += bpp)
+   {
+      a = _mm_add_epi8(a, load_pixel(in + i));
+      store_pixel(out + i, a);
+   }
+}
+
+static void unfilter_avg(uint8_t *out, const uint8_t *in, const uint8_t *prev, unsigned pitch, unsigned bpp)
+{
+   // PAVGB rounds up, so take away the carry of the lowest bit.
+   const __m128i one = _mm_set1_epi8(1);
+   __m128i a = _mm_setzero_si128();
+   for (unsigned i = 0; i < pitch; i += bpp)
+   {
+      __m128i b = load_pixel(prev + i);
+      __m128i avg = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+      a = _mm_add_epi8(load_pixel(in + i), avg);
+      store_pixel(out + i, a);
+   }
+}
+
+static void unfilter_paeth(uint8_t *out, const uint8_t *in, const uint8_t *prev, unsigned pitch, unsigned bpp)
+{
+   const __m128i zero = _mm_setzero_si128();
+   __m128i a = zero;
+   __m128i c = zero;
+   for (unsigned i = 0; i < pitch; i += bpp)
+   {
+      __m128i b = _mm_unpacklo_epi8(load_pixel(prev + i), zero);
+      __m128i pred = _mm_packus_epi16(paeth_sse2(a, b, c), zero);
+      __m128i res = _mm_add_epi8(load_pixel(in + i), pred);
+      store_pixel(out + i, res);
+
+      a = _mm_unpacklo_epi8(res, zero);
+      c = b;
+   }
+}
+#elif defined(RPNG_HAVE_NEON)
+static inline uint8x8_t load_pixel(const uint8_t *ptr)
+{
+   uint32_t pixel;
+   memcpy(&pixel, ptr, sizeof(pixel));
+   return vreinterpret_u8_u32(vdup_n_u32(pixel));
+}
+
+static inline void store_pixel(uint8_t *ptr, uint8x8_t pixel)
+{
+   uint32_t val = vget_lane_u32(vreinterpret_u32_u8(pixel), 0);
+   memcpy(ptr, &val, sizeof(val));
+}
+
+static void unfilter_up(uint8_t *out, const uint8_t *in, const uint8_t *prev, unsigned pitch)
+{
+   unsigned i;
+   for (i = 0; i + 16 <= pitch; i += 16)
+      vst1q_u8(out + i, vaddq_u8(vld1q_u8(in + i), vld1q_u8(prev + i)));
+
+   for (; i < pitch; i++)
+      out[i] = prev[i] + in[i];
+}
+
+static void unfilter_sub(uint8_t *out, const uint8_t *in, unsigned pitch, unsigned bpp)
+{
+   uint8x8_t a = vdup_n_u8(0);
+   for (unsigned i = 0; i < pitch; i += bpp)
+   {
+      a = vadd_u8(a, load_pixel(in + i));
+      store_pixel(out + i, a);
+   }
+}
+
+static void unfilter_avg(uint8_t *out, const uint8_t *in, const uint8_t *prev, unsigned pitch, unsigned bpp)
+{
+   uint8x8_t a = vdup_n_u8(0);
+   for (unsigned i = 0; i < pitch; i += bpp)
+   {
+      // VHADD truncates, as Avg wants.
+      a = vadd_u8(load_pixel(in + i), vhadd_u8(a, load_pixel(prev + i)));
+      store_pixel(out + i, a);
+   }
+}
+
+static void unfilter_paeth(uint8_t *out, const uint8_t *in, const uint8_t *prev, unsigned pitch, unsigned bpp)
+{
+   uint8x8_t a = vdup_n_u8(0);
+   uint8x8_t c = vdup_n_u8(0);
+   for (unsigned i = 0; i < pitch; i += bpp)
+   {
+      uint8x8_t b = load_pixel(prev + i);
+
+      // p - a == b - c, p - b == a - c, p - c == (a + b) - (c + c).
+      uint16x8_t pa = vabdl_u8(b, c);
+      uint16x8_t pb = vabdl_u8(a, c);
+      uint16x8_t pc = vabdq_u16(vaddl_u8(a, b), vaddl_u8(c, c));
+
+      uint8x8_t use_a = vmovn_u16(vandq_u16(vcleq_u16(pa, pb), vcleq_u16(pa, pc)));
+      uint8x8_t use_b = vmovn_u16(vcleq_u16(pb, pc));
+      uint8x8_t pred  = vbsl_u8(use_a, a, vbsl_u8(use_b, b, c));
+
+      a = vadd_u8(load_pixel(in + i), pred);
+      store_pixel(out + i, a);
+      c = b;
+   }
+}
+#else
+static void unfilter_up(uint8_t *out, const uint8_t *in, const uint8_t *prev, unsigned pitch)
+{
+   for (unsigned i = 0; i < pitch; i++)
+      out[i] = prev[i] + in[i];
+}
+
+static void unfilter_sub(uint8_t *out, const uint8_t *in, unsigned pitch, unsigned bpp)
+{
+   for (unsigned i = 0; i < bpp; i++)
+      out[i] = in[i];
+   for (unsigned i = bpp; i < pitch; i++)
+      out[i] = out[i - bpp] + in[i];
+}
+
+static void unfilter_avg(uint8_t *out, const uint8_t *in, const uint8_t *prev, unsigned pitch, unsigned bpp)
+{
+   for (unsigned i = 0; i < bpp; i++)
+      out[i] = (prev[i] >> 1) + in[i];
+   for (unsigned i = bpp; i < pitch; i++)
+      out[i] = ((out[i - bpp] + prev[i]) >> 1) + in[i];
+}
+
+static void unfilter_paeth(uint8_t *out, const uint8_t *in, const uint8_t *prev, unsigned pitch, unsigned bpp)
+{
+   for (unsigned i = 0; i < bpp; i++)
+      out[i] = paeth(0, prev[i], 0) + in[i];
+   for (unsigned i = bpp; i < pitch; i++)
+      out[i] = paeth(out[i - bpp], prev[i], prev[i - bpp]) + in[i];
+}
+#endif
+
 static inline void copy_line_rgb(uint32_t *data, const uint8_t *decoded, unsigned width)
 {
    for (unsigned i = 0; i < width; i++)
@@ -205,7 +400,23 @@ static inline void copy_line_rgb(uint32_t *data, const uint8_t *decoded, unsigne
 
 static inline void copy_line_rgba(uint32_t *data, const uint8_t *decoded, unsigned width)
 {
-   for (unsigned i = 0; i < width; i++)
+   unsigned i = 0;
+
+#if defined(RPNG_HAVE_SSE2)
+   // RGBA in memory is 0xAABBGGRR, swap R and B.
+   const __m128i mask_ag = _mm_set1_epi32(0xff00ff00);
+   const __m128i mask_lo = _mm_set1_epi32(0x000000ff);
+   for (; i + 4 <= width; i += 4)
+   {
+      __m128i x  = _mm_loadu_si128((const __m128i*)(decoded + 4 * i));
+      __m128i ag = _mm_and_si128(x, mask_ag);
+      __m128i b  = _mm_and_si128(_mm_srli_epi32(x, 16), mask_lo);
+      __m128i r  = _mm_slli_epi32(_mm_and_si128(x, mask_lo), 16);
+      _mm_storeu_si128((__m128i*)(data + i), _mm_or_si128(ag, _mm_or_si128(r, b)));
+   }
+#endif
+
+   for (decoded += 4 * i; i < width; i++)
    {
       uint32_t r = *decoded++;
       uint32_t g = *decoded++;
@@ -215,94 +426,150 @@ static inline void copy_line_rgba(uint32_t *data, const uint8_t *decoded, unsign
    }
 }
 
-static bool png_reverse_filter(uint32_t *data, const struct png_ihdr *ihdr,
-      const uint8_t *inflate_buf, size_t inflate_buf_size)
+// IDAT data is read and inflated in pieces of this size.
+#define RPNG_READ_CHUNK_SIZE (64 * 1024)
+
+// Inflates IDAT data as it is read, and unfilters one scanline at a time straight into the output.
+struct png_decoder
 {
-   bool ret = true;
-   unsigned bpp = ihdr->color_type == 2 ? 3 : 4;
-   if (inflate_buf_size < (ihdr->width * bpp + 1) * ihdr->height)
+   z_stream stream;
+   bool stream_init;
+   bool stream_end;
+
+   unsigned bpp;
+   unsigned pitch;
+   unsigned width;
+   unsigned height;
+   unsigned row;
+
+   uint8_t *scanline; // Filter type followed by filtered data.
+   unsigned scanline_pos;
+   uint8_t *prev;
+   uint8_t *decoded;
+
+   uint32_t *data;
+};
+
+static bool png_decoder_init(struct png_decoder *dec, const struct png_ihdr *ihdr)
+{
+   dec->bpp    = ihdr->color_type == 2 ? 3 : 4;
+   dec->pitch  = ihdr->width * dec->bpp;
+   dec->width  = ihdr->width;
+   dec->height = ihdr->height;
+
+   // One byte of padding, see load_pixel().
+   dec->scanline = (uint8_t*)calloc(1, dec->pitch + 2);
+   dec->prev     = (uint8_t*)calloc(1, dec->pitch + 1);
+   dec->decoded  = (uint8_t*)calloc(1, dec->pitch + 1);
+   dec->data     = (uint32_t*)malloc(ihdr->width * ihdr->height * sizeof(uint32_t));
+   if (!dec->scanline || !dec->prev || !dec->decoded || !dec->data)
       return false;
 
-   unsigned pitch = ihdr->width * bpp;
-   uint8_t *prev_scanline    = (uint8_t*)calloc(1, pitch);
-   uint8_t *decoded_scanline = (uint8_t*)calloc(1, pitch);
+   if (inflateInit(&dec->stream) != Z_OK)
+      return false;
+   dec->stream_init = true;
 
-   if (!decoded_scanline || !decoded_scanline)
-      GOTO_END_ERROR();
+   return true;
+}
 
-   for (unsigned h = 0; h < ihdr->height;
-         h++, inflate_buf += pitch, data += ihdr->width)
+static void png_decoder_free(struct png_decoder *dec)
+{
+   if (dec->stream_init)
+      inflateEnd(&dec->stream);
+   free(dec->scanline);
+   free(dec->prev);
+   free(dec->decoded);
+   free(dec->data);
+}
+
+static bool png_decoder_scanline(struct png_decoder *dec)
+{
+   const uint8_t *in = dec->scanline + 1;
+   switch (dec->scanline[0])
    {
-      unsigned filter = *inflate_buf++;
-      switch (filter)
-      {
-         case 0: // None
-            memcpy(decoded_scanline, inflate_buf, pitch);
-            break;
+      case 0: // None
+         memcpy(dec->decoded, in, dec->pitch);
+         break;
+      case 1: // Sub
+         unfilter_sub(dec->decoded, in, dec->pitch, dec->bpp);
+         break;
+      case 2: // Up
+         unfilter_up(dec->decoded, in, dec->prev, dec->pitch);
+         break;
+      case 3: // Average
+         unfilter_avg(dec->decoded, in, dec->prev, dec->pitch, dec->bpp);
+         break;
+      case 4: // Paeth
+         unfilter_paeth(dec->decoded, in, dec->prev, dec->pitch, dec->bpp);
+         break;
+      default:
+         return false;
+   }
 
-         case 1: // Sub
-            for (unsigned i = 0; i < bpp; i++)
-               decoded_scanline[i] = inflate_buf[i];
-            for (unsigned i = bpp; i < pitch; i++)
-               decoded_scanline[i] = decoded_scanline[i - bpp] + inflate_buf[i];
-            break;
+   uint32_t *data = dec->data + dec->row * dec->width;
+   if (dec->bpp == 3)
+      copy_line_rgb(data, dec->decoded, dec->width);
+   else
+      copy_line_rgba(data, dec->decoded, dec->width);
 
-         case 2: // Up
-            for (unsigned i = 0; i < pitch; i++)
-               decoded_scanline[i] = prev_scanline[i] + inflate_buf[i];
-            break;
+   uint8_t *tmp = dec->prev;
+   dec->prev    = dec->decoded;
+   dec->decoded = tmp;
 
-         case 3: // Average
-            for (unsigned i = 0; i < bpp; i++)
-            {
-               uint8_t avg = prev_scanline[i] >> 1;
-               decoded_scanline[i] = avg + inflate_buf[i];
-            }
-            for (unsigned i = bpp; i < pitch; i++)
-            {
-               uint8_t avg = (decoded_scanline[i - bpp] + prev_scanline[i]) >> 1;
-               decoded_scanline[i] = avg + inflate_buf[i];
-            }
-            break;
+   dec->row++;
+   return true;
+}
 
-         case 4: // Paeth
-            for (unsigned i = 0; i < bpp; i++)
-               decoded_scanline[i] = paeth(0, prev_scanline[i], 0) + inflate_buf[i];
-            for (unsigned i = bpp; i < pitch; i++)
-               decoded_scanline[i] = paeth(decoded_scanline[i - bpp], prev_scanline[i], prev_scanline[i - bpp]) + inflate_buf[i];
-            break;
+static bool png_decoder_feed(struct png_decoder *dec, const uint8_t *data, size_t size)
+{
+   dec->stream.next_in  = (uint8_t*)data;
+   dec->stream.avail_in = size;
 
-         default:
-            GOTO_END_ERROR();
+   while (!dec->stream_end)
+   {
+      dec->stream.next_out  = dec->scanline + dec->scanline_pos;
+      dec->stream.avail_out = dec->pitch + 1 - dec->scanline_pos;
+
+      int err = inflate(&dec->stream, Z_NO_FLUSH);
+      if (err == Z_STREAM_END)
+         dec->stream_end = true;
+      else if (err == Z_BUF_ERROR) // Needs more input.
+         break;
+      else if (err != Z_OK)
+         return false;
+
+      dec->scanline_pos = dec->pitch + 1 - dec->stream.avail_out;
+      if (dec->scanline_pos == dec->pitch + 1)
+      {
+         if (dec->row >= dec->height || !png_decoder_scanline(dec))
+            return false;
+         dec->scanline_pos = 0;
       }
-
-      if (bpp == 3)
-         copy_line_rgb(data, decoded_scanline, ihdr->width);
-      else
-         copy_line_rgba(data, decoded_scanline, ihdr->width);
-
-      memcpy(prev_scanline, decoded_scanline, pitch);
+      else if (!dec->stream.avail_in)
+         break;
    }
 
-end:
-   free(decoded_scanline);
-   free(prev_scanline);
-   return ret;
+   return true;
 }
 
-static bool png_append_idat(FILE *file, const struct png_chunk *chunk, struct idat_buffer *buf)
+static bool png_decoder_read_idat(struct png_decoder *dec, FILE *file,
+      const struct png_chunk *chunk, uint8_t *read_buf)
 {
-   uint8_t *new_buffer = (uint8_t*)realloc(buf->data, buf->size + chunk->size);
-   if (!new_buffer)
-      return false;
+   for (uint32_t remaining = chunk->size; remaining; )
+   {
+      size_t size = remaining < RPNG_READ_CHUNK_SIZE ? remaining : RPNG_READ_CHUNK_SIZE;
+      if (fread(read_buf, 1, size, file) != size)
+         return false;
 
-   buf->data  = new_buffer;
-   if (fread(buf->data + buf->size, 1, chunk->size, file) != chunk->size)
-      return false;
-   if (fseek(file, sizeof(uint32_t), SEEK_CUR) < 0)
-      return false;
-   buf->size += chunk->size;
-   return true;
+      // Trailing data after the end of the stream is ignored.
+      if (!dec->stream_end && !png_decoder_feed(dec, read_buf, size))
+         return false;
+
+      remaining -= size;
+   }
+
+   // Ignore CRC.
+   return fseek(file, sizeof(uint32_t), SEEK_CUR) == 0;
 }
 
 bool rpng_load_image_argb(const char *path, uint32_t **data, unsigned *width, unsigned *height)
@@ -314,7 +581,7 @@ bool rpng_load_image_argb(const char *path, uint32_t **data, unsigned *width, un
    bool ret = true;
    FILE *file = fopen(path, "rb");
    if (!file)
-      return NULL;
+      return false;
 
    fseek(file, 0, SEEK_END);
    long file_len = ftell(file);
@@ -323,11 +590,10 @@ bool rpng_load_image_argb(const char *path, uint32_t **data, unsigned *width, un
    bool has_ihdr = false;
    bool has_idat = false;
    bool has_iend = false;
-   uint8_t *inflate_buf = NULL;
-   size_t inflate_buf_size = 0;
-   z_stream stream = {0};
+   uint8_t *read_buf = NULL;
 
-   struct idat_buffer idat_buf = {0};
+   struct png_decoder dec;
+   memset(&dec, 0, sizeof(dec));
    struct png_ihdr ihdr = {0};
 
    char header[8];
@@ -337,6 +603,10 @@ bool rpng_load_image_argb(const char *path, uint32_t **data, unsigned *width, un
    if (memcmp(header, png_magic, sizeof(png_magic)) != 0)
       GOTO_END_ERROR();
 
+   read_buf = (uint8_t*)malloc(RPNG_READ_CHUNK_SIZE);
+   if (!read_buf)
+      GOTO_END_ERROR();
+
    // feof() apparently isn't triggered after a seek (IEND).
    for (long pos = ftell(file); pos < file_len && pos >= 0; pos = ftell(file))
    {
@@ -362,6 +632,9 @@ bool rpng_load_image_argb(const char *path, uint32_t **data, unsigned *width, un
             if (!png_parse_ihdr(file, &chunk, &ihdr))
                GOTO_END_ERROR();
 
+            if (!png_decoder_init(&dec, &ihdr))
+               GOTO_END_ERROR();
+
             has_ihdr = true;
             break;
 
@@ -369,7 +642,7 @@ bool rpng_load_image_argb(const char *path, uint32_t **data, unsigned *width, un
             if (!has_ihdr || has_iend)
                GOTO_END_ERROR();
 
-            if (!png_append_idat(file, &chunk, &idat_buf))
+            if (!png_decoder_read_idat(&dec, file, &chunk, read_buf))
                GOTO_END_ERROR();
 
             has_idat = true;
@@ -390,42 +663,19 @@ bool rpng_load_image_argb(const char *path, uint32_t **data, unsigned *width, un
    if (!has_ihdr || !has_idat || !has_iend)
       GOTO_END_ERROR();
 
-   if (inflateInit(&stream) != Z_OK)
-      GOTO_END_ERROR();
-
-   inflate_buf_size = (ihdr.width + 1) * ihdr.height * sizeof(uint32_t);
-   inflate_buf = (uint8_t*)malloc(inflate_buf_size);
-   if (!inflate_buf)
-      GOTO_END_ERROR();
-
-   stream.next_in   = idat_buf.data;
-   stream.avail_in  = idat_buf.size;
-   stream.avail_out = inflate_buf_size;
-   stream.next_out  = inflate_buf;
-
-   if (inflate(&stream, Z_FINISH) != Z_STREAM_END)
-   {
-      inflateEnd(&stream);
+   if (!dec.stream_end || dec.row != dec.height)
       GOTO_END_ERROR();
-   }
-   inflateEnd(&stream);
 
    *width  = ihdr.width;
    *height = ihdr.height;
-   *data = (uint32_t*)malloc(ihdr.width * ihdr.height * sizeof(uint32_t));
-   if (!*data)
-      GOTO_END_ERROR();
-
-   if (!png_reverse_filter(*data, &ihdr, inflate_buf, stream.total_out))
-      GOTO_END_ERROR();
+   *data   = dec.data;
+   dec.data = NULL;
 
 end:
    if (file)
       fclose(file);
-   if (!ret)
-      free(*data);
-   free(idat_buf.data);
-   free(inflate_buf);
+   png_decoder_free(&dec);
+   free(read_buf);
    return ret;
 }
 
@@ -523,6 +773,27 @@ static void copy_bgr24_line(uint8_t *dst, const uint8_t *src, unsigned width)
    }
 }
 
+// Sum of absolute values of the filtered bytes, taken as signed.
+#if defined(RPNG_HAVE_SSE2)
+static unsigned count_sad(const uint8_t *data, size_t size)
+{
+   // abs((int8_t)x) == abs((x ^ 0x80) - 0x80), which is what PSADBW computes against 0x80.
+   const __m128i bias = _mm_set1_epi8((char)0x80);
+   __m128i sum = _mm_setzero_si128();
+
+   size_t i;
+   for (i = 0; i + 16 <= size; i += 16)
+   {
+      __m128i x = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(data + i)), bias);
+      sum = _mm_add_epi64(sum, _mm_sad_epu8(x, bias));
+   }
+
+   unsigned cnt = _mm_cvtsi128_si32(sum) + _mm_cvtsi128_si32(_mm_srli_si128(sum, 8));
+   for (; i < size; i++)
+      cnt += abs((int8_t)data[i]);
+   return cnt;
+}
+#else
 static unsigned count_sad(const uint8_t *data, size_t size)
 {
    unsigned cnt = 0;
@@ -530,12 +801,24 @@ static unsigned count_sad(const uint8_t *data, size_t size)
       cnt += abs((int8_t)data[i]);
    return cnt;
 }
+#endif
 
 static unsigned filter_up(uint8_t *target, const uint8_t *line, const uint8_t *prev,
       unsigned width, unsigned bpp)
 {
    width *= bpp;
-   for (unsigned i = 0; i < width; i++)
+   unsigned i = 0;
+
+#if defined(RPNG_HAVE_SSE2)
+   for (; i + 16 <= width; i += 16)
+   {
+      __m128i x = _mm_loadu_si128((const __m128i*)(line + i));
+      __m128i b = _mm_loadu_si128((const __m128i*)(prev + i));
+      _mm_storeu_si128((__m128i*)(target + i), _mm_sub_epi8(x, b));
+   }
+#endif
+
+   for (; i < width; i++)
       target[i] = line[i] - prev[i];
 
    return count_sad(target, width);
@@ -547,7 +830,19 @@ static unsigned filter_sub(uint8_t *target, const uint8_t *line,
    width *= bpp;
    for (unsigned i = 0; i < bpp; i++)
       target[i] = line[i];
-   for (unsigned i = bpp; i < width; i++)
+
+   unsigned i = bpp;
+
+#if defined(RPNG_HAVE_SSE2)
+   for (; i + 16 <= width; i += 16)
+   {
+      __m128i x = _mm_loadu_si128((const __m128i*)(line + i));
+      __m128i a = _mm_loadu_si128((const __m128i*)(line + i - bpp));
+      _mm_storeu_si128((__m128i*)(target + i), _mm_sub_epi8(x, a));
+   }
+#endif
+
+   for (; i < width; i++)
       target[i] = line[i] - line[i - bpp];
 
    return count_sad(target, width);
@@ -559,7 +854,23 @@ static unsigned filter_avg(uint8_t *target, const uint8_t *line, const uint8_t *
    width *= bpp;
    for (unsigned i = 0; i < bpp; i++)
       target[i] = line[i] - (prev[i] >> 1);
-   for (unsigned i = bpp; i < width; i++)
+
+   unsigned i = bpp;
+
+#if defined(RPNG_HAVE_SSE2)
+   // PAVGB rounds up, so take away the carry of the lowest bit.
+   const __m128i one = _mm_set1_epi8(1);
+   for (; i + 16 <= width; i += 16)
+   {
+      __m128i x = _mm_loadu_si128((const __m128i*)(line + i));
+      __m128i a = _mm_loadu_si128((const __m128i*)(line + i - bpp));
+      __m128i b = _mm_loadu_si128((const __m128i*)(prev + i));
+      __m128i avg = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+      _mm_storeu_si128((__m128i*)(target + i), _mm_sub_epi8(x, avg));
+   }
+#endif
+
+   for (; i < width; i++)
       target[i] = line[i] - ((line[i - bpp] + prev[i]) >> 1);
 
    return count_sad(target, width);
@@ -571,14 +882,39 @@ static unsigned filter_paeth(uint8_t *target, const uint8_t *line, const uint8_t
    width *= bpp;
    for (unsigned i = 0; i < bpp; i++)
       target[i] = line[i] - paeth(0, prev[i], 0);
-   for (unsigned i = bpp; i < width; i++)
+
+   unsigned i = bpp;
+
+#if defined(RPNG_HAVE_SSE2)
+   __m128i zero = _mm_setzero_si128();
+   for (; i + 16 <= width; i += 16)
+   {
+      __m128i x = _mm_loadu_si128((const __m128i*)(line + i));
+      __m128i a = _mm_loadu_si128((const __m128i*)(line + i - bpp));
+      __m128i b = _mm_loadu_si128((const __m128i*)(prev + i));
+      __m128i c = _mm_loadu_si128((const __m128i*)(prev + i - bpp));
+
+      __m128i lo = paeth_sse2(_mm_unpacklo_epi8(a, zero),
+            _mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(c, zero));
+      __m128i hi = paeth_sse2(_mm_unpackhi_epi8(a, zero),
+            _mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(c, zero));
+
+      _mm_storeu_si128((__m128i*)(target + i), _mm_sub_epi8(x, _mm_packus_epi16(lo, hi)));
+   }
+#endif
+
+   for (; i < width; i++)
       target[i] = line[i] - paeth(line[i - bpp], prev[i], prev[i - bpp]);
 
    return count_sad(target, width);
 }
 
+// In fast mode, filters are only compared every so many lines.
+// Lines in between use the last chosen filter, which mostly holds as images are locally similar.
+#define RPNG_FAST_FILTER_INTERVAL 8
+
 static bool rpng_save_image(const char *path, const uint8_t *data,
-      unsigned width, unsigned height, unsigned pitch, unsigned bpp)
+      unsigned width, unsigned height, unsigned pitch, unsigned bpp, bool fast)
 {
    bool ret = true;
    struct png_ihdr ihdr = {0};
@@ -593,6 +929,7 @@ static bool rpng_save_image(const char *path, const uint8_t *data,
    uint8_t *paeth_filtered = NULL;
    uint8_t *prev_encoded   = NULL;
    uint8_t *encode_target  = NULL;
+   uint8_t filter          = 0;
 
    z_stream stream = {0};
 
@@ -636,6 +973,35 @@ static bool rpng_save_image(const char *path, const uint8_t *data,
       else
          copy_bgr24_line(rgba_line, data, width);
 
+      if (fast && (h % RPNG_FAST_FILTER_INTERVAL))
+      {
+         const uint8_t *filtered = rgba_line;
+         switch (filter)
+         {
+            case 1:
+               filter_sub(sub_filtered, rgba_line, width, bpp);
+               filtered = sub_filtered;
+               break;
+            case 2:
+               filter_up(up_filtered, rgba_line, prev_encoded, width, bpp);
+               filtered = up_filtered;
+               break;
+            case 3:
+               filter_avg(avg_filtered, rgba_line, prev_encoded, width, bpp);
+               filtered = avg_filtered;
+               break;
+            case 4:
+               filter_paeth(paeth_filtered, rgba_line, prev_encoded, width, bpp);
+               filtered = paeth_filtered;
+               break;
+         }
+
+         *encode_target++ = filter;
+         memcpy(encode_target, filtered, width * bpp);
+         memcpy(prev_encoded, rgba_line, width * bpp);
+         continue;
+      }
+
       // Try every filtering method, and choose the method
       // which has most entries as zero.
       // This is probably not very optimal, but it's very simple to implement.
@@ -645,7 +1011,7 @@ static bool rpng_save_image(const char *path, const uint8_t *data,
       unsigned avg_score   = filter_avg(avg_filtered, rgba_line, prev_encoded, width, bpp);
       unsigned paeth_score = filter_paeth(paeth_filtered, rgba_line, prev_encoded, width, bpp);
 
-      uint8_t filter = 0;
+      filter = 0;
       unsigned min_sad = none_score;
       const uint8_t *chosen_filtered = rgba_line;
 
@@ -692,7 +1058,7 @@ static bool rpng_save_image(const char *path, const uint8_t *data,
    stream.next_out  = deflate_buf + 8;
    stream.avail_out = encode_buf_size * 2;
 
-   deflateInit(&stream, 9);
+   deflateInit(&stream, fast ? Z_BEST_SPEED : Z_BEST_COMPRESSION);
    if (deflate(&stream, Z_FINISH) != Z_STREAM_END)
    {
       deflateEnd(&stream);
@@ -716,6 +1082,7 @@ end:
    free(rgba_line);
    free(prev_encoded);
    free(up_filtered);
+   free(sub_filtered);
    free(avg_filtered);
    free(paeth_filtered);
    return ret;
@@ -724,13 +1091,19 @@ end:
 bool rpng_save_image_argb(const char *path, const uint32_t *data,
       unsigned width, unsigned height, unsigned pitch)
 {
-   return rpng_save_image(path, (const uint8_t*)data, width, height, pitch, sizeof(uint32_t));
+   return rpng_save_image(path, (const uint8_t*)data, width, height, pitch, sizeof(uint32_t), false);
 }
 
 bool rpng_save_image_bgr24(const char *path, const uint8_t *data,
       unsigned width, unsigned height, unsigned pitch)
 {
-   return rpng_save_image(path, (const uint8_t*)data, width, height, pitch, 3);
+   return rpng_save_image(path, (const uint8_t*)data, width, height, pitch, 3, false);
+}
+
+bool rpng_save_image_bgr24_fast(const char *path, const uint8_t *data,
+      unsigned width, unsigned height, unsigned pitch)
+{
+   return rpng_save_image(path, (const uint8_t*)data, width, height, pitch, 3, true);
 }
 
 #endif
@@ -34,6 +34,11 @@ bool rpng_save_image_argb(const char *path, const uint32_t *data,
       unsigned width, unsigned height, unsigned pitch);
 bool rpng_save_image_bgr24(const char *path, const uint8_t *data,
       unsigned width, unsigned height, unsigned pitch);
+
+// Only compares filters on some of the lines, and compresses with the fastest setting.
+// Files come out slightly larger, but take a fraction of the time.
+bool rpng_save_image_bgr24_fast(const char *path, const uint8_t *data,
+      unsigned width, unsigned height, unsigned pitch);
 #endif
 
 #ifdef __cplusplus
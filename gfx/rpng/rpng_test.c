@@ -18,16 +18,244 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <time.h>
+#include <zlib.h>
 #include <Imlib2.h>
 
+static uint32_t dword_be(const uint8_t *buf)
+{
+   return ((uint32_t)buf[0] << 24) | ((uint32_t)buf[1] << 16) | ((uint32_t)buf[2] << 8) | buf[3];
+}
+
+static int paeth(int a, int b, int c)
+{
+   int p = a + b - c;
+   int pa = abs(p - a);
+   int pb = abs(p - b);
+   int pc = abs(p - c);
+
+   if (pa <= pb && pa <= pc)
+      return a;
+   else if (pb <= pc)
+      return b;
+   else
+      return c;
+}
+
+// The loader as it used to be: reads the whole file, collects all IDAT chunks,
+// inflates them in one go and unfilters with plain C. Only handles what rpng supports.
+static bool ref_load_image_argb(const char *path, uint32_t **data, unsigned *width, unsigned *height)
+{
+   bool ret = false;
+   uint8_t *file_buf = NULL, *idat = NULL, *inflate_buf = NULL, *prev = NULL, *cur = NULL;
+   size_t idat_size = 0;
+   unsigned w = 0, h = 0, bpp = 0;
+
+   *data = NULL;
+
+   FILE *file = fopen(path, "rb");
+   if (!file)
+      return false;
+   fseek(file, 0, SEEK_END);
+   long len = ftell(file);
+   rewind(file);
+
+   file_buf = (uint8_t*)malloc(len);
+   idat     = (uint8_t*)malloc(len);
+   if (!file_buf || !idat || fread(file_buf, 1, len, file) != (size_t)len)
+      goto end;
+
+   for (long pos = 8; pos + 12 <= len; )
+   {
+      uint32_t size = dword_be(file_buf + pos);
+      const uint8_t *type = file_buf + pos + 4;
+      const uint8_t *chunk = file_buf + pos + 8;
+      if (pos + 12 + (long)size > len)
+         goto end;
+
+      if (memcmp(type, "IHDR", 4) == 0)
+      {
+         w   = dword_be(chunk + 0);
+         h   = dword_be(chunk + 4);
+         bpp = chunk[9] == 2 ? 3 : 4;
+      }
+      else if (memcmp(type, "IDAT", 4) == 0)
+      {
+         memcpy(idat + idat_size, chunk, size);
+         idat_size += size;
+      }
+
+      pos += 12 + size;
+   }
+
+   if (!w || !h)
+      goto end;
+
+   unsigned pitch = w * bpp;
+   uLongf inflate_size = (uLongf)(pitch + 1) * h;
+   inflate_buf = (uint8_t*)malloc(inflate_size);
+   prev        = (uint8_t*)calloc(1, pitch);
+   cur         = (uint8_t*)malloc(pitch);
+   *data       = (uint32_t*)malloc(w * h * sizeof(uint32_t));
+   if (!inflate_buf || !prev || !cur || !*data)
+      goto end;
+
+   if (uncompress(inflate_buf, &inflate_size, idat, idat_size) != Z_OK || inflate_size != (uLongf)(pitch + 1) * h)
+      goto end;
+
+   const uint8_t *in = inflate_buf;
+   for (unsigned y = 0; y < h; y++, in += pitch)
+   {
+      unsigned filter = *in++;
+      for (unsigned i = 0; i < pitch; i++)
+      {
+         int a = i >= bpp ? cur[i - bpp] : 0;
+         int b = prev[i];
+         int c = i >= bpp ? prev[i - bpp] : 0;
+         int pred;
+         switch (filter)
+         {
+            case 0: pred = 0; break;
+            case 1: pred = a; break;
+            case 2: pred = b; break;
+            case 3: pred = (a + b) >> 1; break;
+            case 4: pred = paeth(a, b, c); break;
+            default: goto end;
+         }
+         cur[i] = in[i] + pred;
+      }
+
+      uint32_t *out = *data + y * w;
+      for (unsigned x = 0; x < w; x++)
+      {
+         const uint8_t *px = cur + x * bpp;
+         uint32_t alpha = bpp == 4 ? px[3] : 0xff;
+         out[x] = (alpha << 24) | ((uint32_t)px[0] << 16) | ((uint32_t)px[1] << 8) | px[2];
+      }
+
+      uint8_t *tmp = prev;
+      prev = cur;
+      cur = tmp;
+   }
+
+   *width  = w;
+   *height = h;
+   ret = true;
+
+end:
+   if (!ret)
+   {
+      free(*data);
+      *data = NULL;
+   }
+   fclose(file);
+   free(file_buf);
+   free(idat);
+   free(inflate_buf);
+   free(prev);
+   free(cur);
+   return ret;
+}
+
+static double get_time(void)
+{
+   struct timespec tv;
+   clock_gettime(CLOCK_MONOTONIC, &tv);
+   return tv.tv_sec + tv.tv_nsec / 1000000000.0;
+}
+
+// Smooth gradients with some noise, so the encoder picks a mix of all filter types.
+static void fill_image(uint32_t *data, unsigned width, unsigned height)
+{
+   for (unsigned y = 0; y < height; y++)
+   {
+      for (unsigned x = 0; x < width; x++)
+      {
+         uint32_t r = (x * 255 / width) ^ (rand() & 0x7);
+         uint32_t g = (y * 255 / height) + (rand() & 0x3);
+         uint32_t b = ((x + y) >> 2) & 0xff;
+         uint32_t a = (x >> 4) & 1 ? 0xff : (x * 7 + y) & 0xff;
+         data[y * width + x] = (a << 24) | (r << 16) | (g << 8) | b;
+      }
+   }
+}
+
+static bool bench_image(const char *path, unsigned width, unsigned height)
+{
+   const unsigned iterations = 20;
+   uint32_t *ref = NULL, *data = NULL;
+   unsigned ref_width = 0, ref_height = 0;
+
+   if (!ref_load_image_argb(path, &ref, &ref_width, &ref_height))
+      return false;
+
+   bool ret = rpng_load_image_argb(path, &data, &width, &height) &&
+      width == ref_width && height == ref_height &&
+      memcmp(ref, data, width * height * sizeof(uint32_t)) == 0;
+   fprintf(stderr, "%s: %ux%u: %s.\n", path, width, height, ret ? "OK" : "MISMATCH");
+   free(ref);
+   free(data);
+
+   double start = get_time();
+   for (unsigned i = 0; i < iterations; i++)
+   {
+      ref_load_image_argb(path, &ref, &ref_width, &ref_height);
+      free(ref);
+   }
+   double ref_time = get_time() - start;
+
+   start = get_time();
+   for (unsigned i = 0; i < iterations; i++)
+   {
+      rpng_load_image_argb(path, &data, &width, &height);
+      free(data);
+   }
+   double time = get_time() - start;
+
+   fprintf(stderr, "   Reference: %.3f ms/image, RPNG: %.3f ms/image (%.2fx).\n",
+         1000.0 * ref_time / iterations, 1000.0 * time / iterations, ref_time / time);
+   return ret;
+}
+
+static int bench(void)
+{
+   const unsigned width = 1920, height = 1080;
+   uint32_t *argb = (uint32_t*)malloc(width * height * sizeof(uint32_t));
+   uint8_t *bgr   = (uint8_t*)malloc(width * height * 3);
+   if (!argb || !bgr)
+      return 1;
+
+   fill_image(argb, width, height);
+   for (unsigned i = 0; i < width * height; i++)
+   {
+      bgr[3 * i + 0] = argb[i] >> 0;
+      bgr[3 * i + 1] = argb[i] >> 8;
+      bgr[3 * i + 2] = argb[i] >> 16;
+   }
+
+   bool ret = rpng_save_image_argb("/tmp/rpng_bench_rgba.png", argb, width, height, width * sizeof(uint32_t)) &&
+      rpng_save_image_bgr24("/tmp/rpng_bench_rgb.png", bgr, width, height, width * 3);
+
+   ret = ret && bench_image("/tmp/rpng_bench_rgba.png", width, height);
+   ret = ret && bench_image("/tmp/rpng_bench_rgb.png", width, height);
+
+   free(argb);
+   free(bgr);
+   return ret ? 0 : 1;
+}
+
 int main(int argc, char *argv[])
 {
    if (argc > 2)
    {
-      fprintf(stderr, "Usage: %s <png file>\n", argv[0]);
+      fprintf(stderr, "Usage: %s [<png file> | --bench]\n", argv[0]);
       return 1;
    }
 
+   // Compares against the old whole-file loader on large images, and times both.
+   if (argc == 2 && strcmp(argv[1], "--bench") == 0)
+      return bench();
+
    const char *in_path = argc == 2 ? argv[1] : "/tmp/test.png";
 
    const uint32_t test_data[] = {
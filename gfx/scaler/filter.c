@@ -95,6 +95,66 @@ static bool gen_filter_bilinear(struct scaler_ctx *ctx)
    return true;
 }
 
+// Sharp bilinear is equivalent to point scaling by the largest integer factor which fits,
+// followed by bilinear to the final size.
+// Rather than going through an intermediate frame, fold the prescale into a two-tap filter
+// which samples the original input. Only the seams between source pixels end up blended.
+static void gen_filter_sharp_bilinear_sub(struct scaler_filter *filter, int len, int pos, int step,
+      int factor, int in_len)
+{
+   for (int i = 0; i < len; i++, pos += step)
+   {
+      int prescaled = pos >> 16;
+      int src0      = prescaled / factor;
+      int src1      = (prescaled + 1) / factor;
+
+      // Clamp to the edges of the prescaled image rather than blending with nothing.
+      if (prescaled < 0)
+         src0 = src1 = 0;
+      if (src1 >= in_len)
+         src1 = src0;
+
+      filter->filter_pos[i] = src0;
+
+      if (src0 == src1)
+      {
+         filter->filter[i * 2 + 0] = FILTER_UNITY;
+         filter->filter[i * 2 + 1] = 0;
+      }
+      else
+      {
+         filter->filter[i * 2 + 1] = (pos & 0xffff) >> 2;
+         filter->filter[i * 2 + 0] = FILTER_UNITY - filter->filter[i * 2 + 1];
+      }
+   }
+}
+
+static bool gen_filter_sharp_bilinear(struct scaler_ctx *ctx)
+{
+   ctx->horiz.filter_len    = 2;
+   ctx->horiz.filter_stride = 2;
+   ctx->vert.filter_len     = 2;
+   ctx->vert.filter_stride  = 2;
+
+   if (!allocate_filters(ctx))
+      return false;
+
+   int x_factor = ctx->out_width  > ctx->in_width  ? ctx->out_width  / ctx->in_width  : 1;
+   int y_factor = ctx->out_height > ctx->in_height ? ctx->out_height / ctx->in_height : 1;
+   int in_width  = ctx->in_width  * x_factor;
+   int in_height = ctx->in_height * y_factor;
+
+   int x_pos  = (1 << 15) * in_width / ctx->out_width - (1 << 15);
+   int x_step = (1 << 16) * in_width / ctx->out_width;
+   int y_pos  = (1 << 15) * in_height / ctx->out_height - (1 << 15);
+   int y_step = (1 << 16) * in_height / ctx->out_height;
+
+   gen_filter_sharp_bilinear_sub(&ctx->horiz, ctx->out_width, x_pos, x_step, x_factor, ctx->in_width);
+   gen_filter_sharp_bilinear_sub(&ctx->vert, ctx->out_height, y_pos, y_step, y_factor, ctx->in_height);
+
+   return true;
+}
+
 static inline double filter_sinc(double phase)
 {
    if (fabs(phase) < 0.0001)
@@ -225,6 +285,12 @@ static void fixup_filter(struct scaler_ctx *ctx)
 }
 
 
+static bool is_integer_scale(const struct scaler_ctx *ctx)
+{
+   return ctx->out_width >= ctx->in_width && ctx->out_height >= ctx->in_height &&
+      ctx->out_width % ctx->in_width == 0 && ctx->out_height % ctx->in_height == 0;
+}
+
 bool scaler_gen_filter(struct scaler_ctx *ctx)
 {
    bool ret = true;
@@ -233,6 +299,19 @@ bool scaler_gen_filter(struct scaler_ctx *ctx)
    {
       case SCALER_TYPE_POINT:
          ret = gen_filter_point(ctx);
+         if (ret && is_integer_scale(ctx))
+            ctx->scaler_special = scaler_argb8888_point_integer_special;
+         break;
+
+      case SCALER_TYPE_SHARP_BILINEAR:
+         // With integer ratios there is nothing to blend, so it's plain pixel replication.
+         if (is_integer_scale(ctx))
+         {
+            ret = gen_filter_point(ctx);
+            ctx->scaler_special = scaler_argb8888_point_integer_special;
+         }
+         else
+            ret = gen_filter_sharp_bilinear(ctx);
          break;
 
       case SCALER_TYPE_BILINEAR:
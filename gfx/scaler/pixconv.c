@@ -14,6 +14,7 @@
  */
 
 #include "pixconv.h"
+#include "scaler.h"
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
@@ -27,6 +28,15 @@
 #include <emmintrin.h>
 #endif
 
+#if defined(SCALER_HAVE_AVX2)
+#include <immintrin.h>
+#define SCALER_AVX2 __attribute__((target("avx2")))
+#endif
+
+#if defined(SCALER_HAVE_NEON)
+#include <arm_neon.h>
+#endif
+
 #if defined(__SSE2_)
 void conv_rgb565_0rgb1555(void *output_, const void *input_,
       int width, int height,
@@ -140,6 +150,30 @@ void conv_0rgb1555_rgb565(void *output_, const void *input_,
 }
 #endif
 
+void conv_0rgb1555_argb8888_c(void *output_, const void *input_,
+      int width, int height,
+      int out_stride, int in_stride)
+{
+   const uint16_t *input = (const uint16_t*)input_;
+   uint32_t *output      = (uint32_t*)output_;
+
+   for (int h = 0; h < height; h++, output += out_stride >> 2, input += in_stride >> 1)
+   {
+      for (int w = 0; w < width; w++)
+      {
+         uint32_t col = input[w];
+         uint32_t r = (col >> 10) & 0x1f;
+         uint32_t g = (col >>  5) & 0x1f;
+         uint32_t b = (col >>  0) & 0x1f;
+         r = (r << 3) | (r >> 2);
+         g = (g << 3) | (g >> 2);
+         b = (b << 3) | (b >> 2);
+
+         output[w] = (0xffu << 24) | (r << 16) | (g << 8) | (b << 0);
+      }
+   }
+}
+
 #if defined(__SSE2__)
 void conv_0rgb1555_argb8888(void *output_, const void *input_,
       int width, int height,
@@ -197,7 +231,15 @@ void conv_0rgb1555_argb8888(void *output_, const void *input_,
    }
 }
 #else
-void conv_0rgb1555_argb8888(void *output_, const void *input_,
+void conv_0rgb1555_argb8888(void *output, const void *input,
+      int width, int height,
+      int out_stride, int in_stride)
+{
+   conv_0rgb1555_argb8888_c(output, input, width, height, out_stride, in_stride);
+}
+#endif
+
+void conv_rgb565_argb8888_c(void *output_, const void *input_,
       int width, int height,
       int out_stride, int in_stride)
 {
@@ -209,18 +251,17 @@ void conv_0rgb1555_argb8888(void *output_, const void *input_,
       for (int w = 0; w < width; w++)
       {
          uint32_t col = input[w];
-         uint32_t r = (col >> 10) & 0x1f;
-         uint32_t g = (col >>  5) & 0x1f;
+         uint32_t r = (col >> 11) & 0x1f;
+         uint32_t g = (col >>  5) & 0x3f;
          uint32_t b = (col >>  0) & 0x1f;
          r = (r << 3) | (r >> 2);
-         g = (g << 3) | (g >> 2);
+         g = (g << 2) | (g >> 4);
          b = (b << 3) | (b >> 2);
 
          output[w] = (0xffu << 24) | (r << 16) | (g << 8) | (b << 0);
       }
    }
 }
-#endif
 
 #if defined(__SSE2__)
 void conv_rgb565_argb8888(void *output_, const void *input_,
@@ -281,27 +322,180 @@ void conv_rgb565_argb8888(void *output_, const void *input_,
    }
 }
 #else
-void conv_rgb565_argb8888(void *output_, const void *input_,
+void conv_rgb565_argb8888(void *output, const void *input,
+      int width, int height,
+      int out_stride, int in_stride)
+{
+   conv_rgb565_argb8888_c(output, input, width, height, out_stride, in_stride);
+}
+#endif
+
+#if defined(SCALER_HAVE_AVX2)
+// Same approach as the SSE2 versions, 16 pixels at a time.
+// Unpacks work on 128-bit lanes, so the results need to be reordered before storing.
+SCALER_AVX2 void conv_0rgb1555_argb8888_avx2(void *output_, const void *input_,
       int width, int height,
       int out_stride, int in_stride)
 {
    const uint16_t *input = (const uint16_t*)input_;
    uint32_t *output      = (uint32_t*)output_;
 
+   const __m256i pix_mask_r  = _mm256_set1_epi16(0x1f << 10);
+   const __m256i pix_mask_gb = _mm256_set1_epi16(0x1f <<  5);
+   const __m256i mul15_mid   = _mm256_set1_epi16(0x4200);
+   const __m256i mul15_hi    = _mm256_set1_epi16(0x0210);
+   const __m256i a           = _mm256_set1_epi16(0x00ff);
+
+   int max_width = width - 15;
+
    for (int h = 0; h < height; h++, output += out_stride >> 2, input += in_stride >> 1)
    {
-      for (int w = 0; w < width; w++)
+      int w;
+      for (w = 0; w < max_width; w += 16)
       {
-         uint32_t col = input[w];
-         uint32_t r = (col >> 11) & 0x1f;
-         uint32_t g = (col >>  5) & 0x3f;
-         uint32_t b = (col >>  0) & 0x1f;
-         r = (r << 3) | (r >> 2);
-         g = (g << 2) | (g >> 4);
-         b = (b << 3) | (b >> 2);
+         const __m256i in = _mm256_loadu_si256((const __m256i*)(input + w));
+         __m256i r = _mm256_and_si256(in, pix_mask_r);
+         __m256i g = _mm256_and_si256(in, pix_mask_gb);
+         __m256i b = _mm256_and_si256(_mm256_slli_epi16(in, 5), pix_mask_gb);
 
-         output[w] = (0xffu << 24) | (r << 16) | (g << 8) | (b << 0);
+         r = _mm256_mulhi_epi16(r, mul15_hi);
+         g = _mm256_mulhi_epi16(g, mul15_mid);
+         b = _mm256_mulhi_epi16(b, mul15_mid);
+
+         __m256i res_lo_bg = _mm256_unpacklo_epi8(b, g);
+         __m256i res_hi_bg = _mm256_unpackhi_epi8(b, g);
+         __m256i res_lo_ra = _mm256_unpacklo_epi8(r, a);
+         __m256i res_hi_ra = _mm256_unpackhi_epi8(r, a);
+
+         __m256i res_lo = _mm256_or_si256(res_lo_bg, _mm256_slli_si256(res_lo_ra, 2));
+         __m256i res_hi = _mm256_or_si256(res_hi_bg, _mm256_slli_si256(res_hi_ra, 2));
+
+         _mm256_storeu_si256((__m256i*)(output + w + 0), _mm256_permute2x128_si256(res_lo, res_hi, 0x20));
+         _mm256_storeu_si256((__m256i*)(output + w + 8), _mm256_permute2x128_si256(res_lo, res_hi, 0x31));
+      }
+
+      if (w < width)
+         conv_0rgb1555_argb8888_c(output + w, input + w, width - w, 1, out_stride, in_stride);
+   }
+}
+
+SCALER_AVX2 void conv_rgb565_argb8888_avx2(void *output_, const void *input_,
+      int width, int height,
+      int out_stride, int in_stride)
+{
+   const uint16_t *input = (const uint16_t*)input_;
+   uint32_t *output      = (uint32_t*)output_;
+
+   const __m256i pix_mask_r = _mm256_set1_epi16(0x1f << 10);
+   const __m256i pix_mask_g = _mm256_set1_epi16(0x3f <<  5);
+   const __m256i pix_mask_b = _mm256_set1_epi16(0x1f <<  5);
+   const __m256i mul16_r    = _mm256_set1_epi16(0x0210);
+   const __m256i mul16_g    = _mm256_set1_epi16(0x2080);
+   const __m256i mul16_b    = _mm256_set1_epi16(0x4200);
+   const __m256i a          = _mm256_set1_epi16(0x00ff);
+
+   int max_width = width - 15;
+
+   for (int h = 0; h < height; h++, output += out_stride >> 2, input += in_stride >> 1)
+   {
+      int w;
+      for (w = 0; w < max_width; w += 16)
+      {
+         const __m256i in = _mm256_loadu_si256((const __m256i*)(input + w));
+         __m256i r = _mm256_and_si256(_mm256_srli_epi16(in, 1), pix_mask_r);
+         __m256i g = _mm256_and_si256(in, pix_mask_g);
+         __m256i b = _mm256_and_si256(_mm256_slli_epi16(in, 5), pix_mask_b);
+
+         r = _mm256_mulhi_epi16(r, mul16_r);
+         g = _mm256_mulhi_epi16(g, mul16_g);
+         b = _mm256_mulhi_epi16(b, mul16_b);
+
+         __m256i res_lo_bg = _mm256_unpacklo_epi8(b, g);
+         __m256i res_hi_bg = _mm256_unpackhi_epi8(b, g);
+         __m256i res_lo_ra = _mm256_unpacklo_epi8(r, a);
+         __m256i res_hi_ra = _mm256_unpackhi_epi8(r, a);
+
+         __m256i res_lo = _mm256_or_si256(res_lo_bg, _mm256_slli_si256(res_lo_ra, 2));
+         __m256i res_hi = _mm256_or_si256(res_hi_bg, _mm256_slli_si256(res_hi_ra, 2));
+
+         _mm256_storeu_si256((__m256i*)(output + w + 0), _mm256_permute2x128_si256(res_lo, res_hi, 0x20));
+         _mm256_storeu_si256((__m256i*)(output + w + 8), _mm256_permute2x128_si256(res_lo, res_hi, 0x31));
       }
+
+      if (w < width)
+         conv_rgb565_argb8888_c(output + w, input + w, width - w, 1, out_stride, in_stride);
+   }
+}
+#endif
+
+#if defined(SCALER_HAVE_NEON)
+// vst4 interleaves B, G, R and A for us.
+void conv_0rgb1555_argb8888_neon(void *output_, const void *input_,
+      int width, int height,
+      int out_stride, int in_stride)
+{
+   const uint16_t *input = (const uint16_t*)input_;
+   uint32_t *output      = (uint32_t*)output_;
+
+   const uint16x8_t mask = vdupq_n_u16(0x1f);
+
+   int max_width = width - 7;
+
+   for (int h = 0; h < height; h++, output += out_stride >> 2, input += in_stride >> 1)
+   {
+      int w;
+      for (w = 0; w < max_width; w += 8)
+      {
+         uint16x8_t in = vld1q_u16(input + w);
+         uint8x8_t r = vmovn_u16(vandq_u16(vshrq_n_u16(in, 10), mask));
+         uint8x8_t g = vmovn_u16(vandq_u16(vshrq_n_u16(in,  5), mask));
+         uint8x8_t b = vmovn_u16(vandq_u16(in, mask));
+
+         uint8x8x4_t res;
+         res.val[0] = vorr_u8(vshl_n_u8(b, 3), vshr_n_u8(b, 2));
+         res.val[1] = vorr_u8(vshl_n_u8(g, 3), vshr_n_u8(g, 2));
+         res.val[2] = vorr_u8(vshl_n_u8(r, 3), vshr_n_u8(r, 2));
+         res.val[3] = vdup_n_u8(0xff);
+         vst4_u8((uint8_t*)(output + w), res);
+      }
+
+      if (w < width)
+         conv_0rgb1555_argb8888_c(output + w, input + w, width - w, 1, out_stride, in_stride);
+   }
+}
+
+void conv_rgb565_argb8888_neon(void *output_, const void *input_,
+      int width, int height,
+      int out_stride, int in_stride)
+{
+   const uint16_t *input = (const uint16_t*)input_;
+   uint32_t *output      = (uint32_t*)output_;
+
+   const uint16_t mask5 = 0x1f;
+   const uint16_t mask6 = 0x3f;
+
+   int max_width = width - 7;
+
+   for (int h = 0; h < height; h++, output += out_stride >> 2, input += in_stride >> 1)
+   {
+      int w;
+      for (w = 0; w < max_width; w += 8)
+      {
+         uint16x8_t in = vld1q_u16(input + w);
+         uint8x8_t r = vmovn_u16(vshrq_n_u16(in, 11));
+         uint8x8_t g = vmovn_u16(vandq_u16(vshrq_n_u16(in, 5), vdupq_n_u16(mask6)));
+         uint8x8_t b = vmovn_u16(vandq_u16(in, vdupq_n_u16(mask5)));
+
+         uint8x8x4_t res;
+         res.val[0] = vorr_u8(vshl_n_u8(b, 3), vshr_n_u8(b, 2));
+         res.val[1] = vorr_u8(vshl_n_u8(g, 2), vshr_n_u8(g, 4));
+         res.val[2] = vorr_u8(vshl_n_u8(r, 3), vshr_n_u8(r, 2));
+         res.val[3] = vdup_n_u8(0xff);
+         vst4_u8((uint8_t*)(output + w), res);
+      }
+
+      if (w < width)
+         conv_rgb565_argb8888_c(output + w, input + w, width - w, 1, out_stride, in_stride);
    }
 }
 #endif
@@ -64,5 +64,34 @@ void conv_copy(void *output, const void *input,
       int width, int height,
       int out_stride, int in_stride);
 
+// Reference implementations. Always built, as SIMD variants are tested against these.
+void conv_0rgb1555_argb8888_c(void *output, const void *input,
+      int width, int height,
+      int out_stride, int in_stride);
+
+void conv_rgb565_argb8888_c(void *output, const void *input,
+      int width, int height,
+      int out_stride, int in_stride);
+
+#ifdef SCALER_HAVE_AVX2
+void conv_0rgb1555_argb8888_avx2(void *output, const void *input,
+      int width, int height,
+      int out_stride, int in_stride);
+
+void conv_rgb565_argb8888_avx2(void *output, const void *input,
+      int width, int height,
+      int out_stride, int in_stride);
+#endif
+
+#ifdef SCALER_HAVE_NEON
+void conv_0rgb1555_argb8888_neon(void *output, const void *input,
+      int width, int height,
+      int out_stride, int in_stride);
+
+void conv_rgb565_argb8888_neon(void *output, const void *input,
+      int width, int height,
+      int out_stride, int in_stride);
+#endif
+
 #endif
 
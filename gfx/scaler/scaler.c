@@ -23,6 +23,14 @@
 #include <math.h>
 #include "../../performance.h"
 
+#ifdef HAVE_CONFIG_H
+#include "../../config.h"
+#endif
+
+#ifdef HAVE_THREADS
+#include "../../thread.h"
+#endif
+
 // In case aligned allocs are needed later ...
 void *scaler_alloc(size_t elem_size, size_t size)
 {
@@ -139,6 +147,360 @@ static bool set_pix_conv(struct scaler_ctx *ctx)
    return true;
 }
 
+// rarch_get_cpu_features() is chatty, and scalers are set up quite often (e.g. screenshots).
+static unsigned scaler_simd_features(void)
+{
+   static bool probed;
+   static unsigned simd;
+
+   if (!probed)
+   {
+      struct rarch_cpu_features cpu;
+      rarch_get_cpu_features(&cpu);
+      simd   = cpu.simd;
+      probed = true;
+   }
+
+   return simd;
+}
+
+typedef void (*scaler_pixconv_t)(void*, const void*, int, int, int, int);
+
+static scaler_pixconv_t select_simd_pix_conv(scaler_pixconv_t conv, unsigned simd)
+{
+#if defined(SCALER_HAVE_AVX2)
+   if (simd & RARCH_SIMD_AVX2)
+   {
+      if (conv == conv_rgb565_argb8888)
+         return conv_rgb565_argb8888_avx2;
+      if (conv == conv_0rgb1555_argb8888)
+         return conv_0rgb1555_argb8888_avx2;
+   }
+#endif
+
+#if defined(SCALER_HAVE_NEON)
+   if (simd & RARCH_SIMD_NEON)
+   {
+      if (conv == conv_rgb565_argb8888)
+         return conv_rgb565_argb8888_neon;
+      if (conv == conv_0rgb1555_argb8888)
+         return conv_0rgb1555_argb8888_neon;
+   }
+#endif
+
+   (void)simd;
+   return conv;
+}
+
+// Replaces the compile-time selected kernels with faster ones the CPU supports.
+static void select_simd(struct scaler_ctx *ctx)
+{
+   unsigned simd = scaler_simd_features();
+
+   ctx->in_pixconv     = select_simd_pix_conv(ctx->in_pixconv, simd);
+   ctx->direct_pixconv = select_simd_pix_conv(ctx->direct_pixconv, simd);
+
+   if (ctx->unscaled)
+      return;
+
+#if defined(SCALER_HAVE_AVX2)
+   if (simd & RARCH_SIMD_AVX2)
+   {
+      ctx->scaler_horiz = scaler_argb8888_horiz_avx2;
+      ctx->scaler_vert  = scaler_argb8888_vert_avx2;
+      return;
+   }
+#endif
+
+#if defined(SCALER_HAVE_NEON)
+   if (simd & RARCH_SIMD_NEON)
+   {
+      ctx->scaler_horiz = scaler_argb8888_horiz_neon;
+      ctx->scaler_vert  = scaler_argb8888_vert_neon;
+      return;
+   }
+#endif
+}
+
+#ifdef HAVE_THREADS
+// Threaded scaling splits the output into bands of rows.
+// Every band runs the horizontal pass over exactly the input rows its vertical filter taps touch,
+// so neighbouring bands redo a few rows of overlap rather than synchronizing between passes.
+// The regular kernels are reused on a sub-context describing the band,
+// which guarantees output identical to the single-threaded path.
+struct scaler_band
+{
+   struct scaler_ctx ctx;
+
+   int out_y;
+   int out_rows;
+   int in_y;
+   int in_rows;
+};
+
+struct scaler_worker
+{
+   sthread_t *thread;
+   slock_t *lock;
+   scond_t *cond;
+
+   bool busy;
+   bool alive;
+
+   struct scaler_ctx *ctx;
+   struct scaler_band *band;
+   void *output;
+   const void *input;
+};
+
+struct scaler_thread_pool
+{
+   struct scaler_band *bands;
+   unsigned num_bands;
+
+   struct scaler_worker *workers; // One less than bands. Band 0 is run by the calling thread.
+};
+
+static void scaler_band_free(struct scaler_band *band)
+{
+   scaler_free(band->ctx.scaled.frame);
+   scaler_free(band->ctx.input.frame);
+   scaler_free(band->ctx.vert.filter_pos);
+}
+
+static bool scaler_band_init(struct scaler_ctx *ctx, struct scaler_band *band, int out_y, int out_rows)
+{
+   band->out_y    = out_y;
+   band->out_rows = out_rows;
+
+   if (ctx->unscaled)
+      return true;
+
+   int first = ctx->vert.filter_pos[out_y];
+   int last  = first;
+   for (int h = out_y; h < out_y + out_rows; h++)
+   {
+      if (ctx->vert.filter_pos[h] < first)
+         first = ctx->vert.filter_pos[h];
+      if (ctx->vert.filter_pos[h] > last)
+         last = ctx->vert.filter_pos[h];
+   }
+
+   band->in_y    = first;
+   band->in_rows = last - first + ctx->vert.filter_len;
+
+   struct scaler_ctx *sub = &band->ctx;
+   memcpy(sub, ctx, sizeof(*sub));
+   sub->pool = NULL;
+
+   sub->out_height     = out_rows;
+   sub->scaled.height  = band->in_rows;
+   sub->scaled.frame   = (uint64_t*)scaler_alloc(sizeof(uint64_t), (sub->scaled.stride * sub->scaled.height) >> 3);
+   sub->input.frame    = NULL;
+   sub->vert.filter    = ctx->vert.filter + out_y * ctx->vert.filter_stride;
+   sub->vert.filter_pos = (int*)scaler_alloc(sizeof(int), out_rows);
+   if (!sub->scaled.frame || !sub->vert.filter_pos)
+      return false;
+
+   for (int h = 0; h < out_rows; h++)
+      sub->vert.filter_pos[h] = ctx->vert.filter_pos[out_y + h] - first;
+
+   if (ctx->in_fmt != SCALER_FMT_ARGB8888)
+   {
+      sub->input.frame = (uint32_t*)scaler_alloc(sizeof(uint32_t), (sub->input.stride * band->in_rows) >> 2);
+      if (!sub->input.frame)
+         return false;
+   }
+
+   if (ctx->out_fmt != SCALER_FMT_ARGB8888)
+      sub->output.frame = ctx->output.frame + out_y * (ctx->output.stride >> 2);
+
+   return true;
+}
+
+static void scaler_band_scale(const struct scaler_ctx *ctx, const struct scaler_band *band,
+      void *output, const void *input)
+{
+   uint8_t *out      = (uint8_t*)output + band->out_y * ctx->out_stride;
+   const uint8_t *in = (const uint8_t*)input;
+
+   if (ctx->unscaled)
+   {
+      ctx->direct_pixconv(out, in + band->out_y * ctx->in_stride,
+            ctx->out_width, band->out_rows,
+            ctx->out_stride, ctx->in_stride);
+      return;
+   }
+
+   const struct scaler_ctx *sub = &band->ctx;
+   in += band->in_y * ctx->in_stride;
+
+   if (ctx->in_fmt != SCALER_FMT_ARGB8888)
+   {
+      ctx->in_pixconv(sub->input.frame, in,
+            ctx->in_width, band->in_rows,
+            sub->input.stride, ctx->in_stride);
+
+      ctx->scaler_horiz(sub, sub->input.frame, sub->input.stride);
+   }
+   else
+      ctx->scaler_horiz(sub, in, ctx->in_stride);
+
+   if (ctx->out_fmt != SCALER_FMT_ARGB8888)
+   {
+      ctx->scaler_vert(sub, sub->output.frame, sub->output.stride);
+
+      ctx->out_pixconv(out, sub->output.frame,
+            ctx->out_width, band->out_rows,
+            ctx->out_stride, sub->output.stride);
+   }
+   else
+      ctx->scaler_vert(sub, out, ctx->out_stride);
+}
+
+static void scaler_worker_thread(void *data)
+{
+   struct scaler_worker *worker = (struct scaler_worker*)data;
+
+   for (;;)
+   {
+      slock_lock(worker->lock);
+      while (!worker->busy && worker->alive)
+         scond_wait(worker->cond, worker->lock);
+      bool alive = worker->alive;
+      slock_unlock(worker->lock);
+
+      if (!alive)
+         break;
+
+      scaler_band_scale(worker->ctx, worker->band, worker->output, worker->input);
+
+      slock_lock(worker->lock);
+      worker->busy = false;
+      scond_signal(worker->cond);
+      slock_unlock(worker->lock);
+   }
+}
+
+static void scaler_pool_free(struct scaler_thread_pool *pool)
+{
+   if (!pool)
+      return;
+
+   if (pool->workers)
+   {
+      for (unsigned i = 0; i < pool->num_bands - 1; i++)
+      {
+         struct scaler_worker *worker = &pool->workers[i];
+
+         if (worker->thread)
+         {
+            slock_lock(worker->lock);
+            worker->alive = false;
+            scond_signal(worker->cond);
+            slock_unlock(worker->lock);
+
+            sthread_join(worker->thread);
+         }
+
+         if (worker->lock)
+            slock_free(worker->lock);
+         if (worker->cond)
+            scond_free(worker->cond);
+      }
+   }
+
+   if (pool->bands)
+   {
+      for (unsigned i = 0; i < pool->num_bands; i++)
+         scaler_band_free(&pool->bands[i]);
+   }
+
+   free(pool->workers);
+   free(pool->bands);
+   free(pool);
+}
+
+// Bands smaller than this aren't worth waking up a thread for.
+#define SCALER_MIN_BAND_ROWS 16
+
+static struct scaler_thread_pool *scaler_pool_new(struct scaler_ctx *ctx)
+{
+   unsigned num_bands = ctx->threads;
+   if (num_bands > (unsigned)ctx->out_height / SCALER_MIN_BAND_ROWS)
+      num_bands = ctx->out_height / SCALER_MIN_BAND_ROWS;
+   if (num_bands < 2)
+      return NULL;
+
+   struct scaler_thread_pool *pool = (struct scaler_thread_pool*)calloc(1, sizeof(*pool));
+   if (!pool)
+      return NULL;
+
+   pool->num_bands = num_bands;
+   pool->bands     = (struct scaler_band*)calloc(num_bands, sizeof(*pool->bands));
+   pool->workers   = (struct scaler_worker*)calloc(num_bands - 1, sizeof(*pool->workers));
+   if (!pool->bands || !pool->workers)
+      goto error;
+
+   for (unsigned i = 0; i < num_bands; i++)
+   {
+      int out_y = ctx->out_height * i / num_bands;
+      int out_rows = ctx->out_height * (i + 1) / num_bands - out_y;
+      if (!scaler_band_init(ctx, &pool->bands[i], out_y, out_rows))
+         goto error;
+   }
+
+   for (unsigned i = 0; i < num_bands - 1; i++)
+   {
+      struct scaler_worker *worker = &pool->workers[i];
+      worker->ctx   = ctx;
+      worker->band  = &pool->bands[i + 1];
+      worker->alive = true;
+      worker->lock  = slock_new();
+      worker->cond  = scond_new();
+      if (!worker->lock || !worker->cond)
+         goto error;
+
+      worker->thread = sthread_create(scaler_worker_thread, worker);
+      if (!worker->thread)
+         goto error;
+   }
+
+   return pool;
+
+error:
+   scaler_pool_free(pool);
+   return NULL;
+}
+
+static void scaler_pool_scale(struct scaler_ctx *ctx, void *output, const void *input)
+{
+   struct scaler_thread_pool *pool = ctx->pool;
+
+   for (unsigned i = 0; i < pool->num_bands - 1; i++)
+   {
+      struct scaler_worker *worker = &pool->workers[i];
+      slock_lock(worker->lock);
+      worker->output = output;
+      worker->input  = input;
+      worker->busy   = true;
+      scond_signal(worker->cond);
+      slock_unlock(worker->lock);
+   }
+
+   scaler_band_scale(ctx, &pool->bands[0], output, input);
+
+   for (unsigned i = 0; i < pool->num_bands - 1; i++)
+   {
+      struct scaler_worker *worker = &pool->workers[i];
+      slock_lock(worker->lock);
+      while (worker->busy)
+         scond_wait(worker->cond, worker->lock);
+      slock_unlock(worker->lock);
+   }
+}
+#endif
+
 bool scaler_ctx_gen_filter(struct scaler_ctx *ctx)
 {
    scaler_ctx_gen_reset(ctx);
@@ -171,11 +533,25 @@ bool scaler_ctx_gen_filter(struct scaler_ctx *ctx)
    if (!ctx->unscaled && !scaler_gen_filter(ctx))
       return false;
 
+   select_simd(ctx);
+
+#ifdef HAVE_THREADS
+   // Special paths don't know about bands, keep them on the calling thread.
+   // If a pool can't be created, we'll simply scale single-threaded.
+   if (ctx->threads > 1 && !ctx->scaler_special)
+      ctx->pool = scaler_pool_new(ctx);
+#endif
+
    return true;
 }
 
 void scaler_ctx_gen_reset(struct scaler_ctx *ctx)
 {
+#ifdef HAVE_THREADS
+   scaler_pool_free(ctx->pool);
+#endif
+   ctx->pool = NULL;
+
    scaler_free(ctx->horiz.filter);
    scaler_free(ctx->horiz.filter_pos);
    scaler_free(ctx->vert.filter);
@@ -194,6 +570,14 @@ void scaler_ctx_gen_reset(struct scaler_ctx *ctx)
 void scaler_ctx_scale(struct scaler_ctx *ctx,
       void *output, const void *input)
 {
+#ifdef HAVE_THREADS
+   if (ctx->pool) // Split work across row bands.
+   {
+      scaler_pool_scale(ctx, output, input);
+      return;
+   }
+#endif
+
    if (ctx->unscaled) // Just perform straight pixel conversion.
    {
       ctx->direct_pixconv(output, input,
@@ -16,12 +16,27 @@
 #ifndef SCALER_H__
 #define SCALER_H__
 
+#ifdef HAVE_CONFIG_H
+#include "../../config.h"
+#endif
+
 #include <stdint.h>
 #include <stddef.h>
 #include "../../boolean.h"
 
 #define FILTER_UNITY (1 << 14)
 
+// Kernels which are selected at runtime with rarch_get_cpu_features().
+// AVX2 is compiled with function-level target attributes, so the rest of the build doesn't need -mavx2.
+#if !defined(SCALER_NO_SIMD) && (defined(__x86_64__) || defined(__i386__)) && \
+   (defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define SCALER_HAVE_AVX2
+#endif
+
+#if !defined(SCALER_NO_SIMD) && defined(HAVE_NEON) && (defined(__ARM_NEON__) || defined(__ARM_NEON))
+#define SCALER_HAVE_NEON
+#endif
+
 enum scaler_pix_fmt
 {
    SCALER_FMT_ARGB8888 = 0,
@@ -36,7 +51,8 @@ enum scaler_type
    SCALER_TYPE_UNKNOWN = 0,
    SCALER_TYPE_POINT,
    SCALER_TYPE_BILINEAR,
-   SCALER_TYPE_SINC
+   SCALER_TYPE_SINC,
+   SCALER_TYPE_SHARP_BILINEAR // Integer point prescale, followed by bilinear to the final size.
 };
 
 struct scaler_filter
@@ -47,6 +63,8 @@ struct scaler_filter
    int     *filter_pos;
 };
 
+struct scaler_thread_pool;
+
 struct scaler_ctx
 {
    int in_width;
@@ -61,6 +79,12 @@ struct scaler_ctx
    enum scaler_pix_fmt out_fmt;
    enum scaler_type scaler_type;
 
+   // Number of threads to split the output into row bands with.
+   // 0 or 1 means everything is done on the calling thread.
+   // Only used if built with HAVE_THREADS.
+   unsigned threads;
+   struct scaler_thread_pool *pool;
+
    void (*scaler_horiz)(const struct scaler_ctx*,
          const void*, int);
    void (*scaler_vert)(const struct scaler_ctx*,
@@ -21,11 +21,32 @@
 void scaler_argb8888_vert(const struct scaler_ctx *ctx, void *output, int stride);
 void scaler_argb8888_horiz(const struct scaler_ctx *ctx, const void *input, int stride);
 
+// Reference implementations. Always built, as SIMD variants are tested against these.
+void scaler_argb8888_vert_c(const struct scaler_ctx *ctx, void *output, int stride);
+void scaler_argb8888_horiz_c(const struct scaler_ctx *ctx, const void *input, int stride);
+
+#ifdef SCALER_HAVE_AVX2
+void scaler_argb8888_vert_avx2(const struct scaler_ctx *ctx, void *output, int stride);
+void scaler_argb8888_horiz_avx2(const struct scaler_ctx *ctx, const void *input, int stride);
+#endif
+
+#ifdef SCALER_HAVE_NEON
+void scaler_argb8888_vert_neon(const struct scaler_ctx *ctx, void *output, int stride);
+void scaler_argb8888_horiz_neon(const struct scaler_ctx *ctx, const void *input, int stride);
+#endif
+
 void scaler_argb8888_point_special(const struct scaler_ctx *ctx,
       void *output, const void *input,
       int out_width, int out_height,
       int in_width, int in_height,
       int out_stride, int in_stride);
 
+// Pixel replication. Assumes output size is an exact multiple of input size.
+void scaler_argb8888_point_integer_special(const struct scaler_ctx *ctx,
+      void *output, const void *input,
+      int out_width, int out_height,
+      int in_width, int in_height,
+      int out_stride, int in_stride);
+
 #endif
 
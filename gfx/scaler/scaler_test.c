@@ -0,0 +1,352 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2013 - Hans-Kristian Arntzen
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Verifies that every SIMD kernel the CPU supports is pixel exact with the C reference,
+// and that the integer and sharp bilinear scalers behave as expected.
+// Built with HAVE_THREADS, also verifies that row band threading is pixel exact with a single thread.
+
+#include "scaler.h"
+#include "scaler_int.h"
+#include "pixconv.h"
+#include "../../performance.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef void (*horiz_func_t)(const struct scaler_ctx*, const void*, int);
+typedef void (*vert_func_t)(const struct scaler_ctx*, void*, int);
+typedef void (*pixconv_func_t)(void*, const void*, int, int, int, int);
+
+struct kernel_set
+{
+   const char *ident;
+   unsigned simd;
+   horiz_func_t horiz;
+   vert_func_t vert;
+   pixconv_func_t conv_rgb565;
+   pixconv_func_t conv_0rgb1555;
+};
+
+static const struct kernel_set kernels[] = {
+   { "native", 0, scaler_argb8888_horiz, scaler_argb8888_vert, conv_rgb565_argb8888, conv_0rgb1555_argb8888 },
+#ifdef SCALER_HAVE_AVX2
+   { "AVX2", RARCH_SIMD_AVX2, scaler_argb8888_horiz_avx2, scaler_argb8888_vert_avx2, conv_rgb565_argb8888_avx2, conv_0rgb1555_argb8888_avx2 },
+#endif
+#ifdef SCALER_HAVE_NEON
+   { "NEON", RARCH_SIMD_NEON, scaler_argb8888_horiz_neon, scaler_argb8888_vert_neon, conv_rgb565_argb8888_neon, conv_0rgb1555_argb8888_neon },
+#endif
+};
+
+static unsigned cpu_simd;
+
+// Kernels are swapped in by hand below, so keep scaler_ctx_gen_filter() on the defaults.
+void rarch_get_cpu_features(struct rarch_cpu_features *cpu)
+{
+   cpu->simd = 0;
+}
+
+static void probe_cpu(void)
+{
+#if defined(SCALER_HAVE_AVX2)
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("avx2"))
+      cpu_simd |= RARCH_SIMD_AVX2;
+#elif defined(SCALER_HAVE_NEON)
+   cpu_simd |= RARCH_SIMD_NEON;
+#endif
+}
+
+static void fill_random(void *data, size_t size)
+{
+   uint8_t *buf = (uint8_t*)data;
+   for (size_t i = 0; i < size; i++)
+      buf[i] = rand();
+}
+
+static bool test_scale(const struct kernel_set *set, enum scaler_type type,
+      int in_width, int in_height, int out_width, int out_height)
+{
+   struct scaler_ctx ctx;
+   memset(&ctx, 0, sizeof(ctx));
+
+   ctx.in_width    = in_width;
+   ctx.in_height   = in_height;
+   ctx.in_stride   = in_width * sizeof(uint32_t);
+   ctx.out_width   = out_width;
+   ctx.out_height  = out_height;
+   ctx.out_stride  = out_width * sizeof(uint32_t);
+   ctx.in_fmt      = SCALER_FMT_ARGB8888;
+   ctx.out_fmt     = SCALER_FMT_ARGB8888;
+   ctx.scaler_type = type;
+
+   if (!scaler_ctx_gen_filter(&ctx))
+      return false;
+
+   size_t in_size  = in_width * in_height * sizeof(uint32_t);
+   size_t out_size = out_width * out_height * sizeof(uint32_t);
+   uint32_t *input      = (uint32_t*)malloc(in_size);
+   uint32_t *output_ref = (uint32_t*)malloc(out_size);
+   uint32_t *output     = (uint32_t*)malloc(out_size);
+   fill_random(input, in_size);
+
+   ctx.scaler_horiz = scaler_argb8888_horiz_c;
+   ctx.scaler_vert  = scaler_argb8888_vert_c;
+   ctx.scaler_special = NULL;
+   scaler_ctx_scale(&ctx, output_ref, input);
+
+   ctx.scaler_horiz = set->horiz;
+   ctx.scaler_vert  = set->vert;
+   scaler_ctx_scale(&ctx, output, input);
+
+   bool ret = memcmp(output_ref, output, out_size) == 0;
+   fprintf(stderr, "[%s] Scale %d: %dx%d -> %dx%d: %s.\n", set->ident, (int)type,
+         in_width, in_height, out_width, out_height, ret ? "OK" : "MISMATCH");
+
+   free(input);
+   free(output_ref);
+   free(output);
+   scaler_ctx_gen_reset(&ctx);
+   return ret;
+}
+
+static bool test_conv(const struct kernel_set *set, const char *ident,
+      pixconv_func_t ref, pixconv_func_t conv, int width, int height)
+{
+   size_t in_size  = width * height * sizeof(uint16_t);
+   size_t out_size = width * height * sizeof(uint32_t);
+   uint16_t *input      = (uint16_t*)malloc(in_size);
+   uint32_t *output_ref = (uint32_t*)calloc(1, out_size);
+   uint32_t *output     = (uint32_t*)calloc(1, out_size);
+   fill_random(input, in_size);
+
+   ref(output_ref, input, width, height, width * sizeof(uint32_t), width * sizeof(uint16_t));
+   conv(output, input, width, height, width * sizeof(uint32_t), width * sizeof(uint16_t));
+
+   bool ret = memcmp(output_ref, output, out_size) == 0;
+   fprintf(stderr, "[%s] %s: %dx%d: %s.\n", set->ident, ident, width, height, ret ? "OK" : "MISMATCH");
+
+   free(input);
+   free(output_ref);
+   free(output);
+   return ret;
+}
+
+static bool test_integer_scale(int in_width, int in_height, int x_factor, int y_factor)
+{
+   int out_width  = in_width * x_factor;
+   int out_height = in_height * y_factor;
+
+   struct scaler_ctx ctx;
+   memset(&ctx, 0, sizeof(ctx));
+
+   ctx.in_width    = in_width;
+   ctx.in_height   = in_height;
+   ctx.in_stride   = in_width * sizeof(uint32_t);
+   ctx.out_width   = out_width;
+   ctx.out_height  = out_height;
+   ctx.out_stride  = out_width * sizeof(uint32_t);
+   ctx.in_fmt      = SCALER_FMT_ARGB8888;
+   ctx.out_fmt     = SCALER_FMT_ARGB8888;
+   ctx.scaler_type = SCALER_TYPE_POINT;
+
+   if (!scaler_ctx_gen_filter(&ctx) || ctx.scaler_special != scaler_argb8888_point_integer_special)
+      return false;
+
+   uint32_t *input  = (uint32_t*)malloc(in_width * in_height * sizeof(uint32_t));
+   uint32_t *output = (uint32_t*)malloc(out_width * out_height * sizeof(uint32_t));
+   fill_random(input, in_width * in_height * sizeof(uint32_t));
+
+   scaler_ctx_scale(&ctx, output, input);
+
+   bool ret = true;
+   for (int h = 0; h < out_height; h++)
+      for (int w = 0; w < out_width; w++)
+         ret &= output[h * out_width + w] == input[(h / y_factor) * in_width + w / x_factor];
+
+   fprintf(stderr, "[Integer] %dx%d -> %dx%d: %s.\n", in_width, in_height, out_width, out_height,
+         ret ? "OK" : "MISMATCH");
+
+   free(input);
+   free(output);
+   scaler_ctx_gen_reset(&ctx);
+   return ret;
+}
+
+static bool color_close(uint32_t a, uint32_t b)
+{
+   for (unsigned i = 0; i < 32; i += 8)
+   {
+      int diff = (int)((a >> i) & 0xff) - (int)((b >> i) & 0xff);
+      if (diff < -1 || diff > 1)
+         return false;
+   }
+
+   return true;
+}
+
+// A flat image must stay flat, including at the borders.
+// Blended seams may be off by one due to the fixed point precision of the filters.
+static bool test_sharp_bilinear(int in_width, int in_height, int out_width, int out_height)
+{
+   struct scaler_ctx ctx;
+   memset(&ctx, 0, sizeof(ctx));
+
+   ctx.in_width    = in_width;
+   ctx.in_height   = in_height;
+   ctx.in_stride   = in_width * sizeof(uint32_t);
+   ctx.out_width   = out_width;
+   ctx.out_height  = out_height;
+   ctx.out_stride  = out_width * sizeof(uint32_t);
+   ctx.in_fmt      = SCALER_FMT_ARGB8888;
+   ctx.out_fmt     = SCALER_FMT_ARGB8888;
+   ctx.scaler_type = SCALER_TYPE_SHARP_BILINEAR;
+
+   if (!scaler_ctx_gen_filter(&ctx))
+      return false;
+
+   uint32_t *input  = (uint32_t*)malloc(in_width * in_height * sizeof(uint32_t));
+   uint32_t *output = (uint32_t*)malloc(out_width * out_height * sizeof(uint32_t));
+   for (int i = 0; i < in_width * in_height; i++)
+      input[i] = 0xff804020;
+
+   scaler_ctx_scale(&ctx, output, input);
+
+   bool ret = true;
+   for (int i = 0; i < out_width * out_height; i++)
+      ret &= color_close(output[i], 0xff804020);
+
+   fprintf(stderr, "[Sharp bilinear] %dx%d -> %dx%d: %s.\n", in_width, in_height, out_width, out_height,
+         ret ? "OK" : "MISMATCH");
+
+   free(input);
+   free(output);
+   scaler_ctx_gen_reset(&ctx);
+   return ret;
+}
+
+#ifdef HAVE_THREADS
+static bool test_threads(enum scaler_type type, enum scaler_pix_fmt in_fmt, unsigned threads,
+      int in_width, int in_height, int out_width, int out_height)
+{
+   unsigned bpp = in_fmt == SCALER_FMT_ARGB8888 ? sizeof(uint32_t) : sizeof(uint16_t);
+
+   struct scaler_ctx ctx, ctx_threaded;
+   memset(&ctx, 0, sizeof(ctx));
+
+   ctx.in_width    = in_width;
+   ctx.in_height   = in_height;
+   ctx.in_stride   = in_width * bpp;
+   ctx.out_width   = out_width;
+   ctx.out_height  = out_height;
+   ctx.out_stride  = out_width * sizeof(uint32_t);
+   ctx.in_fmt      = in_fmt;
+   ctx.out_fmt     = SCALER_FMT_ARGB8888;
+   ctx.scaler_type = type;
+   ctx_threaded    = ctx;
+   ctx_threaded.threads = threads;
+
+   if (!scaler_ctx_gen_filter(&ctx) || !scaler_ctx_gen_filter(&ctx_threaded))
+      return false;
+
+   // A silent fallback to one thread would make the comparison pointless.
+   bool ret = ctx_threaded.pool != NULL;
+
+   size_t in_size  = in_width * in_height * bpp;
+   size_t out_size = out_width * out_height * sizeof(uint32_t);
+   uint8_t *input       = (uint8_t*)malloc(in_size);
+   uint32_t *output_ref = (uint32_t*)malloc(out_size);
+   uint32_t *output     = (uint32_t*)malloc(out_size);
+
+   // Scale a few frames, so the workers are reused.
+   for (unsigned i = 0; i < 4 && ret; i++)
+   {
+      fill_random(input, in_size);
+      scaler_ctx_scale(&ctx, output_ref, input);
+      scaler_ctx_scale(&ctx_threaded, output, input);
+      ret = memcmp(output_ref, output, out_size) == 0;
+   }
+
+   fprintf(stderr, "[Threads] Scale %d, format %d, %u threads: %dx%d -> %dx%d: %s.\n",
+         (int)type, (int)in_fmt, threads, in_width, in_height, out_width, out_height,
+         ret ? "OK" : "MISMATCH");
+
+   free(input);
+   free(output_ref);
+   free(output);
+   scaler_ctx_gen_reset(&ctx);
+   scaler_ctx_gen_reset(&ctx_threaded);
+   return ret;
+}
+#endif
+
+int main(void)
+{
+   static const int sizes[][4] = {
+      { 256, 224, 1024, 896 },
+      { 256, 224, 1280, 960 },
+      { 320, 240, 1920, 1080 },
+      { 321, 239, 1001, 777 },
+      { 1920, 1080, 641, 359 },
+      { 37, 29, 19, 15 },
+   };
+
+   probe_cpu();
+
+   bool ret = true;
+   for (unsigned i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++)
+   {
+      const struct kernel_set *set = &kernels[i];
+      if (set->simd && !(cpu_simd & set->simd))
+      {
+         fprintf(stderr, "[%s] Not supported by CPU, skipping.\n", set->ident);
+         continue;
+      }
+
+      for (unsigned j = 0; j < sizeof(sizes) / sizeof(sizes[0]); j++)
+      {
+         ret &= test_scale(set, SCALER_TYPE_BILINEAR, sizes[j][0], sizes[j][1], sizes[j][2], sizes[j][3]);
+         ret &= test_scale(set, SCALER_TYPE_SINC, sizes[j][0], sizes[j][1], sizes[j][2], sizes[j][3]);
+
+         ret &= test_conv(set, "RGB565 -> ARGB8888", conv_rgb565_argb8888_c, set->conv_rgb565,
+               sizes[j][0], sizes[j][1]);
+         ret &= test_conv(set, "0RGB1555 -> ARGB8888", conv_0rgb1555_argb8888_c, set->conv_0rgb1555,
+               sizes[j][0], sizes[j][1]);
+      }
+   }
+
+   for (int factor = 2; factor <= 5; factor++)
+      ret &= test_integer_scale(257, 224, factor, factor);
+   ret &= test_integer_scale(320, 240, 4, 3);
+
+   ret &= test_sharp_bilinear(256, 224, 1280, 960);
+   ret &= test_sharp_bilinear(256, 224, 1920, 1080);
+   ret &= test_sharp_bilinear(320, 240, 1366, 768);
+
+#ifdef HAVE_THREADS
+   for (unsigned threads = 2; threads <= 5; threads++)
+   {
+      ret &= test_threads(SCALER_TYPE_BILINEAR, SCALER_FMT_ARGB8888, threads, 256, 224, 1280, 960);
+      ret &= test_threads(SCALER_TYPE_SINC, SCALER_FMT_ARGB8888, threads, 321, 239, 1001, 777);
+      ret &= test_threads(SCALER_TYPE_SHARP_BILINEAR, SCALER_FMT_ARGB8888, threads, 320, 240, 1366, 768);
+      ret &= test_threads(SCALER_TYPE_BILINEAR, SCALER_FMT_RGB565, threads, 256, 224, 1920, 1080);
+      ret &= test_threads(SCALER_TYPE_BILINEAR, SCALER_FMT_0RGB1555, threads, 320, 240, 1001, 777);
+   }
+   // Downscaling reads more input rows than each band outputs.
+   ret &= test_threads(SCALER_TYPE_BILINEAR, SCALER_FMT_ARGB8888, 4, 1920, 1080, 641, 359);
+#endif
+
+   return ret ? 0 : 1;
+}
+
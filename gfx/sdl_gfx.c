@@ -248,9 +248,13 @@ static void *sdl_gfx_init(const video_info_t *video, const input_driver_t **inpu
 
    sdl_init_font(vid, g_settings.video.font_path, g_settings.video.font_size);
 
-   vid->scaler.scaler_type = video->smooth ? SCALER_TYPE_BILINEAR : SCALER_TYPE_POINT;
+   if (!video->smooth)
+      vid->scaler.scaler_type = SCALER_TYPE_POINT;
+   else
+      vid->scaler.scaler_type = g_settings.video.smooth_sharp ? SCALER_TYPE_SHARP_BILINEAR : SCALER_TYPE_BILINEAR;
    vid->scaler.in_fmt  = video->rgb32 ? SCALER_FMT_ARGB8888 : SCALER_FMT_RGB565;
    vid->scaler.out_fmt = SCALER_FMT_ARGB8888;
+   vid->scaler.threads = g_settings.video.scaler_threads;
 
    return vid;
 
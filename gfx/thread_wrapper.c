@@ -17,6 +17,7 @@
 #include "../thread.h"
 #include "../general.h"
 #include "../performance.h"
+#include "scaler/pixconv.h"
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
@@ -52,6 +53,35 @@ enum thread_cmd
    CMD_DUMMY = INT_MAX
 };
 
+#define FRAME_BUFFERS 3
+#define FRAME_INDEX_MASK 0x3
+#define FRAME_FRESH 0x4
+
+struct thread_frame_buffer
+{
+   uint8_t *data;
+   unsigned width;
+   unsigned height;
+   unsigned pitch;
+   char msg[1024];
+};
+
+static inline unsigned thread_frame_swap(volatile unsigned *index, unsigned val)
+{
+#if defined(__GNUC__)
+   unsigned old;
+   do
+   {
+      old = *index;
+   } while (!__sync_bool_compare_and_swap(index, old, val));
+   return old;
+#elif defined(_WIN32)
+   return InterlockedExchange((volatile LONG*)index, val);
+#else
+#error "Threaded video requires an atomic exchange. Implement thread_frame_swap() for your platform."
+#endif
+}
+
 typedef struct thread_video
 {
    slock_t *lock;
@@ -118,15 +148,25 @@ typedef struct thread_video
    struct rarch_viewport vp;
    struct rarch_viewport read_vp; // Last viewport reported to caller.
 
+   // Frames are handed off through a triple buffer.
+   // The emulator thread owns buffer[write], the video thread owns buffer[read],
+   // and the last completed frame waits in buffer[ready & FRAME_INDEX_MASK].
+   // Indices are only ever exchanged atomically, so neither side waits on the other.
    struct
    {
-      slock_t *lock;
-      uint8_t *buffer;
-      unsigned width;
-      unsigned height;
-      unsigned pitch;
-      bool updated;
-      char msg[1024];
+      slock_t *lock; // Protects state pokes which are applied before rendering.
+      struct thread_frame_buffer buffer[FRAME_BUFFERS];
+      unsigned write;
+      unsigned read;
+      volatile unsigned ready;
+      volatile bool busy; // Video thread is rendering.
+      bool conv_rgb1555; // Real driver cannot take 0RGB1555, so convert to RGB565 as part of the copy.
+
+      unsigned frames;
+      unsigned dropped; // Replaced before the video thread got to them.
+      unsigned late; // Had to wait for the video thread to finish the previous frame.
+      unsigned direct; // Rendered directly into the write buffer by the core.
+      size_t size; // Size of each frame buffer.
    } frame;
 
    video_driver_t video_thread;
@@ -160,10 +200,13 @@ static void thread_loop(void *data)
    {
       bool updated = false;
       slock_lock(thr->lock);
-      while (thr->send_cmd == CMD_NONE && !thr->frame.updated)
+      while (thr->send_cmd == CMD_NONE && !(thr->frame.ready & FRAME_FRESH))
          scond_wait(thr->cond_thread, thr->lock);
-      if (thr->frame.updated)
+      if (thr->frame.ready & FRAME_FRESH)
+      {
          updated = true;
+         thr->frame.busy = true;
+      }
       slock_unlock(thr->lock);
 
       switch (thr->send_cmd)
@@ -171,6 +214,17 @@ static void thread_loop(void *data)
          case CMD_INIT:
             thr->driver_data = thr->driver->init(&thr->info, thr->input, thr->input_data);
             thr->cmd_data.b = thr->driver_data;
+
+            if (thr->driver_data && thr->info.rgb1555)
+            {
+               const video_poke_interface_t *poke = NULL;
+               if (thr->driver->poke_interface)
+                  thr->driver->poke_interface(thr->driver_data, &poke);
+
+               unsigned formats = poke && poke->get_pixel_formats ? poke->get_pixel_formats(thr->driver_data) : 0;
+               thr->frame.conv_rgb1555 = !(formats & (1 << RETRO_PIXEL_FORMAT_0RGB1555));
+            }
+
             thr->driver->viewport_info(thr->driver_data, &thr->vp);
             thread_reply(thr, CMD_INIT);
             break;
@@ -306,6 +360,10 @@ static void thread_loop(void *data)
 
       if (updated)
       {
+         // Grab the newest frame, and give our old buffer back to the emulator thread.
+         thr->frame.read = thread_frame_swap(&thr->frame.ready, thr->frame.read) & FRAME_INDEX_MASK;
+         const struct thread_frame_buffer *buf = &thr->frame.buffer[thr->frame.read];
+
          slock_lock(thr->frame.lock);
 
 #ifdef HAVE_RGUI
@@ -318,8 +376,8 @@ static void thread_loop(void *data)
          }
 
          bool ret = thr->driver->frame(thr->driver_data,
-               thr->frame.buffer, thr->frame.width, thr->frame.height,
-               thr->frame.pitch, *thr->frame.msg ? thr->frame.msg : NULL);
+               buf->data, buf->width, buf->height,
+               buf->pitch, *buf->msg ? buf->msg : NULL);
          slock_unlock(thr->frame.lock);
 
          bool alive = ret && thr->driver->alive(thr->driver_data);
@@ -331,7 +389,7 @@ static void thread_loop(void *data)
          slock_lock(thr->lock);
          thr->alive = alive;
          thr->focus = focus;
-         thr->frame.updated = false;
+         thr->frame.busy = false;
          thr->vp = vp;
          scond_signal(thr->cond_cmd);
          slock_unlock(thr->lock);
@@ -396,39 +454,53 @@ static bool thread_frame(void *data, const void *frame_,
    unsigned copy_stride = width * (thr->info.rgb32 ? sizeof(uint32_t) : sizeof(uint16_t));
 
    const uint8_t *src = (const uint8_t*)frame_;
-   uint8_t *dst = thr->frame.buffer;
-
-   slock_lock(thr->lock);
-   // Drop frame if updated flag is still set, as thread is still working on last frame.
-   if (!thr->frame.updated)
+   struct thread_frame_buffer *buf = &thr->frame.buffer[thr->frame.write];
+   uint8_t *dst = buf->data;
+
+   // Core rendered straight into our buffer through get_current_framebuffer().
+   if (src == dst && pitch == copy_stride)
+      thr->frame.direct++;
+   else if (thr->frame.conv_rgb1555)
+      conv_0rgb1555_rgb565(dst, src, width, height, copy_stride, pitch);
+   else
    {
-      slock_lock(thr->frame.lock);
       for (unsigned h = 0; h < height; h++, src += pitch, dst += copy_stride)
          memcpy(dst, src, copy_stride);
-      thr->frame.updated = true;
-      thr->frame.width  = width;
-      thr->frame.height = height;
-      thr->frame.pitch  = copy_stride;
-
-      if (msg)
-         strlcpy(thr->frame.msg, msg, sizeof(thr->frame.msg));
-      else
-         *thr->frame.msg = '\0';
-
-      scond_signal(thr->cond_thread);
-      slock_unlock(thr->frame.lock);
-
-      // If we are going to render menu,
-      // we'll want to block to avoid stepping menu
-      // at crazy speeds.
+   }
+
+   buf->width  = width;
+   buf->height = height;
+   buf->pitch  = copy_stride;
+
+   if (msg)
+      strlcpy(buf->msg, msg, sizeof(buf->msg));
+   else
+      *buf->msg = '\0';
+
+   // Publish our frame. If the previous one is still there, the video thread never saw it.
+   bool busy = thr->frame.busy;
+   unsigned prev = thread_frame_swap(&thr->frame.ready, thr->frame.write | FRAME_FRESH);
+   thr->frame.write = prev & FRAME_INDEX_MASK;
+
+   thr->frame.frames++;
+   if (prev & FRAME_FRESH)
+      thr->frame.dropped++;
+   else if (busy)
+      thr->frame.late++;
+
+   slock_lock(thr->lock);
+   scond_signal(thr->cond_thread);
+
+   // If we are going to render menu,
+   // we'll want to block to avoid stepping menu
+   // at crazy speeds.
 #ifdef HAVE_RGUI
-      if (thr->rgui_texture)
-      {
-         while (thr->frame.updated)
-            scond_wait(thr->cond_cmd, thr->lock);
-      }
-#endif
+   if (thr->rgui_texture)
+   {
+      while ((thr->frame.ready & FRAME_FRESH) || thr->frame.busy)
+         scond_wait(thr->cond_cmd, thr->lock);
    }
+#endif
    slock_unlock(thr->lock);
 
    RARCH_PERFORMANCE_STOP(thread_frame);
@@ -460,11 +532,19 @@ static bool thread_init(thread_video_t *thr, const video_info_t *info, const inp
    size_t max_size = info->input_scale * RARCH_SCALE_BASE;
    max_size *= max_size;
    max_size *= info->rgb32 ? sizeof(uint32_t) : sizeof(uint16_t);
-   thr->frame.buffer = (uint8_t*)malloc(max_size);
-   if (!thr->frame.buffer)
-      return false;
+   thr->frame.size = max_size;
+   for (unsigned i = 0; i < FRAME_BUFFERS; i++)
+   {
+      thr->frame.buffer[i].data = (uint8_t*)malloc(max_size);
+      if (!thr->frame.buffer[i].data)
+         return false;
+
+      memset(thr->frame.buffer[i].data, 0x80, max_size);
+   }
 
-   memset(thr->frame.buffer, 0x80, max_size);
+   thr->frame.write = 0;
+   thr->frame.ready = 1;
+   thr->frame.read  = 2;
 
    thr->thread = sthread_create(thread_loop, thr);
    if (!thr->thread)
@@ -526,7 +606,11 @@ static void thread_free(void *data)
    thread_wait_reply(thr, CMD_FREE);
    sthread_join(thr->thread);
 
-   free(thr->frame.buffer);
+   RARCH_LOG("[Video thread]: %u frames, %u dropped, %u late, %u zero-copy.\n",
+         thr->frame.frames, thr->frame.dropped, thr->frame.late, thr->frame.direct);
+
+   for (unsigned i = 0; i < FRAME_BUFFERS; i++)
+      free(thr->frame.buffer[i].data);
    slock_free(thr->frame.lock);
    slock_free(thr->lock);
    scond_free(thr->cond_cmd);
@@ -672,6 +756,41 @@ static void thread_apply_state_changes(void *data)
    slock_unlock(thr->frame.lock);
 }
 
+// We can always take 0RGB1555 as the conversion is folded into the frame copy if the real driver cannot.
+static unsigned thread_get_pixel_formats(void *data)
+{
+   thread_video_t *thr = (thread_video_t*)data;
+   unsigned formats = (1 << RETRO_PIXEL_FORMAT_RGB565) | (1 << RETRO_PIXEL_FORMAT_XRGB8888);
+   if (thr->info.rgb1555)
+      formats |= 1 << RETRO_PIXEL_FORMAT_0RGB1555;
+   return formats;
+}
+
+// The write buffer is only touched by the emulator thread, so the core can render into it directly.
+// It stays ours until the frame is published in thread_frame().
+static bool thread_get_current_framebuffer(void *data, struct retro_framebuffer *fb)
+{
+   thread_video_t *thr = (thread_video_t*)data;
+   if (thr->frame.conv_rgb1555)
+      return false;
+
+   unsigned bpp = thr->info.rgb32 ? sizeof(uint32_t) : sizeof(uint16_t);
+   if ((size_t)fb->width * fb->height * bpp > thr->frame.size)
+      return false;
+
+   fb->data  = thr->frame.buffer[thr->frame.write].data;
+   fb->pitch = fb->width * bpp;
+
+   if (thr->info.rgb32)
+      fb->format = RETRO_PIXEL_FORMAT_XRGB8888;
+   else if (thr->info.rgb1555)
+      fb->format = RETRO_PIXEL_FORMAT_0RGB1555;
+   else
+      fb->format = RETRO_PIXEL_FORMAT_RGB565;
+
+   return true;
+}
+
 static const video_poke_interface_t thread_poke = {
    thread_set_blend,
    thread_set_filtering,
@@ -684,6 +803,9 @@ static const video_poke_interface_t thread_poke = {
 #ifdef HAVE_RGUI
    thread_set_rgui_texture,
 #endif
+   NULL, // set_osd_msg
+   thread_get_pixel_formats,
+   thread_get_current_framebuffer,
 };
 
 static void thread_get_poke_interface(void *data, const video_poke_interface_t **iface)
@@ -0,0 +1,247 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2013 - Hans-Kristian Arntzen
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "video_filter.h"
+#include "../general.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_CONFIG_H
+#include "../config.h"
+#endif
+
+#ifdef HAVE_THREADS
+#include "../thread.h"
+#endif
+
+// Slices smaller than this aren't worth waking up a thread for.
+#define FILTER_MIN_SLICE_LINES 8
+
+struct filter_worker
+{
+#ifdef HAVE_THREADS
+   sthread_t *thread;
+   slock_t *lock;
+   scond_t *cond;
+#endif
+
+   bool busy;
+   bool alive;
+
+   rarch_video_filter_t *filt;
+   rarch_filter_slice_t slice;
+};
+
+struct rarch_video_filter
+{
+   const rarch_filter_plugin_t *plugin;
+   void *handle;
+
+   struct filter_worker *workers; // Slice 0 is always run by the calling thread.
+   unsigned num_workers;
+};
+
+#ifdef HAVE_THREADS
+static void filter_worker_thread(void *data)
+{
+   struct filter_worker *worker = (struct filter_worker*)data;
+
+   for (;;)
+   {
+      slock_lock(worker->lock);
+      while (!worker->busy && worker->alive)
+         scond_wait(worker->cond, worker->lock);
+      bool alive = worker->alive;
+      slock_unlock(worker->lock);
+
+      if (!alive)
+         break;
+
+      worker->filt->plugin->process(worker->filt->handle, &worker->slice);
+
+      slock_lock(worker->lock);
+      worker->busy = false;
+      scond_signal(worker->cond);
+      slock_unlock(worker->lock);
+   }
+}
+
+static void filter_workers_free(rarch_video_filter_t *filt)
+{
+   for (unsigned i = 0; i < filt->num_workers; i++)
+   {
+      struct filter_worker *worker = &filt->workers[i];
+
+      if (worker->thread)
+      {
+         slock_lock(worker->lock);
+         worker->alive = false;
+         scond_signal(worker->cond);
+         slock_unlock(worker->lock);
+
+         sthread_join(worker->thread);
+      }
+
+      if (worker->lock)
+         slock_free(worker->lock);
+      if (worker->cond)
+         scond_free(worker->cond);
+   }
+
+   free(filt->workers);
+   filt->workers = NULL;
+   filt->num_workers = 0;
+}
+
+static bool filter_workers_init(rarch_video_filter_t *filt, unsigned num_workers)
+{
+   filt->workers = (struct filter_worker*)calloc(num_workers, sizeof(*filt->workers));
+   if (!filt->workers)
+      return false;
+
+   filt->num_workers = num_workers;
+
+   for (unsigned i = 0; i < num_workers; i++)
+   {
+      struct filter_worker *worker = &filt->workers[i];
+      worker->filt  = filt;
+      worker->alive = true;
+      worker->lock  = slock_new();
+      worker->cond  = scond_new();
+      if (!worker->lock || !worker->cond)
+         return false;
+
+      worker->thread = sthread_create(filter_worker_thread, worker);
+      if (!worker->thread)
+         return false;
+   }
+
+   return true;
+}
+#endif
+
+rarch_video_filter_t *rarch_video_filter_new(const rarch_filter_plugin_t *plugin, unsigned in_fmt,
+      unsigned max_width, unsigned max_height, unsigned threads)
+{
+   if (!(plugin->input_fmts & in_fmt))
+      return NULL;
+
+   rarch_video_filter_t *filt = (rarch_video_filter_t*)calloc(1, sizeof(*filt));
+   if (!filt)
+      return NULL;
+
+   filt->plugin = plugin;
+
+   rarch_filter_info_t info = {0};
+   info.max_width  = max_width;
+   info.max_height = max_height;
+   info.in_fmt     = in_fmt;
+
+   filt->handle = plugin->init(&info);
+   if (!filt->handle)
+      goto error;
+
+#ifdef HAVE_THREADS
+   if (threads > 1 && (plugin->flags & RARCH_FILTER_SLICEABLE))
+   {
+      if (!filter_workers_init(filt, threads - 1))
+         goto error;
+      RARCH_LOG("[Filter]: Running \"%s\" on %u threads.\n", plugin->ident, threads);
+   }
+#else
+   (void)threads;
+#endif
+
+   return filt;
+
+error:
+   rarch_video_filter_free(filt);
+   return NULL;
+}
+
+void rarch_video_filter_free(rarch_video_filter_t *filt)
+{
+   if (!filt)
+      return;
+
+#ifdef HAVE_THREADS
+   filter_workers_free(filt);
+#endif
+
+   if (filt->handle)
+      filt->plugin->free(filt->handle);
+   free(filt);
+}
+
+void rarch_video_filter_output_size(rarch_video_filter_t *filt, unsigned *width, unsigned *height)
+{
+   filt->plugin->output_size(filt->handle, width, height);
+}
+
+void rarch_video_filter_render(rarch_video_filter_t *filt,
+      uint32_t *output, size_t out_pitch,
+      const void *input, size_t in_pitch,
+      unsigned width, unsigned height)
+{
+   rarch_filter_slice_t slice = {0};
+   slice.output    = output;
+   slice.out_pitch = out_pitch;
+   slice.input     = input;
+   slice.in_pitch  = in_pitch;
+   slice.width     = width;
+   slice.height    = height;
+
+   unsigned slices = filt->num_workers + 1;
+   if (slices > height / FILTER_MIN_SLICE_LINES)
+      slices = height / FILTER_MIN_SLICE_LINES;
+
+   if (slices < 2)
+   {
+      slice.first_line = 0;
+      slice.last_line  = height;
+      filt->plugin->process(filt->handle, &slice);
+      return;
+   }
+
+#ifdef HAVE_THREADS
+   for (unsigned i = 1; i < slices; i++)
+   {
+      struct filter_worker *worker = &filt->workers[i - 1];
+
+      slock_lock(worker->lock);
+      worker->slice            = slice;
+      worker->slice.first_line = height * i / slices;
+      worker->slice.last_line  = height * (i + 1) / slices;
+      worker->busy             = true;
+      scond_signal(worker->cond);
+      slock_unlock(worker->lock);
+   }
+
+   slice.first_line = 0;
+   slice.last_line  = height / slices;
+   filt->plugin->process(filt->handle, &slice);
+
+   for (unsigned i = 1; i < slices; i++)
+   {
+      struct filter_worker *worker = &filt->workers[i - 1];
+
+      slock_lock(worker->lock);
+      while (worker->busy)
+         scond_wait(worker->cond, worker->lock);
+      slock_unlock(worker->lock);
+   }
+#endif
+}
+
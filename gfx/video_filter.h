@@ -0,0 +1,41 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2013 - Hans-Kristian Arntzen
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VIDEO_FILTER_H__
+#define VIDEO_FILTER_H__
+
+#include "ext/rarch_filter.h"
+#include "../boolean.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Runs a filter plugin (see ext/rarch_filter.h).
+// Sliceable filters are split into horizontal slices across a pool of threads.
+typedef struct rarch_video_filter rarch_video_filter_t;
+
+// in_fmt is one of RARCH_FILTER_FMT_*, and must be supported by the plugin.
+rarch_video_filter_t *rarch_video_filter_new(const rarch_filter_plugin_t *plugin, unsigned in_fmt,
+      unsigned max_width, unsigned max_height, unsigned threads);
+void rarch_video_filter_free(rarch_video_filter_t *filt);
+
+void rarch_video_filter_output_size(rarch_video_filter_t *filt, unsigned *width, unsigned *height);
+
+void rarch_video_filter_render(rarch_video_filter_t *filt,
+      uint32_t *output, size_t out_pitch,
+      const void *input, size_t in_pitch,
+      unsigned width, unsigned height);
+
+#endif
+
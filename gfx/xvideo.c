@@ -21,6 +21,7 @@
 #include <math.h>
 #include "gfx_common.h"
 #include "fonts/fonts.h"
+#include "yuv/yuv.h"
 
 #include "context/x11_common.h"
 
@@ -58,9 +59,7 @@ typedef struct xv
    bool keep_aspect;
    struct rarch_viewport vp;
 
-   uint8_t *ytable;
-   uint8_t *utable;
-   uint8_t *vtable;
+   struct yuv_ctx yuv;
 
    void *font;
    const font_renderer_driver_t *font_driver;
@@ -72,8 +71,6 @@ typedef struct xv
    uint8_t font_y;
    uint8_t font_u;
    uint8_t font_v;
-
-   void (*render_func)(struct xv*, const void *frame, unsigned width, unsigned height, unsigned pitch);
 } xv_t;
 
 static void xv_set_nonblock_state(void *data, bool state)
@@ -92,35 +89,6 @@ static void sighandler(int sig)
    g_quit = 1;
 }
 
-static inline void calculate_yuv(uint8_t *y, uint8_t *u, uint8_t *v, unsigned r, unsigned g, unsigned b)
-{
-   int y_ = (int)(+((double)r * 0.257) + ((double)g * 0.504) + ((double)b * 0.098) +  16.0);
-   int u_ = (int)(-((double)r * 0.148) - ((double)g * 0.291) + ((double)b * 0.439) + 128.0);
-   int v_ = (int)(+((double)r * 0.439) - ((double)g * 0.368) - ((double)b * 0.071) + 128.0);
-
-   *y = y_ < 0 ? 0 : (y_ > 255 ? 255 : y_);
-   *u = y_ < 0 ? 0 : (u_ > 255 ? 255 : u_);
-   *v = v_ < 0 ? 0 : (v_ > 255 ? 255 : v_);
-}
-
-static void init_yuv_tables(xv_t *xv)
-{
-   xv->ytable = (uint8_t*)malloc(0x10000);
-   xv->utable = (uint8_t*)malloc(0x10000);
-   xv->vtable = (uint8_t*)malloc(0x10000);
-
-   for (unsigned i = 0; i < 0x10000; i++)
-   {
-      // Extract RGB565 color data from i
-      unsigned r = (i >> 11) & 0x1f, g = (i >> 5) & 0x3f, b = (i >> 0) & 0x1f;
-      r = (r << 3) | (r >> 2);  // R5->R8
-      g = (g << 2) | (g >> 4);  // G6->G8
-      b = (b << 3) | (b >> 2);  // B5->B8
-
-      calculate_yuv(&xv->ytable[i], &xv->utable[i], &xv->vtable[i], r, g, b);
-   }
-}
-
 static void xv_init_font(xv_t *xv, const char *font_path, unsigned font_size)
 {
    if (!g_settings.video.font_enable)
@@ -135,134 +103,16 @@ static void xv_init_font(xv_t *xv, const char *font_path, unsigned font_size)
       int b = g_settings.video.msg_color_b * 255;
       b = (b < 0 ? 0 : (b > 255 ? 255 : b));
 
-      calculate_yuv(&xv->font_y, &xv->font_u, &xv->font_v,
+      yuv_calculate(&xv->font_y, &xv->font_u, &xv->font_v,
             r, g, b);
    }
    else
       RARCH_LOG("Could not initialize fonts.\n");
 }
 
-// We render @ 2x scale to combat chroma downsampling. Also makes fonts more bearable :)
-static void render16_yuy2(xv_t *xv, const void *input_, unsigned width, unsigned height, unsigned pitch)
-{
-   const uint16_t *input = (const uint16_t*)input_;
-   uint8_t *output = (uint8_t*)xv->image->data;
-
-   for (unsigned y = 0; y < height; y++)
-   {
-      for (unsigned x = 0; x < width; x++)
-      {
-         uint16_t p = *input++;
-
-         uint8_t y0 = xv->ytable[p];
-         uint8_t u = xv->utable[p];
-         uint8_t v = xv->vtable[p];
-
-         unsigned img_width = xv->width << 1;
-         output[0] = output[img_width] = y0;
-         output[1] = output[img_width + 1] = u;
-         output[2] = output[img_width + 2] = y0;
-         output[3] = output[img_width + 3] = v;
-         output += 4;
-      }
-
-      input  += (pitch >> 1) - width;
-      output += (xv->width - width) << 2;
-   }
-}
-
-static void render16_uyvy(xv_t *xv, const void *input_, unsigned width, unsigned height, unsigned pitch)
-{
-   const uint16_t *input = (const uint16_t*)input_;
-   uint8_t *output = (uint8_t*)xv->image->data;
-
-   for (unsigned y = 0; y < height; y++)
-   {
-      for (unsigned x = 0; x < width; x++)
-      {
-         uint16_t p = *input++;
-
-         uint8_t y0 = xv->ytable[p];
-         uint8_t u = xv->utable[p];
-         uint8_t v = xv->vtable[p];
-
-         unsigned img_width = xv->width << 1;
-         output[0] = output[img_width] = u;
-         output[1] = output[img_width + 1] = y0;
-         output[2] = output[img_width + 2] = v;
-         output[3] = output[img_width + 3] = y0;
-         output += 4;
-      }
-
-      input  += (pitch >> 1) - width;
-      output += (xv->width - width) << 2;
-   }
-}
-
-static void render32_yuy2(xv_t *xv, const void *input_, unsigned width, unsigned height, unsigned pitch)
-{
-   const uint32_t *input = (const uint32_t*)input_;
-   uint8_t *output = (uint8_t*)xv->image->data;
-
-   for (unsigned y = 0; y < height; y++)
-   {
-      for (unsigned x = 0; x < width; x++)
-      {
-         uint32_t p = *input++;
-         p = ((p >> 8) & 0xf800) | ((p >> 5) & 0x07e0) | ((p >> 3) & 0x1f); // ARGB -> RGB16
-
-         uint8_t y0 = xv->ytable[p];
-         uint8_t u = xv->utable[p];
-         uint8_t v = xv->vtable[p];
-
-         unsigned img_width = xv->width << 1;
-         output[0] = output[img_width] = y0;
-         output[1] = output[img_width + 1] = u;
-         output[2] = output[img_width + 2] = y0;
-         output[3] = output[img_width + 3] = v;
-         output += 4;
-      }
-
-      input  += (pitch >> 2) - width;
-      output += (xv->width - width) << 2;
-   }
-}
-
-static void render32_uyvy(xv_t *xv, const void *input_, unsigned width, unsigned height, unsigned pitch)
-{
-   const uint32_t *input = (const uint32_t*)input_;
-   uint16_t *output = (uint16_t*)xv->image->data;
-
-   for (unsigned y = 0; y < height; y++)
-   {
-      for (unsigned x = 0; x < width; x++)
-      {
-         uint32_t p = *input++;
-         p = ((p >> 8) & 0xf800) | ((p >> 5) & 0x07e0) | ((p >> 3) & 0x1f); // ARGB -> RGB16
-
-         uint8_t y0 = xv->ytable[p];
-         uint8_t u = xv->utable[p];
-         uint8_t v = xv->vtable[p];
-
-         unsigned img_width = xv->width << 1;
-         output[0] = output[img_width] = u;
-         output[1] = output[img_width + 1] = y0;
-         output[2] = output[img_width + 2] = v;
-         output[3] = output[img_width + 3] = y0;
-         output += 4;
-      }
-
-      input  += (pitch >> 2) - width;
-      output += (xv->width - width) << 2;
-   }
-}
-
 struct format_desc
 {
-   void (*render_16)(xv_t *xv, const void *input,
-         unsigned width, unsigned height, unsigned pitch);
-   void (*render_32)(xv_t *xv, const void *input,
-         unsigned width, unsigned height, unsigned pitch);
+   enum yuv_fmt fmt;
    char components[4];
    unsigned luma_index[2];
    unsigned u_index;
@@ -271,16 +121,14 @@ struct format_desc
 
 static const struct format_desc formats[] = {
    {
-      render16_yuy2,
-      render32_yuy2,
+      YUV_FMT_YUY2,
       { 'Y', 'U', 'Y', 'V' },
       { 0, 2 },
       1,
       3,
    },
    {
-      render16_uyvy,
-      render32_uyvy,
+      YUV_FMT_UYVY,
       { 'U', 'Y', 'V', 'Y' },
       { 1, 3 },
       0,
@@ -307,7 +155,8 @@ static bool adaptor_set_format(xv_t *xv, Display *dpy, XvPortID port, const vide
                   format[i].component_order[3] == formats[j].components[3])
             {
                xv->fourcc = format[i].id;
-               xv->render_func = video->rgb32 ? formats[j].render_32 : formats[j].render_16;
+               xv->yuv.fmt   = formats[j].fmt;
+               xv->yuv.rgb32 = video->rgb32;
 
                xv->luma_index[0] = formats[j].luma_index[0];
                xv->luma_index[1] = formats[j].luma_index[1];
@@ -476,7 +325,13 @@ static void *xv_init(const video_info_t *video, const input_driver_t **input, vo
          *input = NULL;
    }
 
-   init_yuv_tables(xv);
+   // SIMD where available. Threads split the frame into row bands.
+   xv->yuv.threads = g_settings.video.scaler_threads;
+   if (!yuv_ctx_init(&xv->yuv))
+   {
+      RARCH_ERR("XVideo: Failed to init YUV converter.\n");
+      goto error;
+   }
    xv_init_font(xv, g_settings.video.font_path, g_settings.video.font_size);
 
    return xv;
@@ -683,7 +538,8 @@ static bool xv_frame(void *data, const void *frame, unsigned width, unsigned hei
 
    XWindowAttributes target;
    XGetWindowAttributes(xv->display, xv->window, &target);
-   xv->render_func(xv, frame, width, height, pitch);
+   // We render @ 2x scale to combat chroma downsampling. Also makes fonts more bearable :)
+   yuv_ctx_convert(&xv->yuv, xv->image->data, xv->width << 1, frame, pitch, width, height);
 
    calc_out_rect(xv->keep_aspect, &xv->vp, target.width, target.height);
    xv->vp.full_width = target.width;
@@ -763,9 +619,7 @@ static void xv_free(void *data)
 
    XCloseDisplay(xv->display);
 
-   free(xv->ytable);
-   free(xv->utable);
-   free(xv->vtable);
+   yuv_ctx_free(&xv->yuv);
 
    if (xv->font)
       xv->font_driver->free(xv->font);
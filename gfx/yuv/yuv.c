@@ -0,0 +1,495 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2013 - Hans-Kristian Arntzen
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "yuv.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(YUV_HAVE_SSE2)
+#include <emmintrin.h>
+#endif
+
+#if defined(YUV_HAVE_NEON)
+#include <arm_neon.h>
+#endif
+
+#ifdef HAVE_THREADS
+#include "../../thread.h"
+#endif
+
+// The coefficients are applied in double precision and truncated.
+// Neither fixed point nor single precision floats reproduce this for all 2^16 inputs,
+// so the SIMD kernels keep the lookup table, and vectorize everything around it.
+void yuv_calculate(uint8_t *y, uint8_t *u, uint8_t *v, unsigned r, unsigned g, unsigned b)
+{
+   int y_ = (int)(+((double)r * 0.257) + ((double)g * 0.504) + ((double)b * 0.098) +  16.0);
+   int u_ = (int)(-((double)r * 0.148) - ((double)g * 0.291) + ((double)b * 0.439) + 128.0);
+   int v_ = (int)(+((double)r * 0.439) - ((double)g * 0.368) - ((double)b * 0.071) + 128.0);
+
+   *y = y_ < 0 ? 0 : (y_ > 255 ? 255 : y_);
+   *u = y_ < 0 ? 0 : (u_ > 255 ? 255 : u_);
+   *v = v_ < 0 ? 0 : (v_ > 255 ? 255 : v_);
+}
+
+static bool yuv_init_table(struct yuv_ctx *ctx)
+{
+   ctx->table = (uint32_t*)malloc(0x10000 * sizeof(uint32_t));
+   if (!ctx->table)
+      return false;
+
+   for (unsigned i = 0; i < 0x10000; i++)
+   {
+      // Extract RGB565 color data from i
+      unsigned r = (i >> 11) & 0x1f, g = (i >> 5) & 0x3f, b = (i >> 0) & 0x1f;
+      r = (r << 3) | (r >> 2);  // R5->R8
+      g = (g << 2) | (g >> 4);  // G6->G8
+      b = (b << 3) | (b >> 2);  // B5->B8
+
+      uint8_t y, u, v;
+      yuv_calculate(&y, &u, &v, r, g, b);
+
+      uint8_t packed[4];
+      if (ctx->fmt == YUV_FMT_YUY2)
+      {
+         packed[0] = y;
+         packed[1] = u;
+         packed[2] = y;
+         packed[3] = v;
+      }
+      else
+      {
+         packed[0] = u;
+         packed[1] = y;
+         packed[2] = v;
+         packed[3] = y;
+      }
+
+      // Stored in memory order, so this works regardless of endianness.
+      memcpy(&ctx->table[i], packed, sizeof(packed));
+   }
+
+   return true;
+}
+
+static inline uint32_t argb_to_rgb565(uint32_t p)
+{
+   return ((p >> 8) & 0xf800) | ((p >> 5) & 0x07e0) | ((p >> 3) & 0x1f);
+}
+
+void yuv_convert16_c(const struct yuv_ctx *ctx, uint8_t *output, size_t out_stride,
+      const void *input_, size_t in_pitch, unsigned width, unsigned height)
+{
+   const uint32_t *table = ctx->table;
+   const uint16_t *input = (const uint16_t*)input_;
+
+   for (unsigned h = 0; h < height;
+         h++, input += in_pitch >> 1, output += out_stride << 1)
+   {
+      uint32_t *out0 = (uint32_t*)output;
+      uint32_t *out1 = (uint32_t*)(output + out_stride);
+
+      for (unsigned w = 0; w < width; w++)
+         out0[w] = out1[w] = table[input[w]];
+   }
+}
+
+void yuv_convert32_c(const struct yuv_ctx *ctx, uint8_t *output, size_t out_stride,
+      const void *input_, size_t in_pitch, unsigned width, unsigned height)
+{
+   const uint32_t *table = ctx->table;
+   const uint32_t *input = (const uint32_t*)input_;
+
+   for (unsigned h = 0; h < height;
+         h++, input += in_pitch >> 2, output += out_stride << 1)
+   {
+      uint32_t *out0 = (uint32_t*)output;
+      uint32_t *out1 = (uint32_t*)(output + out_stride);
+
+      for (unsigned w = 0; w < width; w++)
+         out0[w] = out1[w] = table[argb_to_rgb565(input[w])];
+   }
+}
+
+#if defined(YUV_HAVE_SSE2)
+void yuv_convert16_sse2(const struct yuv_ctx *ctx, uint8_t *output, size_t out_stride,
+      const void *input_, size_t in_pitch, unsigned width, unsigned height)
+{
+   const uint32_t *table = ctx->table;
+   const uint16_t *input = (const uint16_t*)input_;
+
+   for (unsigned h = 0; h < height;
+         h++, input += in_pitch >> 1, output += out_stride << 1)
+   {
+      uint32_t *out0 = (uint32_t*)output;
+      uint32_t *out1 = (uint32_t*)(output + out_stride);
+
+      unsigned w;
+      for (w = 0; w + 8 <= width; w += 8)
+      {
+         __m128i lo = _mm_set_epi32(table[input[w + 3]], table[input[w + 2]],
+               table[input[w + 1]], table[input[w + 0]]);
+         __m128i hi = _mm_set_epi32(table[input[w + 7]], table[input[w + 6]],
+               table[input[w + 5]], table[input[w + 4]]);
+
+         _mm_storeu_si128((__m128i*)(out0 + w + 0), lo);
+         _mm_storeu_si128((__m128i*)(out0 + w + 4), hi);
+         _mm_storeu_si128((__m128i*)(out1 + w + 0), lo);
+         _mm_storeu_si128((__m128i*)(out1 + w + 4), hi);
+      }
+
+      for (; w < width; w++)
+         out0[w] = out1[w] = table[input[w]];
+   }
+}
+
+void yuv_convert32_sse2(const struct yuv_ctx *ctx, uint8_t *output, size_t out_stride,
+      const void *input_, size_t in_pitch, unsigned width, unsigned height)
+{
+   const uint32_t *table = ctx->table;
+   const uint32_t *input = (const uint32_t*)input_;
+
+   const __m128i r_mask = _mm_set1_epi32(0xf800);
+   const __m128i g_mask = _mm_set1_epi32(0x07e0);
+   const __m128i b_mask = _mm_set1_epi32(0x001f);
+
+   uint32_t index[4] __attribute__((aligned(16)));
+
+   for (unsigned h = 0; h < height;
+         h++, input += in_pitch >> 2, output += out_stride << 1)
+   {
+      uint32_t *out0 = (uint32_t*)output;
+      uint32_t *out1 = (uint32_t*)(output + out_stride);
+
+      unsigned w;
+      for (w = 0; w + 4 <= width; w += 4)
+      {
+         __m128i p = _mm_loadu_si128((const __m128i*)(input + w));
+         __m128i r = _mm_and_si128(_mm_srli_epi32(p, 8), r_mask);
+         __m128i g = _mm_and_si128(_mm_srli_epi32(p, 5), g_mask);
+         __m128i b = _mm_and_si128(_mm_srli_epi32(p, 3), b_mask);
+         _mm_store_si128((__m128i*)index, _mm_or_si128(_mm_or_si128(r, g), b));
+
+         __m128i res = _mm_set_epi32(table[index[3]], table[index[2]],
+               table[index[1]], table[index[0]]);
+
+         _mm_storeu_si128((__m128i*)(out0 + w), res);
+         _mm_storeu_si128((__m128i*)(out1 + w), res);
+      }
+
+      for (; w < width; w++)
+         out0[w] = out1[w] = table[argb_to_rgb565(input[w])];
+   }
+}
+#endif
+
+#if defined(YUV_HAVE_NEON)
+void yuv_convert16_neon(const struct yuv_ctx *ctx, uint8_t *output, size_t out_stride,
+      const void *input_, size_t in_pitch, unsigned width, unsigned height)
+{
+   const uint32_t *table = ctx->table;
+   const uint16_t *input = (const uint16_t*)input_;
+
+   uint32_t res[8] __attribute__((aligned(16)));
+
+   for (unsigned h = 0; h < height;
+         h++, input += in_pitch >> 1, output += out_stride << 1)
+   {
+      uint32_t *out0 = (uint32_t*)output;
+      uint32_t *out1 = (uint32_t*)(output + out_stride);
+
+      unsigned w;
+      for (w = 0; w + 8 <= width; w += 8)
+      {
+         for (unsigned i = 0; i < 8; i++)
+            res[i] = table[input[w + i]];
+
+         uint32x4_t lo = vld1q_u32(res + 0);
+         uint32x4_t hi = vld1q_u32(res + 4);
+
+         vst1q_u32(out0 + w + 0, lo);
+         vst1q_u32(out0 + w + 4, hi);
+         vst1q_u32(out1 + w + 0, lo);
+         vst1q_u32(out1 + w + 4, hi);
+      }
+
+      for (; w < width; w++)
+         out0[w] = out1[w] = table[input[w]];
+   }
+}
+
+void yuv_convert32_neon(const struct yuv_ctx *ctx, uint8_t *output, size_t out_stride,
+      const void *input_, size_t in_pitch, unsigned width, unsigned height)
+{
+   const uint32_t *table = ctx->table;
+   const uint32_t *input = (const uint32_t*)input_;
+
+   const uint32x4_t r_mask = vdupq_n_u32(0xf800);
+   const uint32x4_t g_mask = vdupq_n_u32(0x07e0);
+   const uint32x4_t b_mask = vdupq_n_u32(0x001f);
+
+   uint32_t index[4] __attribute__((aligned(16)));
+   uint32_t res[4] __attribute__((aligned(16)));
+
+   for (unsigned h = 0; h < height;
+         h++, input += in_pitch >> 2, output += out_stride << 1)
+   {
+      uint32_t *out0 = (uint32_t*)output;
+      uint32_t *out1 = (uint32_t*)(output + out_stride);
+
+      unsigned w;
+      for (w = 0; w + 4 <= width; w += 4)
+      {
+         uint32x4_t p = vld1q_u32(input + w);
+         uint32x4_t r = vandq_u32(vshrq_n_u32(p, 8), r_mask);
+         uint32x4_t g = vandq_u32(vshrq_n_u32(p, 5), g_mask);
+         uint32x4_t b = vandq_u32(vshrq_n_u32(p, 3), b_mask);
+         vst1q_u32(index, vorrq_u32(vorrq_u32(r, g), b));
+
+         for (unsigned i = 0; i < 4; i++)
+            res[i] = table[index[i]];
+
+         uint32x4_t packed = vld1q_u32(res);
+         vst1q_u32(out0 + w, packed);
+         vst1q_u32(out1 + w, packed);
+      }
+
+      for (; w < width; w++)
+         out0[w] = out1[w] = table[argb_to_rgb565(input[w])];
+   }
+}
+#endif
+
+// Row bands are independent, so threaded output is identical to the single-threaded path.
+#ifdef HAVE_THREADS
+
+// Bands smaller than this aren't worth waking up a thread for.
+#define YUV_MIN_BAND_LINES 8
+
+struct yuv_worker
+{
+   sthread_t *thread;
+   slock_t *lock;
+   scond_t *cond;
+
+   bool busy;
+   bool alive;
+
+   const struct yuv_ctx *ctx;
+   uint8_t *output;
+   size_t out_stride;
+   const void *input;
+   size_t in_pitch;
+   unsigned width;
+   unsigned height;
+};
+
+struct yuv_thread_pool
+{
+   struct yuv_worker *workers; // Band 0 is run by the calling thread.
+   unsigned num_workers;
+};
+
+static void yuv_worker_thread(void *data)
+{
+   struct yuv_worker *worker = (struct yuv_worker*)data;
+
+   for (;;)
+   {
+      slock_lock(worker->lock);
+      while (!worker->busy && worker->alive)
+         scond_wait(worker->cond, worker->lock);
+      bool alive = worker->alive;
+      slock_unlock(worker->lock);
+
+      if (!alive)
+         break;
+
+      worker->ctx->convert(worker->ctx, worker->output, worker->out_stride,
+            worker->input, worker->in_pitch, worker->width, worker->height);
+
+      slock_lock(worker->lock);
+      worker->busy = false;
+      scond_signal(worker->cond);
+      slock_unlock(worker->lock);
+   }
+}
+
+static void yuv_pool_free(struct yuv_thread_pool *pool)
+{
+   if (!pool)
+      return;
+
+   for (unsigned i = 0; i < pool->num_workers; i++)
+   {
+      struct yuv_worker *worker = &pool->workers[i];
+
+      if (worker->thread)
+      {
+         slock_lock(worker->lock);
+         worker->alive = false;
+         scond_signal(worker->cond);
+         slock_unlock(worker->lock);
+
+         sthread_join(worker->thread);
+      }
+
+      if (worker->lock)
+         slock_free(worker->lock);
+      if (worker->cond)
+         scond_free(worker->cond);
+   }
+
+   free(pool->workers);
+   free(pool);
+}
+
+static struct yuv_thread_pool *yuv_pool_new(const struct yuv_ctx *ctx)
+{
+   struct yuv_thread_pool *pool = (struct yuv_thread_pool*)calloc(1, sizeof(*pool));
+   if (!pool)
+      return NULL;
+
+   pool->workers = (struct yuv_worker*)calloc(ctx->threads - 1, sizeof(*pool->workers));
+   if (!pool->workers)
+      goto error;
+
+   for (unsigned i = 0; i < ctx->threads - 1; i++)
+   {
+      struct yuv_worker *worker = &pool->workers[i];
+      pool->num_workers++;
+
+      worker->ctx   = ctx;
+      worker->alive = true;
+      worker->lock  = slock_new();
+      worker->cond  = scond_new();
+      if (!worker->lock || !worker->cond)
+         goto error;
+
+      worker->thread = sthread_create(yuv_worker_thread, worker);
+      if (!worker->thread)
+         goto error;
+   }
+
+   return pool;
+
+error:
+   yuv_pool_free(pool);
+   return NULL;
+}
+
+static void yuv_pool_convert(struct yuv_ctx *ctx,
+      uint8_t *output, size_t out_stride,
+      const uint8_t *input, size_t in_pitch,
+      unsigned width, unsigned height)
+{
+   struct yuv_thread_pool *pool = ctx->pool;
+
+   unsigned bands = pool->num_workers + 1;
+   if (bands > height / YUV_MIN_BAND_LINES)
+      bands = height / YUV_MIN_BAND_LINES;
+
+   if (bands < 2)
+   {
+      ctx->convert(ctx, output, out_stride, input, in_pitch, width, height);
+      return;
+   }
+
+   for (unsigned i = 1; i < bands; i++)
+   {
+      struct yuv_worker *worker = &pool->workers[i - 1];
+      unsigned first = height * i / bands;
+      unsigned last  = height * (i + 1) / bands;
+
+      slock_lock(worker->lock);
+      worker->output     = output + 2 * first * out_stride;
+      worker->out_stride = out_stride;
+      worker->input      = input + first * in_pitch;
+      worker->in_pitch   = in_pitch;
+      worker->width      = width;
+      worker->height     = last - first;
+      worker->busy       = true;
+      scond_signal(worker->cond);
+      slock_unlock(worker->lock);
+   }
+
+   ctx->convert(ctx, output, out_stride, input, in_pitch, width, height / bands);
+
+   for (unsigned i = 1; i < bands; i++)
+   {
+      struct yuv_worker *worker = &pool->workers[i - 1];
+
+      slock_lock(worker->lock);
+      while (worker->busy)
+         scond_wait(worker->cond, worker->lock);
+      slock_unlock(worker->lock);
+   }
+}
+#endif
+
+bool yuv_ctx_init(struct yuv_ctx *ctx)
+{
+   if (!yuv_init_table(ctx))
+      return false;
+
+#if defined(YUV_HAVE_SSE2)
+   ctx->convert = ctx->rgb32 ? yuv_convert32_sse2 : yuv_convert16_sse2;
+#elif defined(YUV_HAVE_NEON)
+   ctx->convert = ctx->rgb32 ? yuv_convert32_neon : yuv_convert16_neon;
+#else
+   ctx->convert = ctx->rgb32 ? yuv_convert32_c : yuv_convert16_c;
+#endif
+
+#ifdef HAVE_THREADS
+   if (ctx->threads > 1)
+   {
+      ctx->pool = yuv_pool_new(ctx);
+      if (!ctx->pool)
+      {
+         yuv_ctx_free(ctx);
+         return false;
+      }
+   }
+#endif
+
+   return true;
+}
+
+void yuv_ctx_free(struct yuv_ctx *ctx)
+{
+#ifdef HAVE_THREADS
+   yuv_pool_free(ctx->pool);
+#endif
+   ctx->pool = NULL;
+
+   free(ctx->table);
+   ctx->table = NULL;
+}
+
+void yuv_ctx_convert(struct yuv_ctx *ctx,
+      void *output, size_t out_stride,
+      const void *input, size_t in_pitch,
+      unsigned width, unsigned height)
+{
+#ifdef HAVE_THREADS
+   if (ctx->pool)
+   {
+      yuv_pool_convert(ctx, (uint8_t*)output, out_stride, (const uint8_t*)input, in_pitch, width, height);
+      return;
+   }
+#endif
+
+   ctx->convert(ctx, (uint8_t*)output, out_stride, input, in_pitch, width, height);
+}
+
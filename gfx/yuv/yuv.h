@@ -0,0 +1,104 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2013 - Hans-Kristian Arntzen
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef YUV_H__
+#define YUV_H__
+
+#ifdef HAVE_CONFIG_H
+#include "../../config.h"
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include "../../boolean.h"
+
+// RGB -> packed YUV 4:2:2 conversion, as used by the XVideo driver.
+// Every input pixel becomes a 2x2 block in the output to combat chroma subsampling,
+// so each input pixel maps to exactly one Y/U/V triple.
+
+#if !defined(YUV_NO_SIMD) && defined(__SSE2__)
+#define YUV_HAVE_SSE2
+#endif
+
+#if !defined(YUV_NO_SIMD) && defined(HAVE_NEON) && (defined(__ARM_NEON__) || defined(__ARM_NEON))
+#define YUV_HAVE_NEON
+#endif
+
+enum yuv_fmt
+{
+   YUV_FMT_YUY2 = 0, // Y0 U Y1 V
+   YUV_FMT_UYVY      // U Y0 V Y1
+};
+
+struct yuv_ctx;
+struct yuv_thread_pool;
+
+typedef void (*yuv_convert_func)(const struct yuv_ctx *ctx,
+      uint8_t *output, size_t out_stride,
+      const void *input, size_t in_pitch,
+      unsigned width, unsigned height);
+
+struct yuv_ctx
+{
+   enum yuv_fmt fmt;
+   bool rgb32; // Input is XRGB8888 rather than RGB565.
+
+   // Number of threads to split the input into row bands with.
+   // 0 or 1 means everything is done on the calling thread.
+   // Set before yuv_ctx_init().
+   unsigned threads;
+
+   // Indexed by RGB565. Holds the four bytes a pixel expands to on one output line,
+   // in output byte order.
+   uint32_t *table;
+
+   yuv_convert_func convert;
+   struct yuv_thread_pool *pool;
+};
+
+bool yuv_ctx_init(struct yuv_ctx *ctx);
+void yuv_ctx_free(struct yuv_ctx *ctx);
+
+// Output must hold (2 * width) x (2 * height) pixels, with out_stride in bytes.
+void yuv_ctx_convert(struct yuv_ctx *ctx,
+      void *output, size_t out_stride,
+      const void *input, size_t in_pitch,
+      unsigned width, unsigned height);
+
+// BT.601 studio swing conversion of one 8-bit RGB color.
+void yuv_calculate(uint8_t *y, uint8_t *u, uint8_t *v, unsigned r, unsigned g, unsigned b);
+
+// Kernels. Exposed for testing.
+void yuv_convert16_c(const struct yuv_ctx *ctx, uint8_t *output, size_t out_stride,
+      const void *input, size_t in_pitch, unsigned width, unsigned height);
+void yuv_convert32_c(const struct yuv_ctx *ctx, uint8_t *output, size_t out_stride,
+      const void *input, size_t in_pitch, unsigned width, unsigned height);
+
+#ifdef YUV_HAVE_SSE2
+void yuv_convert16_sse2(const struct yuv_ctx *ctx, uint8_t *output, size_t out_stride,
+      const void *input, size_t in_pitch, unsigned width, unsigned height);
+void yuv_convert32_sse2(const struct yuv_ctx *ctx, uint8_t *output, size_t out_stride,
+      const void *input, size_t in_pitch, unsigned width, unsigned height);
+#endif
+
+#ifdef YUV_HAVE_NEON
+void yuv_convert16_neon(const struct yuv_ctx *ctx, uint8_t *output, size_t out_stride,
+      const void *input, size_t in_pitch, unsigned width, unsigned height);
+void yuv_convert32_neon(const struct yuv_ctx *ctx, uint8_t *output, size_t out_stride,
+      const void *input, size_t in_pitch, unsigned width, unsigned height);
+#endif
+
+#endif
+
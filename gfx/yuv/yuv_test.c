@@ -0,0 +1,215 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2013 - Hans-Kristian Arntzen
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Verifies that the YUV kernels and the threaded path are byte exact with
+// the original table driven XVideo converters, and benchmarks them. Doesn't need an X server.
+
+#include "yuv.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+struct kernel_set
+{
+   const char *ident;
+   yuv_convert_func convert16;
+   yuv_convert_func convert32;
+};
+
+static const struct kernel_set kernels[] = {
+   { "C", yuv_convert16_c, yuv_convert32_c },
+#ifdef YUV_HAVE_SSE2
+   { "SSE2", yuv_convert16_sse2, yuv_convert32_sse2 },
+#endif
+#ifdef YUV_HAVE_NEON
+   { "NEON", yuv_convert16_neon, yuv_convert32_neon },
+#endif
+};
+
+static uint8_t ytable[0x10000];
+static uint8_t utable[0x10000];
+static uint8_t vtable[0x10000];
+
+static void init_ref_tables(void)
+{
+   for (unsigned i = 0; i < 0x10000; i++)
+   {
+      unsigned r = (i >> 11) & 0x1f, g = (i >> 5) & 0x3f, b = (i >> 0) & 0x1f;
+      r = (r << 3) | (r >> 2);
+      g = (g << 2) | (g >> 4);
+      b = (b << 3) | (b >> 2);
+      yuv_calculate(&ytable[i], &utable[i], &vtable[i], r, g, b);
+   }
+}
+
+// The converters as they used to be in gfx/xvideo.c. image_width is in pixels.
+static void render_ref(enum yuv_fmt fmt, bool rgb32, uint8_t *output, unsigned image_width,
+      const void *input_, unsigned width, unsigned height, unsigned pitch)
+{
+   const uint8_t *input = (const uint8_t*)input_;
+   unsigned img_width = image_width << 1;
+
+   for (unsigned y = 0; y < height; y++, input += pitch)
+   {
+      for (unsigned x = 0; x < width; x++)
+      {
+         uint32_t p;
+         if (rgb32)
+         {
+            p = ((const uint32_t*)input)[x];
+            p = ((p >> 8) & 0xf800) | ((p >> 5) & 0x07e0) | ((p >> 3) & 0x1f);
+         }
+         else
+            p = ((const uint16_t*)input)[x];
+
+         uint8_t y0 = ytable[p];
+         uint8_t u = utable[p];
+         uint8_t v = vtable[p];
+
+         if (fmt == YUV_FMT_YUY2)
+         {
+            output[0] = output[img_width] = y0;
+            output[1] = output[img_width + 1] = u;
+            output[2] = output[img_width + 2] = y0;
+            output[3] = output[img_width + 3] = v;
+         }
+         else
+         {
+            output[0] = output[img_width] = u;
+            output[1] = output[img_width + 1] = y0;
+            output[2] = output[img_width + 2] = v;
+            output[3] = output[img_width + 3] = y0;
+         }
+         output += 4;
+      }
+
+      output += (image_width - width) << 2;
+   }
+}
+
+static void fill_random(void *data, size_t size)
+{
+   uint8_t *buf = (uint8_t*)data;
+   for (size_t i = 0; i < size; i++)
+      buf[i] = rand();
+}
+
+static double get_time(void)
+{
+   struct timespec tv;
+   clock_gettime(CLOCK_MONOTONIC, &tv);
+   return tv.tv_sec + tv.tv_nsec / 1000000000.0;
+}
+
+static bool test_kernel(const char *ident, yuv_convert_func convert, unsigned threads,
+      enum yuv_fmt fmt, bool rgb32, unsigned width, unsigned height, bool bench)
+{
+   struct yuv_ctx ctx;
+   memset(&ctx, 0, sizeof(ctx));
+   ctx.fmt     = fmt;
+   ctx.rgb32   = rgb32;
+   ctx.threads = threads;
+   if (!yuv_ctx_init(&ctx))
+      return false;
+   ctx.convert = convert;
+
+   unsigned bpp         = rgb32 ? sizeof(uint32_t) : sizeof(uint16_t);
+   unsigned pitch       = width * bpp + 64; // Padded, like most cores.
+   unsigned image_width = (width << 1) + 16;
+   size_t out_stride    = image_width * 2;
+   size_t out_size      = out_stride * (height << 1);
+
+   uint8_t *input      = (uint8_t*)malloc(pitch * height);
+   uint8_t *output_ref = (uint8_t*)calloc(1, out_size);
+   uint8_t *output     = (uint8_t*)calloc(1, out_size);
+   fill_random(input, pitch * height);
+
+   render_ref(fmt, rgb32, output_ref, image_width, input, width, height, pitch);
+   yuv_ctx_convert(&ctx, output, out_stride, input, pitch, width, height);
+
+   bool ret = memcmp(output_ref, output, out_size) == 0;
+   fprintf(stderr, "[%s, %u thread(s)] %s %s: %ux%u: %s.\n", ident, threads ? threads : 1,
+         rgb32 ? "XRGB8888" : "RGB565", fmt == YUV_FMT_YUY2 ? "YUY2" : "UYVY",
+         width, height, ret ? "OK" : "MISMATCH");
+
+   if (bench)
+   {
+      const unsigned frames = 200;
+
+      double start = get_time();
+      for (unsigned i = 0; i < frames; i++)
+         render_ref(fmt, rgb32, output_ref, image_width, input, width, height, pitch);
+      double ref_time = get_time() - start;
+
+      start = get_time();
+      for (unsigned i = 0; i < frames; i++)
+         yuv_ctx_convert(&ctx, output, out_stride, input, pitch, width, height);
+      double time = get_time() - start;
+
+      fprintf(stderr, "   Reference: %.3f ms/frame, %s: %.3f ms/frame (%.2fx).\n",
+            1000.0 * ref_time / frames, ident, 1000.0 * time / frames, ref_time / time);
+   }
+
+   free(input);
+   free(output_ref);
+   free(output);
+   yuv_ctx_free(&ctx);
+   return ret;
+}
+
+int main(int argc, char *argv[])
+{
+   static const unsigned sizes[][2] = {
+      { 256, 224 },
+      { 320, 240 },
+      { 321, 239 },
+      { 640, 480 },
+      { 7, 3 },
+   };
+
+   static const unsigned threads[] = { 1, 2, 4 };
+
+   // Benchmarking is slow, only do it when asked.
+   bool bench = argc > 1 && strcmp(argv[1], "--bench") == 0;
+
+   init_ref_tables();
+
+   bool ret = true;
+   for (unsigned k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++)
+   {
+      for (unsigned t = 0; t < sizeof(threads) / sizeof(threads[0]); t++)
+      {
+         for (unsigned s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+         {
+            unsigned width  = sizes[s][0];
+            unsigned height = sizes[s][1];
+            bool do_bench   = bench && s == 3;
+
+            ret &= test_kernel(kernels[k].ident, kernels[k].convert16, threads[t],
+                  YUV_FMT_YUY2, false, width, height, do_bench);
+            ret &= test_kernel(kernels[k].ident, kernels[k].convert16, threads[t],
+                  YUV_FMT_UYVY, false, width, height, false);
+            ret &= test_kernel(kernels[k].ident, kernels[k].convert32, threads[t],
+                  YUV_FMT_YUY2, true, width, height, do_bench);
+            ret &= test_kernel(kernels[k].ident, kernels[k].convert32, threads[t],
+                  YUV_FMT_UYVY, true, width, height, false);
+         }
+      }
+   }
+
+   return ret ? 0 : 1;
+}
+
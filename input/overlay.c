@@ -25,6 +25,11 @@
 #include <stddef.h>
 #include <math.h>
 
+// Hit testing only checks the descriptors overlapping the grid cell a pointer is in.
+// Keyboard overlays have 100+ descriptors, and are polled for every pointer each frame.
+#define OVERLAY_GRID_SIZE 16
+#define OVERLAY_GRID_CELLS (OVERLAY_GRID_SIZE * OVERLAY_GRID_SIZE)
+
 enum overlay_hitbox
 {
    OVERLAY_HITBOX_RADIAL = 0,
@@ -63,6 +68,10 @@ struct overlay
    bool full_screen;
 
    char name[64];
+
+   // Descriptor indices per grid cell, in descriptor order. Cell i uses [grid_offset[i], grid_offset[i + 1]).
+   unsigned *grid;
+   unsigned grid_offset[OVERLAY_GRID_CELLS + 1];
 };
 
 struct input_overlay
@@ -113,6 +122,7 @@ static void input_overlay_free_overlay(struct overlay *overlay)
 {
    free(overlay->descs);
    free(overlay->image);
+   free(overlay->grid);
 }
 
 static void input_overlay_free_overlays(input_overlay_t *ol)
@@ -191,6 +201,69 @@ end:
    return ret;
 }
 
+// Descriptors and pointers are in overlay space, where the image spans [0, 1].
+// Anything outside of it ends up in the cells along the edges.
+static unsigned overlay_grid_cell(float coord)
+{
+   float cell = floorf(coord * OVERLAY_GRID_SIZE);
+   if (!(cell >= 0.0f))
+      return 0;
+   if (cell >= OVERLAY_GRID_SIZE - 1)
+      return OVERLAY_GRID_SIZE - 1;
+   return (unsigned)cell;
+}
+
+static void overlay_desc_cells(const struct overlay_desc *desc,
+      unsigned *x0, unsigned *y0, unsigned *x1, unsigned *y1)
+{
+   // Bounding box of both hitbox types, with some slack for rounding in inside_hitbox().
+   float range_x = fabsf(desc->range_x) * 1.001f + 0.0001f;
+   float range_y = fabsf(desc->range_y) * 1.001f + 0.0001f;
+
+   *x0 = overlay_grid_cell(desc->x - range_x);
+   *y0 = overlay_grid_cell(desc->y - range_y);
+   *x1 = overlay_grid_cell(desc->x + range_x);
+   *y1 = overlay_grid_cell(desc->y + range_y);
+}
+
+static bool input_overlay_build_grid(struct overlay *overlay)
+{
+   unsigned fill[OVERLAY_GRID_CELLS] = {0};
+
+   for (size_t i = 0; i < overlay->size; i++)
+   {
+      unsigned x0, y0, x1, y1;
+      overlay_desc_cells(&overlay->descs[i], &x0, &y0, &x1, &y1);
+      for (unsigned y = y0; y <= y1; y++)
+         for (unsigned x = x0; x <= x1; x++)
+            fill[y * OVERLAY_GRID_SIZE + x]++;
+   }
+
+   overlay->grid_offset[0] = 0;
+   for (unsigned i = 0; i < OVERLAY_GRID_CELLS; i++)
+   {
+      overlay->grid_offset[i + 1] = overlay->grid_offset[i] + fill[i];
+      fill[i] = overlay->grid_offset[i];
+   }
+
+   unsigned entries = overlay->grid_offset[OVERLAY_GRID_CELLS];
+   overlay->grid = (unsigned*)malloc((entries ? entries : 1) * sizeof(unsigned));
+   if (!overlay->grid)
+      return false;
+
+   for (size_t i = 0; i < overlay->size; i++)
+   {
+      unsigned x0, y0, x1, y1;
+      overlay_desc_cells(&overlay->descs[i], &x0, &y0, &x1, &y1);
+      for (unsigned y = y0; y <= y1; y++)
+         for (unsigned x = x0; x <= x1; x++)
+            overlay->grid[fill[y * OVERLAY_GRID_SIZE + x]++] = i;
+   }
+
+   RARCH_LOG("[Overlay]: %u descs in %u grid entries.\n", (unsigned)overlay->size, entries);
+   return true;
+}
+
 static bool input_overlay_load_overlay(config_file_t *conf, const char *config_path,
       struct overlay *overlay, unsigned index)
 {
@@ -280,6 +353,12 @@ static bool input_overlay_load_overlay(config_file_t *conf, const char *config_p
       }
    }
 
+   // Hit testing happens in unscaled overlay space, so this doesn't need to be redone when scaling.
+   if (!input_overlay_build_grid(overlay))
+   {
+      RARCH_ERR("[Overlay]: Failed to allocate hit test grid.\n");
+      return false;
+   }
 
    // Assume for now that scaling center is in the middle.
    // TODO: Make this configurable.
@@ -454,7 +533,7 @@ static bool inside_hitbox(const struct overlay_desc *desc, float x, float y)
    }
 }
 
-uint64_t input_overlay_poll(input_overlay_t *ol, int16_t norm_x, int16_t norm_y)
+uint64_t input_overlay_poll(input_overlay_t *ol, const int16_t *norm_x, const int16_t *norm_y, unsigned count)
 {
    if (!ol->enable)
    {
@@ -462,25 +541,31 @@ uint64_t input_overlay_poll(input_overlay_t *ol, int16_t norm_x, int16_t norm_y)
       return 0;
    }
 
-   // norm_x and norm_y is in [-0x7fff, 0x7fff] range, like RETRO_DEVICE_POINTER.
-   float x = (float)(norm_x + 0x7fff) / 0xffff;
-   float y = (float)(norm_y + 0x7fff) / 0xffff;
-
-   x -= ol->active->x;
-   y -= ol->active->y;
-   x /= ol->active->w;
-   y /= ol->active->h;
-
+   const struct overlay *active = ol->active;
    uint64_t state = 0;
-   for (size_t i = 0; i < ol->active->size; i++)
+
+   for (unsigned p = 0; p < count; p++)
    {
-      if (inside_hitbox(&ol->active->descs[i], x, y))
+      // norm_x and norm_y is in [-0x7fff, 0x7fff] range, like RETRO_DEVICE_POINTER.
+      float x = (float)(norm_x[p] + 0x7fff) / 0xffff;
+      float y = (float)(norm_y[p] + 0x7fff) / 0xffff;
+
+      x -= active->x;
+      y -= active->y;
+      x /= active->w;
+      y /= active->h;
+
+      unsigned cell = overlay_grid_cell(y) * OVERLAY_GRID_SIZE + overlay_grid_cell(x);
+      for (unsigned i = active->grid_offset[cell]; i < active->grid_offset[cell + 1]; i++)
       {
-         uint64_t mask = ol->active->descs[i].key_mask;
-         state |= mask;
+         const struct overlay_desc *desc = &active->descs[active->grid[i]];
+         if (inside_hitbox(desc, x, y))
+         {
+            state |= desc->key_mask;
 
-         if (mask & (UINT64_C(1) << RARCH_OVERLAY_NEXT))
-            ol->next_index = ol->active->descs[i].next_index;
+            if (desc->key_mask & (UINT64_C(1) << RARCH_OVERLAY_NEXT))
+               ol->next_index = desc->next_index;
+         }
       }
    }
 
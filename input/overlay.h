@@ -33,9 +33,13 @@ void input_overlay_enable(input_overlay_t *ol, bool enable);
 
 bool input_overlay_full_screen(input_overlay_t *ol);
 
+// Upper bound of pointers polled at once. Extra pointers are ignored.
+#define INPUT_OVERLAY_MAX_POINTERS 16
+
+// Polls all pressed pointers at once. count must be at least 1.
 // norm_x and norm_y are the result of input_translate_coord_viewport().
-// Resulting state is a bitmask of (1 << key_bind_id).
-uint64_t input_overlay_poll(input_overlay_t *ol, int16_t norm_x, int16_t norm_y);
+// Resulting state is a bitmask of (1 << key_bind_id), for all pointers combined.
+uint64_t input_overlay_poll(input_overlay_t *ol, const int16_t *norm_x, const int16_t *norm_y, unsigned count);
 
 // Call when there is nothing to poll. Allows overlay to clear certain state.
 void input_overlay_poll_clear(input_overlay_t *ol);
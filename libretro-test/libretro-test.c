@@ -155,8 +155,21 @@ static void render_checkered(void)
    uint16_t color_r = 31 << 11;
    uint16_t color_g = 63 <<  5;
 
-   uint16_t *line = frame_buf;
-   for (unsigned y = 0; y < 240; y++, line += 320)
+   // Render straight into the frontend's buffer if possible.
+   uint16_t *buf = frame_buf;
+   unsigned stride = 320;
+   struct retro_framebuffer fb = {0};
+   fb.width  = 320;
+   fb.height = 240;
+   if (environ_cb(RETRO_ENVIRONMENT_GET_CURRENT_SOFTWARE_FRAMEBUFFER, &fb) &&
+         fb.format == RETRO_PIXEL_FORMAT_RGB565)
+   {
+      buf    = fb.data;
+      stride = fb.pitch >> 1;
+   }
+
+   uint16_t *line = buf;
+   for (unsigned y = 0; y < 240; y++, line += stride)
    {
       unsigned index_y = ((y - y_coord) >> 4) & 1;
       for (unsigned x = 0; x < 320; x++)
@@ -166,7 +179,7 @@ static void render_checkered(void)
       }
    }
 
-   video_cb(frame_buf, 320, 240, 320 << 1);
+   video_cb(buf, 320, 240, stride << 1);
 }
 
 static void render_audio(void)
@@ -421,6 +421,15 @@ enum retro_mod
                                            // Sets an interface which frontend can use to eject and insert disk images.
                                            // This is used for games which consist of multiple images and must be manually
                                            // swapped out by the user (e.g. PSX).
+#define RETRO_ENVIRONMENT_GET_CURRENT_SOFTWARE_FRAMEBUFFER 14
+                                           // struct retro_framebuffer * --
+                                           // Returns a frontend-owned buffer the implementation can render the next frame into.
+                                           // The implementation sets width and height, and the frontend fills in data, pitch and format.
+                                           // If format differs from the pixel format the implementation uses, the buffer must not be used.
+                                           // Passing data to the video refresh callback avoids a copy in the frontend.
+                                           // The buffer is only valid until the next call to the video refresh callback,
+                                           // and must be requested again for every frame.
+                                           // If the call returns false, the implementation must render into its own buffer as usual.
 
 
 // Callback type passed in RETRO_ENVIRONMENT_SET_KEYBOARD_CALLBACK. Called by the frontend in response to keyboard events.
@@ -504,6 +513,15 @@ enum retro_pixel_format
    RETRO_PIXEL_FORMAT_UNKNOWN  = INT_MAX
 };
 
+struct retro_framebuffer
+{
+   void *data;                      // Set by frontend. Buffer to render the frame into.
+   unsigned width;                  // Set by implementation. Width of the frame which will be rendered.
+   unsigned height;                 // Set by implementation. Height of the frame which will be rendered.
+   size_t pitch;                    // Set by frontend. Length of a line in bytes.
+   enum retro_pixel_format format;  // Set by frontend. Pixel format of the buffer.
+};
+
 struct retro_message
 {
    const char *msg;        // Message to be displayed.
@@ -25,86 +25,269 @@
 #include "message.h"
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+
+#if defined(HAVE_THREADS) && !defined(RARCH_CONSOLE)
+#define NETPLAY_SPECTATE_THREAD
+#include "thread.h"
+#endif
+
+#ifdef __linux__
+#define HAVE_EPOLL
+#include <sys/epoll.h>
+#endif
 
 // Checks if input port/index is controlled by netplay or not.
 static bool netplay_is_alive(netplay_t *handle);
 
 static bool netplay_poll(netplay_t *handle);
-static int16_t netplay_input_state(netplay_t *handle, bool port, unsigned device, unsigned index, unsigned id);
+static int16_t netplay_input_state(netplay_t *handle, unsigned port, unsigned device, unsigned index, unsigned id);
 
 // If we're fast-forward replaying to resync, check if we should actually show frame.
 static bool netplay_should_skip(netplay_t *handle);
 static bool netplay_can_poll(netplay_t *handle);
 static void netplay_set_spectate_input(netplay_t *handle, int16_t input);
+static bool spectate_init(netplay_t *handle);
+static void spectate_deinit(netplay_t *handle);
+
+struct netplay_peer;
+static bool netplay_send_cmd(netplay_t *handle, struct netplay_peer *peer,
+      uint32_t cmd, const void *data, size_t size);
+static bool netplay_get_cmd(netplay_t *handle, struct netplay_peer *peer);
 
-static bool netplay_send_cmd(netplay_t *handle, uint32_t cmd, const void *data, size_t size);
-static bool netplay_get_cmd(netplay_t *handle);
+#define FRAME_PTR(frame) ((frame) % handle->buffer_size)
 
-#define PREV_PTR(x) ((x) == 0 ? handle->buffer_size - 1 : (x) - 1)
-#define NEXT_PTR(x) ((x + 1) % handle->buffer_size)
+// Input is a bitset of RETRO_DEVICE_ID_JOYPAD_* per player.
+#define NETPLAY_INPUT_BITS (RETRO_DEVICE_ID_JOYPAD_R3 + 1)
 
 struct delta_frame
 {
-   void *state;
+   // What the frame last ran with. Real input where we had it, predicted otherwise.
+   uint16_t input[MAX_PLAYERS];
+
+   // Delta snapshots only. XOR between the snapshot of this frame and the next one.
+   size_t delta_ptr;
+   size_t delta_size;
+};
+
+// Real input of one player.
+// Needs to hold everything which can still be replayed or resent to a peer,
+// which is bounded by how far ahead of each other the buffers allow peers to run.
+#define NETPLAY_INPUT_FRAMES 256
+
+struct netplay_player
+{
+   char nick[32];
+   uint16_t input[NETPLAY_INPUT_FRAMES];
+   uint32_t read_frame_count; // First frame we don't have real input for.
+};
 
-   uint16_t real_input_state;
-   uint16_t simulated_input_state;
-   bool is_simulated;
-   uint16_t self_state;
-   bool used_real;
+// Clients only talk to the host, which relays input between them.
+struct netplay_peer
+{
+   int fd; // TCP connection for handshake and commands.
+   unsigned port; // Player controlled by the peer. 0 for the host.
+
+   struct sockaddr_storage addr; // Where to send UDP packets. Host only.
+   socklen_t addr_size;
+   bool has_addr;
+
+   uint32_t ack[MAX_PLAYERS]; // read_frame_count of the peer, as last heard.
+
+   // Timing, see parse_packet().
+   bool has_echo;
+   uint32_t echo_time; // Send time of the newest packet heard, in the peer's clock.
+   rarch_time_t echo_recv; // When we heard it, in ours.
+   float rtt; // Smoothed round trip time and its mean deviation, in usec.
+   float rtt_var;
+   bool has_rtt;
+   uint32_t remote_frame; // Newest frame_count heard from the peer.
+   float advantage; // Smoothed estimate of how many frames we are ahead of the peer.
 };
 
 #define UDP_FRAME_PACKETS 16
-#define MAX_SPECTATORS 16
+// Spectators falling further behind the input stream than this are dropped.
+#define SPECTATE_BUFFER_SIZE (1 << 20)
+// Spectators have this long to send their nick after connecting.
+#define SPECTATE_HANDSHAKE_TIMEOUT 5000000
+
+// UDP packet, all in network order:
+//    uint32_t port of the sender
+//    uint32_t frame_count of the sender
+//    uint32_t time of sending, in usec of the sender's clock
+//    uint32_t echo time, the newest time the sender has heard from the receiver
+//    uint32_t echo hold, usec between hearing the echo time and sending this. NETPLAY_NO_ECHO if nothing heard yet.
+//    uint32_t ack[MAX_PLAYERS], the read_frame_count of the sender for every player
+//    uint32_t mask of players included
+//    Per included player: uint32_t first frame, uint32_t count, uint16_t input[count]
+// Input is sent from where the receiver acked, so lost packets are covered by the next one.
+#define NETPLAY_PACKET_HEADER_SIZE (4 * (6 + MAX_PLAYERS))
+#define NETPLAY_PACKET_SIZE (NETPLAY_PACKET_HEADER_SIZE + MAX_PLAYERS * (8 + 2 * UDP_FRAME_PACKETS))
+#define NETPLAY_NO_ECHO 0xffffffffu
+
+// Input delay is reconsidered this often, in frames.
+#define NETPLAY_SYNC_INTERVAL 60
+// Input delay is only lowered after this many intervals in a row with latency a full frame below it.
+#define NETPLAY_DELAY_DROP_INTERVALS 2
+// While ahead of a peer, we wait this fraction of a frame per frame of lead, every frame.
+#define NETPLAY_PACE_RATE (1.0f / 30.0f)
+// Gives up on peers after being stalled this long, in usec.
+#define NETPLAY_TIMEOUT 8000000
+// Bounds on how long to wait before resending while stalled, in usec.
+#define NETPLAY_MIN_RETRY 20000
+#define NETPLAY_MAX_RETRY 500000
 
 #define NETPLAY_CMD_ACK 0
 #define NETPLAY_CMD_NAK 1
 #define NETPLAY_CMD_FLIP_PLAYERS 2
 
+enum spectator_state
+{
+   SPECTATOR_FREE = 0,
+   SPECTATOR_NICK,   // Receiving their nick.
+   SPECTATOR_HEADER, // Waiting for the emulator thread to make a BSV header.
+   SPECTATOR_STREAM  // Sending our nick, the header, then input.
+};
+
+// A BSV header is shared by every spectator who joined on the same frame.
+struct spectate_header
+{
+   uint32_t *data;
+   size_t size;
+   unsigned refs;
+};
+
+struct netplay_spectator
+{
+   int fd;
+   enum spectator_state state;
+   struct sockaddr_storage addr;
+   rarch_time_t connect_time;
+   bool want_write;
+
+   uint8_t nick[33]; // As received, size prefixed.
+   size_t nick_size;
+
+   struct spectate_header *header; // Until it's sent.
+   size_t out_ptr; // Progress through our nick, then the header.
+   uint64_t pos;   // Next byte of the input stream to send.
+};
+
 struct netplay
 {
    char nick[32];
    char other_nick[32];
-   struct sockaddr_storage other_addr;
 
    struct retro_callbacks cbs;
-   int fd; // TCP connection for state sending, etc. Also used for commands.
+   int fd; // Listening socket while hosting. TCP connection when spectating.
    int udp_fd; // UDP connection for game state updates.
-   unsigned port; // Which port is governed by netplay (other player)?
    bool has_connection;
 
+   unsigned self_port; // Which player we are. The host is 0.
+   struct netplay_player players[MAX_PLAYERS];
+   unsigned num_players;
+
+   struct netplay_peer peers[MAX_PLAYERS - 1];
+   unsigned num_peers;
+
    struct delta_frame *buffer;
    size_t buffer_size;
 
-   size_t self_ptr; // Ptr where we are now.
-   size_t other_ptr; // Points to the last reliable state that self ever had.
-   size_t read_ptr; // Ptr to where we are reading. Generally, other_ptr <= read_ptr <= self_ptr.
-   size_t tmp_ptr; // A temporary pointer used on replay.
-
+   // Snapshots to roll back to, taken before a frame runs.
+   // Only frames which ran on predicted input get one, see netplay_pre_frame_net().
    size_t state_size;
+   size_t state_stride;
+   uint8_t *states; // One per buffer entry, in one block.
+
+   // Delta snapshots. The newest snapshot is kept whole, older ones as XOR against the one after,
+   // in a ring of (word index << 32 | xor) like the rewind buffer.
+   bool delta;
+   uint32_t *state;
+   uint32_t *tmp_state;
+   size_t state_words;
+   bool has_state;
+   uint32_t state_frame; // Frame of the newest snapshot.
+   uint32_t first_state_frame; // Frame of the oldest snapshot.
+   uint64_t *deltas;
+   size_t deltas_mask;
+   size_t deltas_head;
+   size_t deltas_tail;
+
+   // Stats, logged on exit.
+   rarch_time_t start_time;
+   uint64_t serialize_bytes;
+   unsigned snapshots;
+   uint64_t delta_bytes;
+   unsigned delta_count;
+   unsigned rollbacks;
+   uint64_t rollback_frames;
+   unsigned max_rollback;
+   unsigned stalls;
+   rarch_time_t stall_time;
+   unsigned pace_waits;
+   unsigned min_delay_used;
+   unsigned max_delay_used;
+
+   // Our input is used this many frames after it's read. Adapts to round trip time.
+   unsigned input_delay;
+   unsigned min_input_delay;
+   unsigned max_input_delay;
+   uint32_t sync_frame; // When input delay was last reconsidered.
+   unsigned delay_drop_count; // Intervals in a row input delay could have been lowered.
+   float pace_debt; // Frames we owe peers who are behind.
+   float frame_usec;
 
    bool is_replay; // Are we replaying old frames?
    bool can_poll; // We don't want to poll several times on a frame.
 
-   uint32_t packet_buffer[UDP_FRAME_PACKETS * 2]; // To compat UDP packet loss we also send old data along with the packets.
+   // Set if real input arrived for a frame which ran on a bad prediction.
+   bool must_replay;
+   uint32_t replay_frame_count;
+
    uint32_t frame_count;
-   uint32_t read_frame_count;
-   uint32_t other_frame_count;
-   uint32_t tmp_frame_count;
+   uint32_t tmp_frame_count; // Frame being replayed.
    struct addrinfo *addr;
-   struct sockaddr_storage their_addr;
-   bool has_client_addr;
 
-   unsigned timeout_cnt;
+   rarch_time_t last_input_time; // When a peer last gave us new input.
+   rarch_time_t last_stall_log;
 
    // Spectating.
    bool spectate;
    bool spectate_client;
-   int spectate_fds[MAX_SPECTATORS];
    uint16_t *spectate_input;
    size_t spectate_input_ptr;
    size_t spectate_input_size;
 
+   // Spectator broadcasting. The broadcaster owns the spectators and the ring.
+   // Fields marked shared are guarded by spectate_lock.
+   struct netplay_spectator *spectators;
+   unsigned max_spectators;
+   unsigned num_spectators;
+   unsigned num_waiting; // Spectators in SPECTATOR_HEADER.
+   uint8_t spectate_nick[33];
+   size_t spectate_nick_size;
+   uint8_t *spectate_ring;
+   uint64_t spectate_head;
+   uint8_t *spectate_pending; // Shared. Input of frames the broadcaster hasn't taken yet.
+   size_t spectate_pending_size;
+   size_t spectate_pending_cap;
+   uint8_t *spectate_back;
+   size_t spectate_back_cap;
+   struct spectate_header *spectate_header; // Shared. Goes before pending input at header_offset.
+   size_t spectate_header_offset;
+   bool spectate_header_wanted; // Shared.
+   char spectate_msg[512]; // Shared. For the OSD, which only the emulator thread may touch.
+   bool spectate_has_msg;
+#ifdef HAVE_EPOLL
+   int epoll_fd;
+#endif
+#ifdef NETPLAY_SPECTATE_THREAD
+   sthread_t *spectate_thread;
+   slock_t *spectate_lock;
+   int wake_fd;
+   bool spectate_quit; // Shared.
+#endif
+
    // Player flipping
    // Flipping state. If ptr >= flip_frame, we apply the flip.
    // If not, we apply the opposite, effectively creating a trigger point.
@@ -189,8 +372,9 @@ int16_t input_state_net(unsigned port, unsigned device, unsigned index, unsigned
 
 #ifndef HAVE_SOCKET_LEGACY
 // Custom inet_ntop. Win32 doesn't seem to support this ...
-static void log_connection(const struct sockaddr_storage *their_addr,
-      unsigned slot, const char *nick)
+// Leaves msg empty if the address can't be shown.
+static void describe_connection(const struct sockaddr_storage *their_addr,
+      unsigned slot, const char *nick, char *msg, size_t size)
 {
    union
    {
@@ -227,18 +411,25 @@ static void log_connection(const struct sockaddr_storage *their_addr,
             buf_v6, sizeof(buf_v6), NULL, 0, NI_NUMERICHOST);
    }
 
+   *msg = '\0';
    if (str)
+      snprintf(msg, size, "Got connection from: \"%s (%s)\" (#%u)", nick, str, slot);
+}
+
+static void log_connection(const struct sockaddr_storage *their_addr,
+      unsigned slot, const char *nick)
+{
+   char msg[512];
+   describe_connection(their_addr, slot, nick, msg, sizeof(msg));
+   if (*msg)
    {
-      char msg[512];
-      snprintf(msg, sizeof(msg), "Got connection from: \"%s (%s)\" (#%u)", nick, str, slot);
       msg_queue_push(g_extern.msg_queue, msg, 1, 180);
       RARCH_LOG("%s\n", msg);
    }
 }
 #endif
 
-static int init_tcp_connection(const struct addrinfo *res, bool server, bool spectate,
-      struct sockaddr *other_addr, socklen_t addr_size)
+static int init_tcp_connection(const struct addrinfo *res, bool server, bool spectate)
 {
    bool ret = true;
    int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
@@ -256,39 +447,18 @@ static int init_tcp_connection(const struct addrinfo *res, bool server, bool spe
          goto end;
       }
    }
-   else if (spectate)
-   {
-      int yes = 1;
-      setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, CONST_CAST &yes, sizeof(int));
-
-      if (bind(fd, res->ai_addr, res->ai_addrlen) < 0 ||
-            listen(fd, MAX_SPECTATORS) < 0)
-      {
-         ret = false;
-         goto end;
-      }
-   }
    else
    {
+      // Players are accepted in accept_players(), spectators as they come.
       int yes = 1;
       setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, CONST_CAST &yes, sizeof(int));
 
       if (bind(fd, res->ai_addr, res->ai_addrlen) < 0 ||
-            listen(fd, 1) < 0)
-      {
-         ret = false;
-         goto end;
-      }
-
-      int new_fd = accept(fd, other_addr, &addr_size);
-      if (new_fd < 0)
+            listen(fd, spectate ? g_settings.netplay_max_spectators : MAX_PLAYERS) < 0)
       {
          ret = false;
          goto end;
       }
-
-      close(fd);
-      fd = new_fd;
    }
 
 end:
@@ -330,8 +500,7 @@ static bool init_tcp_socket(netplay_t *handle, const char *server, uint16_t port
    while (tmp_info)
    {
       int fd;
-      if ((fd = init_tcp_connection(tmp_info, server, handle->spectate,
-               (struct sockaddr*)&handle->other_addr, sizeof(handle->other_addr))) >= 0)
+      if ((fd = init_tcp_connection(tmp_info, server, handle->spectate)) >= 0)
       {
          ret = true;
          handle->fd = fd;
@@ -469,9 +638,9 @@ static uint32_t implementation_magic_value(void)
    return res;
 }
 
-static bool send_nickname(netplay_t *handle, int fd)
+static bool send_nickname(int fd, const char *nick)
 {
-   uint8_t nick_size = strlen(handle->nick);
+   uint8_t nick_size = strlen(nick);
 
    if (!send_all(fd, &nick_size, sizeof(nick_size)))
    {
@@ -479,7 +648,7 @@ static bool send_nickname(netplay_t *handle, int fd)
       return false;
    }
 
-   if (!send_all(fd, handle->nick, nick_size))
+   if (!send_all(fd, nick, nick_size))
    {
       RARCH_ERR("Failed to send nick.\n");
       return false;
@@ -488,7 +657,8 @@ static bool send_nickname(netplay_t *handle, int fd)
    return true;
 }
 
-static bool get_nickname(netplay_t *handle, int fd)
+// nick must hold 32 bytes.
+static bool get_nickname(int fd, char *nick)
 {
    uint8_t nick_size;
 
@@ -498,67 +668,90 @@ static bool get_nickname(netplay_t *handle, int fd)
       return false;
    }
 
-   if (nick_size >= sizeof(handle->other_nick))
+   if (nick_size >= 32)
    {
       RARCH_ERR("Invalid nick size.\n");
       return false;
    }
 
-   if (!recv_all(fd, handle->other_nick, nick_size))
+   if (!recv_all(fd, nick, nick_size))
    {
       RARCH_ERR("Failed to receive nick.\n");
       return false;
    }
 
+   nick[nick_size] = '\0';
    return true;
 }
 
 static bool send_info(netplay_t *handle)
 {
+   int fd = handle->peers[0].fd;
    uint32_t header[3] = {
       htonl(g_extern.cart_crc),
       htonl(implementation_magic_value()),
       htonl(pretro_get_memory_size(RETRO_MEMORY_SAVE_RAM))
    };
 
-   if (!send_all(handle->fd, header, sizeof(header)))
+   if (!send_all(fd, header, sizeof(header)))
       return false;
 
-   if (!send_nickname(handle, handle->fd))
+   if (!send_nickname(fd, handle->nick))
    {
       RARCH_ERR("Failed to send nick to host.\n");
       return false;
    }
 
+   // Blocks until every player has joined.
+   uint32_t info[2];
+   if (!recv_all(fd, info, sizeof(info)))
+   {
+      RARCH_ERR("Failed to receive player info from host.\n");
+      return false;
+   }
+
+   handle->self_port = ntohl(info[0]);
+   handle->num_players = ntohl(info[1]);
+   if (handle->num_players > MAX_PLAYERS || handle->self_port == 0 ||
+         handle->self_port >= handle->num_players)
+   {
+      RARCH_ERR("Host sent invalid player info.\n");
+      return false;
+   }
+
    // Get SRAM data from Player 1.
    void *sram = pretro_get_memory_data(RETRO_MEMORY_SAVE_RAM);
    unsigned sram_size = pretro_get_memory_size(RETRO_MEMORY_SAVE_RAM);
 
-   if (!recv_all(handle->fd, sram, sram_size))
+   if (!recv_all(fd, sram, sram_size))
    {
       RARCH_ERR("Failed to receive SRAM data from host.\n");
       return false;
    }
 
-   if (!get_nickname(handle, handle->fd))
+   for (unsigned i = 0; i < handle->num_players; i++)
    {
-      RARCH_ERR("Failed to receive nick from host.\n");
-      return false;
+      if (!get_nickname(fd, handle->players[i].nick))
+      {
+         RARCH_ERR("Failed to receive nicks from host.\n");
+         return false;
+      }
    }
 
    char msg[512];
-   snprintf(msg, sizeof(msg), "Connected to: \"%s\"", handle->other_nick);
+   snprintf(msg, sizeof(msg), "Connected to: \"%s\" as player %u of %u",
+         handle->players[0].nick, handle->self_port + 1, handle->num_players);
    RARCH_LOG("%s\n", msg);
    msg_queue_push(g_extern.msg_queue, msg, 1, 180);
 
    return true;
 }
 
-static bool get_info(netplay_t *handle)
+static bool get_info(netplay_t *handle, struct netplay_peer *peer)
 {
    uint32_t header[3];
 
-   if (!recv_all(handle->fd, header, sizeof(header)))
+   if (!recv_all(peer->fd, header, sizeof(header)))
    {
       RARCH_ERR("Failed to receive header from client.\n");
       return false;
@@ -582,30 +775,85 @@ static bool get_info(netplay_t *handle)
       return false;
    }
 
-   if (!get_nickname(handle, handle->fd))
+   if (!get_nickname(peer->fd, handle->players[peer->port].nick))
    {
       RARCH_ERR("Failed to get nickname from client.\n");
       return false;
    }
 
-   // Send SRAM data to our Player 2.
+   return true;
+}
+
+static bool send_start(netplay_t *handle, struct netplay_peer *peer)
+{
+   uint32_t info[2] = {
+      htonl(peer->port),
+      htonl(handle->num_players)
+   };
+
+   if (!send_all(peer->fd, info, sizeof(info)))
+   {
+      RARCH_ERR("Failed to send player info to client.\n");
+      return false;
+   }
+
+   // Send SRAM data to the other players.
    const void *sram = pretro_get_memory_data(RETRO_MEMORY_SAVE_RAM);
    unsigned sram_size = pretro_get_memory_size(RETRO_MEMORY_SAVE_RAM);
-   if (!send_all(handle->fd, sram, sram_size))
+   if (!send_all(peer->fd, sram, sram_size))
    {
       RARCH_ERR("Failed to send SRAM data to client.\n");
       return false;
    }
 
-   if (!send_nickname(handle, handle->fd))
+   for (unsigned i = 0; i < handle->num_players; i++)
    {
-      RARCH_ERR("Failed to send nickname to client.\n");
-      return false;
+      if (!send_nickname(peer->fd, handle->players[i].nick))
+      {
+         RARCH_ERR("Failed to send nicks to client.\n");
+         return false;
+      }
    }
 
+   return true;
+}
+
+static bool accept_players(netplay_t *handle)
+{
+   for (unsigned i = 1; i < handle->num_players; i++)
+   {
+      struct netplay_peer *peer = &handle->peers[handle->num_peers];
+
+      struct sockaddr_storage their_addr;
+      socklen_t addr_size = sizeof(their_addr);
+      peer->fd = accept(handle->fd, (struct sockaddr*)&their_addr, &addr_size);
+      if (peer->fd < 0)
+      {
+         RARCH_ERR("Failed to accept incoming player.\n");
+         return false;
+      }
+
+      peer->port = i;
+      handle->num_peers++;
+
+      if (!get_info(handle, peer))
+         return false;
+
 #ifndef HAVE_SOCKET_LEGACY
-   log_connection(&handle->other_addr, 0, handle->other_nick);
+      log_connection(&their_addr, i, handle->players[i].nick);
 #endif
+   }
+
+   close(handle->fd);
+   handle->fd = -1;
+
+   // Nobody starts before everyone has joined,
+   // or the first players would time out waiting for input from the last.
+   for (unsigned i = 0; i < handle->num_peers; i++)
+   {
+      if (!send_start(handle, &handle->peers[i]))
+         return false;
+   }
 
    return true;
 }
@@ -673,13 +921,13 @@ static bool bsv_parse_header(const uint32_t *header, uint32_t magic)
 
 static bool get_info_spectate(netplay_t *handle)
 {
-   if (!send_nickname(handle, handle->fd))
+   if (!send_nickname(handle->fd, handle->nick))
    {
       RARCH_ERR("Failed to send nickname to host.\n");
       return false;
    }
 
-   if (!get_nickname(handle, handle->fd))
+   if (!get_nickname(handle->fd, handle->other_nick))
    {
       RARCH_ERR("Failed to receive nickname from host.\n");
       return false;
@@ -726,33 +974,220 @@ static bool get_info_spectate(netplay_t *handle)
    return ret;
 }
 
-static void init_buffers(netplay_t *handle)
+static bool init_buffers(netplay_t *handle)
 {
    handle->buffer = (struct delta_frame*)calloc(handle->buffer_size, sizeof(*handle->buffer));
+   if (!handle->buffer)
+      return false;
+
    handle->state_size = pretro_serialize_size();
-   for (unsigned i = 0; i < handle->buffer_size; i++)
+   handle->delta = g_settings.netplay_delta_snapshots;
+
+   if (handle->delta)
+   {
+      handle->state_words = (handle->state_size + 3) / 4;
+      handle->state = (uint32_t*)calloc(handle->state_words + 1, sizeof(uint32_t));
+      handle->tmp_state = (uint32_t*)calloc(handle->state_words + 1, sizeof(uint32_t));
+
+      // Starts out at a quarter of what whole snapshots would take. Grows if the game changes more than that.
+      size_t entries = next_pow2(handle->buffer_size * handle->state_words / 8);
+      if (entries < handle->state_words)
+         entries = next_pow2(handle->state_words);
+      handle->deltas = (uint64_t*)malloc(entries * sizeof(uint64_t));
+      handle->deltas_mask = entries - 1;
+
+      if (!handle->state || !handle->tmp_state || !handle->deltas)
+         return false;
+   }
+   else
+   {
+      handle->state_stride = (handle->state_size + 15) & ~15;
+      handle->states = (uint8_t*)malloc(handle->buffer_size * handle->state_stride + 1);
+      if (!handle->states)
+         return false;
+   }
+
+   // Frame 0 always has zero input, see get_self_input_state().
+   for (unsigned i = 0; i < handle->num_players; i++)
+      handle->players[i].read_frame_count = 1;
+
+   for (unsigned i = 0; i < handle->num_peers; i++)
+      for (unsigned j = 0; j < MAX_PLAYERS; j++)
+         handle->peers[i].ack[j] = 1;
+
+   handle->min_input_delay = g_settings.netplay_input_delay_min;
+   handle->max_input_delay = g_settings.netplay_input_delay_max;
+   if (handle->max_input_delay > UDP_FRAME_PACKETS)
+      handle->max_input_delay = UDP_FRAME_PACKETS;
+   if (handle->min_input_delay > handle->max_input_delay)
+      handle->min_input_delay = handle->max_input_delay;
+   handle->input_delay = handle->min_input_delay;
+   handle->min_delay_used = handle->max_delay_used = handle->input_delay;
+
+   float fps = g_extern.system.av_info.timing.fps;
+   handle->frame_usec = 1000000.0f / (fps > 0.0f ? fps : 60.0f);
+
+   handle->start_time = rarch_get_time_usec();
+   handle->last_input_time = handle->start_time;
+   return true;
+}
+
+static void free_buffers(netplay_t *handle)
+{
+   free(handle->buffer);
+   free(handle->states);
+   free(handle->state);
+   free(handle->tmp_state);
+   free(handle->deltas);
+}
+
+// First frame which doesn't have real input from everyone yet.
+static uint32_t oldest_frame(netplay_t *handle)
+{
+   uint32_t oldest = handle->frame_count + 1;
+   for (unsigned i = 0; i < handle->num_players; i++)
+      if (handle->players[i].read_frame_count < oldest)
+         oldest = handle->players[i].read_frame_count;
+   return oldest;
+}
+
+// Drops delta snapshots older than 'frame', which can't be rolled back to any more.
+static void snapshot_release(netplay_t *handle, uint32_t frame)
+{
+   while (handle->has_state && handle->first_state_frame < frame &&
+         handle->first_state_frame < handle->state_frame)
+   {
+      const struct delta_frame *ptr = &handle->buffer[FRAME_PTR(handle->first_state_frame)];
+      handle->deltas_tail = ptr->delta_ptr + ptr->delta_size;
+      handle->first_state_frame++;
+   }
+}
+
+static bool snapshot_grow(netplay_t *handle)
+{
+   size_t size = 2 * (handle->deltas_mask + 1);
+   uint64_t *deltas = (uint64_t*)malloc(size * sizeof(uint64_t));
+   if (!deltas)
+      return false;
+
+   // Positions are absolute, so deltas keep their place relative to the mask.
+   for (size_t i = handle->deltas_tail; i != handle->deltas_head; i++)
+      deltas[i & (size - 1)] = handle->deltas[i & handle->deltas_mask];
+
+   free(handle->deltas);
+   handle->deltas = deltas;
+   handle->deltas_mask = size - 1;
+   return true;
+}
+
+static void snapshot_save(netplay_t *handle, uint32_t frame)
+{
+   handle->serialize_bytes += handle->state_size;
+   handle->snapshots++;
+
+   if (!handle->delta)
+   {
+      pretro_serialize(handle->states + FRAME_PTR(frame) * handle->state_stride, handle->state_size);
+      return;
+   }
+
+   pretro_serialize(handle->tmp_state, handle->state_size);
+
+   // A rollback found while polling for this frame hasn't happened yet.
+   uint32_t keep = oldest_frame(handle);
+   if (handle->must_replay && handle->replay_frame_count < keep)
+      keep = handle->replay_frame_count;
+   snapshot_release(handle, keep);
+
+   // Older snapshots are only reachable if they lead up to this one.
+   bool chain = handle->has_state && handle->state_frame + 1 == frame;
+   while (chain && handle->deltas_mask + 1 - (handle->deltas_head - handle->deltas_tail) < handle->state_words)
+   {
+      if (!snapshot_grow(handle))
+      {
+         RARCH_ERR("Failed to grow netplay snapshot buffer. Dropping old snapshots.\n");
+         chain = false;
+      }
+   }
+
+   if (!chain)
+   {
+      handle->deltas_tail = handle->deltas_head;
+      handle->first_state_frame = frame;
+   }
+   else
+   {
+      struct delta_frame *ptr = &handle->buffer[FRAME_PTR(handle->state_frame)];
+      ptr->delta_ptr = handle->deltas_head;
+      for (size_t i = 0; i < handle->state_words; i++)
+      {
+         uint32_t xor_ = handle->state[i] ^ handle->tmp_state[i];
+         if (xor_)
+            handle->deltas[handle->deltas_head++ & handle->deltas_mask] = ((uint64_t)i << 32) | xor_;
+      }
+      ptr->delta_size = handle->deltas_head - ptr->delta_ptr;
+
+      handle->delta_bytes += ptr->delta_size * sizeof(uint64_t);
+      handle->delta_count++;
+   }
+
+   uint32_t *tmp = handle->state;
+   handle->state = handle->tmp_state;
+   handle->tmp_state = tmp;
+   handle->state_frame = frame;
+   handle->has_state = true;
+}
+
+// Newer snapshots are lost, replaying takes them again.
+static bool snapshot_load(netplay_t *handle, uint32_t frame)
+{
+   if (!handle->delta)
+      return pretro_unserialize(handle->states + FRAME_PTR(frame) * handle->state_stride, handle->state_size);
+
+   if (!handle->has_state || frame < handle->first_state_frame || frame > handle->state_frame)
+      return false;
+
+   while (handle->state_frame > frame)
    {
-      handle->buffer[i].state = malloc(handle->state_size);
-      handle->buffer[i].is_simulated = true;
+      const struct delta_frame *ptr = &handle->buffer[FRAME_PTR(--handle->state_frame)];
+      for (size_t i = 0; i < ptr->delta_size; i++)
+      {
+         uint64_t delta = handle->deltas[(ptr->delta_ptr + i) & handle->deltas_mask];
+         handle->state[delta >> 32] ^= (uint32_t)delta;
+      }
+      handle->deltas_head = ptr->delta_ptr;
    }
+
+   return pretro_unserialize(handle->state, handle->state_size);
 }
 
 netplay_t *netplay_new(const char *server, uint16_t port,
-      unsigned frames, const struct retro_callbacks *cb,
+      unsigned frames, unsigned players,
+      const struct retro_callbacks *cb,
       bool spectate,
       const char *nick)
 {
    if (frames > UDP_FRAME_PACKETS)
       frames = UDP_FRAME_PACKETS;
 
+   if (players < 2)
+      players = 2;
+   if (players > MAX_PLAYERS)
+      players = MAX_PLAYERS;
+
    netplay_t *handle = (netplay_t*)calloc(1, sizeof(*handle));
    if (!handle)
       return NULL;
 
    handle->fd = -1;
    handle->udp_fd = -1;
+#ifdef HAVE_EPOLL
+   handle->epoll_fd = -1;
+#endif
+#ifdef NETPLAY_SPECTATE_THREAD
+   handle->wake_fd = -1;
+#endif
    handle->cbs = *cb;
-   handle->port = server ? 0 : 1;
    handle->spectate = spectate;
    handle->spectate_client = server != NULL;
    strlcpy(handle->nick, nick, sizeof(handle->nick));
@@ -770,37 +1205,56 @@ netplay_t *netplay_new(const char *server, uint16_t port,
          if (!get_info_spectate(handle))
             goto error;
       }
-
-      for (unsigned i = 0; i < MAX_SPECTATORS; i++)
-         handle->spectate_fds[i] = -1;
+      else if (!spectate_init(handle))
+         goto error;
    }
    else
    {
+      for (unsigned i = 0; i < MAX_PLAYERS - 1; i++)
+         handle->peers[i].fd = -1;
+
       if (server)
       {
+         handle->peers[0].fd = handle->fd;
+         handle->peers[0].port = 0;
+         handle->num_peers = 1;
+         handle->fd = -1;
+
          if (!send_info(handle))
             goto error;
       }
       else
       {
-         if (!get_info(handle))
+         handle->self_port = 0;
+         handle->num_players = players;
+         strlcpy(handle->players[0].nick, nick, sizeof(handle->players[0].nick));
+
+         if (!accept_players(handle))
             goto error;
       }
 
       handle->buffer_size = frames + 1;
 
-      init_buffers(handle);
+      if (!init_buffers(handle))
+         goto error;
       handle->has_connection = true;
    }
 
    return handle;
 
 error:
+   if (handle->spectate)
+      spectate_deinit(handle);
    if (handle->fd >= 0)
       close(handle->fd);
    if (handle->udp_fd >= 0)
       close(handle->udp_fd);
+   for (unsigned i = 0; i < handle->num_peers; i++)
+      close(handle->peers[i].fd);
+   if (handle->addr)
+      freeaddrinfo(handle->addr);
 
+   free_buffers(handle);
    free(handle);
    return NULL;
 }
@@ -811,19 +1265,95 @@ static bool netplay_is_alive(netplay_t *handle)
    return handle->has_connection;
 }
 
-static bool send_chunk(netplay_t *handle)
+static uint8_t *write_u32(uint8_t *out, uint32_t val)
+{
+   val = htonl(val);
+   memcpy(out, &val, sizeof(val));
+   return out + sizeof(val);
+}
+
+static uint8_t *write_u16(uint8_t *out, uint16_t val)
+{
+   val = htons(val);
+   memcpy(out, &val, sizeof(val));
+   return out + sizeof(val);
+}
+
+static uint32_t read_u32(const uint8_t *in)
+{
+   uint32_t val;
+   memcpy(&val, in, sizeof(val));
+   return ntohl(val);
+}
+
+static uint16_t read_u16(const uint8_t *in)
+{
+   uint16_t val;
+   memcpy(&val, in, sizeof(val));
+   return ntohs(val);
+}
+
+// The host sends everyone's input but the peer's own. Clients only send their own.
+static size_t pack_input(netplay_t *handle, const struct netplay_peer *peer, uint8_t *packet)
+{
+   rarch_time_t now = rarch_get_time_usec();
+   uint8_t *out = write_u32(packet, handle->self_port);
+   out = write_u32(out, handle->frame_count);
+   out = write_u32(out, (uint32_t)now);
+   out = write_u32(out, peer->echo_time);
+   out = write_u32(out, peer->has_echo ? (uint32_t)(now - peer->echo_recv) : NETPLAY_NO_ECHO);
+   for (unsigned i = 0; i < MAX_PLAYERS; i++)
+      out = write_u32(out, handle->players[i].read_frame_count);
+
+   uint8_t *mask_ptr = out;
+   uint32_t mask = 0;
+   out += sizeof(uint32_t);
+
+   for (unsigned i = 0; i < handle->num_players; i++)
+   {
+      if (i == peer->port || (handle->self_port != 0 && i != handle->self_port))
+         continue;
+
+      const struct netplay_player *player = &handle->players[i];
+      uint32_t frame = peer->ack[i];
+      uint32_t count = player->read_frame_count - frame;
+      if (frame >= player->read_frame_count)
+         continue;
+      if (count > UDP_FRAME_PACKETS)
+         count = UDP_FRAME_PACKETS;
+
+      mask |= 1 << i;
+      out = write_u32(out, frame);
+      out = write_u32(out, count);
+      for (uint32_t j = 0; j < count; j++)
+         out = write_u16(out, player->input[(frame + j) % NETPLAY_INPUT_FRAMES]);
+   }
+
+   write_u32(mask_ptr, mask);
+   return out - packet;
+}
+
+static bool send_chunk(netplay_t *handle, const struct netplay_peer *peer)
 {
    const struct sockaddr *addr = NULL;
+   socklen_t addr_size = 0;
    if (handle->addr)
+   {
       addr = handle->addr->ai_addr;
-   else if (handle->has_client_addr)
-      addr = (const struct sockaddr*)&handle->their_addr;
+      addr_size = handle->addr->ai_addrlen;
+   }
+   else if (peer->has_addr)
+   {
+      addr = (const struct sockaddr*)&peer->addr;
+      addr_size = peer->addr_size;
+   }
 
    if (addr)
    {
-      if (sendto(handle->udp_fd, CONST_CAST handle->packet_buffer,
-               sizeof(handle->packet_buffer), 0, addr,
-               sizeof(struct sockaddr)) != sizeof(handle->packet_buffer))
+      uint8_t packet[NETPLAY_PACKET_SIZE];
+      size_t size = pack_input(handle, peer, packet);
+
+      if (sendto(handle->udp_fd, CONST_CAST packet, size, 0, addr, addr_size) != (ssize_t)size)
       {
          warn_hangup();
          handle->has_connection = false;
@@ -833,21 +1363,46 @@ static bool send_chunk(netplay_t *handle)
    return true;
 }
 
-#define MAX_RETRIES 16
-#define RETRY_MS 500
+static bool send_chunks(netplay_t *handle)
+{
+   for (unsigned i = 0; i < handle->num_peers; i++)
+   {
+      if (!send_chunk(handle, &handle->peers[i]))
+         return false;
+   }
+   return true;
+}
+
+// Resend after what TCP would consider a lost packet, rather than waiting out a fixed timeout.
+static rarch_time_t retry_timeout(netplay_t *handle)
+{
+   rarch_time_t timeout = NETPLAY_MIN_RETRY;
+   for (unsigned i = 0; i < handle->num_peers; i++)
+   {
+      const struct netplay_peer *peer = &handle->peers[i];
+      rarch_time_t rto = peer->has_rtt ? (rarch_time_t)(peer->rtt + 4.0f * peer->rtt_var) : NETPLAY_MAX_RETRY;
+      if (rto > timeout)
+         timeout = rto;
+   }
+
+   return timeout > NETPLAY_MAX_RETRY ? NETPLAY_MAX_RETRY : timeout;
+}
 
 static int poll_input(netplay_t *handle, bool block)
 {
-   int max_fd = (handle->fd > handle->udp_fd ? handle->fd : handle->udp_fd) + 1;
+   int max_fd = handle->udp_fd;
+   for (unsigned i = 0; i < handle->num_peers; i++)
+      if (handle->peers[i].fd > max_fd)
+         max_fd = handle->peers[i].fd;
+   max_fd++;
 
+   rarch_time_t timeout = block ? retry_timeout(handle) : 0;
    struct timeval tv = {0};
-   tv.tv_sec = 0;
-   tv.tv_usec = block ? (RETRY_MS * 1000) : 0;
+   tv.tv_sec = timeout / 1000000;
+   tv.tv_usec = timeout % 1000000;
 
    do
-   { 
-      handle->timeout_cnt++;
-
+   {
       // select() does not take pointer to const struct timeval.
       // Technically possible for select() to modify tmp_tv, so we go paranoia mode.
       struct timeval tmp_tv = tv;
@@ -855,111 +1410,236 @@ static int poll_input(netplay_t *handle, bool block)
       fd_set fds;
       FD_ZERO(&fds);
       FD_SET(handle->udp_fd, &fds);
-      FD_SET(handle->fd, &fds);
+      for (unsigned i = 0; i < handle->num_peers; i++)
+         FD_SET(handle->peers[i].fd, &fds);
 
       if (select(max_fd, &fds, NULL, NULL, &tmp_tv) < 0)
          return -1;
 
       // Somewhat hacky,
       // but we aren't using the TCP connection for anything useful atm.
-      if (FD_ISSET(handle->fd, &fds) && !netplay_get_cmd(handle))
-         return -1; 
+      for (unsigned i = 0; i < handle->num_peers; i++)
+      {
+         if (FD_ISSET(handle->peers[i].fd, &fds) && !netplay_get_cmd(handle, &handle->peers[i]))
+            return -1;
+      }
 
       if (FD_ISSET(handle->udp_fd, &fds))
          return 1;
 
-      if (block && !send_chunk(handle))
+      if (!block)
+         return 0;
+
+      if (!send_chunks(handle))
       {
          warn_hangup();
          handle->has_connection = false;
          return -1;
       }
 
-      if (block)
+      rarch_time_t now = rarch_get_time_usec();
+      if (now - handle->last_input_time >= NETPLAY_TIMEOUT)
+         return -1;
+
+      if (now - handle->last_stall_log >= 1000000)
       {
-         RARCH_LOG("Network is stalling, resending packet... Count %u of %d ...\n",
-               handle->timeout_cnt, MAX_RETRIES);
+         RARCH_LOG("Network is stalling, resending packet... Waited %u ms of %u ms ...\n",
+               (unsigned)((now - handle->last_input_time) / 1000), NETPLAY_TIMEOUT / 1000);
+         handle->last_stall_log = now;
       }
-   } while ((handle->timeout_cnt < MAX_RETRIES) && block);
-
-   if (block)
-      return -1;
-   return 0;
+   } while (true);
 }
 
 // Grab our own input state and send this over the network.
 static bool get_self_input_state(netplay_t *handle)
 {
-   struct delta_frame *ptr = &handle->buffer[handle->self_ptr];
-
-   uint32_t state = 0;
+   uint16_t state = 0;
    if (handle->frame_count > 0) // First frame we always give zero input since relying on input from first frame screws up when we use -F 0.
    {
       retro_input_state_t cb = handle->cbs.state_cb;
-      for (unsigned i = 0; i < RARCH_FIRST_META_KEY; i++)
+      for (unsigned i = 0; i < NETPLAY_INPUT_BITS; i++)
       {
-         int16_t tmp = cb(g_settings.input.netplay_client_swap_input ? 0 : !handle->port,
+         int16_t tmp = cb(g_settings.input.netplay_client_swap_input ? 0 : handle->self_port,
                RETRO_DEVICE_JOYPAD, 0, i);
          state |= tmp ? 1 << i : 0;
       }
    }
 
-   memmove(handle->packet_buffer, handle->packet_buffer + 2,
-         sizeof (handle->packet_buffer) - 2 * sizeof(uint32_t));
-   handle->packet_buffer[(UDP_FRAME_PACKETS - 1) * 2] = htonl(handle->frame_count); 
-   handle->packet_buffer[(UDP_FRAME_PACKETS - 1) * 2 + 1] = htonl(state);
+   // If the input delay just went up, the frames in between get this input too.
+   // If it went down, the frame is already covered and this input is dropped.
+   struct netplay_player *player = &handle->players[handle->self_port];
+   uint32_t frame = handle->frame_count + handle->input_delay;
+   while (player->read_frame_count <= frame)
+      player->input[player->read_frame_count++ % NETPLAY_INPUT_FRAMES] = state;
+
+   return send_chunks(handle);
+}
 
-   if (!send_chunk(handle))
+// Real input for players we haven't heard from yet is predicted to be the last we got.
+// TODO: Somewhat better prediction. :P
+static void fill_input(netplay_t *handle, uint32_t frame)
+{
+   struct delta_frame *ptr = &handle->buffer[FRAME_PTR(frame)];
+   for (unsigned i = 0; i < handle->num_players; i++)
    {
-      warn_hangup();
-      handle->has_connection = false;
-      return false;
+      const struct netplay_player *player = &handle->players[i];
+      uint32_t real = frame < player->read_frame_count ? frame : player->read_frame_count - 1;
+      ptr->input[i] = player->input[real % NETPLAY_INPUT_FRAMES];
    }
-
-   ptr->self_state = state;
-   handle->self_ptr = NEXT_PTR(handle->self_ptr);
-   return true;
 }
 
-// TODO: Somewhat better prediction. :P
-static void simulate_input(netplay_t *handle)
+static void add_input(netplay_t *handle, unsigned port, uint16_t input)
 {
-   size_t ptr = PREV_PTR(handle->self_ptr);
-   size_t prev = PREV_PTR(handle->read_ptr);
+   struct netplay_player *player = &handle->players[port];
+   uint32_t frame = player->read_frame_count++;
+   player->input[frame % NETPLAY_INPUT_FRAMES] = input;
+   handle->last_input_time = rarch_get_time_usec();
 
-   handle->buffer[ptr].simulated_input_state = handle->buffer[prev].real_input_state;
-   handle->buffer[ptr].is_simulated = true;
-   handle->buffer[ptr].used_real = false;
+   // The frame ran with a bad prediction. Everything from it has to run again.
+   if (frame < handle->frame_count &&
+         handle->buffer[FRAME_PTR(frame)].input[port] != input &&
+         (!handle->must_replay || frame < handle->replay_frame_count))
+   {
+      handle->must_replay = true;
+      handle->replay_frame_count = frame;
+   }
 }
 
-static void parse_packet(netplay_t *handle, uint32_t *buffer, unsigned size)
+// Round trip time is measured like NTP does. Every packet echoes the newest send time heard
+// from the receiver, and how long ago that was, so the receiver can take the hold time out.
+// The peer's frame count, pushed forward by half a round trip, tells how far ahead of it we run.
+static void update_timing(netplay_t *handle, struct netplay_peer *peer,
+      uint32_t remote_frame, uint32_t time, uint32_t echo_time, uint32_t echo_hold)
 {
-   for (unsigned i = 0; i < size * 2; i++)
-      buffer[i] = ntohl(buffer[i]);
+   rarch_time_t now = rarch_get_time_usec();
+   peer->has_echo = true;
+   peer->echo_time = time;
+   peer->echo_recv = now;
 
-   for (unsigned i = 0; i < size && handle->read_frame_count <= handle->frame_count; i++)
+   if (echo_hold != NETPLAY_NO_ECHO)
    {
-      uint32_t frame = buffer[2 * i + 0];
-      uint32_t state = buffer[2 * i + 1];
-
-      if (frame == handle->read_frame_count)
+      uint32_t rtt = (uint32_t)now - echo_time - echo_hold;
+      if (rtt < NETPLAY_TIMEOUT)
       {
-         handle->buffer[handle->read_ptr].is_simulated = false;
-         handle->buffer[handle->read_ptr].real_input_state = state;
-         handle->read_ptr = NEXT_PTR(handle->read_ptr);
-         handle->read_frame_count++;
-         handle->timeout_cnt = 0;
+         // Same smoothing as TCP.
+         if (!peer->has_rtt)
+         {
+            peer->rtt = rtt;
+            peer->rtt_var = rtt / 2.0f;
+            peer->has_rtt = true;
+         }
+         else
+         {
+            float err = rtt - peer->rtt;
+            peer->rtt += err / 8.0f;
+            peer->rtt_var += ((err < 0.0f ? -err : err) - peer->rtt_var) / 4.0f;
+         }
       }
    }
+
+   // Reordered packets would make the peer look further behind than it is.
+   if ((int32_t)(remote_frame - peer->remote_frame) < 0)
+      return;
+   peer->remote_frame = remote_frame;
+
+   float remote_now = remote_frame + (peer->has_rtt ? peer->rtt / 2.0f / handle->frame_usec : 0.0f);
+   peer->advantage += ((float)handle->frame_count - remote_now - peer->advantage) / 8.0f;
 }
 
-static bool receive_data(netplay_t *handle, uint32_t *buffer, size_t size)
+// Returns true if the packet had input we didn't have yet.
+static bool parse_packet(netplay_t *handle, const uint8_t *packet, size_t size,
+      const struct sockaddr_storage *addr, socklen_t addr_size)
 {
-   socklen_t addrlen = sizeof(handle->their_addr);
-   if (recvfrom(handle->udp_fd, NONCONST_CAST buffer, size, 0, (struct sockaddr*)&handle->their_addr, &addrlen) != (ssize_t)size)
+   const uint8_t *end = packet + size;
+   if (size < NETPLAY_PACKET_HEADER_SIZE)
       return false;
-   handle->has_client_addr = true;
-   return true;
+
+   unsigned port = read_u32(packet);
+   struct netplay_peer *peer = NULL;
+   for (unsigned i = 0; i < handle->num_peers; i++)
+   {
+      if (handle->peers[i].port == port)
+      {
+         peer = &handle->peers[i];
+         break;
+      }
+   }
+   if (!peer)
+      return false;
+
+   // The host finds out where to send to the first time it hears from a client.
+   // It's latched, so a forged packet can't redirect the client's stream later on.
+   if (handle->self_port == 0 && !peer->has_addr)
+   {
+      memcpy(&peer->addr, addr, addr_size);
+      peer->addr_size = addr_size;
+      peer->has_addr = true;
+   }
+
+   update_timing(handle, peer, read_u32(packet + 4), read_u32(packet + 8),
+         read_u32(packet + 12), read_u32(packet + 16));
+
+   const uint8_t *in = packet + 20;
+   for (unsigned i = 0; i < MAX_PLAYERS; i++, in += 4)
+   {
+      uint32_t ack = read_u32(in);
+      if (ack > peer->ack[i] && ack <= handle->players[i].read_frame_count)
+         peer->ack[i] = ack;
+   }
+
+   uint32_t mask = read_u32(in);
+   in += 4;
+
+   bool new_input = false;
+   for (unsigned i = 0; i < handle->num_players; i++)
+   {
+      if (!(mask & (1 << i)))
+         continue;
+
+      if (end - in < 8)
+         return new_input;
+      uint32_t frame = read_u32(in);
+      uint32_t count = read_u32(in + 4);
+      in += 8;
+      if (count > UDP_FRAME_PACKETS || (size_t)(end - in) < 2 * count)
+         return new_input;
+
+      // Clients may only speak for themselves.
+      bool accept = i != handle->self_port && (handle->self_port != 0 || i == port);
+      for (uint32_t j = 0; j < count; j++, in += 2)
+      {
+         if (accept && frame + j == handle->players[i].read_frame_count)
+         {
+            add_input(handle, i, read_u16(in));
+            new_input = true;
+         }
+      }
+   }
+
+   return new_input;
+}
+
+static bool receive_data(netplay_t *handle, bool *new_input)
+{
+   uint8_t packet[NETPLAY_PACKET_SIZE];
+   struct sockaddr_storage their_addr;
+   socklen_t addr_size = sizeof(their_addr);
+
+   ssize_t ret = recvfrom(handle->udp_fd, NONCONST_CAST packet, sizeof(packet), 0,
+         (struct sockaddr*)&their_addr, &addr_size);
+   if (ret < 0)
+      return false;
+
+   if (parse_packet(handle, packet, ret, &their_addr, addr_size))
+      *new_input = true;
+   return true;
+}
+
+// Everyone needs to be within buffer_size frames of the oldest frame we lack real input for,
+// or we'd overwrite the snapshot we need to replay from.
+static bool must_block(netplay_t *handle)
+{
+   return oldest_frame(handle) + handle->buffer_size <= handle->frame_count + 1;
 }
 
 // Poll network to see if we have anything new. If our network buffer is full, we simply have to block for new input data.
@@ -973,101 +1653,101 @@ static bool netplay_poll(netplay_t *handle)
    if (!get_self_input_state(handle))
       return false;
 
-   // We skip reading the first frame so the host has a chance to grab our host info so we don't block forever :')
-   if (handle->frame_count == 0)
+   // The host relays input between clients. Batch it up, rather than sending on every packet.
+   bool relay = false;
+   rarch_time_t stall_start = 0;
+   for (;;)
    {
-      handle->buffer[0].used_real = true;
-      handle->buffer[0].is_simulated = false;
-      handle->buffer[0].real_input_state = 0;
-      handle->read_ptr = NEXT_PTR(handle->read_ptr);
-      handle->read_frame_count++;
-      return true;
-   }
+      bool block = must_block(handle);
+      if (block && relay)
+      {
+         if (!send_chunks(handle))
+            return false;
+         relay = false;
+      }
 
-   // We might have reached the end of the buffer, where we simply have to block.
-   int res = poll_input(handle, handle->other_ptr == handle->self_ptr);
-   if (res == -1)
-   {
-      handle->has_connection = false;
-      warn_hangup();
-      return false;
-   }
+      if (block && !stall_start)
+      {
+         stall_start = rarch_get_time_usec();
+         handle->stalls++;
+      }
 
-   if (res == 1)
-   {
-      uint32_t first_read = handle->read_frame_count;
-      do 
+      int res = poll_input(handle, block);
+      if (res == -1)
       {
-         uint32_t buffer[UDP_FRAME_PACKETS * 2];
-         if (!receive_data(handle, buffer, sizeof(buffer)))
-         {
-            warn_hangup();
-            handle->has_connection = false;
-            return false;
-         }
-         parse_packet(handle, buffer, UDP_FRAME_PACKETS);
+         handle->has_connection = false;
+         warn_hangup();
+         return false;
+      }
 
-      } while ((handle->read_frame_count <= handle->frame_count) && 
-            poll_input(handle, (handle->other_ptr == handle->self_ptr) && 
-               (first_read == handle->read_frame_count)) == 1);
-   }
-   else
-   {
-      // Cannot allow this. Should not happen though.
-      if (handle->self_ptr == handle->other_ptr)
+      if (res == 0)
+         break;
+
+      bool new_input = false;
+      if (!receive_data(handle, &new_input))
       {
          warn_hangup();
+         handle->has_connection = false;
          return false;
       }
+
+      relay |= new_input && handle->self_port == 0;
    }
 
-   if (handle->read_ptr != handle->self_ptr)
-      simulate_input(handle);
-   else
-      handle->buffer[PREV_PTR(handle->self_ptr)].used_real = true;
+   if (stall_start)
+      handle->stall_time += rarch_get_time_usec() - stall_start;
 
+   if (relay && !send_chunks(handle))
+      return false;
+
+   fill_input(handle, handle->frame_count);
    return true;
 }
 
-static bool netplay_send_cmd(netplay_t *handle, uint32_t cmd, const void *data, size_t size)
+static bool netplay_send_cmd(netplay_t *handle, struct netplay_peer *peer,
+      uint32_t cmd, const void *data, size_t size)
 {
+   (void)handle;
    cmd = (cmd << 16) | (size & 0xffff);
    cmd = htonl(cmd);
 
-   if (!send_all(handle->fd, &cmd, sizeof(cmd)))
+   if (!send_all(peer->fd, &cmd, sizeof(cmd)))
       return false;
 
-   if (!send_all(handle->fd, data, size))
+   if (!send_all(peer->fd, data, size))
       return false;
 
    return true;
 }
 
-static bool netplay_cmd_ack(netplay_t *handle)
+static bool netplay_cmd_ack(netplay_t *handle, struct netplay_peer *peer)
 {
+   (void)handle;
    uint32_t cmd = htonl(NETPLAY_CMD_ACK);
-   return send_all(handle->fd, &cmd, sizeof(cmd));
+   return send_all(peer->fd, &cmd, sizeof(cmd));
 }
 
-static bool netplay_cmd_nak(netplay_t *handle)
+static bool netplay_cmd_nak(netplay_t *handle, struct netplay_peer *peer)
 {
+   (void)handle;
    uint32_t cmd = htonl(NETPLAY_CMD_NAK);
-   return send_all(handle->fd, &cmd, sizeof(cmd));
+   return send_all(peer->fd, &cmd, sizeof(cmd));
 }
 
-static bool netplay_get_response(netplay_t *handle)
+static bool netplay_get_response(netplay_t *handle, struct netplay_peer *peer)
 {
+   (void)handle;
    uint32_t response;
-   if (!recv_all(handle->fd, &response, sizeof(response)))
+   if (!recv_all(peer->fd, &response, sizeof(response)))
       return false;
 
    return ntohl(response) == NETPLAY_CMD_ACK;
 }
 
-static bool netplay_get_cmd(netplay_t *handle)
+static bool netplay_get_cmd(netplay_t *handle, struct netplay_peer *peer)
 {
    uint32_t cmd;
-   if (!recv_all(handle->fd, &cmd, sizeof(cmd)))
+   if (!recv_all(peer->fd, &cmd, sizeof(cmd)))
       return false;
 
    cmd = ntohl(cmd);
@@ -1082,21 +1762,21 @@ static bool netplay_get_cmd(netplay_t *handle)
          if (cmd_size != sizeof(uint32_t))
          {
             RARCH_ERR("CMD_FLIP_PLAYERS has unexpected command size.\n");
-            return netplay_cmd_nak(handle);
+            return netplay_cmd_nak(handle, peer);
          }
 
          uint32_t flip_frame;
-         if (!recv_all(handle->fd, &flip_frame, sizeof(flip_frame)))
+         if (!recv_all(peer->fd, &flip_frame, sizeof(flip_frame)))
          {
             RARCH_ERR("Failed to receive CMD_FLIP_PLAYERS argument.\n");
-            return netplay_cmd_nak(handle);
+            return netplay_cmd_nak(handle, peer);
          }
 
          flip_frame = ntohl(flip_frame);
          if (flip_frame < handle->flip_frame)
          {
             RARCH_ERR("Host asked us to flip players in the past. Not possible ...\n");
-            return netplay_cmd_nak(handle);
+            return netplay_cmd_nak(handle, peer);
          }
 
          handle->flip ^= true;
@@ -1105,12 +1785,12 @@ static bool netplay_get_cmd(netplay_t *handle)
          RARCH_LOG("Netplay players are flipped.\n");
          msg_queue_push(g_extern.msg_queue, "Netplay players are flipped.", 1, 180);
 
-         return netplay_cmd_ack(handle);
+         return netplay_cmd_ack(handle, peer);
       }
 
       default:
          RARCH_ERR("Unknown netplay command received.\n");
-         return netplay_cmd_nak(handle);
+         return netplay_cmd_nak(handle, peer);
    }
 }
 
@@ -1126,35 +1806,36 @@ void netplay_flip_players(netplay_t *handle)
       goto error;
    }
 
-   if (handle->port == 0)
+   if (handle->self_port != 0)
    {
       msg = "Cannot flip players if you're not the host.";
       goto error;
    }
 
-   // Make sure both clients are definitely synced up.
+   // Make sure all clients are definitely synced up.
    if (handle->frame_count < (handle->flip_frame + 2 * UDP_FRAME_PACKETS))
    {
       msg = "Cannot flip players yet. Wait a second or two before attempting flip.";
       goto error;
    }
 
-   if (netplay_send_cmd(handle, NETPLAY_CMD_FLIP_PLAYERS, &flip_frame_net, sizeof(flip_frame_net))
-         && netplay_get_response(handle))
+   for (unsigned i = 0; i < handle->num_peers; i++)
    {
-      RARCH_LOG("Netplay players are flipped.\n");
-      msg_queue_push(g_extern.msg_queue, "Netplay players are flipped.", 1, 180);
-
-      // Queue up a flip well enough in the future.
-      handle->flip ^= true;
-      handle->flip_frame = flip_frame;
-   }
-   else
-   {
-      msg = "Failed to flip players.";
-      goto error;
+      if (!netplay_send_cmd(handle, &handle->peers[i], NETPLAY_CMD_FLIP_PLAYERS,
+               &flip_frame_net, sizeof(flip_frame_net)) ||
+            !netplay_get_response(handle, &handle->peers[i]))
+      {
+         msg = "Failed to flip players.";
+         goto error;
+      }
    }
 
+   RARCH_LOG("Netplay players are flipped.\n");
+   msg_queue_push(g_extern.msg_queue, "Netplay players are flipped.", 1, 180);
+
+   // Queue up a flip well enough in the future.
+   handle->flip ^= true;
+   handle->flip_frame = flip_frame;
    return;
 
 error:
@@ -1162,56 +1843,72 @@ error:
    msg_queue_push(g_extern.msg_queue, msg, 1, 180);
 }
 
-static bool netplay_flip_port(netplay_t *handle, bool port)
+// Flipping swaps players 1 and 2.
+static unsigned netplay_flip_port(netplay_t *handle, unsigned port, uint32_t frame)
 {
-   if (handle->flip_frame == 0)
+   if (handle->flip_frame == 0 || port > 1)
       return port;
 
-   size_t frame = handle->is_replay ? handle->tmp_frame_count : handle->frame_count;
-
    return port ^ handle->flip ^ (frame < handle->flip_frame);
 }
 
-int16_t netplay_input_state(netplay_t *handle, bool port, unsigned device, unsigned index, unsigned id)
+int16_t netplay_input_state(netplay_t *handle, unsigned port, unsigned device, unsigned index, unsigned id)
 {
-   uint16_t input_state = 0;
-   size_t ptr = handle->is_replay ? handle->tmp_ptr : PREV_PTR(handle->self_ptr);
+   if (port >= handle->num_players || id >= NETPLAY_INPUT_BITS)
+      return 0;
 
-   port = netplay_flip_port(handle, port);
-
-   if ((port ? 1 : 0) == handle->port)
-   {
-      if (handle->buffer[ptr].is_simulated)
-         input_state = handle->buffer[ptr].simulated_input_state;
-      else
-         input_state = handle->buffer[ptr].real_input_state;
-   }
-   else
-      input_state = handle->buffer[ptr].self_state;
+   uint32_t frame = handle->is_replay ? handle->tmp_frame_count : handle->frame_count;
+   uint16_t input_state = handle->buffer[FRAME_PTR(frame)].input[netplay_flip_port(handle, port, frame)];
 
    return ((1 << id) & input_state) ? 1 : 0;
 }
 
 void netplay_free(netplay_t *handle)
 {
-   close(handle->fd);
-
+   // Stops the broadcaster before the listening socket goes away under it.
    if (handle->spectate)
-   {
-      for (unsigned i = 0; i < MAX_SPECTATORS; i++)
-         if (handle->spectate_fds[i] >= 0)
-            close(handle->spectate_fds[i]);
+      spectate_deinit(handle);
 
+   if (handle->fd >= 0)
+      close(handle->fd);
+
+   if (handle->spectate)
       free(handle->spectate_input);
-   }
    else
    {
       close(handle->udp_fd);
 
-      for (unsigned i = 0; i < handle->buffer_size; i++)
-         free(handle->buffer[i].state);
+      for (unsigned i = 0; i < handle->num_peers; i++)
+         close(handle->peers[i].fd);
 
-      free(handle->buffer);
+      if (handle->frame_count)
+      {
+         double secs = (rarch_get_time_usec() - handle->start_time) / 1000000.0;
+         RARCH_LOG("Netplay: %u frames, %u snapshots, %.2f MB/s serialized. %u rollbacks, %.1f frames deep on average, %u at most.\n",
+               (unsigned)handle->frame_count, handle->snapshots,
+               secs > 0.0 ? handle->serialize_bytes / secs / 1000000.0 : 0.0,
+               handle->rollbacks, handle->rollbacks ? (double)handle->rollback_frames / handle->rollbacks : 0.0,
+               handle->max_rollback);
+
+         RARCH_LOG("Netplay: Stalled %u times, %.2f s in total. Waited %u frames for peers to catch up. Input delay was %u to %u frames.\n",
+               handle->stalls, handle->stall_time / 1000000.0, handle->pace_waits,
+               handle->min_delay_used, handle->max_delay_used);
+
+         for (unsigned i = 0; i < handle->num_peers; i++)
+         {
+            const struct netplay_peer *peer = &handle->peers[i];
+            if (peer->has_rtt)
+               RARCH_LOG("Netplay: Round trip to player %u (%s) is %.1f ms, %.1f ms jitter.\n",
+                     peer->port + 1, handle->players[peer->port].nick,
+                     peer->rtt / 1000.0f, peer->rtt_var / 1000.0f);
+         }
+
+         if (handle->delta && handle->delta_count)
+            RARCH_LOG("Netplay: Snapshot deltas are %u bytes on average, full state is %u bytes.\n",
+                  (unsigned)(handle->delta_bytes / handle->delta_count), (unsigned)handle->state_size);
+      }
+
+      free_buffers(handle);
    }
 
    if (handle->addr)
@@ -1225,12 +1922,99 @@ static bool netplay_should_skip(netplay_t *handle)
    return handle->is_replay && handle->has_connection;
 }
 
+// We can't run faster than the display or audio lets us, so whoever is ahead waits for the others.
+// Waits are whole frames. Anything shorter is absorbed by vsync or audio sync and never slows us down.
+static void netplay_pace(netplay_t *handle)
+{
+   float advantage = 0.0f;
+   for (unsigned i = 0; i < handle->num_peers; i++)
+      if (handle->peers[i].advantage > advantage)
+         advantage = handle->peers[i].advantage;
+
+   // Jitter alone moves the estimate around by a fraction of a frame.
+   if (advantage < 1.0f)
+   {
+      handle->pace_debt = 0.0f;
+      return;
+   }
+
+   handle->pace_debt += (advantage - 0.5f) * NETPLAY_PACE_RATE;
+   if (handle->pace_debt >= 1.0f)
+   {
+      rarch_sleep((unsigned)(handle->frame_usec / 1000.0f + 0.5f));
+      handle->pace_debt -= 1.0f;
+      handle->pace_waits++;
+   }
+}
+
+// Input delay is picked to cover the one way trip, so the peer usually has our input before it's needed.
+// Rollback covers what's left.
+static void netplay_sync(netplay_t *handle)
+{
+   if (!handle->has_connection)
+      return;
+
+   netplay_pace(handle);
+
+   if (handle->frame_count - handle->sync_frame < NETPLAY_SYNC_INTERVAL)
+      return;
+   handle->sync_frame = handle->frame_count;
+
+   float latency = 0.0f;
+   float rtt = 0.0f;
+   for (unsigned i = 0; i < handle->num_peers; i++)
+   {
+      const struct netplay_peer *peer = &handle->peers[i];
+      if (peer->has_rtt && peer->rtt / 2.0f + peer->rtt_var > latency)
+      {
+         latency = peer->rtt / 2.0f + peer->rtt_var;
+         rtt = peer->rtt;
+      }
+   }
+
+   // Latency hovering around a frame boundary would otherwise flip the delay back and forth.
+   // We go up as soon as the rounded latency is above the delay, but only come down
+   // once latency has been a full frame below it for NETPLAY_DELAY_DROP_INTERVALS in a row.
+   float frames = latency / handle->frame_usec;
+   bool up = frames + 0.5f >= handle->input_delay + 1.0f &&
+      handle->input_delay < handle->max_input_delay;
+   bool down = frames <= handle->input_delay - 1.0f &&
+      handle->input_delay > handle->min_input_delay;
+
+   if (!down)
+      handle->delay_drop_count = 0;
+   else if (++handle->delay_drop_count < NETPLAY_DELAY_DROP_INTERVALS)
+      down = false;
+
+   // One frame at a time. Every change drops or repeats a frame of our input.
+   if (up || down)
+   {
+      if (up)
+         handle->input_delay++;
+      else
+         handle->input_delay--;
+      handle->delay_drop_count = 0;
+
+      if (handle->input_delay < handle->min_delay_used)
+         handle->min_delay_used = handle->input_delay;
+      if (handle->input_delay > handle->max_delay_used)
+         handle->max_delay_used = handle->input_delay;
+
+      RARCH_LOG("Netplay: Input delay is now %u frames. Round trip time is %.1f ms.\n",
+            handle->input_delay, rtt / 1000.0f);
+   }
+}
+
 static void netplay_pre_frame_net(netplay_t *handle)
 {
-   pretro_serialize(handle->buffer[handle->self_ptr].state, handle->state_size);
-   handle->can_poll = true;
+   netplay_sync(handle);
 
+   handle->can_poll = true;
    input_poll_net();
+
+   // If everyone's input for this frame is already here, we can never roll back to it.
+   if (handle->has_connection && handle->frame_count >= oldest_frame(handle))
+      snapshot_save(handle, handle->frame_count);
 }
 
 static void netplay_set_spectate_input(netplay_t *handle, int16_t input)
@@ -1253,7 +2037,7 @@ int16_t input_state_spectate(unsigned port, unsigned device, unsigned index, uns
    return res;
 }
 
-static int16_t netplay_get_spectate_input(netplay_t *handle, bool port, unsigned device, unsigned index, unsigned id)
+static int16_t netplay_get_spectate_input(netplay_t *handle, unsigned port, unsigned device, unsigned index, unsigned id)
 {
    int16_t inp;
    if (recv_all(handle->fd, NONCONST_CAST &inp, sizeof(inp)))
@@ -1274,88 +2058,661 @@ int16_t input_state_spectate_client(unsigned port, unsigned device, unsigned ind
    return netplay_get_spectate_input(g_extern.netplay, port, device, index, id);
 }
 
-static void netplay_pre_frame_spectate(netplay_t *handle)
+// Spectator broadcasting.
+// The emulator thread only hands over input and BSV headers. Accepting, handshaking and sending
+// is done by a broadcaster thread with non-blocking sockets, so no spectator can stall the game.
+// Every spectator sends from its own position in one shared ring of input,
+// and is dropped if it falls too far behind.
+// Without threads, the broadcaster runs once a frame on the emulator thread instead.
+
+#define SPECTATE_ID_LISTEN(handle) ((handle)->max_spectators)
+#define SPECTATE_ID_WAKE(handle) ((handle)->max_spectators + 1)
+
+static void spectate_lock(netplay_t *handle)
 {
-   if (handle->spectate_client)
-      return;
+#ifdef NETPLAY_SPECTATE_THREAD
+   slock_lock(handle->spectate_lock);
+#endif
+}
 
-   fd_set fds;
-   FD_ZERO(&fds);
-   FD_SET(handle->fd, &fds);
+static void spectate_unlock(netplay_t *handle)
+{
+#ifdef NETPLAY_SPECTATE_THREAD
+   slock_unlock(handle->spectate_lock);
+#endif
+}
 
-   struct timeval tmp_tv = {0};
-   if (select(handle->fd + 1, &fds, NULL, NULL, &tmp_tv) <= 0)
-      return;
+static bool socket_nonblock(int fd)
+{
+#if defined(_WIN32)
+   u_long mode = 1;
+   return ioctlsocket(fd, FIONBIO, &mode) == 0;
+#elif defined(__CELLOS_LV2__)
+   int i = 1;
+   return setsockopt(fd, SOL_SOCKET, SO_NBIO, &i, sizeof(int)) == 0;
+#else
+   return fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) == 0;
+#endif
+}
 
-   if (!FD_ISSET(handle->fd, &fds))
+static bool socket_would_block(void)
+{
+#if defined(_WIN32)
+   return WSAGetLastError() == WSAEWOULDBLOCK;
+#elif defined(__CELLOS_LV2__)
+   return sys_net_errno == SYS_NET_EWOULDBLOCK || sys_net_errno == SYS_NET_EAGAIN;
+#else
+   return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+}
+
+static void spectate_header_unref(struct spectate_header *header)
+{
+   if (--header->refs)
       return;
 
-   struct sockaddr_storage their_addr;
-   socklen_t addr_size = sizeof(their_addr);
-   int new_fd = accept(handle->fd, (struct sockaddr*)&their_addr, &addr_size);
-   if (new_fd < 0)
+   free(header->data);
+   free(header);
+}
+
+// Shown on the OSD by the emulator thread.
+static void spectate_message(netplay_t *handle, const char *msg)
+{
+   RARCH_LOG("%s\n", msg);
+
+   spectate_lock(handle);
+   strlcpy(handle->spectate_msg, msg, sizeof(handle->spectate_msg));
+   handle->spectate_has_msg = true;
+   spectate_unlock(handle);
+}
+
+#ifdef HAVE_EPOLL
+static bool spectate_watch(netplay_t *handle, int op, int fd, uint32_t id, bool write)
+{
+   struct epoll_event event = {0};
+   event.events = EPOLLIN | (write ? EPOLLOUT : 0);
+   event.data.u32 = id;
+   return epoll_ctl(handle->epoll_fd, op, fd, &event) == 0;
+}
+#endif
+
+static void spectator_drop(netplay_t *handle, struct netplay_spectator *spectator, const char *reason)
+{
+   unsigned index = spectator - handle->spectators;
+
+   if (spectator->state == SPECTATOR_NICK)
+      RARCH_LOG("Spectator (#%u) dropped during handshake: %s.\n", index, reason);
+   else
    {
-      RARCH_ERR("Failed to accept incoming spectator.\n");
+      char msg[512];
+      snprintf(msg, sizeof(msg), "Spectator \"%s\" (#%u) disconnected: %s.",
+            (const char*)spectator->nick + 1, index, reason);
+      spectate_message(handle, msg);
+   }
+
+   if (spectator->state == SPECTATOR_HEADER)
+      handle->num_waiting--;
+   if (spectator->header)
+      spectate_header_unref(spectator->header);
+
+   close(spectator->fd);
+   memset(spectator, 0, sizeof(*spectator));
+   spectator->fd = -1;
+   handle->num_spectators--;
+}
+
+static void spectator_want_write(netplay_t *handle, struct netplay_spectator *spectator, bool write)
+{
+   if (spectator->want_write == write)
       return;
+
+   spectator->want_write = write;
+#ifdef HAVE_EPOLL
+   spectate_watch(handle, EPOLL_CTL_MOD, spectator->fd, spectator - handle->spectators, write);
+#endif
+}
+
+// Sends as much as the socket takes right now.
+static bool spectator_flush(netplay_t *handle, struct netplay_spectator *spectator)
+{
+   if (spectator->state != SPECTATOR_STREAM)
+      return true;
+
+   for (;;)
+   {
+      const uint8_t *data;
+      size_t size;
+
+      if (spectator->header)
+      {
+         size_t ptr = spectator->out_ptr;
+         if (ptr < handle->spectate_nick_size)
+         {
+            data = handle->spectate_nick + ptr;
+            size = handle->spectate_nick_size - ptr;
+         }
+         else
+         {
+            ptr -= handle->spectate_nick_size;
+            data = (const uint8_t*)spectator->header->data + ptr;
+            size = spectator->header->size - ptr;
+         }
+      }
+      else
+      {
+         if (spectator->pos == handle->spectate_head)
+            break;
+
+         size_t ptr = spectator->pos & (SPECTATE_BUFFER_SIZE - 1);
+         data = handle->spectate_ring + ptr;
+         size = handle->spectate_head - spectator->pos;
+         if (size > SPECTATE_BUFFER_SIZE - ptr)
+            size = SPECTATE_BUFFER_SIZE - ptr;
+      }
+
+      ssize_t ret = send(spectator->fd, CONST_CAST data, size, 0);
+      if (ret < 0)
+      {
+         if (!socket_would_block())
+            return false;
+
+         spectator_want_write(handle, spectator, true);
+         return true;
+      }
+
+      if (spectator->header)
+      {
+         spectator->out_ptr += ret;
+         if (spectator->out_ptr == handle->spectate_nick_size + spectator->header->size)
+         {
+            spectate_header_unref(spectator->header);
+            spectator->header = NULL;
+         }
+      }
+      else
+         spectator->pos += ret;
    }
 
-   int index = -1;
-   for (unsigned i = 0; i < MAX_SPECTATORS; i++)
+   spectator_want_write(handle, spectator, false);
+   return true;
+}
+
+static bool spectator_read(netplay_t *handle, struct netplay_spectator *spectator)
+{
+   uint8_t buf[64];
+
+   for (;;)
    {
-      if (handle->spectate_fds[i] == -1)
+      // Nothing is expected after the nick, but we still need to notice hangups.
+      uint8_t *data = buf;
+      size_t size = sizeof(buf);
+      if (spectator->state == SPECTATOR_NICK)
       {
-         index = i;
-         break;
+         data = spectator->nick + spectator->nick_size;
+         size = (spectator->nick_size ? 1 + spectator->nick[0] : 1) - spectator->nick_size;
+      }
+
+      ssize_t ret = recv(spectator->fd, NONCONST_CAST data, size, 0);
+      if (ret == 0)
+         return false;
+      if (ret < 0)
+         return socket_would_block();
+
+      if (spectator->state != SPECTATOR_NICK)
+         continue;
+
+      spectator->nick_size += ret;
+      if (spectator->nick[0] >= 32)
+         return false;
+
+      if (spectator->nick_size == 1 + (size_t)spectator->nick[0])
+      {
+         spectator->nick[spectator->nick_size] = '\0';
+         spectator->state = SPECTATOR_HEADER;
+         handle->num_waiting++;
+
+#ifndef HAVE_SOCKET_LEGACY
+         char msg[512];
+         describe_connection(&spectator->addr, spectator - handle->spectators,
+               (const char*)spectator->nick + 1, msg, sizeof(msg));
+         if (*msg)
+            spectate_message(handle, msg);
+#endif
       }
    }
+}
 
-   // No vacant client streams :(
-   if (index == -1)
+static void spectate_accept(netplay_t *handle)
+{
+   for (;;)
    {
-      close(new_fd);
-      return;
+      struct sockaddr_storage their_addr;
+      socklen_t addr_size = sizeof(their_addr);
+      int fd = accept(handle->fd, (struct sockaddr*)&their_addr, &addr_size);
+      if (fd < 0)
+      {
+         if (!socket_would_block())
+            RARCH_ERR("Failed to accept incoming spectator.\n");
+         return;
+      }
+
+      struct netplay_spectator *spectator = NULL;
+      for (unsigned i = 0; i < handle->max_spectators && !spectator; i++)
+         if (handle->spectators[i].state == SPECTATOR_FREE)
+            spectator = &handle->spectators[i];
+
+      if (!spectator)
+      {
+         RARCH_WARN("Spectator limit of %u reached, refusing connection.\n", handle->max_spectators);
+         close(fd);
+         continue;
+      }
+
+      int flag = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, CONST_CAST &flag, sizeof(int));
+
+#ifdef HAVE_EPOLL
+      if (!socket_nonblock(fd) ||
+            !spectate_watch(handle, EPOLL_CTL_ADD, fd, spectator - handle->spectators, false))
+#elif !defined(_WIN32)
+      if (!socket_nonblock(fd) || fd >= FD_SETSIZE)
+#else
+      if (!socket_nonblock(fd))
+#endif
+      {
+         RARCH_ERR("Failed to set up spectator socket.\n");
+         close(fd);
+         continue;
+      }
+
+      memset(spectator, 0, sizeof(*spectator));
+      spectator->fd = fd;
+      spectator->state = SPECTATOR_NICK;
+      spectator->addr = their_addr;
+      spectator->connect_time = rarch_get_time_usec();
+      handle->num_spectators++;
    }
+}
 
-   if (!get_nickname(handle, new_fd))
+static void spectate_event(netplay_t *handle, unsigned id, bool readable, bool writable)
+{
+   if (id == SPECTATE_ID_LISTEN(handle))
+      spectate_accept(handle);
+#ifdef NETPLAY_SPECTATE_THREAD
+   else if (id == SPECTATE_ID_WAKE(handle))
    {
-      RARCH_ERR("Failed to get nickname from client.\n");
-      close(new_fd);
-      return;
+      char buf[64];
+      while (recv(handle->wake_fd, buf, sizeof(buf), 0) > 0);
    }
+#endif
+   else
+   {
+      struct netplay_spectator *spectator = &handle->spectators[id];
+      if (spectator->state == SPECTATOR_FREE)
+         return;
 
-   if (!send_nickname(handle, new_fd))
+      if (readable && !spectator_read(handle, spectator))
+         spectator_drop(handle, spectator, "connection closed");
+      else if (writable && !spectator_flush(handle, spectator))
+         spectator_drop(handle, spectator, "connection closed");
+   }
+}
+
+static void spectate_wait(netplay_t *handle, int timeout_ms)
+{
+#ifdef HAVE_EPOLL
+   struct epoll_event events[64];
+   int num_events = epoll_wait(handle->epoll_fd, events, 64, timeout_ms);
+   for (int i = 0; i < num_events; i++)
    {
-      RARCH_ERR("Failed to send nickname to client.\n");
-      close(new_fd);
-      return;
+      spectate_event(handle, events[i].data.u32,
+            events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR),
+            events[i].events & EPOLLOUT);
    }
+#else
+   fd_set read_fds, write_fds;
+   FD_ZERO(&read_fds);
+   FD_ZERO(&write_fds);
+
+   int max_fd = handle->fd;
+   FD_SET(handle->fd, &read_fds);
+#ifdef NETPLAY_SPECTATE_THREAD
+   FD_SET(handle->wake_fd, &read_fds);
+   if (handle->wake_fd > max_fd)
+      max_fd = handle->wake_fd;
+#endif
 
-   size_t header_size;
-   uint32_t *header = bsv_header_generate(&header_size, implementation_magic_value());
-   if (!header)
+   for (unsigned i = 0; i < handle->max_spectators; i++)
    {
-      RARCH_ERR("Failed to generate BSV header.\n");
-      close(new_fd);
+      const struct netplay_spectator *spectator = &handle->spectators[i];
+      if (spectator->state == SPECTATOR_FREE)
+         continue;
+
+      FD_SET(spectator->fd, &read_fds);
+      if (spectator->want_write)
+         FD_SET(spectator->fd, &write_fds);
+      if (spectator->fd > max_fd)
+         max_fd = spectator->fd;
+   }
+
+   struct timeval tv = {0};
+   tv.tv_sec = timeout_ms / 1000;
+   tv.tv_usec = (timeout_ms % 1000) * 1000;
+   if (select(max_fd + 1, &read_fds, &write_fds, NULL, &tv) <= 0)
       return;
+
+   // Spectators first, so a slot reused by accept() can't pick up stale results.
+   for (unsigned i = 0; i < handle->max_spectators; i++)
+   {
+      const struct netplay_spectator *spectator = &handle->spectators[i];
+      if (spectator->state != SPECTATOR_FREE)
+         spectate_event(handle, i, FD_ISSET(spectator->fd, &read_fds), FD_ISSET(spectator->fd, &write_fds));
    }
 
-   int bufsize = header_size;
-   setsockopt(new_fd, SOL_SOCKET, SO_SNDBUF, CONST_CAST &bufsize, sizeof(int));
+#ifdef NETPLAY_SPECTATE_THREAD
+   if (FD_ISSET(handle->wake_fd, &read_fds))
+      spectate_event(handle, SPECTATE_ID_WAKE(handle), true, false);
+#endif
+   if (FD_ISSET(handle->fd, &read_fds))
+      spectate_event(handle, SPECTATE_ID_LISTEN(handle), true, false);
+#endif
+}
 
-   if (!send_all(new_fd, header, header_size))
+static void spectate_append(netplay_t *handle, const uint8_t *data, size_t size)
+{
+   for (unsigned i = 0; i < handle->max_spectators; i++)
    {
-      RARCH_ERR("Failed to send header to client.\n");
-      close(new_fd);
-      free(header);
-      return;
+      struct netplay_spectator *spectator = &handle->spectators[i];
+      if (spectator->state == SPECTATOR_STREAM &&
+            handle->spectate_head + size - spectator->pos > SPECTATE_BUFFER_SIZE)
+         spectator_drop(handle, spectator, "too slow");
    }
 
-   free(header);
-   handle->spectate_fds[index] = new_fd;
+   while (size)
+   {
+      size_t ptr = handle->spectate_head & (SPECTATE_BUFFER_SIZE - 1);
+      size_t copy = SPECTATE_BUFFER_SIZE - ptr;
+      if (copy > size)
+         copy = size;
 
-#ifndef HAVE_SOCKET_LEGACY
-   log_connection(&their_addr, index, handle->other_nick);
+      memcpy(handle->spectate_ring + ptr, data, copy);
+      handle->spectate_head += copy;
+      data += copy;
+      size -= copy;
+   }
+}
+
+// Takes over what the emulator thread handed us since last time.
+static void spectate_take_pending(netplay_t *handle)
+{
+   spectate_lock(handle);
+   uint8_t *pending = handle->spectate_pending;
+   size_t pending_size = handle->spectate_pending_size;
+   size_t pending_cap = handle->spectate_pending_cap;
+   handle->spectate_pending = handle->spectate_back;
+   handle->spectate_pending_cap = handle->spectate_back_cap;
+   handle->spectate_pending_size = 0;
+
+   struct spectate_header *header = handle->spectate_header;
+   size_t header_offset = handle->spectate_header_offset;
+   handle->spectate_header = NULL;
+   spectate_unlock(handle);
+
+   handle->spectate_back = pending;
+   handle->spectate_back_cap = pending_cap;
+
+   if (header)
+   {
+      header->refs = 1;
+      for (unsigned i = 0; i < handle->max_spectators; i++)
+      {
+         struct netplay_spectator *spectator = &handle->spectators[i];
+         if (spectator->state != SPECTATOR_HEADER)
+            continue;
+
+         spectator->state = SPECTATOR_STREAM;
+         spectator->header = header;
+         spectator->pos = handle->spectate_head + header_offset;
+         header->refs++;
+         handle->num_waiting--;
+      }
+      spectate_header_unref(header);
+   }
+
+   spectate_append(handle, pending, pending_size);
+}
+
+static void spectate_pump(netplay_t *handle, int timeout_ms)
+{
+   spectate_wait(handle, timeout_ms);
+   spectate_take_pending(handle);
+
+   rarch_time_t now = rarch_get_time_usec();
+   for (unsigned i = 0; i < handle->max_spectators; i++)
+   {
+      struct netplay_spectator *spectator = &handle->spectators[i];
+      if (spectator->state == SPECTATOR_NICK && now - spectator->connect_time > SPECTATE_HANDSHAKE_TIMEOUT)
+         spectator_drop(handle, spectator, "handshake timed out");
+      else if (spectator->state == SPECTATOR_STREAM && !spectator->want_write &&
+            !spectator_flush(handle, spectator))
+         spectator_drop(handle, spectator, "connection closed");
+   }
+
+   spectate_lock(handle);
+   handle->spectate_header_wanted = handle->num_waiting > 0;
+   spectate_unlock(handle);
+}
+
+#ifdef NETPLAY_SPECTATE_THREAD
+static void spectate_thread(void *data)
+{
+   netplay_t *handle = (netplay_t*)data;
+
+   for (;;)
+   {
+      slock_lock(handle->spectate_lock);
+      bool quit = handle->spectate_quit;
+      slock_unlock(handle->spectate_lock);
+      if (quit)
+         break;
+
+      spectate_pump(handle, 1000);
+   }
+}
+
+static void spectate_wake(netplay_t *handle)
+{
+   char c = 0;
+   send(handle->wake_fd, CONST_CAST &c, sizeof(c), 0);
+}
+
+// A loopback UDP socket connected to itself. Works with select() on every platform, unlike a pipe.
+static int init_wake_socket(void)
+{
+   int fd = socket(AF_INET, SOCK_DGRAM, 0);
+   if (fd < 0)
+      return -1;
+
+   struct sockaddr_in addr;
+   memset(&addr, 0, sizeof(addr));
+   addr.sin_family = AF_INET;
+   addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   socklen_t addr_size = sizeof(addr);
+
+   if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+         getsockname(fd, (struct sockaddr*)&addr, &addr_size) < 0 ||
+         connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+         !socket_nonblock(fd))
+   {
+      close(fd);
+      return -1;
+   }
+
+   return fd;
+}
+#endif
+
+static bool spectate_init(netplay_t *handle)
+{
+   handle->max_spectators = g_settings.netplay_max_spectators;
+   if (!handle->max_spectators)
+      handle->max_spectators = 1;
+
+#ifndef HAVE_EPOLL
+   // select() can't watch more sockets than this, and needs two for the listening and wakeup sockets.
+   // Winsock silently ignores the sockets past the limit.
+   if (handle->max_spectators > FD_SETSIZE - 2)
+   {
+      RARCH_WARN("Can only watch %u spectators at once on this platform.\n", (unsigned)(FD_SETSIZE - 2));
+      handle->max_spectators = FD_SETSIZE - 2;
+   }
+#endif
+
+   handle->spectators = (struct netplay_spectator*)calloc(handle->max_spectators, sizeof(*handle->spectators));
+   handle->spectate_ring = (uint8_t*)malloc(SPECTATE_BUFFER_SIZE);
+   if (!handle->spectators || !handle->spectate_ring)
+      return false;
+
+   for (unsigned i = 0; i < handle->max_spectators; i++)
+      handle->spectators[i].fd = -1;
+
+   handle->spectate_nick_size = 1 + strlen(handle->nick);
+   handle->spectate_nick[0] = handle->spectate_nick_size - 1;
+   memcpy(handle->spectate_nick + 1, handle->nick, handle->spectate_nick_size - 1);
+
+   if (!socket_nonblock(handle->fd))
+      return false;
+
+#ifdef HAVE_EPOLL
+   handle->epoll_fd = epoll_create(handle->max_spectators + 2);
+   if (handle->epoll_fd < 0 ||
+         !spectate_watch(handle, EPOLL_CTL_ADD, handle->fd, SPECTATE_ID_LISTEN(handle), false))
+   {
+      RARCH_ERR("Failed to set up epoll for spectators.\n");
+      return false;
+   }
+#endif
+
+#ifdef NETPLAY_SPECTATE_THREAD
+   handle->wake_fd = init_wake_socket();
+   if (handle->wake_fd < 0)
+   {
+      RARCH_ERR("Failed to create wakeup socket for spectators.\n");
+      return false;
+   }
+#ifdef HAVE_EPOLL
+   if (!spectate_watch(handle, EPOLL_CTL_ADD, handle->wake_fd, SPECTATE_ID_WAKE(handle), false))
+      return false;
 #endif
+
+   handle->spectate_lock = slock_new();
+   if (!handle->spectate_lock)
+      return false;
+   handle->spectate_thread = sthread_create(spectate_thread, handle);
+   if (!handle->spectate_thread)
+      return false;
+#endif
+
+   RARCH_LOG("Accepting up to %u spectators.\n", handle->max_spectators);
+   return true;
+}
+
+static void spectate_deinit(netplay_t *handle)
+{
+#ifdef NETPLAY_SPECTATE_THREAD
+   if (handle->spectate_thread)
+   {
+      slock_lock(handle->spectate_lock);
+      handle->spectate_quit = true;
+      slock_unlock(handle->spectate_lock);
+      spectate_wake(handle);
+
+      sthread_join(handle->spectate_thread);
+      handle->spectate_thread = NULL;
+   }
+
+   if (handle->spectate_lock)
+      slock_free(handle->spectate_lock);
+   handle->spectate_lock = NULL;
+   if (handle->wake_fd >= 0)
+      close(handle->wake_fd);
+   handle->wake_fd = -1;
+#endif
+
+#ifdef HAVE_EPOLL
+   if (handle->epoll_fd >= 0)
+      close(handle->epoll_fd);
+   handle->epoll_fd = -1;
+#endif
+
+   if (handle->spectators)
+   {
+      for (unsigned i = 0; i < handle->max_spectators; i++)
+      {
+         struct netplay_spectator *spectator = &handle->spectators[i];
+         if (spectator->state == SPECTATOR_FREE)
+            continue;
+
+         close(spectator->fd);
+         if (spectator->header)
+            spectate_header_unref(spectator->header);
+      }
+   }
+
+   if (handle->spectate_header)
+   {
+      free(handle->spectate_header->data);
+      free(handle->spectate_header);
+   }
+
+   free(handle->spectators);
+   free(handle->spectate_ring);
+   free(handle->spectate_pending);
+   free(handle->spectate_back);
+   handle->spectators = NULL;
+   handle->spectate_ring = NULL;
+   handle->spectate_pending = NULL;
+   handle->spectate_back = NULL;
+   handle->spectate_header = NULL;
+}
+
+static void netplay_pre_frame_spectate(netplay_t *handle)
+{
+   if (handle->spectate_client)
+      return;
+
+   char msg[512];
+   spectate_lock(handle);
+   bool want_header = handle->spectate_header_wanted && !handle->spectate_header;
+   bool has_msg = handle->spectate_has_msg;
+   if (has_msg)
+      strlcpy(msg, handle->spectate_msg, sizeof(msg));
+   handle->spectate_has_msg = false;
+   spectate_unlock(handle);
+
+   if (has_msg)
+      msg_queue_push(g_extern.msg_queue, msg, 1, 180);
+
+   if (!want_header)
+      return;
+
+   // Has to be made here, it holds a save state of the frame spectators start on.
+   struct spectate_header *header = (struct spectate_header*)calloc(1, sizeof(*header));
+   if (!header)
+      return;
+
+   header->data = bsv_header_generate(&header->size, implementation_magic_value());
+   if (!header->data)
+   {
+      RARCH_ERR("Failed to generate BSV header.\n");
+      free(header);
+      return;
+   }
+
+   spectate_lock(handle);
+   handle->spectate_header = header;
+   handle->spectate_header_offset = handle->spectate_pending_size;
+   spectate_unlock(handle);
 }
 
 void netplay_pre_frame(netplay_t *handle)
@@ -1370,48 +2727,48 @@ static void netplay_post_frame_net(netplay_t *handle)
 {
    handle->frame_count++;
 
-   // Nothing to do...
-   if (handle->other_frame_count == handle->read_frame_count)
+   // Nothing to do, we predicted correctly.
+   if (!handle->must_replay)
       return;
 
-   // Skip ahead if we predicted correctly. Skip until our simulation failed.
-   while (handle->other_frame_count < handle->read_frame_count)
+   // Replay frames
+   uint32_t oldest = oldest_frame(handle);
+   handle->is_replay = true;
+   handle->tmp_frame_count = handle->replay_frame_count;
+
+   if (!snapshot_load(handle, handle->replay_frame_count))
    {
-      const struct delta_frame *ptr = &handle->buffer[handle->other_ptr];
-      if ((ptr->simulated_input_state != ptr->real_input_state) && !ptr->used_real)
-         break;
-      handle->other_ptr = NEXT_PTR(handle->other_ptr);
-      handle->other_frame_count++;
+      RARCH_ERR("Netplay lost the snapshot of frame %u.\n", (unsigned)handle->replay_frame_count);
+      warn_hangup();
+      handle->has_connection = false;
+      handle->must_replay = false;
+      handle->is_replay = false;
+      return;
    }
 
-   if (handle->other_frame_count < handle->read_frame_count)
-   {
-      // Replay frames
-      handle->is_replay = true;
-      handle->tmp_ptr = handle->other_ptr;
-      handle->tmp_frame_count = handle->other_frame_count;
+   uint32_t depth = handle->frame_count - handle->replay_frame_count;
+   handle->rollbacks++;
+   handle->rollback_frames += depth;
+   if (depth > handle->max_rollback)
+      handle->max_rollback = depth;
 
-      pretro_unserialize(handle->buffer[handle->other_ptr].state, handle->state_size);
-      bool first = true;
-      while (first || (handle->tmp_ptr != handle->self_ptr))
-      {
-         pretro_serialize(handle->buffer[handle->tmp_ptr].state, handle->state_size);
+   while (handle->tmp_frame_count < handle->frame_count)
+   {
+      if (handle->tmp_frame_count != handle->replay_frame_count && handle->tmp_frame_count >= oldest)
+         snapshot_save(handle, handle->tmp_frame_count);
+      fill_input(handle, handle->tmp_frame_count);
 #if defined(HAVE_THREADS) && !defined(RARCH_CONSOLE)
-         lock_autosave();
+      lock_autosave();
 #endif
-         pretro_run();
+      pretro_run();
 #if defined(HAVE_THREADS) && !defined(RARCH_CONSOLE)
-         unlock_autosave();
+      unlock_autosave();
 #endif
-         handle->tmp_ptr = NEXT_PTR(handle->tmp_ptr);
-         handle->tmp_frame_count++;
-         first = false;
-      }
-
-      handle->other_ptr = handle->read_ptr;
-      handle->other_frame_count = handle->read_frame_count;
-      handle->is_replay = false;
+      handle->tmp_frame_count++;
    }
+
+   handle->must_replay = false;
+   handle->is_replay = false;
 }
 
 static void netplay_post_frame_spectate(netplay_t *handle)
@@ -1419,27 +2776,34 @@ static void netplay_post_frame_spectate(netplay_t *handle)
    if (handle->spectate_client)
       return;
 
-   for (unsigned i = 0; i < MAX_SPECTATORS; i++)
-   {
-      if (handle->spectate_fds[i] == -1)
-         continue;
+   size_t size = handle->spectate_input_ptr * sizeof(uint16_t);
+   handle->spectate_input_ptr = 0;
 
-      if (!send_all(handle->spectate_fds[i],
-               handle->spectate_input, handle->spectate_input_ptr * sizeof(int16_t)))
+   spectate_lock(handle);
+   if (handle->spectate_pending_size + size > handle->spectate_pending_cap)
+   {
+      size_t cap = 2 * (handle->spectate_pending_size + size);
+      uint8_t *pending = (uint8_t*)realloc(handle->spectate_pending, cap);
+      if (!pending)
       {
-         RARCH_LOG("Client (#%u) disconnected ...\n", i);
-
-         char msg[512];
-         snprintf(msg, sizeof(msg), "Client (#%u) disconnected.", i);
-         msg_queue_push(g_extern.msg_queue, msg, 1, 180);
-
-         close(handle->spectate_fds[i]);
-         handle->spectate_fds[i] = -1;
-         break;
+         spectate_unlock(handle);
+         RARCH_ERR("Failed to queue input for spectators.\n");
+         return;
       }
+
+      handle->spectate_pending = pending;
+      handle->spectate_pending_cap = cap;
    }
 
-   handle->spectate_input_ptr = 0;
+   memcpy(handle->spectate_pending + handle->spectate_pending_size, handle->spectate_input, size);
+   handle->spectate_pending_size += size;
+   spectate_unlock(handle);
+
+#ifdef NETPLAY_SPECTATE_THREAD
+   spectate_wake(handle);
+#else
+   spectate_pump(handle, 0);
+#endif
 }
 
 // Here we check if we have new input and replay from recorded input.
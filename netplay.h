@@ -44,13 +44,14 @@ struct retro_callbacks
 bool netplay_init_network(void);
 
 // Creates a new netplay handle. A NULL host means we're hosting (player 1). :)
+// The host waits for 'players' players in total, and tells each client which player it is.
 netplay_t *netplay_new(const char *server,
-      uint16_t port, unsigned frames,
+      uint16_t port, unsigned frames, unsigned players,
       const struct retro_callbacks *cb, bool spectate,
       const char *nick);
 void netplay_free(netplay_t *handle);
 
-// On regular netplay, flip who controls player 1 and 2.
+// On regular netplay, flip who controls player 1 and 2. Host only.
 void netplay_flip_players(netplay_t *handle);
 
 // Call this before running retro_run()
@@ -77,6 +77,12 @@ void rarch_perf_log(void)
    RARCH_LOG("[PERF]: Performance counters:\n");
    for (unsigned i = 0; i < perf_ptr; i++)
       RARCH_PERFORMANCE_LOG(perf_counters[i]->ident, *perf_counters[i]);
+
+   if (g_extern.frame_dupe.checked)
+   {
+      RARCH_LOG("[PERF]: Duplicate frames skipped: %u of %u.\n",
+            g_extern.frame_dupe.skipped, g_extern.frame_dupe.checked);
+   }
 }
 
 rarch_perf_tick_t rarch_get_perf_counter(void)
@@ -177,9 +183,9 @@ static void x86_cpuid(int func, int flags[4])
          "cpuid\n"
          "xchg %%" REG_b ", %%" REG_S "\n"
          : "=a"(flags[0]), "=S"(flags[1]), "=c"(flags[2]), "=d"(flags[3])
-         : "a"(func));
+         : "a"(func), "c"(0)); // Sub-leaf is only relevant for func = 7.
 #elif defined(_MSC_VER)
-   __cpuid(flags, func);
+   __cpuidex(flags, func, 0);
 #else
    RARCH_WARN("Unknown compiler. Cannot check CPUID with inline assembly.\n");
    memset(flags, 0, 4 * sizeof(int));
@@ -200,7 +206,8 @@ void rarch_get_cpu_features(struct rarch_cpu_features *cpu)
    memcpy(vendor, vendor_shuffle, sizeof(vendor_shuffle));
    RARCH_LOG("[CPUID]: Vendor: %s\n", vendor);
 
-   if (flags[0] < 1) // Does CPUID not support func = 1? (unlikely ...)
+   int max_flag = flags[0];
+   if (max_flag < 1) // Does CPUID not support func = 1? (unlikely ...)
       return;
 
    x86_cpuid(1, flags);
@@ -215,9 +222,18 @@ void rarch_get_cpu_features(struct rarch_cpu_features *cpu)
    if ((flags[2] & avx_flags) == avx_flags)
       cpu->simd |= RARCH_SIMD_AVX;
 
+   // AVX2 lives in extended features (func = 7). Requires OS support for AVX as well.
+   if (max_flag >= 7 && (cpu->simd & RARCH_SIMD_AVX))
+   {
+      x86_cpuid(7, flags);
+      if (flags[1] & (1 << 5))
+         cpu->simd |= RARCH_SIMD_AVX2;
+   }
+
    RARCH_LOG("[CPUID]: SSE:  %u\n", !!(cpu->simd & RARCH_SIMD_SSE));
    RARCH_LOG("[CPUID]: SSE2: %u\n", !!(cpu->simd & RARCH_SIMD_SSE2));
    RARCH_LOG("[CPUID]: AVX:  %u\n", !!(cpu->simd & RARCH_SIMD_AVX));
+   RARCH_LOG("[CPUID]: AVX2: %u\n", !!(cpu->simd & RARCH_SIMD_AVX2));
 #elif defined(ANDROID) && defined(ANDROID_ARM)
    uint64_t cpu_flags = android_getCpuFeatures();
 
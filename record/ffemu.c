@@ -50,6 +50,10 @@ extern "C" {
 #include <time.h>
 #endif
 
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
 #ifdef HAVE_CONFIG_H
 #include "../config.h"
 #endif
@@ -122,11 +126,47 @@ struct ff_audio_info
    double ratio;
 };
 
+enum ffemu_stream
+{
+   FFEMU_STREAM_VIDEO = 0,
+   FFEMU_STREAM_AUDIO,
+
+   FFEMU_STREAMS
+};
+
+// Encoded packet waiting to be muxed.
+// Owns a copy of the data, as the encoders reuse their output buffers.
+struct ffemu_packet
+{
+   AVPacket pkt;
+   struct ffemu_packet *next;
+};
+
+struct ffemu_packet_queue
+{
+   struct ffemu_packet *head;
+   struct ffemu_packet *tail;
+   unsigned count;
+   scond_t *space; // Signalled when a packet is muxed. Only this stream's encoder thread waits on it.
+};
+
 struct ff_muxer_info
 {
    AVFormatContext *ctx;
    AVStream *astream;
    AVStream *vstream;
+
+   // Protected by the mux lock.
+   struct ffemu_packet_queue queue[FFEMU_STREAMS];
+   bool error;
+};
+
+// What ffemu_push_video() does when all frame slots are waiting to be encoded.
+enum ffemu_overflow
+{
+   FFEMU_OVERFLOW_BLOCK = 0, // Wait for the encoder.
+   FFEMU_OVERFLOW_DROP,      // Drop the frame.
+   FFEMU_OVERFLOW_GROW       // Allocate more slots, up to frame_queue_max_size. Blocks after that.
 };
 
 struct ff_config_param
@@ -138,6 +178,9 @@ struct ff_config_param
    enum PixelFormat out_pix_fmt;
    unsigned threads;
    unsigned frame_drop_ratio;
+   unsigned frame_queue_size;
+   unsigned frame_queue_max_size;
+   enum ffemu_overflow frame_queue_overflow;
    unsigned sample_rate;
    unsigned scale_factor;
 
@@ -150,7 +193,34 @@ struct ff_config_param
    AVDictionary *audio_opts;
 };
 
-struct ffemu
+// Single producer, single consumer ring of frame slot indices.
+// Capacity is a power of two, so the free running counters can wrap around.
+struct ffemu_index_queue
+{
+   unsigned *indices;
+   unsigned mask;
+   volatile unsigned head; // Only written by the producer.
+   volatile unsigned tail; // Only written by the consumer.
+};
+
+// Frames are written once into a slot by the emulator thread,
+// and read in place by the video thread.
+struct ffemu_frame_slot
+{
+   struct ffemu_video_data attr;
+   uint8_t *data;
+};
+
+struct ffemu_frame_stats
+{
+   unsigned frames;
+   unsigned dropped;
+   unsigned blocked;
+   rarch_time_t block_time;
+   unsigned peak;
+};
+
+typedef struct ffemu
 {
    struct ff_video_info video;
    struct ff_audio_info audio;
@@ -159,17 +229,30 @@ struct ffemu
    
    struct ffemu_params params;
 
-   scond_t *cond;
-   slock_t *cond_lock;
-   slock_t *lock;
-   fifo_buffer_t *audio_fifo;
-   fifo_buffer_t *video_fifo;
-   fifo_buffer_t *attr_fifo;
-   sthread_t *thread;
+   // Video (scaling and encoding), audio (resampling and encoding) and muxing
+   // each run on their own thread, so a slow video codec doesn't hold back audio.
+   sthread_t *video_thread;
+   sthread_t *audio_thread;
+   sthread_t *mux_thread;
+
+   slock_t *video_lock;
+   scond_t *video_cond;
+   slock_t *audio_lock;
+   scond_t *audio_cond;
+   slock_t *mux_lock;
+   scond_t *mux_cond;
+
+   fifo_buffer_t *audio_fifo; // Protected by the audio lock.
+
+   struct ffemu_frame_slot *slots;
+   unsigned slots_alloc; // Only touched by the emulator thread after init.
+   size_t slot_size;
+   struct ffemu_index_queue free_slots; // Emulator thread <- video thread.
+   struct ffemu_index_queue video_queue; // Emulator thread -> video thread.
+   struct ffemu_frame_stats frame_stats;
 
    volatile bool alive;
-   volatile bool can_sleep;
-};
+} ffemu_t;
 
 static bool ffemu_codec_has_sample_format(enum AVSampleFormat fmt, const enum AVSampleFormat *fmts)
 {
@@ -446,12 +529,17 @@ static bool ffemu_init_video(ffemu_t *handle)
    return true;
 }
 
+#define MAX_FRAMES 32
+
 static bool ffemu_init_config(struct ff_config_param *params, const char *config)
 {
    params->out_pix_fmt = PIX_FMT_NONE;
    params->scale_factor = 1;
    params->threads = 1;
    params->frame_drop_ratio = 1;
+   params->frame_queue_size = MAX_FRAMES;
+   params->frame_queue_max_size = MAX_FRAMES;
+   params->frame_queue_overflow = FFEMU_OVERFLOW_BLOCK;
 
    if (!config)
       return true;
@@ -469,6 +557,33 @@ static bool ffemu_init_config(struct ff_config_param *params, const char *config
 
    config_get_uint(params->conf, "threads", &params->threads);
 
+   // Frames waiting to be encoded, and what to do when the encoder can't keep up.
+   if (!config_get_uint(params->conf, "frame_queue_size", &params->frame_queue_size) ||
+         !params->frame_queue_size)
+      params->frame_queue_size = MAX_FRAMES;
+
+   char overflow[64] = {0};
+   if (config_get_array(params->conf, "frame_queue_overflow", overflow, sizeof(overflow)))
+   {
+      if (!strcmp(overflow, "block"))
+         params->frame_queue_overflow = FFEMU_OVERFLOW_BLOCK;
+      else if (!strcmp(overflow, "drop"))
+         params->frame_queue_overflow = FFEMU_OVERFLOW_DROP;
+      else if (!strcmp(overflow, "grow"))
+         params->frame_queue_overflow = FFEMU_OVERFLOW_GROW;
+      else
+      {
+         RARCH_ERR("Invalid frame_queue_overflow \"%s\". Use \"block\", \"drop\" or \"grow\".\n", overflow);
+         return false;
+      }
+   }
+
+   if (params->frame_queue_overflow == FFEMU_OVERFLOW_GROW)
+      config_get_uint(params->conf, "frame_queue_max_size", &params->frame_queue_max_size);
+   if (params->frame_queue_max_size < params->frame_queue_size)
+      params->frame_queue_max_size = params->frame_queue_overflow == FFEMU_OVERFLOW_GROW ?
+         4 * params->frame_queue_size : params->frame_queue_size;
+
    if (!config_get_uint(params->conf, "frame_drop_ratio", &params->frame_drop_ratio)
          || !params->frame_drop_ratio)
       params->frame_drop_ratio = 1;
@@ -550,49 +665,185 @@ static bool ffemu_init_muxer_post(ffemu_t *handle)
    return avformat_write_header(handle->muxer.ctx, NULL) >= 0;
 }
 
-#define MAX_FRAMES 32
+static inline void ffemu_memory_barrier(void)
+{
+#if defined(__GNUC__)
+   __sync_synchronize();
+#elif defined(_WIN32)
+   MemoryBarrier();
+#else
+#error "Recording requires a memory barrier. Implement ffemu_memory_barrier() for your platform."
+#endif
+}
 
-static void ffemu_thread(void *data);
+static bool index_queue_init(struct ffemu_index_queue *queue, unsigned size)
+{
+   unsigned capacity = next_pow2(size);
+   queue->indices = (unsigned*)calloc(capacity, sizeof(unsigned));
+   queue->mask    = capacity - 1;
+   queue->head    = 0;
+   queue->tail    = 0;
+   return queue->indices != NULL;
+}
+
+static void index_queue_free(struct ffemu_index_queue *queue)
+{
+   free(queue->indices);
+   queue->indices = NULL;
+}
+
+static unsigned index_queue_size(const struct ffemu_index_queue *queue)
+{
+   return queue->head - queue->tail;
+}
+
+// There are never more indices than the queue can hold, so this can't fail.
+static void index_queue_push(struct ffemu_index_queue *queue, unsigned index)
+{
+   unsigned head = queue->head;
+   queue->indices[head & queue->mask] = index;
+
+   // The index (and the slot it refers to) must be visible before the new head.
+   ffemu_memory_barrier();
+   queue->head = head + 1;
+}
+
+static bool index_queue_pop(struct ffemu_index_queue *queue, unsigned *index)
+{
+   unsigned tail = queue->tail;
+   if (queue->head == tail)
+      return false;
+
+   ffemu_memory_barrier();
+   *index = queue->indices[tail & queue->mask];
+
+   // Done with the entry before the producer is allowed to reuse it.
+   ffemu_memory_barrier();
+   queue->tail = tail + 1;
+   return true;
+}
+
+static bool ffemu_alloc_slot(ffemu_t *handle, unsigned *index)
+{
+   // Some extra space, as FFmpeg tends to read a bit past the end.
+   uint8_t *data = (uint8_t*)av_malloc(handle->slot_size +
+         handle->params.fb_width * handle->video.pix_size + 64);
+   if (!data)
+      return false;
+
+   *index = handle->slots_alloc++;
+   handle->slots[*index].data = data;
+   return true;
+}
+
+static bool init_slots(ffemu_t *handle)
+{
+   unsigned max_slots = handle->config.frame_queue_max_size;
+
+   handle->slot_size = handle->params.fb_width * handle->params.fb_height * handle->video.pix_size;
+   handle->slots = (struct ffemu_frame_slot*)calloc(max_slots, sizeof(*handle->slots));
+   if (!handle->slots)
+      return false;
+
+   if (!index_queue_init(&handle->free_slots, max_slots) ||
+         !index_queue_init(&handle->video_queue, max_slots))
+      return false;
+
+   // The video thread isn't running yet, so it's safe to fill its side of the queue.
+   for (unsigned i = 0; i < handle->config.frame_queue_size; i++)
+   {
+      unsigned index;
+      if (!ffemu_alloc_slot(handle, &index))
+         return false;
+      index_queue_push(&handle->free_slots, index);
+   }
+
+   return true;
+}
+
+static void deinit_slots(ffemu_t *handle)
+{
+   if (handle->slots)
+   {
+      for (unsigned i = 0; i < handle->slots_alloc; i++)
+         av_free(handle->slots[i].data);
+      free(handle->slots);
+      handle->slots = NULL;
+   }
+
+   handle->slots_alloc = 0;
+   index_queue_free(&handle->free_slots);
+   index_queue_free(&handle->video_queue);
+}
+
+static void ffemu_video_thread(void *data);
+static void ffemu_audio_thread(void *data);
+static void ffemu_mux_thread(void *data);
 
 static bool init_thread(ffemu_t *handle)
 {
-   handle->lock = slock_new();
-   handle->cond_lock = slock_new();
-   handle->cond = scond_new();
+   handle->video_lock = slock_new();
+   handle->video_cond = scond_new();
+   handle->audio_lock = slock_new();
+   handle->audio_cond = scond_new();
+   handle->mux_lock = slock_new();
+   handle->mux_cond = scond_new();
+   for (unsigned i = 0; i < FFEMU_STREAMS; i++)
+      handle->muxer.queue[i].space = scond_new();
    handle->audio_fifo = fifo_new(32000 * sizeof(int16_t) * handle->params.channels * MAX_FRAMES / 60); // Some arbitrary max size.
-   handle->attr_fifo = fifo_new(sizeof(struct ffemu_video_data) * MAX_FRAMES);
-   handle->video_fifo = fifo_new(handle->params.fb_width * handle->params.fb_height *
-            handle->video.pix_size * MAX_FRAMES);
 
-   handle->alive = true;
-   handle->can_sleep = true;
-   handle->thread = sthread_create(ffemu_thread, handle);
+   if (!init_slots(handle))
+   {
+      RARCH_ERR("Failed to allocate %u frame slots.\n", handle->config.frame_queue_size);
+      return false;
+   }
 
-   assert(handle->lock && handle->cond_lock &&
-      handle->cond && handle->audio_fifo &&
-      handle->attr_fifo && handle->video_fifo && handle->thread);
+   handle->alive = true;
+   handle->mux_thread = sthread_create(ffemu_mux_thread, handle);
+   handle->video_thread = sthread_create(ffemu_video_thread, handle);
+   handle->audio_thread = sthread_create(ffemu_audio_thread, handle);
+
+   assert(handle->video_lock && handle->video_cond &&
+      handle->audio_lock && handle->audio_cond &&
+      handle->mux_lock && handle->mux_cond &&
+      handle->muxer.queue[FFEMU_STREAM_VIDEO].space &&
+      handle->muxer.queue[FFEMU_STREAM_AUDIO].space &&
+      handle->audio_fifo && handle->mux_thread &&
+      handle->video_thread && handle->audio_thread);
 
    return true;
 }
 
+// Waiters check their condition with the lock held, so signal with it held as well.
+static void ffemu_signal(slock_t *lock, scond_t *cond)
+{
+   slock_lock(lock);
+   scond_signal(cond);
+   slock_unlock(lock);
+}
+
+// Stops the threads. Data still queued is left for ffemu_flush_buffers().
 static void deinit_thread(ffemu_t *handle)
 {
-   if (!handle->thread)
+   if (!handle->alive)
       return;
 
-   slock_lock(handle->cond_lock);
    handle->alive = false;
-   handle->can_sleep = false;
-   slock_unlock(handle->cond_lock);
 
-   scond_signal(handle->cond);
-   sthread_join(handle->thread);
+   // Wake up everything which might be waiting.
+   ffemu_signal(handle->video_lock, handle->video_cond);
+   ffemu_signal(handle->audio_lock, handle->audio_cond);
+   ffemu_signal(handle->mux_lock, handle->mux_cond);
+   for (unsigned i = 0; i < FFEMU_STREAMS; i++)
+      ffemu_signal(handle->mux_lock, handle->muxer.queue[i].space);
 
-   slock_free(handle->lock);
-   slock_free(handle->cond_lock);
-   scond_free(handle->cond);
+   sthread_join(handle->video_thread);
+   sthread_join(handle->audio_thread);
+   sthread_join(handle->mux_thread);
 
-   handle->thread = NULL;
+   handle->video_thread = NULL;
+   handle->audio_thread = NULL;
+   handle->mux_thread = NULL;
 }
 
 static void deinit_thread_buf(ffemu_t *handle)
@@ -602,21 +853,50 @@ static void deinit_thread_buf(ffemu_t *handle)
       fifo_free(handle->audio_fifo);
       handle->audio_fifo = NULL;
    }
-   
-   if (handle->attr_fifo)
-   {
-      fifo_free(handle->attr_fifo);
-      handle->attr_fifo = NULL;
-   }
 
-   if (handle->video_fifo)
+   for (unsigned i = 0; i < FFEMU_STREAMS; i++)
    {
-      fifo_free(handle->video_fifo);
-      handle->video_fifo = NULL;
+      struct ffemu_packet_queue *queue = &handle->muxer.queue[i];
+      while (queue->head)
+      {
+         struct ffemu_packet *next = queue->head->next;
+         av_free(queue->head);
+         queue->head = next;
+      }
+      queue->tail = NULL;
+      queue->count = 0;
+
+      if (queue->space)
+         scond_free(queue->space);
+      queue->space = NULL;
    }
+
+   if (handle->video_lock)
+      slock_free(handle->video_lock);
+   if (handle->video_cond)
+      scond_free(handle->video_cond);
+   if (handle->audio_lock)
+      slock_free(handle->audio_lock);
+   if (handle->audio_cond)
+      scond_free(handle->audio_cond);
+   if (handle->mux_lock)
+      slock_free(handle->mux_lock);
+   if (handle->mux_cond)
+      scond_free(handle->mux_cond);
+
+   handle->video_lock = NULL;
+   handle->video_cond = NULL;
+   handle->audio_lock = NULL;
+   handle->audio_cond = NULL;
+   handle->mux_lock = NULL;
+   handle->mux_cond = NULL;
+
+   deinit_slots(handle);
 }
 
-ffemu_t *ffemu_new(const struct ffemu_params *params)
+static void ffmpeg_free(void *data);
+
+static void *ffmpeg_new(const struct ffemu_params *params)
 {
    av_register_all();
    avformat_network_init();
@@ -648,12 +928,13 @@ ffemu_t *ffemu_new(const struct ffemu_params *params)
    return handle;
 
 error:
-   ffemu_free(handle);
+   ffmpeg_free(handle);
    return NULL;
 }
 
-void ffemu_free(ffemu_t *handle)
+static void ffmpeg_free(void *data)
 {
+   ffemu_t *handle = (ffemu_t*)data;
    if (!handle)
       return;
 
@@ -700,95 +981,206 @@ void ffemu_free(ffemu_t *handle)
    free(handle);
 }
 
-bool ffemu_push_video(ffemu_t *handle, const struct ffemu_video_data *data)
+static bool ffemu_get_slot(ffemu_t *handle, unsigned *index)
 {
-   bool drop_frame = handle->video.frame_drop_count++ % handle->video.frame_drop_ratio;
-   handle->video.frame_drop_count %= handle->video.frame_drop_ratio;
-   if (drop_frame)
+   if (index_queue_pop(&handle->free_slots, index))
       return true;
 
-   for (;;)
+   if (handle->config.frame_queue_overflow == FFEMU_OVERFLOW_DROP)
    {
-      slock_lock(handle->lock);
-      unsigned avail = fifo_write_avail(handle->attr_fifo);
-      slock_unlock(handle->lock);
+      handle->frame_stats.dropped++;
+      return false;
+   }
 
-      if (!handle->alive)
-         return false;
+   // New slots go straight to the caller. Only the video thread pushes to free_slots.
+   if (handle->config.frame_queue_overflow == FFEMU_OVERFLOW_GROW &&
+         handle->slots_alloc < handle->config.frame_queue_max_size &&
+         ffemu_alloc_slot(handle, index))
+      return true;
 
-      if (avail >= sizeof(*data))
-         break;
+   handle->frame_stats.blocked++;
+   rarch_time_t start = rarch_get_time_usec();
 
-      slock_lock(handle->cond_lock);
-      if (handle->can_sleep)
-      {
-         handle->can_sleep = false;
-         scond_wait(handle->cond, handle->cond_lock);
-         handle->can_sleep = true;
-      }
-      else
-         scond_signal(handle->cond);
+   bool ret;
+   slock_lock(handle->video_lock);
+   while (!(ret = index_queue_pop(&handle->free_slots, index)) && handle->alive)
+      scond_wait(handle->video_cond, handle->video_lock);
+   slock_unlock(handle->video_lock);
+
+   handle->frame_stats.block_time += rarch_get_time_usec() - start;
+   return ret;
+}
 
-      slock_unlock(handle->cond_lock);
+static bool ffmpeg_push_video(void *data, const struct ffemu_video_data *video_data)
+{
+   ffemu_t *handle = (ffemu_t*)data;
+
+   bool drop_frame = handle->video.frame_drop_count++ % handle->video.frame_drop_ratio;
+   handle->video.frame_drop_count %= handle->video.frame_drop_ratio;
+   if (drop_frame)
+      return true;
+
+   if (!video_data->is_dupe && (size_t)video_data->width * video_data->height * handle->video.pix_size > handle->slot_size)
+   {
+      RARCH_ERR("Frame of %ux%u doesn't fit in recording buffer.\n", video_data->width, video_data->height);
+      return false;
    }
 
-   slock_lock(handle->lock);
+   unsigned index;
+   if (!ffemu_get_slot(handle, &index))
+      return handle->alive; // Dropped, or shutting down.
+
+   struct ffemu_frame_slot *slot = &handle->slots[index];
 
    // Tightly pack our frame to conserve memory. libretro tends to use a very large pitch.
-   struct ffemu_video_data attr_data = *data;
+   slot->attr = *video_data;
+   slot->attr.data = slot->data;
 
-   if (attr_data.is_dupe)
-      attr_data.width = attr_data.height = attr_data.pitch = 0;
+   if (slot->attr.is_dupe)
+      slot->attr.width = slot->attr.height = slot->attr.pitch = 0;
    else
-      attr_data.pitch = attr_data.width * handle->video.pix_size;
+      slot->attr.pitch = slot->attr.width * handle->video.pix_size;
 
-   fifo_write(handle->attr_fifo, &attr_data, sizeof(attr_data));
+   const uint8_t *src = (const uint8_t*)video_data->data;
+   if (video_data->pitch == slot->attr.pitch)
+      memcpy(slot->data, src, slot->attr.pitch * slot->attr.height);
+   else
+   {
+      for (unsigned y = 0; y < slot->attr.height; y++, src += video_data->pitch)
+         memcpy(slot->data + y * slot->attr.pitch, src, slot->attr.pitch);
+   }
 
-   int offset = 0;
-   for (unsigned y = 0; y < attr_data.height; y++, offset += data->pitch)
-      fifo_write(handle->video_fifo, (const uint8_t*)data->data + offset, attr_data.pitch);
+   index_queue_push(&handle->video_queue, index);
+   ffemu_signal(handle->video_lock, handle->video_cond);
 
-   slock_unlock(handle->lock);
-   scond_signal(handle->cond);
+   handle->frame_stats.frames++;
+   unsigned queued = index_queue_size(&handle->video_queue);
+   if (queued > handle->frame_stats.peak)
+      handle->frame_stats.peak = queued;
 
    return true;
 }
 
-bool ffemu_push_audio(ffemu_t *handle, const struct ffemu_audio_data *data)
+static bool ffmpeg_push_audio(void *data, const struct ffemu_audio_data *audio_data)
 {
-   for (;;)
+   ffemu_t *handle = (ffemu_t*)data;
+   size_t size = audio_data->frames * handle->params.channels * sizeof(int16_t);
+
+   slock_lock(handle->audio_lock);
+   while (handle->alive && fifo_write_avail(handle->audio_fifo) < size)
+      scond_wait(handle->audio_cond, handle->audio_lock);
+
+   bool alive = handle->alive;
+   if (alive)
    {
-      slock_lock(handle->lock);
-      unsigned avail = fifo_write_avail(handle->audio_fifo);
-      slock_unlock(handle->lock);
+      fifo_write(handle->audio_fifo, audio_data->data, size);
+      scond_signal(handle->audio_cond);
+   }
+   slock_unlock(handle->audio_lock);
 
-      if (!handle->alive)
-         return false;
+   return alive;
+}
 
-      if (avail >= data->frames * handle->params.channels * sizeof(int16_t))
-         break;
+// The muxer writes packets in timestamp order. If one stream runs this far ahead of the other,
+// e.g. because of encoder delay, it stops waiting and lets libavformat interleave instead.
+#define MUX_INTERLEAVE_PACKETS 64
+// Encoders wait for the muxer beyond this.
+#define MUX_MAX_PACKETS 256
 
-      slock_lock(handle->cond_lock);
-      if (handle->can_sleep)
-      {
-         handle->can_sleep = false;
-         scond_wait(handle->cond, handle->cond_lock);
-         handle->can_sleep = true;
-      }
-      else
-         scond_signal(handle->cond);
+static int64_t ffemu_packet_ts(const AVPacket *pkt)
+{
+   return pkt->dts != (int64_t)AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+}
 
-      slock_unlock(handle->cond_lock);
-   }
+// Called from the video and audio threads, and when flushing.
+static bool ffemu_mux_push(ffemu_t *handle, enum ffemu_stream stream, const AVPacket *pkt)
+{
+   struct ffemu_packet *packet = (struct ffemu_packet*)av_malloc(sizeof(*packet) + pkt->size);
+   if (!packet)
+      return false;
+
+   packet->pkt      = *pkt;
+   packet->pkt.data = (uint8_t*)(packet + 1);
+   packet->next     = NULL;
+   memcpy(packet->pkt.data, pkt->data, pkt->size);
+
+   struct ffemu_packet_queue *queue = &handle->muxer.queue[stream];
 
-   slock_lock(handle->lock);
-   fifo_write(handle->audio_fifo, data->data, data->frames * handle->params.channels * sizeof(int16_t));
-   slock_unlock(handle->lock);
-   scond_signal(handle->cond);
+   slock_lock(handle->mux_lock);
+   while (handle->alive && queue->count >= MUX_MAX_PACKETS)
+      scond_wait(queue->space, handle->mux_lock);
 
+   if (queue->tail)
+      queue->tail->next = packet;
+   else
+      queue->head = packet;
+   queue->tail = packet;
+   queue->count++;
+
+   scond_signal(handle->mux_cond);
+   slock_unlock(handle->mux_lock);
    return true;
 }
 
+// Pops the packet which should be muxed next, or NULL to wait for the other stream.
+// Everything goes when flushing. Mux lock must be held.
+static struct ffemu_packet *ffemu_mux_pop(ffemu_t *handle, bool flush, enum ffemu_stream *stream)
+{
+   struct ffemu_packet_queue *video = &handle->muxer.queue[FFEMU_STREAM_VIDEO];
+   struct ffemu_packet_queue *audio = &handle->muxer.queue[FFEMU_STREAM_AUDIO];
+
+   if (video->head && audio->head)
+   {
+      *stream = av_compare_ts(ffemu_packet_ts(&video->head->pkt), handle->muxer.vstream->time_base,
+            ffemu_packet_ts(&audio->head->pkt), handle->muxer.astream->time_base) <= 0 ?
+         FFEMU_STREAM_VIDEO : FFEMU_STREAM_AUDIO;
+   }
+   else if (video->head && (flush || video->count > MUX_INTERLEAVE_PACKETS))
+      *stream = FFEMU_STREAM_VIDEO;
+   else if (audio->head && (flush || audio->count > MUX_INTERLEAVE_PACKETS))
+      *stream = FFEMU_STREAM_AUDIO;
+   else
+      return NULL;
+
+   struct ffemu_packet_queue *queue = &handle->muxer.queue[*stream];
+   struct ffemu_packet *packet = queue->head;
+   queue->head = packet->next;
+   if (!queue->head)
+      queue->tail = NULL;
+   queue->count--;
+
+   return packet;
+}
+
+static void ffemu_mux_write(ffemu_t *handle, struct ffemu_packet *packet)
+{
+   if (!handle->muxer.error && av_interleaved_write_frame(handle->muxer.ctx, &packet->pkt) < 0)
+   {
+      RARCH_ERR("[FFmpeg]: Failed to write packet. Recording will be incomplete.\n");
+      handle->muxer.error = true;
+   }
+
+   av_free(packet);
+}
+
+// Writes whatever can be written in order, or everything when flushing.
+// Only used once the threads are stopped.
+static void ffemu_mux_flush(ffemu_t *handle, bool flush)
+{
+   for (;;)
+   {
+      enum ffemu_stream stream;
+      slock_lock(handle->mux_lock);
+      struct ffemu_packet *packet = ffemu_mux_pop(handle, flush, &stream);
+      slock_unlock(handle->mux_lock);
+
+      if (!packet)
+         break;
+
+      ffemu_mux_write(handle, packet);
+   }
+}
+
 static bool encode_video(ffemu_t *handle, AVPacket *pkt, AVFrame *frame)
 {
    av_init_packet(pkt);
@@ -847,6 +1239,7 @@ static void ffemu_scale_input(ffemu_t *handle, const struct ffemu_video_data *da
          handle->video.scaler.in_stride = data->pitch;
 
          handle->video.scaler.scaler_type = shrunk ? SCALER_TYPE_BILINEAR : SCALER_TYPE_POINT;
+         handle->video.scaler.threads     = g_settings.video.scaler_threads;
 
          handle->video.scaler.out_width  = handle->params.out_width;
          handle->video.scaler.out_height = handle->params.out_height;
@@ -872,7 +1265,7 @@ static bool ffemu_push_video_thread(ffemu_t *handle, const struct ffemu_video_da
 
    if (pkt.size)
    {
-      if (av_interleaved_write_frame(handle->muxer.ctx, &pkt) < 0)
+      if (!ffemu_mux_push(handle, FFEMU_STREAM_VIDEO, &pkt))
          return false;
    }
 
@@ -1076,7 +1469,7 @@ static bool ffemu_push_audio_thread(ffemu_t *handle, struct ffemu_audio_data *da
 
       if (pkt.size)
       {
-         if (av_interleaved_write_frame(handle->muxer.ctx, &pkt) < 0)
+         if (!ffemu_mux_push(handle, FFEMU_STREAM_AUDIO, &pkt))
             return false;
       }
    }
@@ -1102,7 +1495,7 @@ static void ffemu_flush_audio(ffemu_t *handle, void *audio_buf, size_t audio_buf
    {
       AVPacket pkt;
       if (!encode_audio(handle, &pkt, true) || !pkt.size ||
-            av_interleaved_write_frame(handle->muxer.ctx, &pkt) < 0)
+            !ffemu_mux_push(handle, FFEMU_STREAM_AUDIO, &pkt))
          break;
    }
 }
@@ -1113,14 +1506,13 @@ static void ffemu_flush_video(ffemu_t *handle)
    {
       AVPacket pkt;
       if (!encode_video(handle, &pkt, NULL) || !pkt.size ||
-            av_interleaved_write_frame(handle->muxer.ctx, &pkt) < 0)
+            !ffemu_mux_push(handle, FFEMU_STREAM_VIDEO, &pkt))
          break;
    }
 }
 
 static void ffemu_flush_buffers(ffemu_t *handle)
 {
-   void *video_buf = av_malloc(2 * handle->params.fb_width * handle->params.fb_height * handle->video.pix_size);
    size_t audio_buf_size = handle->audio.codec->frame_size * handle->params.channels * sizeof(int16_t);
    void *audio_buf = av_malloc(audio_buf_size);
 
@@ -1142,16 +1534,16 @@ static void ffemu_flush_buffers(ffemu_t *handle)
          did_work = true;
       }
 
-      struct ffemu_video_data attr_buf;
-      if (fifo_read_avail(handle->attr_fifo) >= sizeof(attr_buf))
+      unsigned index;
+      if (index_queue_pop(&handle->video_queue, &index))
       {
-         fifo_read(handle->attr_fifo, &attr_buf, sizeof(attr_buf));
-         fifo_read(handle->video_fifo, video_buf, attr_buf.height * attr_buf.pitch);
-         attr_buf.data = video_buf;
-         ffemu_push_video_thread(handle, &attr_buf);
+         ffemu_push_video_thread(handle, &handle->slots[index].attr);
+         index_queue_push(&handle->free_slots, index);
 
          did_work = true;
       }
+
+      ffemu_mux_flush(handle, false);
    } while (did_work);
 
    // Flush out last audio.
@@ -1160,17 +1552,26 @@ static void ffemu_flush_buffers(ffemu_t *handle)
    // Flush out last video.
    ffemu_flush_video(handle);
 
-   av_free(video_buf);
+   // Mux whatever the encoders left behind.
+   ffemu_mux_flush(handle, true);
+
    av_free(audio_buf);
 }
 
-bool ffemu_finalize(ffemu_t *handle)
+static bool ffmpeg_finalize(void *data)
 {
+   ffemu_t *handle = (ffemu_t*)data;
+
    deinit_thread(handle);
 
    // Flush out data still in buffers (internal, and FFmpeg internal).
    ffemu_flush_buffers(handle);
 
+   const struct ffemu_frame_stats *stats = &handle->frame_stats;
+   RARCH_LOG("[FFmpeg]: Frame queue: %u frames, %u dropped, blocked %u times (%.1f ms), %u slots, at most %u queued.\n",
+         stats->frames, stats->dropped, stats->blocked, stats->block_time / 1000.0,
+         handle->slots_alloc, stats->peak);
+
    deinit_thread_buf(handle);
 
    // Write final data.
@@ -1179,75 +1580,95 @@ bool ffemu_finalize(ffemu_t *handle)
    return true;
 }
 
-static void ffemu_thread(void *data)
+static void ffemu_video_thread(void *data)
 {
    ffemu_t *ff = (ffemu_t*)data;
 
-   // For some reason, FFmpeg has a tendency to crash if we don't overallocate a bit. :s
-   void *video_buf = av_malloc(2 * ff->params.fb_width * ff->params.fb_height * ff->video.pix_size);
-   assert(video_buf);
+   while (ff->alive)
+   {
+      unsigned index;
+      bool avail;
+
+      slock_lock(ff->video_lock);
+      while (!(avail = index_queue_pop(&ff->video_queue, &index)) && ff->alive)
+         scond_wait(ff->video_cond, ff->video_lock);
+      slock_unlock(ff->video_lock);
+
+      if (!avail)
+         break;
+
+      // Scaled straight from the slot, then handed back.
+      ffemu_push_video_thread(ff, &ff->slots[index].attr);
+      index_queue_push(&ff->free_slots, index);
+      ffemu_signal(ff->video_lock, ff->video_cond);
+   }
+}
+
+static void ffemu_audio_thread(void *data)
+{
+   ffemu_t *ff = (ffemu_t*)data;
 
    size_t audio_buf_size = ff->audio.codec->frame_size * ff->params.channels * sizeof(int16_t);
    void *audio_buf = av_malloc(audio_buf_size);
 
    while (ff->alive)
    {
-      struct ffemu_video_data attr_buf;
+      slock_lock(ff->audio_lock);
+      while (ff->alive && fifo_read_avail(ff->audio_fifo) < audio_buf_size)
+         scond_wait(ff->audio_cond, ff->audio_lock);
 
-      bool avail_video = false;
-      bool avail_audio = false;
+      if (!ff->alive)
+      {
+         slock_unlock(ff->audio_lock);
+         break;
+      }
 
-      slock_lock(ff->lock);
-      if (fifo_read_avail(ff->attr_fifo) >= sizeof(attr_buf))
-         avail_video = true;
+      fifo_read(ff->audio_fifo, audio_buf, audio_buf_size);
+      scond_signal(ff->audio_cond);
+      slock_unlock(ff->audio_lock);
 
-      if (fifo_read_avail(ff->audio_fifo) >= audio_buf_size)
-         avail_audio = true;
-      slock_unlock(ff->lock);
+      struct ffemu_audio_data aud = {0};
+      aud.frames = ff->audio.codec->frame_size;
+      aud.data = audio_buf;
 
-      if (!avail_video && !avail_audio)
-      {
-         slock_lock(ff->cond_lock);
-         if (ff->can_sleep)
-         {
-            ff->can_sleep = false;
-            scond_wait(ff->cond, ff->cond_lock);
-            ff->can_sleep = true;
-         }
-         else
-            scond_signal(ff->cond);
+      ffemu_push_audio_thread(ff, &aud, true);
+   }
 
-         slock_unlock(ff->cond_lock);
-      }
+   av_free(audio_buf);
+}
 
-      if (avail_video)
+static void ffemu_mux_thread(void *data)
+{
+   ffemu_t *ff = (ffemu_t*)data;
+
+   slock_lock(ff->mux_lock);
+   while (ff->alive)
+   {
+      enum ffemu_stream stream;
+      struct ffemu_packet *packet = ffemu_mux_pop(ff, false, &stream);
+      if (!packet)
       {
-         slock_lock(ff->lock);
-         fifo_read(ff->attr_fifo, &attr_buf, sizeof(attr_buf));
-         fifo_read(ff->video_fifo, video_buf, attr_buf.height * attr_buf.pitch);
-         slock_unlock(ff->lock);
-         scond_signal(ff->cond);
-
-         attr_buf.data = video_buf;
-         ffemu_push_video_thread(ff, &attr_buf);
+         scond_wait(ff->mux_cond, ff->mux_lock);
+         continue;
       }
 
-      if (avail_audio)
-      {
-         slock_lock(ff->lock);
-         fifo_read(ff->audio_fifo, audio_buf, audio_buf_size);
-         slock_unlock(ff->lock);
-         scond_signal(ff->cond);
+      scond_signal(ff->muxer.queue[stream].space);
+      slock_unlock(ff->mux_lock);
 
-         struct ffemu_audio_data aud = {0};
-         aud.frames = ff->audio.codec->frame_size;
-         aud.data = audio_buf;
+      // Disk I/O happens without the lock, so the encoders can keep queueing.
+      ffemu_mux_write(ff, packet);
 
-         ffemu_push_audio_thread(ff, &aud, true);
-      }
+      slock_lock(ff->mux_lock);
    }
-
-   av_free(video_buf);
-   av_free(audio_buf);
+   slock_unlock(ff->mux_lock);
 }
 
+const ffemu_backend_t ffemu_ffmpeg = {
+   ffmpeg_new,
+   ffmpeg_free,
+   ffmpeg_push_video,
+   ffmpeg_push_audio,
+   ffmpeg_finalize,
+   "ffmpeg",
+};
+
@@ -78,14 +78,21 @@ struct ffemu_audio_data
    size_t frames;
 };
 
-typedef struct ffemu ffemu_t;
+// A recorder backend, picked by the extension of the file recorded to.
+typedef struct ffemu_backend
+{
+   void *(*init)(const struct ffemu_params *params);
+   void (*free)(void *data);
+
+   bool (*push_video)(void *data, const struct ffemu_video_data *video_data);
+   bool (*push_audio)(void *data, const struct ffemu_audio_data *audio_data);
+   bool (*finalize)(void *data);
 
-ffemu_t *ffemu_new(const struct ffemu_params *params);
-void ffemu_free(ffemu_t* handle);
+   const char *ident;
+} ffemu_backend_t;
 
-bool ffemu_push_video(ffemu_t *handle, const struct ffemu_video_data *data);
-bool ffemu_push_audio(ffemu_t *handle, const struct ffemu_audio_data *data);
-bool ffemu_finalize(ffemu_t *handle);
+extern const ffemu_backend_t ffemu_ffmpeg;
+extern const ffemu_backend_t ffemu_rcap; // Native lossless capture, see rcap.h. Always available.
 
 #ifdef __cplusplus
 }
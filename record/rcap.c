@@ -0,0 +1,298 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2013 - Hans-Kristian Arntzen
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Recorder backend writing the native capture format. See rcap.h.
+// Compressing a delta is cheap enough to be done right away on the emulator thread.
+
+#include "rcap.h"
+#include "ffemu.h"
+#include "../general.h"
+#include "../conf/config_file.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// A key frame every 5 seconds at 60 fps.
+#define RCAP_KEY_INTERVAL 300
+
+typedef struct rcap
+{
+   FILE *file;
+   uint64_t offset;
+   bool error;
+
+   struct rcap_header header;
+   unsigned pix_size;
+
+   // Packed frames. prev is what deltas are taken against.
+   uint8_t *frame;
+   uint8_t *prev;
+   size_t frame_size;
+   unsigned width;
+   unsigned height;
+   unsigned since_key;
+
+   uint8_t *rle;
+   uint8_t *lz;
+
+   uint32_t frames;
+   struct rcap_index_entry *index;
+   size_t index_size;
+   size_t index_cap;
+
+   uint64_t raw_bytes;
+   uint64_t video_bytes;
+   uint64_t audio_bytes;
+} rcap_t;
+
+static bool rcap_write(rcap_t *rcap, const void *data, size_t size)
+{
+   if (rcap->error)
+      return false;
+   if (!size)
+      return true;
+
+   if (fwrite(data, 1, size, rcap->file) != size)
+   {
+      RARCH_ERR("[RCAP]: Failed to write capture. Disk full?\n");
+      rcap->error = true;
+      return false;
+   }
+
+   rcap->offset += size;
+   return true;
+}
+
+static bool rcap_write_chunk(rcap_t *rcap, enum rcap_chunk_type type,
+      const void *head, size_t head_size, const void *data, size_t size)
+{
+   struct rcap_chunk chunk;
+   chunk.type = type;
+   chunk.size = head_size + size;
+
+   return rcap_write(rcap, &chunk, sizeof(chunk)) &&
+      rcap_write(rcap, head, head_size) &&
+      rcap_write(rcap, data, size);
+}
+
+static void rcap_free(void *data)
+{
+   rcap_t *rcap = (rcap_t*)data;
+   if (!rcap)
+      return;
+
+   if (rcap->file)
+      fclose(rcap->file);
+
+   free(rcap->frame);
+   free(rcap->prev);
+   free(rcap->rle);
+   free(rcap->lz);
+   free(rcap->index);
+   free(rcap);
+}
+
+static void *rcap_init(const struct ffemu_params *params)
+{
+   rcap_t *rcap = (rcap_t*)calloc(1, sizeof(*rcap));
+   if (!rcap)
+      return NULL;
+
+   struct rcap_header *header = &rcap->header;
+   header->magic        = RCAP_MAGIC;
+   header->version      = RCAP_VERSION;
+   header->pix_fmt      = params->pix_fmt;
+   header->channels     = params->channels;
+   header->fps          = params->fps;
+   header->sample_rate  = params->samplerate;
+   header->out_width    = params->out_width;
+   header->out_height   = params->out_height;
+   header->aspect_ratio = params->aspect_ratio;
+   header->key_interval = RCAP_KEY_INTERVAL;
+
+   if (params->config)
+   {
+      config_file_t *conf = config_file_new(params->config);
+      if (!conf)
+      {
+         RARCH_ERR("[RCAP]: Failed to load record config \"%s\".\n", params->config);
+         goto error;
+      }
+
+      unsigned key_interval;
+      if (config_get_uint(conf, "key_interval", &key_interval) && key_interval)
+         header->key_interval = key_interval;
+      config_file_free(conf);
+   }
+
+   rcap->pix_size   = rcap_pix_size(params->pix_fmt);
+   rcap->frame_size = params->fb_width * params->fb_height * rcap->pix_size;
+   rcap->frame      = (uint8_t*)malloc(rcap->frame_size);
+   rcap->prev       = (uint8_t*)malloc(rcap->frame_size);
+   rcap->rle        = (uint8_t*)malloc(rcap_rle_bound(rcap->frame_size));
+   rcap->lz         = (uint8_t*)malloc(rcap_lz_bound(rcap_rle_bound(rcap->frame_size)));
+   if (!rcap->frame || !rcap->prev || !rcap->rle || !rcap->lz)
+      goto error;
+
+   rcap->file = fopen(params->filename, "wb");
+   if (!rcap->file)
+   {
+      RARCH_ERR("[RCAP]: Failed to open \"%s\".\n", params->filename);
+      goto error;
+   }
+   setvbuf(rcap->file, NULL, _IOFBF, 1 << 20);
+
+   if (!rcap_write(rcap, header, sizeof(*header)))
+      goto error;
+
+   return rcap;
+
+error:
+   rcap_free(rcap);
+   return NULL;
+}
+
+static bool rcap_add_index(rcap_t *rcap, const struct rcap_video *video)
+{
+   if (rcap->index_size >= rcap->index_cap)
+   {
+      size_t cap = rcap->index_cap ? 2 * rcap->index_cap : 4096;
+      struct rcap_index_entry *index = (struct rcap_index_entry*)
+         realloc(rcap->index, cap * sizeof(*index));
+      if (!index)
+         return false;
+
+      rcap->index     = index;
+      rcap->index_cap = cap;
+   }
+
+   struct rcap_index_entry *entry = &rcap->index[rcap->index_size++];
+   entry->offset = rcap->offset;
+   entry->frame  = video->frame;
+   entry->flags  = video->flags;
+   return true;
+}
+
+static bool rcap_push_video(void *data, const struct ffemu_video_data *video_data)
+{
+   rcap_t *rcap = (rcap_t*)data;
+
+   struct rcap_video video = {0};
+   video.frame = rcap->frames;
+
+   // Frameskip, or the core duped. Costs nothing, but keeps the frame count in sync with audio.
+   if (video_data->is_dupe)
+   {
+      video.flags = RCAP_FRAME_DUPE;
+      if (!rcap_add_index(rcap, &video))
+         return false;
+
+      rcap->frames++;
+      return rcap_write_chunk(rcap, RCAP_CHUNK_VIDEO, &video, sizeof(video), NULL, 0);
+   }
+
+   size_t line_size = video_data->width * rcap->pix_size;
+   size_t size      = line_size * video_data->height;
+   if (size > rcap->frame_size)
+   {
+      RARCH_ERR("[RCAP]: Frame of %ux%u doesn't fit in recording buffer.\n",
+            video_data->width, video_data->height);
+      return false;
+   }
+
+   // Pitch is negative for bottom-up GPU read-backs.
+   const uint8_t *src = (const uint8_t*)video_data->data;
+   if ((size_t)video_data->pitch == line_size)
+      memcpy(rcap->frame, src, size);
+   else
+   {
+      for (unsigned y = 0; y < video_data->height; y++, src += video_data->pitch)
+         memcpy(rcap->frame + y * line_size, src, line_size);
+   }
+
+   if (video_data->width != rcap->width || video_data->height != rcap->height ||
+         rcap->since_key >= rcap->header.key_interval)
+   {
+      memset(rcap->prev, 0, size);
+      video.flags |= RCAP_FRAME_KEY;
+      rcap->since_key = 0;
+   }
+   rcap->since_key++;
+
+   video.width    = video_data->width;
+   video.height   = video_data->height;
+   video.rle_size = rcap_rle_encode(rcap->rle, rcap->frame, rcap->prev, size);
+   size_t lz_size = rcap_lz_compress(rcap->lz, rcap->rle, video.rle_size);
+
+   uint8_t *tmp = rcap->prev;
+   rcap->prev   = rcap->frame;
+   rcap->frame  = tmp;
+   rcap->width  = video_data->width;
+   rcap->height = video_data->height;
+
+   rcap->raw_bytes   += size;
+   rcap->video_bytes += lz_size;
+
+   if (!rcap_add_index(rcap, &video))
+      return false;
+
+   rcap->frames++;
+   return rcap_write_chunk(rcap, RCAP_CHUNK_VIDEO, &video, sizeof(video), rcap->lz, lz_size);
+}
+
+static bool rcap_push_audio(void *data, const struct ffemu_audio_data *audio_data)
+{
+   rcap_t *rcap = (rcap_t*)data;
+   size_t size = audio_data->frames * rcap->header.channels * sizeof(int16_t);
+
+   rcap->audio_bytes += size;
+   return rcap_write_chunk(rcap, RCAP_CHUNK_AUDIO, NULL, 0, audio_data->data, size);
+}
+
+static bool rcap_finalize(void *data)
+{
+   rcap_t *rcap = (rcap_t*)data;
+
+   uint64_t index_offset = rcap->offset;
+   if (!rcap_write_chunk(rcap, RCAP_CHUNK_INDEX, NULL, 0,
+            rcap->index, rcap->index_size * sizeof(*rcap->index)))
+      return false;
+
+   rcap->header.index_offset = index_offset;
+   if (fseek(rcap->file, 0, SEEK_SET) != 0 ||
+         fwrite(&rcap->header, sizeof(rcap->header), 1, rcap->file) != 1 ||
+         fflush(rcap->file) != 0)
+   {
+      RARCH_ERR("[RCAP]: Failed to write index.\n");
+      return false;
+   }
+
+   RARCH_LOG("[RCAP]: %u frames, %.1f MB video (%.1f:1), %.1f MB audio.\n",
+         (unsigned)rcap->frames, rcap->video_bytes / 1000000.0,
+         rcap->video_bytes ? (double)rcap->raw_bytes / rcap->video_bytes : 0.0,
+         rcap->audio_bytes / 1000000.0);
+
+   return true;
+}
+
+const ffemu_backend_t ffemu_rcap = {
+   rcap_init,
+   rcap_free,
+   rcap_push_video,
+   rcap_push_audio,
+   rcap_finalize,
+   "rcap",
+};
+
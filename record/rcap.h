@@ -0,0 +1,115 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2013 - Hans-Kristian Arntzen
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RCAP_H
+#define __RCAP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "../boolean.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// RetroArch capture (.rcap). Lossless, cheap enough to write in real time, and needs no libraries.
+// Use tools/retroarch-transcode to turn it into something a video encoder can read.
+//
+// Everything is stored in host byte order. The magic catches files from the other endianness.
+//
+// Layout:
+//    struct rcap_header
+//    Chunks, each a struct rcap_chunk followed by 'size' bytes of payload.
+//    The last chunk is an RCAP_CHUNK_INDEX if the recording was finalized.
+//
+// Video chunk: struct rcap_video, followed by the compressed frame.
+//    Frames are packed (pitch is width * pixel size), and XORed against the previous frame,
+//    unless they are key frames. The result is run-length coded (rcap_rle_encode),
+//    then LZ compressed (rcap_lz_compress).
+// Audio chunk: Interleaved signed 16-bit PCM.
+// Index chunk: One struct rcap_index_entry per video frame.
+
+#define RCAP_MAGIC 0x50414352 // "RCAP"
+#define RCAP_VERSION 1
+
+struct rcap_header
+{
+   uint32_t magic;
+   uint32_t version;
+   uint32_t pix_fmt; // enum ffemu_pix_format.
+   uint32_t channels;
+   double fps;
+   double sample_rate;
+   // What the frontend asked for, e.g. with --size. Frames are stored as they came in.
+   uint32_t out_width;
+   uint32_t out_height;
+   float aspect_ratio;
+   uint32_t key_interval;
+   uint64_t index_offset; // 0 if the recording wasn't finalized.
+};
+
+enum rcap_chunk_type
+{
+   RCAP_CHUNK_VIDEO = 1,
+   RCAP_CHUNK_AUDIO,
+   RCAP_CHUNK_INDEX
+};
+
+struct rcap_chunk
+{
+   uint32_t type;
+   uint32_t size;
+};
+
+#define RCAP_FRAME_KEY  (1 << 0) // Not a delta. Decoding can start here.
+#define RCAP_FRAME_DUPE (1 << 1) // Same as the last frame. No data.
+
+struct rcap_video
+{
+   uint32_t frame;
+   uint32_t flags;
+   uint32_t width;
+   uint32_t height;
+   uint32_t rle_size; // Size after run-length coding, before LZ.
+};
+
+struct rcap_index_entry
+{
+   uint64_t offset; // Of the chunk.
+   uint32_t frame;
+   uint32_t flags;
+};
+
+unsigned rcap_pix_size(unsigned pix_fmt);
+
+// Worst case output sizes.
+size_t rcap_rle_bound(size_t size);
+size_t rcap_lz_bound(size_t size);
+
+// Run-length codes cur XOR prev. Use a cleared prev for key frames.
+size_t rcap_rle_encode(uint8_t *out, const uint8_t *cur, const uint8_t *prev, size_t size);
+// XORs the decoded delta into frame. Clear frame first for key frames.
+bool rcap_rle_decode(uint8_t *frame, size_t size, const uint8_t *in, size_t in_size);
+
+size_t rcap_lz_compress(uint8_t *out, const uint8_t *in, size_t in_size);
+// Fails if the data is corrupt, or doesn't decompress to exactly out_size bytes.
+bool rcap_lz_decompress(uint8_t *out, size_t out_size, const uint8_t *in, size_t in_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -0,0 +1,341 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2013 - Hans-Kristian Arntzen
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Frame compression for the capture format. Shared by the recorder and retroarch-transcode.
+
+#include "rcap.h"
+#include "ffemu.h"
+#include <string.h>
+
+unsigned rcap_pix_size(unsigned pix_fmt)
+{
+   switch (pix_fmt)
+   {
+      case FFEMU_PIX_RGB565:
+         return 2;
+      case FFEMU_PIX_BGR24:
+         return 3;
+      case FFEMU_PIX_ARGB8888:
+         return 4;
+      default:
+         return 0;
+   }
+}
+
+static inline uint64_t load64(const uint8_t *ptr)
+{
+   uint64_t val;
+   memcpy(&val, ptr, sizeof(val));
+   return val;
+}
+
+static inline uint32_t load32(const uint8_t *ptr)
+{
+   uint32_t val;
+   memcpy(&val, ptr, sizeof(val));
+   return val;
+}
+
+// Run-length coding of the delta.
+// A sequence of (varint zero bytes, varint literal bytes, literal bytes).
+// Short zero runs are kept in the literals, so the output is never much larger than the input.
+#define RLE_MIN_ZEROS 4
+
+size_t rcap_rle_bound(size_t size)
+{
+   return size + 16;
+}
+
+static uint8_t *write_varint(uint8_t *out, size_t val)
+{
+   while (val >= 0x80)
+   {
+      *out++ = (uint8_t)(val | 0x80);
+      val >>= 7;
+   }
+   *out++ = (uint8_t)val;
+   return out;
+}
+
+static bool read_varint(const uint8_t **in, const uint8_t *end, size_t *val)
+{
+   size_t ret = 0;
+   for (unsigned shift = 0; *in < end && shift < 8 * sizeof(size_t); shift += 7)
+   {
+      uint8_t byte = *(*in)++;
+      ret |= (size_t)(byte & 0x7f) << shift;
+      if (!(byte & 0x80))
+      {
+         *val = ret;
+         return true;
+      }
+   }
+   return false;
+}
+
+static size_t skip_zeros(const uint8_t *cur, const uint8_t *prev, size_t i, size_t size)
+{
+   while (i + 8 <= size && load64(cur + i) == load64(prev + i))
+      i += 8;
+   while (i < size && cur[i] == prev[i])
+      i++;
+   return i;
+}
+
+static size_t skip_literals(const uint8_t *cur, const uint8_t *prev, size_t i, size_t size)
+{
+   // Whole words without a zero byte in the delta. The byte loop finds the first one.
+   while (i + 8 <= size)
+   {
+      uint64_t delta = load64(cur + i) ^ load64(prev + i);
+      if ((delta - 0x0101010101010101ULL) & ~delta & 0x8080808080808080ULL)
+         break;
+      i += 8;
+   }
+   while (i < size && cur[i] != prev[i])
+      i++;
+   return i;
+}
+
+size_t rcap_rle_encode(uint8_t *out, const uint8_t *cur, const uint8_t *prev, size_t size)
+{
+   uint8_t *o = out;
+   size_t i = 0;
+
+   while (i < size)
+   {
+      size_t zero_start = i;
+      i = skip_zeros(cur, prev, i, size);
+
+      // Extend the literals over zero runs which are too short to be worth coding.
+      size_t lit_start = i;
+      size_t lit_end   = i;
+      while (lit_end < size)
+      {
+         lit_end = skip_literals(cur, prev, lit_end, size);
+
+         size_t zero_end = lit_end;
+         while (zero_end < size && zero_end - lit_end < RLE_MIN_ZEROS && cur[zero_end] == prev[zero_end])
+            zero_end++;
+
+         if (zero_end - lit_end >= RLE_MIN_ZEROS || zero_end == size)
+            break;
+         lit_end = zero_end;
+      }
+
+      o = write_varint(o, lit_start - zero_start);
+      o = write_varint(o, lit_end - lit_start);
+
+      for (; i + 8 <= lit_end; i += 8, o += 8)
+      {
+         uint64_t delta = load64(cur + i) ^ load64(prev + i);
+         memcpy(o, &delta, sizeof(delta));
+      }
+      for (; i < lit_end; i++)
+         *o++ = cur[i] ^ prev[i];
+   }
+
+   return o - out;
+}
+
+bool rcap_rle_decode(uint8_t *frame, size_t size, const uint8_t *in, size_t in_size)
+{
+   const uint8_t *end = in + in_size;
+   size_t i = 0;
+
+   while (in < end)
+   {
+      size_t zeros, literals;
+      if (!read_varint(&in, end, &zeros) || !read_varint(&in, end, &literals))
+         return false;
+
+      if (zeros > size - i)
+         return false;
+      i += zeros;
+
+      if (literals > size - i || literals > (size_t)(end - in))
+         return false;
+
+      for (size_t j = 0; j < literals; j++)
+         frame[i + j] ^= in[j];
+
+      i  += literals;
+      in += literals;
+   }
+
+   return i == size;
+}
+
+// LZ77 in the style of LZ4.
+// Sequences of a token (literal length << 4 | match length - 4), literals, 16-bit offset.
+// Lengths of 15 continue in extra bytes, 255 meaning another byte follows.
+// The last sequence has only literals.
+#define LZ_HASH_BITS 14
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 0xffff
+
+size_t rcap_lz_bound(size_t size)
+{
+   return size + size / 255 + 16;
+}
+
+static inline uint32_t lz_hash(uint32_t seq)
+{
+   return (seq * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static uint8_t *lz_write_length(uint8_t *out, size_t len)
+{
+   for (len -= 15; len >= 255; len -= 255)
+      *out++ = 255;
+   *out++ = (uint8_t)len;
+   return out;
+}
+
+static bool lz_read_length(const uint8_t **in, const uint8_t *end, size_t *len)
+{
+   for (;;)
+   {
+      if (*in >= end)
+         return false;
+
+      uint8_t byte = *(*in)++;
+      *len += byte;
+      if (byte != 255)
+         return true;
+   }
+}
+
+static uint8_t *lz_write_sequence(uint8_t *out, const uint8_t *literals, size_t num_literals,
+      size_t offset, size_t match_len)
+{
+   uint8_t *token = out++;
+   *token = (num_literals < 15 ? num_literals : 15) << 4;
+   if (num_literals >= 15)
+      out = lz_write_length(out, num_literals);
+
+   memcpy(out, literals, num_literals);
+   out += num_literals;
+
+   if (!offset)
+      return out;
+
+   *out++ = offset & 0xff;
+   *out++ = offset >> 8;
+
+   match_len -= LZ_MIN_MATCH;
+   *token |= match_len < 15 ? match_len : 15;
+   if (match_len >= 15)
+      out = lz_write_length(out, match_len);
+
+   return out;
+}
+
+size_t rcap_lz_compress(uint8_t *out, const uint8_t *in, size_t in_size)
+{
+   uint32_t table[1 << LZ_HASH_BITS];
+   memset(table, 0, sizeof(table));
+
+   const uint8_t *ip     = in;
+   const uint8_t *anchor = in;
+   const uint8_t *end    = in + in_size;
+   const uint8_t *limit  = in_size >= LZ_MIN_MATCH ? end - LZ_MIN_MATCH : in;
+   uint8_t *op = out;
+
+   // Step faster through data which doesn't compress.
+   unsigned misses = 0;
+
+   while (ip < limit)
+   {
+      uint32_t seq = load32(ip);
+      uint32_t hash = lz_hash(seq);
+      const uint8_t *ref = in + table[hash];
+      table[hash] = ip - in;
+
+      if (ref >= ip || ip - ref > LZ_MAX_OFFSET || load32(ref) != seq)
+      {
+         ip += 1 + (misses++ >> 6);
+         continue;
+      }
+
+      const uint8_t *match_end = ip + LZ_MIN_MATCH;
+      ref += LZ_MIN_MATCH;
+      while (match_end < end && *match_end == *ref)
+      {
+         match_end++;
+         ref++;
+      }
+
+      op = lz_write_sequence(op, anchor, ip - anchor, match_end - ref, match_end - ip);
+      ip = anchor = match_end;
+      misses = 0;
+   }
+
+   return lz_write_sequence(op, anchor, end - anchor, 0, 0) - out;
+}
+
+bool rcap_lz_decompress(uint8_t *out, size_t out_size, const uint8_t *in, size_t in_size)
+{
+   const uint8_t *ip  = in;
+   const uint8_t *end = in + in_size;
+   uint8_t *op   = out;
+   uint8_t *oend = out + out_size;
+
+   while (ip < end)
+   {
+      unsigned token = *ip++;
+
+      size_t num_literals = token >> 4;
+      if (num_literals == 15 && !lz_read_length(&ip, end, &num_literals))
+         return false;
+      if (num_literals > (size_t)(end - ip) || num_literals > (size_t)(oend - op))
+         return false;
+
+      memcpy(op, ip, num_literals);
+      op += num_literals;
+      ip += num_literals;
+
+      if (ip == end)
+         break;
+
+      if (end - ip < 2)
+         return false;
+      size_t offset = ip[0] | (ip[1] << 8);
+      ip += 2;
+      if (!offset || offset > (size_t)(op - out))
+         return false;
+
+      size_t match_len = token & 15;
+      if (match_len == 15 && !lz_read_length(&ip, end, &match_len))
+         return false;
+      match_len += LZ_MIN_MATCH;
+      if (match_len > (size_t)(oend - op))
+         return false;
+
+      // Matches may overlap themselves, which is how runs are coded.
+      const uint8_t *ref = op - offset;
+      if (offset >= match_len)
+         memcpy(op, ref, match_len);
+      else
+      {
+         for (size_t i = 0; i < match_len; i++)
+            op[i] = ref[i];
+      }
+      op += match_len;
+   }
+
+   return op == oend;
+}
+
@@ -0,0 +1,295 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2013 - Hans-Kristian Arntzen
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Round trips frames through the capture compression, checks that corrupt data is rejected,
+// and benchmarks it on something resembling a 2D game.
+
+#include "rcap.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static double get_time(void)
+{
+   struct timespec tv;
+   clock_gettime(CLOCK_MONOTONIC, &tv);
+   return tv.tv_sec + tv.tv_nsec / 1000000000.0;
+}
+
+struct codec_buffers
+{
+   uint8_t *rle;
+   uint8_t *lz;
+   uint8_t *rle_dec;
+   uint8_t *frame_dec;
+};
+
+static void buffers_init(struct codec_buffers *buf, size_t size)
+{
+   buf->rle       = (uint8_t*)malloc(rcap_rle_bound(size));
+   buf->lz        = (uint8_t*)malloc(rcap_lz_bound(rcap_rle_bound(size)));
+   buf->rle_dec   = (uint8_t*)malloc(rcap_rle_bound(size));
+   buf->frame_dec = (uint8_t*)malloc(size + 1);
+}
+
+static void buffers_free(struct codec_buffers *buf)
+{
+   free(buf->rle);
+   free(buf->lz);
+   free(buf->rle_dec);
+   free(buf->frame_dec);
+}
+
+// Encodes cur against prev, and decodes it again on top of prev.
+static bool round_trip(struct codec_buffers *buf, const uint8_t *cur, const uint8_t *prev,
+      size_t size, size_t *compressed)
+{
+   size_t rle_size = rcap_rle_encode(buf->rle, cur, prev, size);
+   if (rle_size > rcap_rle_bound(size))
+      return false;
+
+   size_t lz_size = rcap_lz_compress(buf->lz, buf->rle, rle_size);
+   if (lz_size > rcap_lz_bound(rle_size))
+      return false;
+
+   if (compressed)
+      *compressed = lz_size;
+
+   memcpy(buf->frame_dec, prev, size);
+   buf->frame_dec[size] = 0xa5; // Guard.
+
+   return rcap_lz_decompress(buf->rle_dec, rle_size, buf->lz, lz_size) &&
+      rcap_rle_decode(buf->frame_dec, size, buf->rle_dec, rle_size) &&
+      memcmp(buf->frame_dec, cur, size) == 0 &&
+      buf->frame_dec[size] == 0xa5;
+}
+
+enum pattern
+{
+   PATTERN_RANDOM = 0,
+   PATTERN_ZERO,
+   PATTERN_SPARSE,
+   PATTERN_RUNS,
+   PATTERN_ALTERNATING,
+
+   PATTERNS
+};
+
+static const char *pattern_names[PATTERNS] = {
+   "random", "zero", "sparse", "runs", "alternating",
+};
+
+static void fill_pattern(uint8_t *cur, const uint8_t *prev, size_t size, enum pattern pattern)
+{
+   memcpy(cur, prev, size);
+   for (size_t i = 0; i < size; i++)
+   {
+      switch (pattern)
+      {
+         case PATTERN_RANDOM:
+            cur[i] = rand();
+            break;
+         case PATTERN_SPARSE:
+            if ((rand() & 63) == 0)
+               cur[i] = rand();
+            break;
+         case PATTERN_RUNS:
+            if ((i / 37) & 1)
+               cur[i] = (uint8_t)(i / 37);
+            break;
+         case PATTERN_ALTERNATING:
+            // Worst case for the run-length coder.
+            if ((i % 5) == 0)
+               cur[i] ^= 0xff;
+            break;
+         default:
+            break;
+      }
+   }
+}
+
+static bool test_patterns(void)
+{
+   static const size_t sizes[] = { 0, 1, 3, 4, 7, 8, 9, 15, 16, 17, 255, 256, 1000, 65536 + 13, 256 * 224 * 2 };
+
+   bool ret = true;
+   for (unsigned s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+   {
+      size_t size = sizes[s];
+      struct codec_buffers buf;
+      buffers_init(&buf, size);
+
+      uint8_t *prev = (uint8_t*)malloc(size + 1);
+      uint8_t *cur  = (uint8_t*)malloc(size + 1);
+
+      for (unsigned p = 0; p < PATTERNS; p++)
+      {
+         for (unsigned key = 0; key < 2; key++)
+         {
+            if (key)
+               memset(prev, 0, size);
+            else
+               fill_pattern(prev, prev, size, PATTERN_RANDOM);
+
+            fill_pattern(cur, prev, size, (enum pattern)p);
+
+            if (!round_trip(&buf, cur, prev, size, NULL))
+            {
+               fprintf(stderr, "%s %s, %u bytes: MISMATCH.\n", pattern_names[p],
+                     key ? "key" : "delta", (unsigned)size);
+               ret = false;
+            }
+         }
+      }
+
+      free(prev);
+      free(cur);
+      buffers_free(&buf);
+   }
+
+   fprintf(stderr, "Round trips: %s.\n", ret ? "OK" : "FAILED");
+   return ret;
+}
+
+// Decoding truncated or damaged data must fail or produce garbage, but never touch memory
+// outside the buffers. Run under a memory checker to make that meaningful.
+static bool test_corrupt(void)
+{
+   const size_t size = 4096;
+   struct codec_buffers buf;
+   buffers_init(&buf, size);
+
+   uint8_t *prev = (uint8_t*)calloc(1, size);
+   uint8_t *cur  = (uint8_t*)malloc(size);
+   fill_pattern(cur, prev, size, PATTERN_RUNS);
+
+   size_t rle_size = rcap_rle_encode(buf.rle, cur, prev, size);
+   size_t lz_size  = rcap_lz_compress(buf.lz, buf.rle, rle_size);
+
+   bool ret = true;
+   for (size_t len = 0; len < lz_size; len++)
+   {
+      if (rcap_lz_decompress(buf.rle_dec, rle_size, buf.lz, len))
+         ret = false;
+   }
+
+   for (unsigned i = 0; i < 1000; i++)
+   {
+      uint8_t *damaged = (uint8_t*)malloc(lz_size);
+      memcpy(damaged, buf.lz, lz_size);
+      damaged[rand() % lz_size] ^= 1 << (rand() & 7);
+
+      if (rcap_lz_decompress(buf.rle_dec, rle_size, damaged, lz_size))
+         rcap_rle_decode(buf.frame_dec, size, buf.rle_dec, rle_size);
+      free(damaged);
+   }
+
+   for (size_t len = 0; len < rle_size; len++)
+   {
+      if (rcap_rle_decode(buf.frame_dec, size, buf.rle, len))
+         ret = false;
+   }
+
+   free(prev);
+   free(cur);
+   buffers_free(&buf);
+
+   fprintf(stderr, "Truncated data: %s.\n", ret ? "OK" : "ACCEPTED");
+   return ret;
+}
+
+// A scrolling tiled background with a few moving sprites, in RGB565.
+static void render_scene(uint16_t *frame, unsigned width, unsigned height, unsigned t)
+{
+   for (unsigned y = 0; y < height; y++)
+   {
+      for (unsigned x = 0; x < width; x++)
+      {
+         unsigned tx = (x + t) & 15, ty = y & 15;
+         frame[y * width + x] = (tx == 0 || ty == 0) ? 0x18e3 : (uint16_t)(0x2104 * (((x + t) >> 4) & 3));
+      }
+   }
+
+   for (unsigned s = 0; s < 8; s++)
+   {
+      unsigned sx = (s * 37 + t * (s + 1)) % (width - 16);
+      unsigned sy = (s * 23 + t) % (height - 16);
+      for (unsigned y = 0; y < 16; y++)
+         for (unsigned x = 0; x < 16; x++)
+            frame[(sy + y) * width + sx + x] = (uint16_t)(0xf800 >> s) ^ (x * y);
+   }
+}
+
+static void bench(bool scroll)
+{
+   const unsigned width = 256, height = 224, frames = 600;
+   size_t size = width * height * sizeof(uint16_t);
+
+   struct codec_buffers buf;
+   buffers_init(&buf, size);
+   uint16_t *prev = (uint16_t*)calloc(1, size);
+   uint16_t *cur  = (uint16_t*)malloc(size);
+
+   double encode_time = 0.0, decode_time = 0.0;
+   size_t total = 0;
+   bool ok = true;
+
+   for (unsigned t = 0; t < frames; t++)
+   {
+      render_scene(cur, width, height, scroll ? t : 0);
+
+      double start = get_time();
+      size_t rle_size = rcap_rle_encode(buf.rle, (const uint8_t*)cur, (const uint8_t*)prev, size);
+      size_t lz_size  = rcap_lz_compress(buf.lz, buf.rle, rle_size);
+      encode_time += get_time() - start;
+      total += lz_size;
+
+      memcpy(buf.frame_dec, prev, size);
+      start = get_time();
+      ok &= rcap_lz_decompress(buf.rle_dec, rle_size, buf.lz, lz_size) &&
+         rcap_rle_decode(buf.frame_dec, size, buf.rle_dec, rle_size);
+      decode_time += get_time() - start;
+      ok &= memcmp(buf.frame_dec, cur, size) == 0;
+
+      uint16_t *tmp = prev;
+      prev = cur;
+      cur = tmp;
+   }
+
+   fprintf(stderr, "%s 256x224 RGB565: %.1f KiB/frame (%.1f:1), encode %.3f ms/frame, decode %.3f ms/frame%s.\n",
+         scroll ? "Scrolling" : "Static", total / 1024.0 / frames, (double)size * frames / total,
+         1000.0 * encode_time / frames, 1000.0 * decode_time / frames, ok ? "" : ", MISMATCH");
+
+   free(prev);
+   free(cur);
+   buffers_free(&buf);
+}
+
+int main(int argc, char *argv[])
+{
+   bool ret = true;
+   ret &= test_patterns();
+   ret &= test_corrupt();
+
+   if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+   {
+      bench(false);
+      bench(true);
+   }
+
+   return ret ? 0 : 1;
+}
+
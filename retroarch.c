@@ -25,7 +25,9 @@
 #include "general.h"
 #include "dynamic.h"
 #include "performance.h"
+#include "timeline.h"
 #include "audio/utils.h"
+#include "gfx/video_filter.h"
 #include "record/ffemu.h"
 #include "rewind.h"
 #include "movie.h"
@@ -191,7 +193,7 @@ static void readjust_audio_input_rate(void)
    //      g_extern.audio_data.src_ratio, g_extern.audio_data.orig_src_ratio);
 }
 
-#ifdef HAVE_FFMPEG
+#ifdef HAVE_RECORD
 static void deinit_recording(void);
 
 static void recording_dump_frame(const void *data, unsigned width, unsigned height, size_t pitch)
@@ -247,19 +249,108 @@ static void recording_dump_frame(const void *data, unsigned width, unsigned heig
       ffemu_data.is_dupe = !data;
    }
 
-   ffemu_push_video(g_extern.rec, &ffemu_data);
+   g_extern.rec_driver->push_video(g_extern.rec, &ffemu_data);
 }
 #endif
 
+// Set while re-pushing the cached frame, which is identical to the last one on purpose.
+static bool video_frame_cached;
+
+// Compares the frame against a copy of the previous one.
+// Lines are compared until the first difference, and only the remaining lines need to be copied.
+static bool video_frame_is_dupe(const void *data, unsigned width, unsigned height, size_t pitch)
+{
+   size_t line_size = width * (g_extern.system.pix_fmt == RETRO_PIXEL_FORMAT_XRGB8888 ? sizeof(uint32_t) : sizeof(uint16_t));
+
+   if (width != g_extern.frame_dupe.width || height != g_extern.frame_dupe.height)
+   {
+      size_t size = line_size * height;
+      if (size > g_extern.frame_dupe.size)
+      {
+         uint8_t *buffer = (uint8_t*)realloc(g_extern.frame_dupe.buffer, size);
+         if (!buffer)
+            return false;
+
+         g_extern.frame_dupe.buffer = buffer;
+         g_extern.frame_dupe.size = size;
+      }
+
+      g_extern.frame_dupe.width = width;
+      g_extern.frame_dupe.height = height;
+      g_extern.frame_dupe.valid = false;
+   }
+
+   const uint8_t *src = (const uint8_t*)data;
+   uint8_t *dst = g_extern.frame_dupe.buffer;
+
+   unsigned h = 0;
+   if (g_extern.frame_dupe.valid)
+   {
+      for (; h < height; h++, src += pitch, dst += line_size)
+         if (memcmp(dst, src, line_size))
+            break;
+
+      if (h == height)
+         return true;
+   }
+
+   for (; h < height; h++, src += pitch, dst += line_size)
+      memcpy(dst, src, line_size);
+
+   g_extern.frame_dupe.valid = true;
+   return false;
+}
+
 static void video_frame(const void *data, unsigned width, unsigned height, size_t pitch)
 {
-   if (!g_extern.video_active)
+   if (!g_extern.video_active || g_extern.run_ahead.hide_video)
       return;
 
-   if (g_extern.system.pix_fmt == RETRO_PIXEL_FORMAT_0RGB1555 && data)
+   if (g_extern.frameskip.skip)
+   {
+#ifdef HAVE_RECORD
+      // Keep the recording in sync by duping the last frame.
+      if (g_extern.recording)
+         recording_dump_frame(NULL, width, height, pitch);
+#endif
+      return;
+   }
+
+   RARCH_TIMELINE_BEGIN(RARCH_TIMELINE_VIDEO);
+
+   bool dupe = false;
+   if (!data && !video_frame_cached)
+      g_extern.frame_dupe.core_dupes = true;
+   else if (data && g_settings.video.dupe_detect && !g_extern.frame_dupe.core_dupes && !video_frame_cached)
+   {
+      RARCH_PERFORMANCE_INIT(video_frame_dupe);
+      RARCH_PERFORMANCE_START(video_frame_dupe);
+      dupe = video_frame_is_dupe(data, width, height, pitch);
+      RARCH_PERFORMANCE_STOP(video_frame_dupe);
+
+      g_extern.frame_dupe.checked++;
+      if (dupe)
+      {
+         g_extern.frame_dupe.skipped++;
+         data = NULL;
+      }
+   }
+
+   // If the driver takes 0RGB1555 directly, we only need a converted copy for recording.
+   const void *conv_data = data;
+   size_t conv_pitch = pitch;
+
+#ifdef HAVE_RECORD
+   bool need_conv = !driver.video_rgb1555 || g_extern.recording;
+#else
+   bool need_conv = !driver.video_rgb1555;
+#endif
+
+   if (g_extern.system.pix_fmt == RETRO_PIXEL_FORMAT_0RGB1555 && data && need_conv)
    {
       RARCH_PERFORMANCE_INIT(video_frame_conv);
       RARCH_PERFORMANCE_START(video_frame_conv);
+      RARCH_TIMELINE_BEGIN(RARCH_TIMELINE_VIDEO_CONV);
       driver.scaler.in_width = width;
       driver.scaler.in_height = height;
       driver.scaler.out_width = width;
@@ -268,16 +359,23 @@ static void video_frame(const void *data, unsigned width, unsigned height, size_
       driver.scaler.out_stride = width * sizeof(uint16_t);
 
       scaler_ctx_scale(&driver.scaler, driver.scaler_out, data);
-      data = driver.scaler_out;
-      pitch = driver.scaler.out_stride;
+      conv_data = driver.scaler_out;
+      conv_pitch = driver.scaler.out_stride;
+      RARCH_TIMELINE_END(RARCH_TIMELINE_VIDEO_CONV);
       RARCH_PERFORMANCE_STOP(video_frame_conv);
+
+      if (!driver.video_rgb1555)
+      {
+         data = conv_data;
+         pitch = conv_pitch;
+      }
    }
 
    // Slightly messy code,
    // but we really need to do processing before blocking on VSync for best possible scheduling.
-#ifdef HAVE_FFMPEG
+#ifdef HAVE_RECORD
    if (g_extern.recording && (!g_extern.filter.active || !g_settings.video.post_filter_record || !data || g_extern.record_gpu_buffer))
-      recording_dump_frame(data, width, height, pitch);
+      recording_dump_frame(conv_data, width, height, conv_pitch);
 #endif
 
    const char *msg = msg_queue_pull(g_extern.msg_queue);
@@ -287,44 +385,93 @@ static void video_frame(const void *data, unsigned width, unsigned height, size_
    if (g_extern.filter.active && data)
    {
       struct scaler_ctx *scaler = &g_extern.filter.scaler;
-      scaler->in_width   = scaler->out_width = width;
-      scaler->in_height  = scaler->out_height = height;
-      scaler->in_stride  = pitch;
-      scaler->out_stride = width * sizeof(uint16_t);
-
-      scaler_ctx_scale(scaler, g_extern.filter.scaler_out, data);
-
       unsigned owidth = width;
       unsigned oheight = height;
-      g_extern.filter.psize(&owidth, &oheight);
-      g_extern.filter.prender(g_extern.filter.colormap, g_extern.filter.buffer, 
-            g_extern.filter.pitch, g_extern.filter.scaler_out, scaler->out_stride, width, height);
 
-#ifdef HAVE_FFMPEG
+      RARCH_TIMELINE_BEGIN(RARCH_TIMELINE_VIDEO_FILTER);
+
+      if (g_extern.filter.plugin)
+      {
+         RARCH_PERFORMANCE_INIT(video_frame_filter);
+         RARCH_PERFORMANCE_START(video_frame_filter);
+
+         const void *input = data;
+         size_t input_pitch = pitch;
+         if (g_extern.filter.convert)
+         {
+            scaler->in_width   = scaler->out_width = width;
+            scaler->in_height  = scaler->out_height = height;
+            scaler->in_stride  = pitch;
+            scaler->out_stride = width * (scaler->out_fmt == SCALER_FMT_ARGB8888 ? sizeof(uint32_t) : sizeof(uint16_t));
+
+            scaler_ctx_scale(scaler, g_extern.filter.scaler_out, data);
+            input = g_extern.filter.scaler_out;
+            input_pitch = scaler->out_stride;
+         }
+
+         rarch_video_filter_output_size(g_extern.filter.plugin, &owidth, &oheight);
+         rarch_video_filter_render(g_extern.filter.plugin, g_extern.filter.buffer, g_extern.filter.pitch,
+               input, input_pitch, width, height);
+
+         RARCH_PERFORMANCE_STOP(video_frame_filter);
+      }
+      else
+      {
+         scaler->in_width   = scaler->out_width = width;
+         scaler->in_height  = scaler->out_height = height;
+         scaler->in_stride  = pitch;
+         scaler->out_stride = width * sizeof(uint16_t);
+
+         scaler_ctx_scale(scaler, g_extern.filter.scaler_out, data);
+
+         g_extern.filter.psize(&owidth, &oheight);
+         g_extern.filter.prender(g_extern.filter.colormap, g_extern.filter.buffer, 
+               g_extern.filter.pitch, (const uint16_t*)g_extern.filter.scaler_out, scaler->out_stride, width, height);
+      }
+
+      RARCH_TIMELINE_END(RARCH_TIMELINE_VIDEO_FILTER);
+
+#ifdef HAVE_RECORD
       if (g_extern.recording && g_settings.video.post_filter_record)
          recording_dump_frame(g_extern.filter.buffer, owidth, oheight, g_extern.filter.pitch);
 #endif
 
+      RARCH_TIMELINE_BEGIN(RARCH_TIMELINE_VIDEO_DRIVER);
       if (!video_frame_func(g_extern.filter.buffer, owidth, oheight, g_extern.filter.pitch, msg))
          g_extern.video_active = false;
+      RARCH_TIMELINE_END(RARCH_TIMELINE_VIDEO_DRIVER);
+   }
+   else
+   {
+      RARCH_TIMELINE_BEGIN(RARCH_TIMELINE_VIDEO_DRIVER);
+      if (!video_frame_func(data, width, height, pitch, msg))
+         g_extern.video_active = false;
+      RARCH_TIMELINE_END(RARCH_TIMELINE_VIDEO_DRIVER);
    }
-   else if (!video_frame_func(data, width, height, pitch, msg))
-      g_extern.video_active = false;
 #else
+   RARCH_TIMELINE_BEGIN(RARCH_TIMELINE_VIDEO_DRIVER);
    if (!video_frame_func(data, width, height, pitch, msg))
       g_extern.video_active = false;
+   RARCH_TIMELINE_END(RARCH_TIMELINE_VIDEO_DRIVER);
 #endif
 
+   RARCH_TIMELINE_END(RARCH_TIMELINE_VIDEO);
+
+   // The cached frame still holds what the core pushed.
+   if (dupe)
+      return;
+
    g_extern.frame_cache.data   = data;
    g_extern.frame_cache.width  = width;
    g_extern.frame_cache.height = height;
    g_extern.frame_cache.pitch  = pitch;
+   g_extern.frame_cache.driver_owned = data && data == g_extern.frame_cache.driver_fb;
 }
 
 void rarch_render_cached_frame(void)
 {
-#ifdef HAVE_FFMPEG
-   // Cannot allow FFmpeg recording when pushing duped frames.
+#ifdef HAVE_RECORD
+   // Cannot allow recording when pushing duped frames.
    bool recording = g_extern.recording;
    g_extern.recording = false;
 #endif
@@ -332,26 +479,61 @@ void rarch_render_cached_frame(void)
    // Not 100% safe, since the library might have
    // freed the memory, but no known implementations do this :D
    // It would be really stupid at any rate ...
+   video_frame_cached = true;
    video_frame(g_extern.frame_cache.data,
          g_extern.frame_cache.width,
          g_extern.frame_cache.height,
          g_extern.frame_cache.pitch);
+   video_frame_cached = false;
 
-#ifdef HAVE_FFMPEG
+#ifdef HAVE_RECORD
    g_extern.recording = recording;
 #endif
 }
 
+// Copies the cached frame out of a driver framebuffer, before the driver reuses or frees it.
+void rarch_detach_cached_frame(void)
+{
+   g_extern.frame_cache.driver_fb = NULL;
+   if (!g_extern.frame_cache.driver_owned)
+      return;
+   g_extern.frame_cache.driver_owned = false;
+
+   size_t line_size = g_extern.frame_cache.width *
+      (g_extern.system.pix_fmt == RETRO_PIXEL_FORMAT_XRGB8888 ? sizeof(uint32_t) : sizeof(uint16_t));
+   size_t size = line_size * g_extern.frame_cache.height;
+   if (size > g_extern.frame_cache.size)
+   {
+      uint8_t *buffer = (uint8_t*)realloc(g_extern.frame_cache.buffer, size);
+      if (!buffer)
+      {
+         g_extern.frame_cache.data = NULL;
+         return;
+      }
+
+      g_extern.frame_cache.buffer = buffer;
+      g_extern.frame_cache.size = size;
+   }
+
+   const uint8_t *src = (const uint8_t*)g_extern.frame_cache.data;
+   uint8_t *dst = g_extern.frame_cache.buffer;
+   for (unsigned h = 0; h < g_extern.frame_cache.height; h++, src += g_extern.frame_cache.pitch, dst += line_size)
+      memcpy(dst, src, line_size);
+
+   g_extern.frame_cache.data  = g_extern.frame_cache.buffer;
+   g_extern.frame_cache.pitch = line_size;
+}
+
 static bool audio_flush(const int16_t *data, size_t samples)
 {
-#ifdef HAVE_FFMPEG
+#ifdef HAVE_RECORD
    if (g_extern.recording)
    {
       struct ffemu_audio_data ffemu_data = {0};
       ffemu_data.data                    = data;
       ffemu_data.frames                  = samples / 2;
 
-      ffemu_push_audio(g_extern.rec, &ffemu_data);
+      g_extern.rec_driver->push_audio(g_extern.rec, &ffemu_data);
    }
 #endif
 
@@ -366,8 +548,10 @@ static bool audio_flush(const int16_t *data, size_t samples)
    struct resampler_data src_data = {0};
    RARCH_PERFORMANCE_INIT(audio_convert_s16);
    RARCH_PERFORMANCE_START(audio_convert_s16);
+   RARCH_TIMELINE_BEGIN(RARCH_TIMELINE_AUDIO_CONV);
    audio_convert_s16_to_float(g_extern.audio_data.data, data, samples,
          g_extern.audio_data.volume_gain);
+   RARCH_TIMELINE_END(RARCH_TIMELINE_AUDIO_CONV);
    RARCH_PERFORMANCE_STOP(audio_convert_s16);
 
 #if defined(HAVE_DYLIB)
@@ -377,7 +561,11 @@ static bool audio_flush(const int16_t *data, size_t samples)
    dsp_input.frames              = samples >> 1;
 
    if (g_extern.audio_data.dsp_plugin)
+   {
+      RARCH_TIMELINE_BEGIN(RARCH_TIMELINE_AUDIO_DSP);
       g_extern.audio_data.dsp_plugin->process(g_extern.audio_data.dsp_handle, &dsp_output, &dsp_input);
+      RARCH_TIMELINE_END(RARCH_TIMELINE_AUDIO_DSP);
+   }
 
    src_data.data_in      = dsp_output.samples ? dsp_output.samples : g_extern.audio_data.data;
    src_data.input_frames = dsp_output.samples ? dsp_output.frames : (samples >> 1);
@@ -397,37 +585,39 @@ static bool audio_flush(const int16_t *data, size_t samples)
 
    RARCH_PERFORMANCE_INIT(resampler_proc);
    RARCH_PERFORMANCE_START(resampler_proc);
+   RARCH_TIMELINE_BEGIN(RARCH_TIMELINE_AUDIO_RESAMPLE);
    rarch_resampler_process(g_extern.audio_data.resampler,
          g_extern.audio_data.resampler_data, &src_data);
+   RARCH_TIMELINE_END(RARCH_TIMELINE_AUDIO_RESAMPLE);
    RARCH_PERFORMANCE_STOP(resampler_proc);
 
    output_data   = g_extern.audio_data.outsamples;
    output_frames = src_data.output_frames;
 
-   if (g_extern.audio_data.use_float)
-   {
-      if (audio_write_func(output_data, output_frames * sizeof(float) * 2) < 0)
-      {
-         RARCH_ERR("Audio backend failed to write. Will continue without sound.\n");
-         return false;
-      }
-   }
-   else
+   const void *output = output_data;
+   size_t output_size = output_frames * sizeof(float) * 2;
+
+   if (!g_extern.audio_data.use_float)
    {
       RARCH_PERFORMANCE_INIT(audio_convert_float);
       RARCH_PERFORMANCE_START(audio_convert_float);
+      RARCH_TIMELINE_BEGIN(RARCH_TIMELINE_AUDIO_CONV);
       audio_convert_float_to_s16(g_extern.audio_data.conv_outsamples,
             output_data, output_frames * 2);
+      RARCH_TIMELINE_END(RARCH_TIMELINE_AUDIO_CONV);
       RARCH_PERFORMANCE_STOP(audio_convert_float);
 
-      if (audio_write_func(g_extern.audio_data.conv_outsamples, output_frames * sizeof(int16_t) * 2) < 0)
-      {
-         RARCH_ERR("Audio backend failed to write. Will continue without sound.\n");
-         return false;
-      }
+      output = g_extern.audio_data.conv_outsamples;
+      output_size = output_frames * sizeof(int16_t) * 2;
    }
 
-   return true;
+   RARCH_TIMELINE_BEGIN(RARCH_TIMELINE_AUDIO_WRITE);
+   bool ret = audio_write_func(output, output_size) >= 0;
+   RARCH_TIMELINE_END(RARCH_TIMELINE_AUDIO_WRITE);
+
+   if (!ret)
+      RARCH_ERR("Audio backend failed to write. Will continue without sound.\n");
+   return ret;
 }
 
 static void audio_sample_rewind(int16_t left, int16_t right)
@@ -447,24 +637,34 @@ size_t audio_sample_batch_rewind(const int16_t *data, size_t frames)
 
 static void audio_sample(int16_t left, int16_t right)
 {
+   if (g_extern.run_ahead.speculative)
+      return;
+
    g_extern.audio_data.conv_outsamples[g_extern.audio_data.data_ptr++] = left;
    g_extern.audio_data.conv_outsamples[g_extern.audio_data.data_ptr++] = right;
 
    if (g_extern.audio_data.data_ptr < g_extern.audio_data.chunk_size)
       return;
 
+   RARCH_TIMELINE_BEGIN(RARCH_TIMELINE_AUDIO);
    g_extern.audio_active = audio_flush(g_extern.audio_data.conv_outsamples,
          g_extern.audio_data.data_ptr) && g_extern.audio_active;
+   RARCH_TIMELINE_END(RARCH_TIMELINE_AUDIO);
 
    g_extern.audio_data.data_ptr = 0;
 }
 
 size_t audio_sample_batch(const int16_t *data, size_t frames)
 {
+   if (g_extern.run_ahead.speculative)
+      return frames;
+
    if (frames > (AUDIO_CHUNK_SIZE_NONBLOCKING >> 1))
       frames = AUDIO_CHUNK_SIZE_NONBLOCKING >> 1;
 
+   RARCH_TIMELINE_BEGIN(RARCH_TIMELINE_AUDIO);
    g_extern.audio_active = audio_flush(data, frames << 1) && g_extern.audio_active;
+   RARCH_TIMELINE_END(RARCH_TIMELINE_AUDIO);
    return frames;
 }
 
@@ -476,33 +676,42 @@ static inline void input_poll_overlay(void)
    unsigned device = input_overlay_full_screen(driver.overlay) ?
       RARCH_DEVICE_POINTER_SCREEN : RETRO_DEVICE_POINTER;
 
-   bool polled = false;
-   for (unsigned i = 0;
-         input_input_state_func(NULL, 0, device, i, RETRO_DEVICE_ID_POINTER_PRESSED);
-         i++)
+   int16_t x[INPUT_OVERLAY_MAX_POINTERS];
+   int16_t y[INPUT_OVERLAY_MAX_POINTERS];
+   unsigned count = 0;
+   while (count < INPUT_OVERLAY_MAX_POINTERS &&
+         input_input_state_func(NULL, 0, device, count, RETRO_DEVICE_ID_POINTER_PRESSED))
    {
-      int16_t x = input_input_state_func(NULL, 0,
-            device, i, RETRO_DEVICE_ID_POINTER_X);
-      int16_t y = input_input_state_func(NULL, 0,
-            device, i, RETRO_DEVICE_ID_POINTER_Y);
-
-      driver.overlay_state |= input_overlay_poll(driver.overlay, x, y);
-      polled = true;
+      x[count] = input_input_state_func(NULL, 0,
+            device, count, RETRO_DEVICE_ID_POINTER_X);
+      y[count] = input_input_state_func(NULL, 0,
+            device, count, RETRO_DEVICE_ID_POINTER_Y);
+      count++;
    }
 
-   if (!polled)
+   if (count)
+      driver.overlay_state = input_overlay_poll(driver.overlay, x, y, count);
+   else
       input_overlay_poll_clear(driver.overlay);
 }
 #endif
 
 static void input_poll(void)
 {
+   // Keep the input of the real frame.
+   if (g_extern.run_ahead.speculative)
+      return;
+
+   RARCH_TIMELINE_BEGIN(RARCH_TIMELINE_INPUT_POLL);
+
    input_poll_func();
 
 #ifdef HAVE_OVERLAY
    if (driver.overlay) // Poll overlay state
       input_poll_overlay();
 #endif
+
+   RARCH_TIMELINE_END(RARCH_TIMELINE_INPUT_POLL);
 }
 
 // Turbo scheme: If turbo button is held, all buttons pressed except for D-pad will go into
@@ -680,7 +889,8 @@ static void print_help(void)
 
 #ifdef HAVE_NETPLAY
    puts("\t-H/--host: Host netplay as player 1.");
-   puts("\t-C/--connect: Connect to netplay as player 2.");
+   puts("\t-C/--connect: Connect to netplay. The host decides which player you are.");
+   puts("\t--players: Number of players in netplay, up to 8. Only used by the host. Default is 2.");
    puts("\t--port: Port used to netplay. Default is 55435.");
    puts("\t-F/--frames: Sync frames when using netplay.");
    puts("\t--spectate: Netplay will become spectating mode.");
@@ -693,10 +903,15 @@ static void print_help(void)
    puts("\t\tAvailable commands are listed if command is invalid.");
 #endif
 
+#ifdef HAVE_RECORD
 #ifdef HAVE_FFMPEG
-   puts("\t-r/--record: Path to record video file.\n\t\tUsing .mkv extension is recommended.");
+   puts("\t-r/--record: Path to record video file.\n\t\tUsing .mkv extension is recommended.\n\t\t"
+         "Using .rcap records losslessly without encoding. Convert it with retroarch-transcode.");
+#else
+   puts("\t-r/--record: Path to record lossless .rcap capture to. Convert it with retroarch-transcode.");
+#endif
    puts("\t--recordconfig: Path to settings used during recording.");
-   puts("\t--size: Overrides output video size when recording with FFmpeg (format: WIDTHxHEIGHT).");
+   puts("\t--size: Overrides output video size when recording (format: WIDTHxHEIGHT).");
 #endif
    puts("\t-v/--verbose: Verbose logging.");
    puts("\t-U/--ups: Specifies path for UPS patch that will be applied to ROM.");
@@ -811,7 +1026,7 @@ static void parse_input(int argc, char *argv[])
       { "help", 0, NULL, 'h' },
       { "save", 1, NULL, 's' },
       { "fullscreen", 0, NULL, 'f' },
-#ifdef HAVE_FFMPEG
+#ifdef HAVE_RECORD
       { "record", 1, NULL, 'r' },
       { "recordconfig", 1, &val, 'R' },
       { "size", 1, &val, 's' },
@@ -844,6 +1059,7 @@ static void parse_input(int argc, char *argv[])
       { "port", 1, &val, 'p' },
       { "spectate", 0, &val, 'S' },
       { "nick", 1, &val, 'N' },
+      { "players", 1, &val, 'P' },
 #endif
 #ifdef HAVE_NETWORK_CMD
       { "command", 1, &val, 'c' },
@@ -858,10 +1074,10 @@ static void parse_input(int argc, char *argv[])
       { NULL, 0, NULL, 0 }
    };
 
-#ifdef HAVE_FFMPEG
-#define FFMPEG_RECORD_ARG "r:"
+#ifdef HAVE_RECORD
+#define RECORD_ARG "r:"
 #else
-#define FFMPEG_RECORD_ARG
+#define RECORD_ARG
 #endif
 
 #ifdef HAVE_DYNAMIC
@@ -882,7 +1098,7 @@ static void parse_input(int argc, char *argv[])
 #define BSV_MOVIE_ARG
 #endif
 
-   const char *optstring = "hs:fvS:m:p4jJA:g:b:c:B:Y:Z:U:DN:X:" BSV_MOVIE_ARG NETPLAY_ARG DYNAMIC_ARG FFMPEG_RECORD_ARG;
+   const char *optstring = "hs:fvS:m:p4jJA:g:b:c:B:Y:Z:U:DN:X:" BSV_MOVIE_ARG NETPLAY_ARG DYNAMIC_ARG RECORD_ARG;
 #ifdef RARCH_CONSOLE
    // hack - done for reentrancy reasons
    g_extern.has_set_save_path = false;
@@ -1001,7 +1217,7 @@ static void parse_input(int argc, char *argv[])
             strlcpy(g_extern.config_path, optarg, sizeof(g_extern.config_path));
             break;
 
-#ifdef HAVE_FFMPEG
+#ifdef HAVE_RECORD
          case 'r':
             strlcpy(g_extern.record_path, optarg, sizeof(g_extern.record_path));
             g_extern.recording = true;
@@ -1087,6 +1303,16 @@ static void parse_input(int argc, char *argv[])
                case 'N':
                   strlcpy(g_extern.netplay_nick, optarg, sizeof(g_extern.netplay_nick));
                   break;
+
+               case 'P':
+                  g_extern.netplay_players = strtoul(optarg, NULL, 0);
+                  if (g_extern.netplay_players < 2 || g_extern.netplay_players > MAX_PLAYERS)
+                  {
+                     RARCH_ERR("Netplay needs between 2 and %d players.\n", MAX_PLAYERS);
+                     print_help();
+                     rarch_fail(1, "parse_input()");
+                  }
+                  break;
 #endif
 
 #ifdef HAVE_NETWORK_CMD
@@ -1116,7 +1342,7 @@ static void parse_input(int argc, char *argv[])
                   g_extern.block_patch = true;
                   break;
 
-#ifdef HAVE_FFMPEG
+#ifdef HAVE_RECORD
                case 's':
                {
                   errno = 0;
@@ -1285,7 +1511,21 @@ static inline void save_files(void)
 }
 
 
+#ifdef HAVE_RECORD
+// .rcap is always the native capture. Anything else goes to FFmpeg, if we have it.
+static const ffemu_backend_t *find_record_driver(const char *path)
+{
+   if (strcasecmp(path_get_extension(path), "rcap") == 0)
+      return &ffemu_rcap;
+
 #ifdef HAVE_FFMPEG
+   return &ffemu_ffmpeg;
+#else
+   RARCH_WARN("Built without FFmpeg. Recording lossless capture to \"%s\" regardless.\n", path);
+   return &ffemu_rcap;
+#endif
+}
+
 static void init_recording(void)
 {
    if (!g_extern.recording)
@@ -1372,16 +1612,18 @@ static void init_recording(void)
       }
    }
 
-   RARCH_LOG("Recording with FFmpeg to %s @ %ux%u. (FB size: %ux%u pix_fmt: %u)\n",
-         g_extern.record_path,
+   g_extern.rec_driver = find_record_driver(g_extern.record_path);
+
+   RARCH_LOG("Recording with %s to %s @ %ux%u. (FB size: %ux%u pix_fmt: %u)\n",
+         g_extern.rec_driver->ident, g_extern.record_path,
          params.out_width, params.out_height,
          params.fb_width, params.fb_height,
          (unsigned)params.pix_fmt);
 
-   g_extern.rec = ffemu_new(&params);
+   g_extern.rec = g_extern.rec_driver->init(&params);
    if (!g_extern.rec)
    {
-      RARCH_ERR("Failed to start FFmpeg recording.\n");
+      RARCH_ERR("Failed to start recording.\n");
       g_extern.recording = false;
 
       free(g_extern.record_gpu_buffer);
@@ -1394,8 +1636,8 @@ static void deinit_recording(void)
    if (!g_extern.recording)
       return;
 
-   ffemu_finalize(g_extern.rec);
-   ffemu_free(g_extern.rec);
+   g_extern.rec_driver->finalize(g_extern.rec);
+   g_extern.rec_driver->free(g_extern.rec);
    g_extern.rec = NULL;
 
    free(g_extern.record_gpu_buffer);
@@ -1420,6 +1662,40 @@ void rarch_deinit_msg_queue(void)
    }
 }
 
+static void init_timeline(void)
+{
+   if (!g_settings.timeline_frames)
+      return;
+
+   g_extern.timeline = rarch_timeline_new(g_settings.timeline_frames);
+   if (g_extern.timeline)
+      RARCH_LOG("Recording frame timeline of the last %u frames.\n", g_settings.timeline_frames);
+   else
+      RARCH_ERR("Failed to allocate frame timeline.\n");
+}
+
+static void deinit_timeline(void)
+{
+   if (!g_extern.timeline)
+      return;
+
+   if (*g_settings.timeline_path)
+   {
+      const char *ext = path_get_extension(g_settings.timeline_path);
+      bool ret = strcasecmp(ext, "csv") == 0 ?
+         rarch_timeline_write_csv(g_extern.timeline, g_settings.timeline_path) :
+         rarch_timeline_write_trace(g_extern.timeline, g_settings.timeline_path);
+
+      if (ret)
+         RARCH_LOG("Wrote frame timeline to \"%s\".\n", g_settings.timeline_path);
+      else
+         RARCH_ERR("Failed to write frame timeline to \"%s\".\n", g_settings.timeline_path);
+   }
+
+   rarch_timeline_free(g_extern.timeline);
+   g_extern.timeline = NULL;
+}
+
 static void init_cheats(void)
 {
    if (*g_settings.cheat_database)
@@ -1479,6 +1755,214 @@ static void deinit_rewind(void)
    g_extern.state_buf = NULL;
 }
 
+// Shown frames in a row which must be fine before skipping less.
+#define FRAMESKIP_RECOVER_FRAMES 60
+
+// Decides whether the coming frame is shown.
+// Skips more when the audio buffer is about to underrun or frames take too long,
+// and less once both have been fine for a while.
+static void update_frameskip(void)
+{
+   rarch_time_t now = rarch_get_time_usec();
+   rarch_time_t budget = (rarch_time_t)(1000000.0 / g_extern.system.av_info.timing.fps);
+
+   if (g_extern.frameskip.last_time)
+   {
+      // Don't let pauses and the menu throw off the estimate.
+      rarch_time_t delta = now - g_extern.frameskip.last_time;
+      if (delta > 4 * budget)
+         delta = 4 * budget;
+      g_extern.frameskip.frame_time += (delta - g_extern.frameskip.frame_time) / 8;
+   }
+   else
+      g_extern.frameskip.frame_time = budget;
+   g_extern.frameskip.last_time = now;
+
+   unsigned min_level = g_settings.video.frameskip_min;
+   unsigned max_level = g_settings.video.frameskip_max;
+
+   // Only adjust when the next frame would be shown anyways, so every level gets a chance to work.
+   if (g_extern.frameskip.skipped_in_row >= g_extern.frameskip.level)
+   {
+      bool audio_low = false;
+      bool audio_ok  = true;
+      if (g_extern.audio_active && driver.audio->write_avail && driver.audio->buffer_size)
+      {
+         size_t size  = audio_buffer_size_func();
+         size_t avail = audio_write_avail_func();
+         if (size)
+         {
+            float fill = 1.0f - (float)avail / size;
+            audio_low  = fill < 0.25f;
+            audio_ok   = fill > 0.5f;
+         }
+      }
+
+      bool slow = g_extern.frameskip.frame_time > budget + budget / 10;
+      bool fast = g_extern.frameskip.frame_time <= budget + budget / 50;
+
+      if ((audio_low || slow) && g_extern.frameskip.level < max_level)
+      {
+         g_extern.frameskip.level++;
+         g_extern.frameskip.healthy = 0;
+      }
+      else if (audio_ok && fast)
+      {
+         if (++g_extern.frameskip.healthy >= FRAMESKIP_RECOVER_FRAMES && g_extern.frameskip.level > min_level)
+         {
+            g_extern.frameskip.level--;
+            g_extern.frameskip.healthy = 0;
+         }
+      }
+      else
+         g_extern.frameskip.healthy = 0;
+   }
+
+   if (g_extern.frameskip.level < min_level)
+      g_extern.frameskip.level = min_level;
+   else if (g_extern.frameskip.level > max_level)
+      g_extern.frameskip.level = max_level;
+
+   g_extern.frameskip.skip = g_extern.frameskip.skipped_in_row < g_extern.frameskip.level;
+   if (g_extern.frameskip.skip)
+   {
+      g_extern.frameskip.skipped_in_row++;
+      g_extern.frameskip.skipped++;
+   }
+   else
+      g_extern.frameskip.skipped_in_row = 0;
+
+   g_extern.frameskip.frames++;
+   if (g_extern.frameskip.level > g_extern.frameskip.max_level)
+      g_extern.frameskip.max_level = g_extern.frameskip.level;
+}
+
+static void deinit_frameskip(void)
+{
+   if (g_extern.frameskip.frames)
+   {
+      RARCH_LOG("Frameskip: %u of %u frames skipped (%.1f%%), at most %u in a row.\n",
+            g_extern.frameskip.skipped, g_extern.frameskip.frames,
+            100.0 * g_extern.frameskip.skipped / g_extern.frameskip.frames,
+            g_extern.frameskip.max_level);
+   }
+
+   memset(&g_extern.frameskip, 0, sizeof(g_extern.frameskip));
+}
+
+// Counters are kept for the performance log.
+static void deinit_frame_dupe(void)
+{
+   free(g_extern.frame_dupe.buffer);
+   g_extern.frame_dupe.buffer = NULL;
+   g_extern.frame_dupe.size = 0;
+   g_extern.frame_dupe.width = g_extern.frame_dupe.height = 0;
+   g_extern.frame_dupe.valid = false;
+   g_extern.frame_dupe.core_dupes = false;
+}
+
+static void init_run_ahead(void)
+{
+   if (!g_settings.run_ahead_frames)
+      return;
+
+   g_extern.run_ahead.state_size = pretro_serialize_size();
+   if (!g_extern.run_ahead.state_size)
+   {
+      RARCH_ERR("Implementation does not support save states. Cannot use run-ahead.\n");
+      return;
+   }
+
+   // Allocated once, every frame serializes into the same buffer.
+   g_extern.run_ahead.state = malloc(g_extern.run_ahead.state_size);
+   if (!g_extern.run_ahead.state)
+   {
+      RARCH_ERR("Failed to allocate memory for run-ahead.\n");
+      return;
+   }
+
+   g_extern.run_ahead.frames       = 0;
+   g_extern.run_ahead.run_time     = 0;
+   g_extern.run_ahead.extra_time   = 0;
+   g_extern.run_ahead.present_time = 0;
+   RARCH_LOG("Running %u frame(s) ahead.\n", g_settings.run_ahead_frames);
+}
+
+static void deinit_run_ahead(void)
+{
+   if (g_extern.run_ahead.frames)
+   {
+      double run_time   = (double)g_extern.run_ahead.run_time / g_extern.run_ahead.frames;
+      double extra_time = (double)(g_extern.run_ahead.extra_time - g_extern.run_ahead.present_time) /
+         g_extern.run_ahead.frames;
+      RARCH_LOG("Run-ahead: %u frames, %.1f usec/frame for the real frame, %.1f usec/frame extra (%.0f%% more CPU time).\n",
+            g_extern.run_ahead.frames, run_time, extra_time,
+            run_time > 0.0 ? 100.0 * extra_time / run_time : 0.0);
+   }
+
+   free(g_extern.run_ahead.state);
+   g_extern.run_ahead.state = NULL;
+   g_extern.run_ahead.frames = 0;
+}
+
+// Presenting the frame would happen without run-ahead as well, so it's not counted as overhead.
+static void video_frame_run_ahead(const void *data, unsigned width, unsigned height, size_t pitch)
+{
+   rarch_time_t start = rarch_get_time_usec();
+   video_frame(data, width, height, pitch);
+   g_extern.run_ahead.present_time += rarch_get_time_usec() - start;
+}
+
+// Runs the real frame without showing it, then runs ahead and shows the last speculative frame.
+// Afterwards, rolls back to the real frame. Audio only comes from the real frame, so it stays continuous.
+static void run_ahead(void)
+{
+   rarch_time_t start = rarch_get_time_usec();
+
+   g_extern.run_ahead.hide_video = true;
+   pretro_run();
+   g_extern.run_ahead.hide_video = false;
+
+   rarch_time_t ahead = rarch_get_time_usec();
+   g_extern.run_ahead.run_time += ahead - start;
+
+   RARCH_TIMELINE_BEGIN(RARCH_TIMELINE_RUN_AHEAD);
+
+   if (!pretro_serialize(g_extern.run_ahead.state, g_extern.run_ahead.state_size))
+   {
+      RARCH_ERR("Failed to serialize state for run-ahead. Disabling run-ahead.\n");
+      deinit_run_ahead();
+      RARCH_TIMELINE_END(RARCH_TIMELINE_RUN_AHEAD);
+      return;
+   }
+
+   g_extern.run_ahead.speculative = true;
+   g_extern.run_ahead.hide_video = true;
+   for (unsigned i = 1; i < g_settings.run_ahead_frames; i++)
+      pretro_run();
+   g_extern.run_ahead.hide_video = false;
+
+   pretro_set_video_refresh(video_frame_run_ahead);
+   pretro_run();
+   pretro_set_video_refresh(video_frame);
+   g_extern.run_ahead.speculative = false;
+
+   if (!pretro_unserialize(g_extern.run_ahead.state, g_extern.run_ahead.state_size))
+   {
+      // The game has now run ahead for real, which we can't undo.
+      RARCH_ERR("Failed to restore state after run-ahead. The game has skipped ahead %u frames. Disabling run-ahead.\n",
+            g_settings.run_ahead_frames);
+      deinit_run_ahead();
+      RARCH_TIMELINE_END(RARCH_TIMELINE_RUN_AHEAD);
+      return;
+   }
+
+   RARCH_TIMELINE_END(RARCH_TIMELINE_RUN_AHEAD);
+
+   g_extern.run_ahead.extra_time += rarch_get_time_usec() - ahead;
+   g_extern.run_ahead.frames++;
+}
+
 #ifdef HAVE_BSV_MOVIE
 static void init_movie(void)
 {
@@ -1552,11 +2036,11 @@ static void init_netplay(void)
       g_extern.netplay_is_client = true;
    }
    else
-      RARCH_LOG("Waiting for client...\n");
+      RARCH_LOG("Waiting for clients...\n");
 
    g_extern.netplay = netplay_new(g_extern.netplay_is_client ? g_extern.netplay_server : NULL,
          g_extern.netplay_port ? g_extern.netplay_port : RARCH_DEFAULT_PORT,
-         g_extern.netplay_sync_frames, &cbs, g_extern.netplay_is_spectate,
+         g_extern.netplay_sync_frames, g_extern.netplay_players, &cbs, g_extern.netplay_is_spectate,
          g_extern.netplay_nick);
 
    if (!g_extern.netplay)
@@ -2619,7 +3103,9 @@ static void do_state_checks(void)
       check_savestates(false);
 #endif
 
+      RARCH_TIMELINE_BEGIN(RARCH_TIMELINE_REWIND);
       check_rewind();
+      RARCH_TIMELINE_END(RARCH_TIMELINE_REWIND);
       check_slowmotion();
 
 #ifdef HAVE_BSV_MOVIE
@@ -2802,15 +3288,20 @@ int rarch_main_init(int argc, char *argv[])
 #ifdef HAVE_NETPLAY
    if (!g_extern.netplay)
 #endif
+   {
       init_rewind();
+      init_run_ahead();
+   }
       
    init_libretro_cbs();
    init_controllers();
    
-#ifdef HAVE_FFMPEG
+#ifdef HAVE_RECORD
    init_recording();
 #endif
 
+   init_timeline();
+
 #ifdef HAVE_NETPLAY
    g_extern.use_sram = !g_extern.sram_save_disable && !g_extern.netplay_is_client;
 #else
@@ -2843,6 +3334,7 @@ error:
    pretro_deinit();
    uninit_drivers();
    uninit_libretro_sym();
+   deinit_frame_dupe();
 
    g_extern.main_is_init = false;
    return 1;
@@ -2899,8 +3391,16 @@ bool rarch_main_iterate(void)
       rarch_cmd_pre_frame(driver.command);
 #endif
 
+   if (g_extern.timeline)
+   {
+      rarch_timeline_frame(g_extern.timeline, g_extern.frame_count);
+      rarch_timeline_begin(g_extern.timeline, RARCH_TIMELINE_FRAME);
+   }
+
    // Checks for stuff like fullscreen, save states, etc.
+   RARCH_TIMELINE_BEGIN(RARCH_TIMELINE_STATE_CHECKS);
    do_state_checks();
+   RARCH_TIMELINE_END(RARCH_TIMELINE_STATE_CHECKS);
 
    // Run libretro for one frame.
 #if defined(HAVE_THREADS) && !defined(RARCH_CONSOLE)
@@ -2917,7 +3417,22 @@ bool rarch_main_iterate(void)
       bsv_movie_set_frame_start(g_extern.bsv.movie);
 #endif
 
-   pretro_run();
+   if (g_settings.video.frameskip_auto)
+      update_frameskip();
+
+   // Movies record and replay input as it is read, and rewinding plays backwards, so run plainly then.
+   // Skipped frames are not shown, so there is nothing to run ahead for.
+   bool use_run_ahead = g_extern.run_ahead.state && !g_extern.frame_is_reverse && !g_extern.frameskip.skip;
+#ifdef HAVE_BSV_MOVIE
+   use_run_ahead = use_run_ahead && !g_extern.bsv.movie;
+#endif
+
+   RARCH_TIMELINE_BEGIN(RARCH_TIMELINE_RUN);
+   if (use_run_ahead)
+      run_ahead();
+   else
+      pretro_run();
+   RARCH_TIMELINE_END(RARCH_TIMELINE_RUN);
    g_extern.frame_count++;
 
 #ifdef HAVE_BSV_MOVIE
@@ -2934,6 +3449,8 @@ bool rarch_main_iterate(void)
    unlock_autosave();
 #endif
 
+   RARCH_TIMELINE_END(RARCH_TIMELINE_FRAME);
+
 #ifdef HAVE_RMENU
    if (input_key_pressed_func(RARCH_FRAMEADVANCE))
    {
@@ -2961,17 +3478,27 @@ void rarch_main_deinit(void)
       deinit_autosave();
 #endif
 
-#ifdef HAVE_FFMPEG
+#ifdef HAVE_RECORD
    deinit_recording();
 #endif
 
+   deinit_timeline();
+   deinit_frameskip();
+
+#ifdef HAVE_SCREENSHOTS
+   screenshot_deinit();
+#endif
+
    if (g_extern.use_sram)
       save_files();
 
 #ifdef HAVE_NETPLAY
    if (!g_extern.netplay)
 #endif
+   {
       deinit_rewind();
+      deinit_run_ahead();
+   }
 
    deinit_cheats();
 
@@ -2985,6 +3512,10 @@ void rarch_main_deinit(void)
    pretro_deinit();
    uninit_drivers();
    uninit_libretro_sym();
+   deinit_frame_dupe();
+
+   free(g_extern.frame_cache.buffer);
+   memset(&g_extern.frame_cache, 0, sizeof(g_extern.frame_cache));
 
    if (g_extern.rom_file_temporary)
    {
@@ -28,9 +28,17 @@
 #include "config.h"
 #endif
 
+#if defined(HAVE_THREADS) && !defined(RARCH_CONSOLE)
+#include "thread.h"
+#define SCREENSHOT_ASYNC
+#endif
+
 #ifdef HAVE_ZLIB_DEFLATE
 #include "gfx/rpng/rpng.h"
+#define IMG_EXT "png"
 #else
+#define IMG_EXT "bmp"
+
 static bool write_header_bmp(FILE *file, unsigned width, unsigned height)
 {
    unsigned line_size = (width * 3 + 3) & ~3;
@@ -58,91 +66,262 @@ static bool write_header_bmp(FILE *file, unsigned width, unsigned height)
 
    return fwrite(header, 1, sizeof(header), file) == sizeof(header);
 }
+#endif
 
-static void dump_lines_file(FILE *file, uint8_t **lines, size_t line_size, unsigned height)
+// Converts to BGR24 with the SIMD converters of the scaler.
+static bool convert_bgr24(uint8_t *out, int out_stride, const uint8_t *frame,
+      unsigned width, unsigned height, int stride, enum scaler_pix_fmt fmt, bool bottom_up)
 {
-   for (unsigned i = 0; i < height; i++)
-      fwrite(lines[i], 1, line_size, file);
+   if (bottom_up)
+   {
+      frame += ((int)height - 1) * stride;
+      stride = -stride;
+   }
+
+   struct scaler_ctx scaler = {0};
+   scaler.in_width    = width;
+   scaler.in_height   = height;
+   scaler.out_width   = width;
+   scaler.out_height  = height;
+   scaler.in_stride   = stride;
+   scaler.out_stride  = out_stride;
+   scaler.in_fmt      = fmt;
+   scaler.out_fmt     = SCALER_FMT_BGR24;
+   scaler.scaler_type = SCALER_TYPE_POINT;
+
+   if (!scaler_ctx_gen_filter(&scaler))
+      return false;
+
+   scaler_ctx_scale(&scaler, out, frame);
+   scaler_ctx_gen_reset(&scaler);
+   return true;
 }
 
-static void dump_line_bgr(uint8_t *line, const uint8_t *src, unsigned width)
+// Frame is top-down.
+static bool write_screenshot(const char *path, const uint8_t *frame,
+      unsigned width, unsigned height, int stride, enum scaler_pix_fmt fmt, bool fast)
 {
-   memcpy(line, src, width * 3);
+   bool ret = false;
+
+#ifdef HAVE_ZLIB_DEFLATE
+   unsigned out_stride = width * 3;
+   bool bottom_up = false;
+#else
+   unsigned out_stride = (width * 3 + 3) & ~3;
+   bool bottom_up = true;
+#endif
+
+   uint8_t *out_buffer = (uint8_t*)calloc(out_stride, height);
+   if (!out_buffer)
+      return false;
+
+   if (!convert_bgr24(out_buffer, out_stride, frame, width, height, stride, fmt, bottom_up))
+   {
+      RARCH_ERR("Failed to convert screenshot.\n");
+      goto end;
+   }
+
+#ifdef HAVE_ZLIB_DEFLATE
+   if (fast)
+      ret = rpng_save_image_bgr24_fast(path, out_buffer, width, height, out_stride);
+   else
+      ret = rpng_save_image_bgr24(path, out_buffer, width, height, out_stride);
+#else
+   (void)fast;
+
+   // Scoped, so the goto above doesn't jump over the declaration in C++ builds.
+   {
+      FILE *file = fopen(path, "wb");
+      if (!file)
+      {
+         RARCH_ERR("Failed to open file \"%s\" for screenshot.\n", path);
+         goto end;
+      }
+
+      ret = write_header_bmp(file, width, height) &&
+         fwrite(out_buffer, out_stride, height, file) == height;
+      fclose(file);
+   }
+#endif
+
+   if (!ret)
+      RARCH_ERR("Failed to take screenshot.\n");
+
+end:
+   free(out_buffer);
+   return ret;
 }
 
-static void dump_line_16(uint8_t *line, const uint16_t *src, unsigned width)
+#ifdef SCREENSHOT_ASYNC
+// Screenshots are taken by copying the frame into a pooled buffer.
+// Conversion and encoding is done on a worker thread.
+#define SCREENSHOT_JOBS 2
+
+struct screenshot_job
 {
-   for (unsigned i = 0; i < width; i++)
+   uint8_t *buffer; // Top-down lines in the pixel format of the frame.
+   size_t size;
+   unsigned width;
+   unsigned height;
+   unsigned stride;
+   enum scaler_pix_fmt fmt;
+   bool fast;
+   char path[PATH_MAX];
+
+   bool pending;
+   unsigned seq;
+};
+
+static struct
+{
+   sthread_t *thread;
+   slock_t *lock;
+   scond_t *work_cond;
+   scond_t *done_cond;
+   bool alive;
+
+   unsigned seq;
+   struct screenshot_job jobs[SCREENSHOT_JOBS];
+} worker;
+
+static struct screenshot_job *next_pending_job(void)
+{
+   struct screenshot_job *next = NULL;
+   for (unsigned i = 0; i < SCREENSHOT_JOBS; i++)
    {
-      uint16_t pixel = *src++;
-      uint8_t b = (pixel >>  0) & 0x1f;
-      uint8_t g = (pixel >>  5) & 0x3f;
-      uint8_t r = (pixel >> 11) & 0x1f;
-      *line++   = (b << 3) | (b >> 2);
-      *line++   = (g << 2) | (g >> 4);
-      *line++   = (r << 3) | (r >> 2);
+      struct screenshot_job *job = &worker.jobs[i];
+      if (job->pending && (!next || (int)(job->seq - next->seq) < 0))
+         next = job;
    }
+   return next;
 }
 
-static void dump_line_32(uint8_t *line, const uint32_t *src, unsigned width)
+static void screenshot_thread(void *data)
 {
-   for (unsigned i = 0; i < width; i++)
+   (void)data;
+
+   slock_lock(worker.lock);
+   for (;;)
    {
-      uint32_t pixel = *src++;
-      *line++ = (pixel >>  0) & 0xff;
-      *line++ = (pixel >>  8) & 0xff;
-      *line++ = (pixel >> 16) & 0xff;
+      struct screenshot_job *job = next_pending_job();
+      if (!job)
+      {
+         if (!worker.alive)
+            break;
+         scond_wait(worker.work_cond, worker.lock);
+         continue;
+      }
+
+      // Nobody else touches a pending job.
+      slock_unlock(worker.lock);
+      write_screenshot(job->path, job->buffer, job->width, job->height, job->stride, job->fmt, job->fast);
+      slock_lock(worker.lock);
+
+      job->pending = false;
+      scond_signal(worker.done_cond);
    }
+   slock_unlock(worker.lock);
 }
 
-static void dump_content(FILE *file, const void *frame,
-      int width, int height, int pitch, bool bgr24)
+static bool screenshot_thread_init(void)
 {
-   union
-   {
-      const uint8_t *u8;
-      const uint16_t *u16;
-      const uint32_t *u32;
-   } u;
-   u.u8 = (const uint8_t*)frame;
+   if (worker.thread)
+      return true;
 
-   uint8_t **lines = (uint8_t**)calloc(height, sizeof(uint8_t*));
-   if (!lines)
-      return;
+   worker.lock      = slock_new();
+   worker.work_cond = scond_new();
+   worker.done_cond = scond_new();
+   worker.alive     = true;
 
-   size_t line_size = (width * 3 + 3) & ~3;
+   if (worker.lock && worker.work_cond && worker.done_cond)
+      worker.thread = sthread_create(screenshot_thread, NULL);
 
-   for (int i = 0; i < height; i++)
+   if (!worker.thread)
    {
-      lines[i] = (uint8_t*)calloc(1, line_size);
-      if (!lines[i])
-         goto end;
+      RARCH_WARN("Failed to start screenshot thread. Screenshots will be taken synchronously.\n");
+      screenshot_deinit();
+      return false;
    }
 
-   if (bgr24) // BGR24 byte order. Can directly copy.
+   return true;
+}
+
+// Frame is top-down.
+static bool queue_screenshot(const char *path, const uint8_t *frame,
+      unsigned width, unsigned height, int stride, unsigned bpp, enum scaler_pix_fmt fmt, bool fast)
+{
+   // Only waits if the previous screenshots are still being encoded.
+   slock_lock(worker.lock);
+   struct screenshot_job *job = NULL;
+   while (!job)
    {
-      for (int j = 0; j < height; j++, u.u8 += pitch)
-         dump_line_bgr(lines[j], u.u8, width);
+      for (unsigned i = 0; i < SCREENSHOT_JOBS && !job; i++)
+         if (!worker.jobs[i].pending)
+            job = &worker.jobs[i];
+
+      if (!job)
+         scond_wait(worker.done_cond, worker.lock);
    }
-   else if (g_extern.system.pix_fmt == RETRO_PIXEL_FORMAT_XRGB8888)
+   slock_unlock(worker.lock);
+
+   unsigned line_size = width * bpp;
+   size_t size = (size_t)line_size * height;
+   if (size > job->size)
    {
-      for (int j = 0; j < height; j++, u.u8 += pitch)
-         dump_line_32(lines[j], u.u32, width);
+      uint8_t *buffer = (uint8_t*)realloc(job->buffer, size);
+      if (!buffer)
+         return false;
+      job->buffer = buffer;
+      job->size = size;
    }
-   else // RGB565
+
+   uint8_t *dst = job->buffer;
+   for (unsigned h = 0; h < height; h++, dst += line_size, frame += stride)
+      memcpy(dst, frame, line_size);
+
+   job->width  = width;
+   job->height = height;
+   job->stride = line_size;
+   job->fmt    = fmt;
+   job->fast   = fast;
+   strlcpy(job->path, path, sizeof(job->path));
+
+   slock_lock(worker.lock);
+   job->seq = worker.seq++;
+   job->pending = true;
+   scond_signal(worker.work_cond);
+   slock_unlock(worker.lock);
+   return true;
+}
+#endif
+
+void screenshot_deinit(void)
+{
+#ifdef SCREENSHOT_ASYNC
+   if (worker.thread)
    {
-      for (int j = 0; j < height; j++, u.u8 += pitch)
-         dump_line_16(lines[j], u.u16, width);
+      // Finishes pending screenshots first.
+      slock_lock(worker.lock);
+      worker.alive = false;
+      scond_signal(worker.work_cond);
+      slock_unlock(worker.lock);
+
+      sthread_join(worker.thread);
    }
 
-   dump_lines_file(file, lines, line_size, height);
+   if (worker.lock)
+      slock_free(worker.lock);
+   if (worker.work_cond)
+      scond_free(worker.work_cond);
+   if (worker.done_cond)
+      scond_free(worker.done_cond);
 
-end:
-   for (int i = 0; i < height; i++)
-      free(lines[i]);
-   free(lines);
-}
+   for (unsigned i = 0; i < SCREENSHOT_JOBS; i++)
+      free(worker.jobs[i].buffer);
+
+   memset(&worker, 0, sizeof(worker));
 #endif
+}
 
 // Take frame bottom-up.
 bool screenshot_dump(const char *folder, const void *frame,
@@ -151,64 +330,40 @@ bool screenshot_dump(const char *folder, const void *frame,
    char filename[PATH_MAX];
    char shotname[PATH_MAX];
 
-#ifdef HAVE_ZLIB_DEFLATE
-#define IMG_EXT "png"
-#else
-#define IMG_EXT "bmp"
-#endif
-
    fill_dated_filename(shotname, IMG_EXT, sizeof(shotname));
    fill_pathname_join(filename, folder, shotname, sizeof(filename));
 
-#ifdef HAVE_ZLIB_DEFLATE
-   uint8_t *out_buffer = (uint8_t*)malloc(width * height * 3);
-   if (!out_buffer)
-      return false;
-
-   struct scaler_ctx scaler = {0};
-   scaler.in_width   = width;
-   scaler.in_height  = height;
-   scaler.out_width  = width;
-   scaler.out_height = height;
-   scaler.in_stride  = -pitch;
-   scaler.out_stride = width * 3;
-   scaler.out_fmt = SCALER_FMT_BGR24;
-   scaler.scaler_type = SCALER_TYPE_POINT;
-
+   enum scaler_pix_fmt fmt;
+   unsigned bpp;
    if (bgr24)
-      scaler.in_fmt = SCALER_FMT_BGR24;
+   {
+      fmt = SCALER_FMT_BGR24;
+      bpp = 3;
+   }
    else if (g_extern.system.pix_fmt == RETRO_PIXEL_FORMAT_XRGB8888)
-      scaler.in_fmt = SCALER_FMT_ARGB8888;
+   {
+      fmt = SCALER_FMT_ARGB8888;
+      bpp = sizeof(uint32_t);
+   }
+   else if (g_extern.system.pix_fmt == RETRO_PIXEL_FORMAT_0RGB1555 && driver.video_rgb1555)
+   {
+      fmt = SCALER_FMT_0RGB1555; // Cached frame was never converted.
+      bpp = sizeof(uint16_t);
+   }
    else
-      scaler.in_fmt = SCALER_FMT_RGB565;
-
-   scaler_ctx_gen_filter(&scaler);
-   scaler_ctx_scale(&scaler, out_buffer, (const uint8_t*)frame + ((int)height - 1) * pitch);
-   scaler_ctx_gen_reset(&scaler);
-
-   RARCH_LOG("Using RPNG for PNG screenshots.\n");
-   bool ret = rpng_save_image_bgr24(filename, out_buffer, width, height, width * 3);
-   if (!ret)
-      RARCH_ERR("Failed to take screenshot.\n");
-   free(out_buffer);
-   return ret;
-#else
-   FILE *file = fopen(filename, "wb");
-   if (!file)
    {
-      RARCH_ERR("Failed to open file \"%s\" for screenshot.\n", filename);
-      return false;
+      fmt = SCALER_FMT_RGB565;
+      bpp = sizeof(uint16_t);
    }
 
-   bool ret = write_header_bmp(file, width, height);
-
-   if (ret)
-      dump_content(file, frame, width, height, pitch, bgr24);
-   else
-      RARCH_ERR("Failed to write image header.\n");
+   // The frame is bottom-up, the encoder wants top-down.
+   const uint8_t *top = (const uint8_t*)frame + ((int)height - 1) * pitch;
 
-   fclose(file);
-   return ret;
+#ifdef SCREENSHOT_ASYNC
+   if (screenshot_thread_init())
+      return queue_screenshot(filename, top, width, height, -pitch, bpp, fmt, g_settings.screenshot_png_fast);
 #endif
-}
 
+   (void)bpp;
+   return write_screenshot(filename, top, width, height, -pitch, fmt, g_settings.screenshot_png_fast);
+}
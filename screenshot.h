@@ -25,4 +25,7 @@ bool screenshot_dump(const char *folder, const void *frame,
 
 void screenshot_generate_filename(char *filename, size_t size);
 
+// Waits for screenshots still being written, and frees the worker.
+void screenshot_deinit(void);
+
 #endif
@@ -162,7 +162,16 @@ void config_set_defaults(void)
    g_settings.video.disable_composition = disable_composition;
    g_settings.video.vsync = vsync;
    g_settings.video.threaded = video_threaded;
+   g_settings.video.scaler_threads = video_scaler_threads;
+   g_settings.video.filter_threads = video_filter_threads;
+   g_settings.video.capture_interval = video_capture_interval;
+   g_settings.video.capture_max_frames = video_capture_max_frames;
+   g_settings.video.dupe_detect = video_dupe_detect;
+   g_settings.video.frameskip_auto = video_frameskip_auto;
+   g_settings.video.frameskip_min = video_frameskip_min;
+   g_settings.video.frameskip_max = video_frameskip_max;
    g_settings.video.smooth = video_smooth;
+   g_settings.video.smooth_sharp = video_smooth_sharp;
    g_settings.video.force_aspect = force_aspect;
    g_settings.video.scale_integer = scale_integer;
    g_settings.video.crop_overscan = crop_overscan;
@@ -192,6 +201,7 @@ void config_set_defaults(void)
    g_settings.video.post_filter_record = post_filter_record;
    g_settings.video.gpu_record = gpu_record;
    g_settings.video.gpu_screenshot = gpu_screenshot;
+   g_settings.screenshot_png_fast = screenshot_png_fast;
 
    g_settings.audio.enable = audio_enable;
    g_settings.audio.out_rate = out_rate;
@@ -208,7 +218,13 @@ void config_set_defaults(void)
 
    g_settings.rewind_enable = rewind_enable;
    g_settings.rewind_buffer_size = rewind_buffer_size;
+   g_settings.image_cache_size = image_cache_size;
    g_settings.rewind_granularity = rewind_granularity;
+   g_settings.run_ahead_frames = run_ahead_frames;
+   g_settings.netplay_delta_snapshots = netplay_delta_snapshots;
+   g_settings.netplay_max_spectators = netplay_max_spectators;
+   g_settings.netplay_input_delay_min = netplay_input_delay_min;
+   g_settings.netplay_input_delay_max = netplay_input_delay_max;
    g_settings.slowmotion_ratio = slowmotion_ratio;
    g_settings.pause_nonactive = pause_nonactive;
    g_settings.autosave_interval = autosave_interval;
@@ -220,6 +236,7 @@ void config_set_defaults(void)
    g_settings.network_cmd_enable   = network_cmd_enable;
    g_settings.network_cmd_port     = network_cmd_port;
    g_settings.stdin_cmd_enable     = stdin_cmd_enable;
+   g_settings.timeline_frames      = timeline_frames;
 
    rarch_assert(sizeof(g_settings.input.binds[0]) >= sizeof(retro_keybinds_1));
    rarch_assert(sizeof(g_settings.input.binds[1]) >= sizeof(retro_keybinds_rest));
@@ -446,7 +463,25 @@ bool config_load_file(const char *path)
    CONFIG_GET_BOOL(video.disable_composition, "video_disable_composition");
    CONFIG_GET_BOOL(video.vsync, "video_vsync");
    CONFIG_GET_BOOL(video.threaded, "video_threaded");
+   CONFIG_GET_INT(video.scaler_threads, "video_scaler_threads");
+   CONFIG_GET_INT(video.filter_threads, "video_filter_threads");
+   CONFIG_GET_BOOL(video.dupe_detect, "video_dupe_detect");
+   CONFIG_GET_BOOL(video.frameskip_auto, "video_frameskip_auto");
+   CONFIG_GET_INT(video.frameskip_min, "video_frameskip_min");
+   CONFIG_GET_INT(video.frameskip_max, "video_frameskip_max");
+   if (g_settings.video.frameskip_max < g_settings.video.frameskip_min)
+      g_settings.video.frameskip_max = g_settings.video.frameskip_min;
+   CONFIG_GET_PATH(video.capture_directory, "video_capture_directory");
+   if (*g_settings.video.capture_directory && !path_is_directory(g_settings.video.capture_directory))
+   {
+      RARCH_WARN("video_capture_directory is not an existing directory, ignoring ...\n");
+      *g_settings.video.capture_directory = '\0';
+   }
+   CONFIG_GET_STRING(video.capture_frames, "video_capture_frames");
+   CONFIG_GET_INT(video.capture_interval, "video_capture_interval");
+   CONFIG_GET_INT(video.capture_max_frames, "video_capture_max_frames");
    CONFIG_GET_BOOL(video.smooth, "video_smooth");
+   CONFIG_GET_BOOL(video.smooth_sharp, "video_smooth_sharp");
    CONFIG_GET_BOOL(video.force_aspect, "video_force_aspect");
    CONFIG_GET_BOOL(video.scale_integer, "video_scale_integer");
    CONFIG_GET_BOOL(video.crop_overscan, "video_crop_overscan");
@@ -659,6 +694,12 @@ bool config_load_file(const char *path)
    CONFIG_GET_STRING(video.gl_context, "video_gl_context");
    CONFIG_GET_STRING(audio.driver, "audio_driver");
    CONFIG_GET_PATH(audio.dsp_plugin, "audio_dsp_plugin");
+   CONFIG_GET_PATH(audio.resampler_cache_directory, "audio_resampler_cache_directory");
+   if (*g_settings.audio.resampler_cache_directory && !path_is_directory(g_settings.audio.resampler_cache_directory))
+   {
+      RARCH_WARN("audio_resampler_cache_directory is not an existing directory, ignoring ...\n");
+      *g_settings.audio.resampler_cache_directory = '\0';
+   }
    CONFIG_GET_STRING(input.driver, "input_driver");
 
    if (!*g_settings.libretro)
@@ -670,6 +711,23 @@ bool config_load_file(const char *path)
       RARCH_WARN("screenshot_directory is not an existing directory, ignoring ...\n");
       *g_settings.screenshot_directory = '\0';
    }
+   CONFIG_GET_BOOL(screenshot_png_fast, "screenshot_png_fast");
+
+   int cache_size = 0;
+   if (config_get_int(conf, "image_cache_size", &cache_size))
+   {
+      if (cache_size >= 0)
+         g_settings.image_cache_size = cache_size * UINT64_C(1000000);
+      else
+         RARCH_WARN("image_cache_size can't be negative, ignoring ...\n");
+   }
+
+   CONFIG_GET_PATH(image_cache_directory, "image_cache_directory");
+   if (*g_settings.image_cache_directory && !path_is_directory(g_settings.image_cache_directory))
+   {
+      RARCH_WARN("image_cache_directory is not an existing directory, ignoring ...\n");
+      *g_settings.image_cache_directory = '\0';
+   }
 
    CONFIG_GET_BOOL(rewind_enable, "rewind_enable");
 
@@ -678,6 +736,11 @@ bool config_load_file(const char *path)
       g_settings.rewind_buffer_size = buffer_size * UINT64_C(1000000);
 
    CONFIG_GET_INT(rewind_granularity, "rewind_granularity");
+   CONFIG_GET_INT(run_ahead_frames, "run_ahead_frames");
+   CONFIG_GET_BOOL(netplay_delta_snapshots, "netplay_delta_snapshots");
+   CONFIG_GET_INT(netplay_max_spectators, "netplay_max_spectators");
+   CONFIG_GET_INT(netplay_input_delay_min, "netplay_input_delay_min");
+   CONFIG_GET_INT(netplay_input_delay_max, "netplay_input_delay_max");
    CONFIG_GET_FLOAT(slowmotion_ratio, "slowmotion_ratio");
    if (g_settings.slowmotion_ratio < 1.0f)
       g_settings.slowmotion_ratio = 1.0f;
@@ -697,6 +760,9 @@ bool config_load_file(const char *path)
    CONFIG_GET_INT(network_cmd_port, "network_cmd_port");
    CONFIG_GET_BOOL(stdin_cmd_enable, "stdin_cmd_enable");
 
+   CONFIG_GET_INT(timeline_frames, "timeline_frames");
+   CONFIG_GET_PATH(timeline_path, "timeline_path");
+
    CONFIG_GET_INT(input.turbo_period, "input_turbo_period");
    CONFIG_GET_INT(input.turbo_duty_cycle, "input_duty_cycle");
 
@@ -0,0 +1,267 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2013 - Hans-Kristian Arntzen
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "timeline.h"
+#include "general.h"
+#include "performance.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Audio is typically flushed a few times per frame, so this leaves plenty of headroom.
+#define TIMELINE_EVENTS_PER_FRAME 64
+
+static const char *stage_names[RARCH_TIMELINE_STAGES] = {
+   "frame",
+   "state_checks",
+   "rewind",
+   "retro_run",
+   "run_ahead",
+   "input_poll",
+   "video_frame",
+   "video_conv",
+   "video_filter",
+   "video_driver",
+   "audio_flush",
+   "audio_conv",
+   "audio_dsp",
+   "audio_resample",
+   "audio_write",
+};
+
+struct timeline_event
+{
+   rarch_time_t start;
+   uint32_t duration;
+   uint32_t frame;
+   uint32_t stage;
+};
+
+struct rarch_timeline
+{
+   struct timeline_event *events;
+   size_t capacity;
+   size_t ptr;   // Next event to write.
+   bool wrapped; // Oldest events have been overwritten.
+
+   unsigned frames;
+   unsigned frame;
+   rarch_time_t open[RARCH_TIMELINE_STAGES];
+};
+
+rarch_timeline_t *rarch_timeline_new(unsigned frames)
+{
+   if (!frames)
+      return NULL;
+
+   rarch_timeline_t *timeline = (rarch_timeline_t*)calloc(1, sizeof(*timeline));
+   if (!timeline)
+      return NULL;
+
+   timeline->frames   = frames;
+   timeline->capacity = (size_t)frames * TIMELINE_EVENTS_PER_FRAME;
+   timeline->events   = (struct timeline_event*)calloc(timeline->capacity, sizeof(*timeline->events));
+   if (!timeline->events)
+   {
+      free(timeline);
+      return NULL;
+   }
+
+   return timeline;
+}
+
+void rarch_timeline_free(rarch_timeline_t *timeline)
+{
+   if (!timeline)
+      return;
+
+   free(timeline->events);
+   free(timeline);
+}
+
+void rarch_timeline_frame(rarch_timeline_t *timeline, unsigned frame)
+{
+   timeline->frame = frame;
+}
+
+void rarch_timeline_begin(rarch_timeline_t *timeline, enum rarch_timeline_stage stage)
+{
+   timeline->open[stage] = rarch_get_time_usec();
+}
+
+void rarch_timeline_end(rarch_timeline_t *timeline, enum rarch_timeline_stage stage)
+{
+   struct timeline_event *event = &timeline->events[timeline->ptr];
+   event->start    = timeline->open[stage];
+   event->duration = (uint32_t)(rarch_get_time_usec() - event->start);
+   event->frame    = timeline->frame;
+   event->stage    = stage;
+
+   if (++timeline->ptr >= timeline->capacity)
+   {
+      timeline->ptr = 0;
+      timeline->wrapped = true;
+   }
+}
+
+// Events in chronological order (of when they ended).
+static const struct timeline_event *timeline_event(const rarch_timeline_t *timeline, size_t index)
+{
+   if (timeline->wrapped)
+      index = (timeline->ptr + index) % timeline->capacity;
+   return &timeline->events[index];
+}
+
+static size_t timeline_num_events(const rarch_timeline_t *timeline)
+{
+   return timeline->wrapped ? timeline->capacity : timeline->ptr;
+}
+
+// The ring usually holds more frames than asked for, as most frames have few events.
+// Only export the last ones. If the ring has wrapped around, the oldest frame is incomplete.
+static unsigned timeline_first_frame(const rarch_timeline_t *timeline, size_t num_events)
+{
+   unsigned first_frame = timeline_event(timeline, 0)->frame + (timeline->wrapped ? 1 : 0);
+   unsigned last_frame  = timeline_event(timeline, num_events - 1)->frame;
+
+   if (last_frame - first_frame >= timeline->frames)
+      first_frame = last_frame - timeline->frames + 1;
+   return first_frame;
+}
+
+bool rarch_timeline_write_trace(rarch_timeline_t *timeline, const char *path)
+{
+   FILE *file = fopen(path, "w");
+   if (!file)
+      return false;
+
+   size_t num_events = timeline_num_events(timeline);
+   unsigned first_frame = num_events ? timeline_first_frame(timeline, num_events) : 0;
+
+   // Events are ordered by when they ended, so outer stages come after the ones nested in them.
+   rarch_time_t base = 0;
+   bool have_base = false;
+   for (size_t i = 0; i < num_events; i++)
+   {
+      const struct timeline_event *event = timeline_event(timeline, i);
+      if (event->frame >= first_frame && (!have_base || event->start < base))
+      {
+         base = event->start;
+         have_base = true;
+      }
+   }
+
+   fprintf(file, "{\"traceEvents\":[");
+   const char *separator = "\n";
+   for (size_t i = 0; i < num_events; i++)
+   {
+      const struct timeline_event *event = timeline_event(timeline, i);
+      if (event->frame < first_frame)
+         continue;
+
+      fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%lld,\"dur\":%u,\"args\":{\"frame\":%u}}",
+            separator, stage_names[event->stage], (long long)(event->start - base),
+            (unsigned)event->duration, (unsigned)event->frame);
+      separator = ",\n";
+   }
+   fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+   fclose(file);
+   return true;
+}
+
+static int uint32_cmp(const void *a_, const void *b_)
+{
+   uint32_t a = *(const uint32_t*)a_;
+   uint32_t b = *(const uint32_t*)b_;
+   return a < b ? -1 : (a > b ? 1 : 0);
+}
+
+static uint32_t percentile(const uint32_t *sorted, size_t count, unsigned pct)
+{
+   size_t rank = (count * pct + 99) / 100; // Nearest rank.
+   return sorted[rank ? rank - 1 : 0];
+}
+
+bool rarch_timeline_write_csv(rarch_timeline_t *timeline, const char *path)
+{
+   size_t num_events = timeline_num_events(timeline);
+   if (!num_events)
+      return false;
+
+   unsigned first_frame = timeline_first_frame(timeline, num_events);
+   unsigned last_frame  = timeline_event(timeline, num_events - 1)->frame;
+   if (last_frame < first_frame)
+      return false;
+
+   size_t num_frames = last_frame - first_frame + 1;
+
+   // Total time per frame per stage. Stages can run several times per frame.
+   uint32_t *totals = (uint32_t*)calloc(num_frames * RARCH_TIMELINE_STAGES, sizeof(uint32_t));
+   bool *seen = (bool*)calloc(num_frames * RARCH_TIMELINE_STAGES, sizeof(bool));
+   uint32_t *sorted = (uint32_t*)malloc(num_frames * sizeof(uint32_t));
+   FILE *file = fopen(path, "w");
+
+   bool ret = totals && seen && sorted && file;
+   if (!ret)
+      goto end;
+
+   for (size_t i = 0; i < num_events; i++)
+   {
+      const struct timeline_event *event = timeline_event(timeline, i);
+      if (event->frame < first_frame)
+         continue;
+
+      size_t index = (event->frame - first_frame) * RARCH_TIMELINE_STAGES + event->stage;
+      totals[index] += event->duration;
+      seen[index] = true;
+   }
+
+   fprintf(file, "stage,frames,mean_usec,p50_usec,p95_usec,p99_usec,max_usec\n");
+   for (unsigned stage = 0; stage < RARCH_TIMELINE_STAGES; stage++)
+   {
+      size_t count = 0;
+      uint64_t sum = 0;
+      for (size_t f = 0; f < num_frames; f++)
+      {
+         size_t index = f * RARCH_TIMELINE_STAGES + stage;
+         if (seen[index])
+         {
+            sorted[count++] = totals[index];
+            sum += totals[index];
+         }
+      }
+
+      if (!count)
+         continue;
+
+      qsort(sorted, count, sizeof(uint32_t), uint32_cmp);
+      fprintf(file, "%s,%u,%.1f,%u,%u,%u,%u\n", stage_names[stage], (unsigned)count,
+            (double)sum / count,
+            (unsigned)percentile(sorted, count, 50),
+            (unsigned)percentile(sorted, count, 95),
+            (unsigned)percentile(sorted, count, 99),
+            (unsigned)sorted[count - 1]);
+   }
+
+end:
+   if (file)
+      fclose(file);
+   free(totals);
+   free(seen);
+   free(sorted);
+   return ret;
+}
+
@@ -0,0 +1,79 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2013 - Hans-Kristian Arntzen
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RARCH_TIMELINE_H
+#define __RARCH_TIMELINE_H
+
+#include "boolean.h"
+#include <stddef.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+// Per-frame timeline of the main loop.
+// Unlike the PERF_TEST counters, this is enabled at runtime, and keeps every
+// occurence of a stage for the last N frames, so single slow frames can be found.
+// Stages may nest, e.g. video_frame is called from within the core's retro_run().
+
+enum rarch_timeline_stage
+{
+   RARCH_TIMELINE_FRAME = 0,
+   RARCH_TIMELINE_STATE_CHECKS,
+   RARCH_TIMELINE_REWIND,
+   RARCH_TIMELINE_RUN,
+   RARCH_TIMELINE_RUN_AHEAD,
+   RARCH_TIMELINE_INPUT_POLL,
+   RARCH_TIMELINE_VIDEO,
+   RARCH_TIMELINE_VIDEO_CONV,
+   RARCH_TIMELINE_VIDEO_FILTER,
+   RARCH_TIMELINE_VIDEO_DRIVER,
+   RARCH_TIMELINE_AUDIO,
+   RARCH_TIMELINE_AUDIO_CONV,
+   RARCH_TIMELINE_AUDIO_DSP,
+   RARCH_TIMELINE_AUDIO_RESAMPLE,
+   RARCH_TIMELINE_AUDIO_WRITE,
+
+   RARCH_TIMELINE_STAGES
+};
+
+typedef struct rarch_timeline rarch_timeline_t;
+
+// Keeps the last 'frames' frames.
+rarch_timeline_t *rarch_timeline_new(unsigned frames);
+void rarch_timeline_free(rarch_timeline_t *timeline);
+
+void rarch_timeline_frame(rarch_timeline_t *timeline, unsigned frame);
+void rarch_timeline_begin(rarch_timeline_t *timeline, enum rarch_timeline_stage stage);
+void rarch_timeline_end(rarch_timeline_t *timeline, enum rarch_timeline_stage stage);
+
+// Chrome trace event format. Open in chrome://tracing.
+bool rarch_timeline_write_trace(rarch_timeline_t *timeline, const char *path);
+// One line per stage with p50/p95/p99 of the time spent in it per frame.
+bool rarch_timeline_write_csv(rarch_timeline_t *timeline, const char *path);
+
+// Cheap enough to leave in when the timeline is disabled.
+#define RARCH_TIMELINE_BEGIN(stage) do { \
+   if (g_extern.timeline) \
+      rarch_timeline_begin(g_extern.timeline, stage); \
+} while(0)
+
+#define RARCH_TIMELINE_END(stage) do { \
+   if (g_extern.timeline) \
+      rarch_timeline_end(g_extern.timeline, stage); \
+} while(0)
+
+#endif
+
@@ -0,0 +1,458 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2013 - Hans-Kristian Arntzen
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Sits between a netplay host and its clients, and delays, jitters and drops UDP packets, e.g.:
+// retroarch-netplay-proxy -l 50 -j 10 -d 5 55436 localhost 55435
+// Clients then connect to port 55436 instead of the host.
+// TCP is passed through as is. It only carries the handshake and commands.
+
+#include "../netplay_compat.h"
+#include "../compat/getopt_rarch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#define MAX_CLIENTS 16
+#define MAX_QUEUED 4096
+#define MAX_PACKET 2048
+
+static unsigned g_latency; // One way, in ms.
+static unsigned g_jitter;
+static unsigned g_drop;
+static bool g_verbose;
+
+static void print_help(void)
+{
+   puts("=======================");
+   puts("retroarch-netplay-proxy");
+   puts("=======================");
+   puts("Usage: retroarch-netplay-proxy [ -l/--latency <ms> | -j/--jitter <ms> | -d/--drop <percent> | -v/--verbose | -h/--help ] <port> <host> <host port>");
+   puts("");
+   puts("-l/--latency: Delay added to every UDP packet, each way.");
+   puts("-j/--jitter: Random variation of the delay, up to this much either way. Reorders packets.");
+   puts("-d/--drop: Percentage of UDP packets to drop.");
+   puts("-v/--verbose: Print statistics every 5 seconds.");
+   puts("-h/--help: This help.");
+}
+
+static void parse_input(int argc, char *argv[])
+{
+   char optstring[] = "l:j:d:vh";
+   struct option opts[] = {
+      { "latency", 1, NULL, 'l' },
+      { "jitter", 1, NULL, 'j' },
+      { "drop", 1, NULL, 'd' },
+      { "verbose", 0, NULL, 'v' },
+      { "help", 0, NULL, 'h' },
+      { NULL, 0, NULL, 0 }
+   };
+
+   int option_index = 0;
+   for (;;)
+   {
+      int c = getopt_long(argc, argv, optstring, opts, &option_index);
+      if (c == -1)
+         break;
+
+      switch (c)
+      {
+         case 'h':
+            print_help();
+            exit(0);
+
+         case 'l':
+            g_latency = strtoul(optarg, NULL, 0);
+            break;
+
+         case 'j':
+            g_jitter = strtoul(optarg, NULL, 0);
+            break;
+
+         case 'd':
+            g_drop = strtoul(optarg, NULL, 0);
+            break;
+
+         case 'v':
+            g_verbose = true;
+            break;
+
+         default:
+            print_help();
+            exit(1);
+      }
+   }
+
+   if (optind != argc - 3)
+   {
+      print_help();
+      exit(1);
+   }
+}
+
+static uint64_t get_time_usec(void)
+{
+   struct timespec tv;
+   clock_gettime(CLOCK_MONOTONIC, &tv);
+   return (uint64_t)tv.tv_sec * 1000000 + tv.tv_nsec / 1000;
+}
+
+struct packet
+{
+   bool used;
+   uint64_t due;
+   int fd;
+   struct sockaddr_storage to; // Unused for connected sockets.
+   socklen_t to_size;
+   size_t size;
+   uint8_t data[MAX_PACKET];
+};
+
+// Every client gets its own socket towards the host, so the host still tells them apart.
+struct udp_client
+{
+   struct sockaddr_storage addr;
+   socklen_t addr_size;
+   int fd;
+};
+
+struct tcp_pair
+{
+   int fd[2];
+};
+
+static struct packet g_queue[MAX_QUEUED];
+static struct udp_client g_clients[MAX_CLIENTS];
+static unsigned g_num_clients;
+static struct tcp_pair g_pairs[MAX_CLIENTS];
+static unsigned g_num_pairs;
+
+static uint64_t g_forwarded;
+static uint64_t g_dropped;
+static uint64_t g_overflow;
+
+static void queue_packet(int fd, const struct sockaddr_storage *to, socklen_t to_size,
+      const uint8_t *data, size_t size)
+{
+   if ((unsigned)(rand() % 100) < g_drop)
+   {
+      g_dropped++;
+      return;
+   }
+
+   int delay = g_latency * 1000;
+   if (g_jitter)
+      delay += (int)(rand() % (2 * g_jitter * 1000 + 1)) - (int)(g_jitter * 1000);
+   if (delay < 0)
+      delay = 0;
+
+   for (unsigned i = 0; i < MAX_QUEUED; i++)
+   {
+      struct packet *packet = &g_queue[i];
+      if (packet->used)
+         continue;
+
+      packet->used = true;
+      packet->due = get_time_usec() + delay;
+      packet->fd = fd;
+      packet->to_size = to_size;
+      if (to)
+         memcpy(&packet->to, to, to_size);
+      packet->size = size;
+      memcpy(packet->data, data, size);
+      return;
+   }
+
+   g_overflow++;
+}
+
+// Returns usec until the next packet is due.
+static uint64_t send_due(void)
+{
+   uint64_t now = get_time_usec();
+   uint64_t next = 1000000;
+
+   for (unsigned i = 0; i < MAX_QUEUED; i++)
+   {
+      struct packet *packet = &g_queue[i];
+      if (!packet->used)
+         continue;
+
+      if (packet->due > now)
+      {
+         if (packet->due - now < next)
+            next = packet->due - now;
+         continue;
+      }
+
+      if (packet->to_size)
+         sendto(packet->fd, packet->data, packet->size, 0, (struct sockaddr*)&packet->to, packet->to_size);
+      else
+         send(packet->fd, packet->data, packet->size, 0);
+
+      packet->used = false;
+      g_forwarded++;
+   }
+
+   return next;
+}
+
+static int bind_socket(const struct addrinfo *info)
+{
+   int fd = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+   if (fd < 0)
+      return -1;
+
+   int yes = 1;
+   setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(int));
+
+   if (bind(fd, info->ai_addr, info->ai_addrlen) < 0 ||
+         (info->ai_socktype == SOCK_STREAM && listen(fd, MAX_CLIENTS) < 0))
+   {
+      close(fd);
+      return -1;
+   }
+
+   return fd;
+}
+
+static int connect_socket(const struct addrinfo *info)
+{
+   int fd = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+   if (fd < 0)
+      return -1;
+
+   if (connect(fd, info->ai_addr, info->ai_addrlen) < 0)
+   {
+      close(fd);
+      return -1;
+   }
+
+   if (info->ai_socktype == SOCK_STREAM)
+   {
+      int yes = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(int));
+   }
+
+   return fd;
+}
+
+static struct addrinfo *resolve(const char *node, const char *port, int socktype)
+{
+   struct addrinfo hints, *res = NULL;
+   memset(&hints, 0, sizeof(hints));
+   hints.ai_family = AF_INET;
+   hints.ai_socktype = socktype;
+   if (!node)
+      hints.ai_flags = AI_PASSIVE;
+
+   if (getaddrinfo(node, port, &hints, &res) < 0 || !res)
+   {
+      fprintf(stderr, "Failed to resolve %s:%s.\n", node ? node : "*", port);
+      exit(1);
+   }
+
+   return res;
+}
+
+static void accept_tcp(int listen_fd, const struct addrinfo *host)
+{
+   int fd = accept(listen_fd, NULL, NULL);
+   if (fd < 0)
+      return;
+
+   if (g_num_pairs >= MAX_CLIENTS)
+   {
+      close(fd);
+      return;
+   }
+
+   int host_fd = connect_socket(host);
+   if (host_fd < 0)
+   {
+      fprintf(stderr, "Failed to connect to host.\n");
+      close(fd);
+      return;
+   }
+
+   int yes = 1;
+   setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(int));
+
+   g_pairs[g_num_pairs].fd[0] = fd;
+   g_pairs[g_num_pairs].fd[1] = host_fd;
+   g_num_pairs++;
+   fprintf(stderr, "New TCP connection (%u open).\n", g_num_pairs);
+}
+
+static bool relay_tcp(int from, int to)
+{
+   uint8_t buf[4096];
+   ssize_t ret = recv(from, buf, sizeof(buf), 0);
+   if (ret <= 0)
+      return false;
+
+   for (ssize_t sent = 0; sent < ret; )
+   {
+      ssize_t written = send(to, buf + sent, ret - sent, 0);
+      if (written <= 0)
+         return false;
+      sent += written;
+   }
+
+   return true;
+}
+
+static void close_pair(unsigned index)
+{
+   close(g_pairs[index].fd[0]);
+   close(g_pairs[index].fd[1]);
+   g_pairs[index] = g_pairs[--g_num_pairs];
+   fprintf(stderr, "TCP connection closed (%u open).\n", g_num_pairs);
+}
+
+static struct udp_client *find_client(const struct sockaddr_storage *addr, socklen_t addr_size,
+      const struct addrinfo *host)
+{
+   for (unsigned i = 0; i < g_num_clients; i++)
+   {
+      if (g_clients[i].addr_size == addr_size && memcmp(&g_clients[i].addr, addr, addr_size) == 0)
+         return &g_clients[i];
+   }
+
+   if (g_num_clients >= MAX_CLIENTS)
+      return NULL;
+
+   int fd = connect_socket(host);
+   if (fd < 0)
+      return NULL;
+
+   struct udp_client *client = &g_clients[g_num_clients++];
+   memcpy(&client->addr, addr, addr_size);
+   client->addr_size = addr_size;
+   client->fd = fd;
+   fprintf(stderr, "New UDP client (%u total).\n", g_num_clients);
+   return client;
+}
+
+int main(int argc, char *argv[])
+{
+   parse_input(argc, argv);
+   signal(SIGPIPE, SIG_IGN);
+   srand(time(NULL));
+
+   struct addrinfo *tcp_listen = resolve(NULL, argv[optind], SOCK_STREAM);
+   struct addrinfo *udp_listen = resolve(NULL, argv[optind], SOCK_DGRAM);
+   struct addrinfo *tcp_host = resolve(argv[optind + 1], argv[optind + 2], SOCK_STREAM);
+   struct addrinfo *udp_host = resolve(argv[optind + 1], argv[optind + 2], SOCK_DGRAM);
+
+   int tcp_fd = bind_socket(tcp_listen);
+   int udp_fd = bind_socket(udp_listen);
+   if (tcp_fd < 0 || udp_fd < 0)
+   {
+      fprintf(stderr, "Failed to bind port %s.\n", argv[optind]);
+      return 1;
+   }
+
+   fprintf(stderr, "Forwarding port %s to %s:%s. Latency %u ms, jitter %u ms, drop %u %%.\n",
+         argv[optind], argv[optind + 1], argv[optind + 2], g_latency, g_jitter, g_drop);
+
+   uint64_t last_stats = get_time_usec();
+   for (;;)
+   {
+      uint64_t next = send_due();
+
+      fd_set fds;
+      FD_ZERO(&fds);
+      int max_fd = tcp_fd > udp_fd ? tcp_fd : udp_fd;
+      FD_SET(tcp_fd, &fds);
+      FD_SET(udp_fd, &fds);
+      for (unsigned i = 0; i < g_num_clients; i++)
+      {
+         FD_SET(g_clients[i].fd, &fds);
+         if (g_clients[i].fd > max_fd)
+            max_fd = g_clients[i].fd;
+      }
+      for (unsigned i = 0; i < g_num_pairs; i++)
+      {
+         for (unsigned j = 0; j < 2; j++)
+         {
+            FD_SET(g_pairs[i].fd[j], &fds);
+            if (g_pairs[i].fd[j] > max_fd)
+               max_fd = g_pairs[i].fd[j];
+         }
+      }
+
+      struct timeval tv;
+      tv.tv_sec = next / 1000000;
+      tv.tv_usec = next % 1000000;
+      if (select(max_fd + 1, &fds, NULL, NULL, &tv) < 0)
+         break;
+
+      uint8_t buf[MAX_PACKET];
+
+      if (FD_ISSET(udp_fd, &fds))
+      {
+         struct sockaddr_storage addr;
+         socklen_t addr_size = sizeof(addr);
+         ssize_t ret = recvfrom(udp_fd, buf, sizeof(buf), 0, (struct sockaddr*)&addr, &addr_size);
+         struct udp_client *client = ret > 0 ? find_client(&addr, addr_size, udp_host) : NULL;
+         if (client)
+            queue_packet(client->fd, NULL, 0, buf, ret);
+      }
+
+      for (unsigned i = 0; i < g_num_clients; i++)
+      {
+         if (!FD_ISSET(g_clients[i].fd, &fds))
+            continue;
+
+         ssize_t ret = recv(g_clients[i].fd, buf, sizeof(buf), 0);
+         if (ret > 0)
+            queue_packet(udp_fd, &g_clients[i].addr, g_clients[i].addr_size, buf, ret);
+      }
+
+      for (unsigned i = 0; i < g_num_pairs; )
+      {
+         bool alive = true;
+         for (unsigned j = 0; j < 2 && alive; j++)
+            if (FD_ISSET(g_pairs[i].fd[j], &fds))
+               alive = relay_tcp(g_pairs[i].fd[j], g_pairs[i].fd[j ^ 1]);
+
+         if (alive)
+            i++;
+         else
+            close_pair(i);
+      }
+
+      if (FD_ISSET(tcp_fd, &fds))
+         accept_tcp(tcp_fd, tcp_host);
+
+      uint64_t now = get_time_usec();
+      if (g_verbose && now - last_stats >= 5000000)
+      {
+         fprintf(stderr, "Forwarded %llu packets, dropped %llu, %llu didn't fit in the queue.\n",
+               (unsigned long long)g_forwarded, (unsigned long long)g_dropped,
+               (unsigned long long)g_overflow);
+         last_stats = now;
+      }
+   }
+
+   freeaddrinfo(tcp_listen);
+   freeaddrinfo(udp_listen);
+   freeaddrinfo(tcp_host);
+   freeaddrinfo(udp_host);
+   return 0;
+}
@@ -0,0 +1,467 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2013 - Hans-Kristian Arntzen
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Converts a .rcap capture to YUV4MPEG2 video and WAV audio, which any encoder can read, e.g.:
+// retroarch-transcode -o - -a game.wav game.rcap | ffmpeg -i - -i game.wav game.mkv
+
+#include "../compat/getopt_rarch.h"
+#include "../record/rcap.h"
+#include "../record/ffemu.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *g_in_path;
+static const char *g_out_path;
+static const char *g_audio_path;
+static unsigned g_width;
+static unsigned g_height;
+static unsigned g_start;
+static unsigned g_frames = ~0u;
+
+static void print_help(void)
+{
+   puts("===================");
+   puts("retroarch-transcode");
+   puts("===================");
+   puts("Usage: retroarch-transcode [ -o/--output <file> | -a/--audio <file> | -s/--size <WxH> | --start <frame> | --frames <count> | -h/--help ] <capture.rcap>");
+   puts("");
+   puts("-o/--output: YUV4MPEG2 file to write video to. Use - for stdout.");
+   puts("-a/--audio: WAV file to write audio to.");
+   puts("-s/--size: Output size. Defaults to the size recorded with. Frames are scaled with nearest neighbor.");
+   puts("--start: First frame to convert. Seeks to the closest key frame, if the capture has an index.");
+   puts("--frames: Number of frames to convert.");
+   puts("-h/--help: This help.");
+}
+
+static void parse_input(int argc, char *argv[])
+{
+   char optstring[] = "o:a:s:h";
+   struct option opts[] = {
+      { "output", 1, NULL, 'o' },
+      { "audio", 1, NULL, 'a' },
+      { "size", 1, NULL, 's' },
+      { "start", 1, NULL, 'S' },
+      { "frames", 1, NULL, 'F' },
+      { "help", 0, NULL, 'h' },
+      { NULL, 0, NULL, 0 }
+   };
+
+   int option_index = 0;
+   for (;;)
+   {
+      int c = getopt_long(argc, argv, optstring, opts, &option_index);
+      if (c == -1)
+         break;
+
+      switch (c)
+      {
+         case 'h':
+            print_help();
+            exit(0);
+
+         case 'o':
+            g_out_path = optarg;
+            break;
+
+         case 'a':
+            g_audio_path = optarg;
+            break;
+
+         case 's':
+            if (sscanf(optarg, "%ux%u", &g_width, &g_height) != 2 || !g_width || !g_height)
+            {
+               fprintf(stderr, "Wrong format for --size.\n");
+               exit(1);
+            }
+            break;
+
+         case 'S':
+            g_start = strtoul(optarg, NULL, 0);
+            break;
+
+         case 'F':
+            g_frames = strtoul(optarg, NULL, 0);
+            break;
+
+         default:
+            print_help();
+            exit(1);
+      }
+   }
+
+   if (optind != argc - 1 || (!g_out_path && !g_audio_path))
+   {
+      print_help();
+      exit(1);
+   }
+
+   g_in_path = argv[optind];
+}
+
+struct decoder
+{
+   FILE *file;
+   struct rcap_header header;
+   unsigned pix_size;
+
+   uint8_t *payload;
+   size_t payload_size;
+   uint8_t *rle;
+   size_t rle_size;
+
+   uint8_t *frame;
+   size_t frame_size;
+   unsigned width;
+   unsigned height;
+   bool have_key;
+};
+
+static bool grow(uint8_t **buf, size_t *cur_size, size_t size)
+{
+   if (size <= *cur_size)
+      return true;
+
+   uint8_t *new_buf = (uint8_t*)realloc(*buf, size);
+   if (!new_buf)
+      return false;
+
+   *buf = new_buf;
+   *cur_size = size;
+   return true;
+}
+
+// Seeks to the last key frame at or before 'frame'.
+static bool seek_key_frame(struct decoder *dec, unsigned frame)
+{
+   if (!dec->header.index_offset)
+   {
+      fprintf(stderr, "Capture has no index, decoding from the start.\n");
+      return true;
+   }
+
+   struct rcap_chunk chunk;
+   if (fseek(dec->file, dec->header.index_offset, SEEK_SET) != 0 ||
+         fread(&chunk, sizeof(chunk), 1, dec->file) != 1 || chunk.type != RCAP_CHUNK_INDEX)
+      return false;
+
+   size_t entries = chunk.size / sizeof(struct rcap_index_entry);
+   struct rcap_index_entry *index = (struct rcap_index_entry*)malloc(chunk.size + 1);
+   if (!index || fread(index, sizeof(*index), entries, dec->file) != entries)
+   {
+      free(index);
+      return false;
+   }
+
+   uint64_t offset = sizeof(dec->header);
+   for (size_t i = 0; i < entries && index[i].frame <= frame; i++)
+   {
+      if (index[i].flags & RCAP_FRAME_KEY)
+         offset = index[i].offset;
+   }
+   free(index);
+
+   return fseek(dec->file, offset, SEEK_SET) == 0;
+}
+
+static bool decode_video(struct decoder *dec, const struct rcap_video *video,
+      const uint8_t *data, size_t size)
+{
+   if (video->flags & RCAP_FRAME_DUPE)
+      return true;
+
+   size_t frame_size = (size_t)video->width * video->height * dec->pix_size;
+   if (video->rle_size > rcap_rle_bound(frame_size))
+      return false;
+
+   if (video->flags & RCAP_FRAME_KEY)
+   {
+      if (!grow(&dec->frame, &dec->frame_size, frame_size))
+         return false;
+
+      memset(dec->frame, 0, frame_size);
+      dec->width    = video->width;
+      dec->height   = video->height;
+      dec->have_key = true;
+   }
+   else if (!dec->have_key)
+      return true; // Started in between key frames. Skip until the next one.
+   else if (video->width != dec->width || video->height != dec->height)
+      return false;
+
+   return grow(&dec->rle, &dec->rle_size, video->rle_size + 1) &&
+      rcap_lz_decompress(dec->rle, video->rle_size, data, size) &&
+      rcap_rle_decode(dec->frame, frame_size, dec->rle, video->rle_size);
+}
+
+static inline void read_pixel(const uint8_t *pix, unsigned pix_fmt, int *r, int *g, int *b)
+{
+   switch (pix_fmt)
+   {
+      case FFEMU_PIX_RGB565:
+      {
+         uint16_t p;
+         memcpy(&p, pix, sizeof(p));
+         *r = (p >> 11) & 0x1f;
+         *g = (p >>  5) & 0x3f;
+         *b = (p >>  0) & 0x1f;
+         *r = (*r << 3) | (*r >> 2);
+         *g = (*g << 2) | (*g >> 4);
+         *b = (*b << 3) | (*b >> 2);
+         break;
+      }
+
+      case FFEMU_PIX_BGR24:
+         *b = pix[0];
+         *g = pix[1];
+         *r = pix[2];
+         break;
+
+      default:
+      {
+         uint32_t p;
+         memcpy(&p, pix, sizeof(p));
+         *r = (p >> 16) & 0xff;
+         *g = (p >>  8) & 0xff;
+         *b = (p >>  0) & 0xff;
+         break;
+      }
+   }
+}
+
+// Nearest neighbor scale to BT.601 4:4:4 planes.
+static void convert_frame(const struct decoder *dec, uint8_t *yuv, unsigned width, unsigned height)
+{
+   size_t plane = (size_t)width * height;
+   if (!dec->have_key)
+   {
+      memset(yuv, 16, plane);
+      memset(yuv + plane, 128, 2 * plane);
+      return;
+   }
+
+   size_t pitch = dec->width * dec->pix_size;
+   for (unsigned y = 0; y < height; y++)
+   {
+      const uint8_t *line = dec->frame + (size_t)(y * dec->height / height) * pitch;
+      uint8_t *out_y = yuv + y * width;
+      uint8_t *out_u = out_y + plane;
+      uint8_t *out_v = out_u + plane;
+
+      for (unsigned x = 0; x < width; x++)
+      {
+         int r, g, b;
+         read_pixel(line + (x * dec->width / width) * dec->pix_size, dec->header.pix_fmt, &r, &g, &b);
+
+         out_y[x] = (( 66 * r + 129 * g +  25 * b + 128) >> 8) + 16;
+         out_u[x] = ((-38 * r -  74 * g + 112 * b + 128) >> 8) + 128;
+         out_v[x] = ((112 * r -  94 * g -  18 * b + 128) >> 8) + 128;
+      }
+   }
+}
+
+static void write_le16(uint8_t *buf, uint16_t val)
+{
+   buf[0] = val & 0xff;
+   buf[1] = val >> 8;
+}
+
+static void write_le32(uint8_t *buf, uint32_t val)
+{
+   write_le16(buf, val & 0xffff);
+   write_le16(buf + 2, val >> 16);
+}
+
+static bool write_wav_header(FILE *file, unsigned channels, unsigned rate, uint32_t data_size)
+{
+   uint8_t header[44];
+   memcpy(header, "RIFF", 4);
+   write_le32(header + 4, data_size + 36);
+   memcpy(header + 8, "WAVEfmt ", 8);
+   write_le32(header + 16, 16);
+   write_le16(header + 20, 1); // PCM
+   write_le16(header + 22, channels);
+   write_le32(header + 24, rate);
+   write_le32(header + 28, rate * channels * sizeof(int16_t));
+   write_le16(header + 32, channels * sizeof(int16_t));
+   write_le16(header + 34, 16);
+   memcpy(header + 36, "data", 4);
+   write_le32(header + 40, data_size);
+
+   return fwrite(header, sizeof(header), 1, file) == 1;
+}
+
+int main(int argc, char *argv[])
+{
+   parse_input(argc, argv);
+
+   struct decoder dec = {0};
+   dec.file = fopen(g_in_path, "rb");
+   if (!dec.file)
+   {
+      fprintf(stderr, "Couldn't open \"%s\".\n", g_in_path);
+      return 1;
+   }
+
+   if (fread(&dec.header, sizeof(dec.header), 1, dec.file) != 1 ||
+         dec.header.magic != RCAP_MAGIC || dec.header.version != RCAP_VERSION ||
+         !(dec.pix_size = rcap_pix_size(dec.header.pix_fmt)))
+   {
+      fprintf(stderr, "\"%s\" is not a capture this version can read.\n", g_in_path);
+      return 1;
+   }
+
+   unsigned width  = g_width ? g_width : dec.header.out_width;
+   unsigned height = g_height ? g_height : dec.header.out_height;
+   if (!width || !height)
+   {
+      fprintf(stderr, "Capture has no output size, use --size.\n");
+      return 1;
+   }
+
+   FILE *video_file = NULL;
+   FILE *audio_file = NULL;
+   uint8_t *yuv = NULL;
+   bool ret = false;
+
+   // Audio is written from where the first output video frame is.
+   bool started = !g_start;
+   bool corrupt = false;
+   unsigned frames_out = 0;
+   uint64_t audio_size = 0;
+   unsigned rate = (unsigned)(dec.header.sample_rate + 0.5);
+
+   if (g_out_path)
+   {
+      video_file = strcmp(g_out_path, "-") ? fopen(g_out_path, "wb") : stdout;
+      yuv = (uint8_t*)malloc(3 * width * height);
+      if (!video_file || !yuv)
+      {
+         fprintf(stderr, "Couldn't open \"%s\".\n", g_out_path);
+         goto end;
+      }
+
+      // The capture's aspect ratio is for the whole frame. YUV4MPEG2 wants it per pixel.
+      double fps = dec.header.fps;
+      double par = dec.header.aspect_ratio > 0.0f ? dec.header.aspect_ratio * height / width : 1.0;
+      fprintf(video_file, "YUV4MPEG2 W%u H%u F%u:1000 Ip A%u:1000 C444\n",
+            width, height, (unsigned)(fps * 1000.0 + 0.5), (unsigned)(par * 1000.0 + 0.5));
+   }
+
+   if (g_audio_path)
+   {
+      audio_file = fopen(g_audio_path, "wb");
+      // Sizes are filled in at the end.
+      if (!audio_file || !write_wav_header(audio_file, dec.header.channels, rate, 0))
+      {
+         fprintf(stderr, "Couldn't open \"%s\".\n", g_audio_path);
+         goto end;
+      }
+   }
+
+   if (g_start && !seek_key_frame(&dec, g_start))
+   {
+      fprintf(stderr, "Capture index is corrupt.\n");
+      goto end;
+   }
+
+   for (;;)
+   {
+      struct rcap_chunk chunk;
+      if (fread(&chunk, sizeof(chunk), 1, dec.file) != 1 || chunk.type == RCAP_CHUNK_INDEX)
+         break;
+
+      if (!grow(&dec.payload, &dec.payload_size, chunk.size + 1) ||
+            fread(dec.payload, 1, chunk.size, dec.file) != chunk.size)
+      {
+         fprintf(stderr, "Capture is truncated. It was probably not finalized.\n");
+         break;
+      }
+
+      if (chunk.type == RCAP_CHUNK_AUDIO)
+      {
+         if (started && audio_file)
+         {
+            if (fwrite(dec.payload, 1, chunk.size, audio_file) != chunk.size)
+               goto end;
+            audio_size += chunk.size;
+         }
+         continue;
+      }
+      else if (chunk.type != RCAP_CHUNK_VIDEO)
+         continue;
+
+      struct rcap_video video;
+      if (chunk.size < sizeof(video))
+      {
+         corrupt = true;
+         break;
+      }
+      memcpy(&video, dec.payload, sizeof(video));
+
+      if (!decode_video(&dec, &video, dec.payload + sizeof(video), chunk.size - sizeof(video)))
+      {
+         corrupt = true;
+         break;
+      }
+
+      if (video.frame < g_start)
+         continue;
+      if (frames_out >= g_frames)
+         break;
+      started = true;
+
+      if (video_file)
+      {
+         // Dupes repeat the last frame, which is still in the buffer.
+         if (!(video.flags & RCAP_FRAME_DUPE) || !frames_out)
+            convert_frame(&dec, yuv, width, height);
+
+         if (fputs("FRAME\n", video_file) == EOF ||
+               fwrite(yuv, 3 * width * height, 1, video_file) != 1)
+            goto end;
+      }
+      frames_out++;
+   }
+
+   if (corrupt)
+      fprintf(stderr, "Capture is corrupt. Stopping at frame %u.\n", g_start + frames_out);
+
+   if (audio_file)
+   {
+      if (audio_size > 0xffffffffu - 36)
+         fprintf(stderr, "Audio is too long for WAV. Header will be wrong.\n");
+      if (fseek(audio_file, 0, SEEK_SET) != 0 ||
+            !write_wav_header(audio_file, dec.header.channels, rate, (uint32_t)audio_size))
+         goto end;
+   }
+
+   fprintf(stderr, "Converted %u frames, %.1f seconds of audio.\n", frames_out,
+         dec.header.channels && rate ? audio_size / (2.0 * dec.header.channels * rate) : 0.0);
+   ret = true;
+
+end:
+   if (video_file && video_file != stdout)
+      fclose(video_file);
+   if (audio_file)
+      fclose(audio_file);
+   fclose(dec.file);
+   free(yuv);
+   free(dec.payload);
+   free(dec.rle);
+   free(dec.frame);
+   return ret ? 0 : 1;
+}
+